@@ -0,0 +1,57 @@
+# Compiling shader sources into the executables removes all file I/O from the shader loading at startup.
+# The sources are registered under their absolute paths, so the code loading them does not change.
+option(XE_EMBED_SHADERS "Embed shader sources into the executables" OFF)
+
+# Writes a source file registering the shaders with xe::utils::register_embedded_shader.
+function(xe_generate_embedded_shaders output)
+    set(arrays "")
+    set(entries "")
+    set(index 0)
+    foreach (shader ${ARGN})
+        file(READ ${shader} hex HEX)
+        string(LENGTH "${hex}" hex_length)
+        math(EXPR size "${hex_length} / 2")
+        string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+        # 16 bytes per line, CMake regular expressions have no {n} repetitions.
+        string(REPEAT "0x..," 16 row)
+        string(REGEX REPLACE "(${row})" "\\1\n            " bytes "${bytes}")
+        string(APPEND arrays "    const char shader_${index}[] = {\n            ${bytes}0x00};\n\n")
+        string(APPEND entries "            {\"${shader}\", shader_${index}, ${size}},\n")
+        math(EXPR index "${index} + 1")
+    endforeach ()
+
+    file(WRITE ${output}.tmp
+            "// Generated by cmake/EmbedShaders.cmake, do not edit.\n\n"
+            "#include \"Application/shader_preprocessor.h\"\n\n"
+            "namespace {\n"
+            "${arrays}"
+            "    const xe::utils::EmbeddedShaderRegistrar registrar({\n"
+            "${entries}"
+            "    });\n"
+            "}\n")
+    # Touch the output only when it really changed, so nothing is rebuilt needlessly.
+    execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${output}.tmp ${output})
+    file(REMOVE ${output}.tmp)
+endfunction()
+
+# xe_embed_shaders(<executable> <directory>...)
+# The file is generated at configure time and CMake re-runs when any of the shaders changes.
+function(xe_embed_shaders target)
+    if (NOT XE_EMBED_SHADERS)
+        return()
+    endif ()
+    set(shaders "")
+    foreach (dir ${ARGN})
+        if (EXISTS ${dir})
+            file(GLOB_RECURSE dir_shaders LIST_DIRECTORIES false ${dir}/*)
+            list(APPEND shaders ${dir_shaders})
+        endif ()
+    endforeach ()
+    if (NOT shaders)
+        return()
+    endif ()
+    set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${shaders})
+    set(output ${CMAKE_BINARY_DIR}/embedded_shaders/${target}_shaders.cpp)
+    xe_generate_embedded_shaders(${output} ${shaders})
+    target_sources(${target} PRIVATE ${output})
+endfunction()
@@ -7,11 +7,21 @@
 std::list<RegisteredObject *> RegisteredObject::registry_;
 
 void RegisteredObject::add(RegisteredObject *p) {
-    registry_.push_back(p);
+    if (p->registered_)
+        return;
+    p->self_ = registry_.insert(registry_.end(), p);
+    p->registered_ = true;
+}
+
+void RegisteredObject::remove(RegisteredObject *p) {
+    if (!p->registered_)
+        return;
+    registry_.erase(p->self_);
+    p->registered_ = false;
 }
 
 void RegisteredObject::cleanup() {
-    for (auto p: registry_) {
-        delete p;
-    }
+    // The destructor removes the object from the list, so the list is not iterated while deleting.
+    while (!registry_.empty())
+        delete registry_.front();
 }
@@ -11,15 +11,29 @@ class RegisteredObject {
 public:
     static void add(RegisteredObject *p);
 
+    static void remove(RegisteredObject *p);
+
     static void cleanup();
 
     RegisteredObject() {
         RegisteredObject::add(this);
     }
 
-    virtual ~RegisteredObject() = default;
+    // Copies are not registered, they must not share the registry entry of the original.
+    RegisteredObject(const RegisteredObject &) {}
+
+    RegisteredObject &operator=(const RegisteredObject &) { return *this; }
+
+    // Objects deleted before the cleanup remove themselves from the registry.
+    virtual ~RegisteredObject() {
+        RegisteredObject::remove(this);
+    }
 
 
 private:
     static std::list<RegisteredObject *> registry_;
+
+    // Position in the registry, so removing an object does not search the list.
+    std::list<RegisteredObject *>::iterator self_;
+    bool registered_ = false;
 };
\ No newline at end of file
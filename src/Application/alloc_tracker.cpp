@@ -0,0 +1,309 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "alloc_tracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+#include "imgui.h"
+
+#include "overlay.h"
+
+namespace {
+    const size_t N_TAGS = static_cast<size_t>(xe::AllocTag::count);
+
+    struct AtomicCounters {
+        std::atomic<uint64_t> allocations;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> bytes;
+        std::atomic<int64_t> live_bytes;
+        std::atomic<int64_t> peak_bytes;
+        std::atomic<int64_t> frame_peak_bytes;
+        std::atomic<uint64_t> arena_bytes;
+    };
+
+    // Zero initialized before any constructor runs, so allocations made during the static initialization
+    // are counted too.
+    AtomicCounters counters[N_TAGS];
+    std::atomic<uint64_t> hot_allocations;
+    std::atomic<uint64_t> last_hot_size;
+    std::atomic<uint8_t> last_hot_tag;
+
+    thread_local xe::AllocTag current = xe::AllocTag::untagged;
+    thread_local bool hot = false;
+
+    // In front of every tracked block.
+    struct Header {
+        void *base;
+        size_t size;
+        xe::AllocTag tag;
+    };
+
+    void raise_peak(std::atomic<int64_t> &peak, int64_t value) {
+        auto p = peak.load(std::memory_order_relaxed);
+        while (value > p && !peak.compare_exchange_weak(p, value, std::memory_order_relaxed)) {}
+    }
+}
+
+namespace xe {
+
+    const char *alloc_tag_name(AllocTag tag) {
+        switch (tag) {
+            case AllocTag::untagged:
+                return "untagged";
+            case AllocTag::application:
+                return "Application";
+            case AllocTag::engine:
+                return "Engine";
+            case AllocTag::object_reader:
+                return "ObjectReader";
+            case AllocTag::imgui:
+                return "ImGui";
+            default:
+                return "?";
+        }
+    }
+
+    namespace alloc_tracker {
+        AllocTag current_tag() { return current; }
+
+        AllocTag set_tag(AllocTag tag) {
+            return std::exchange(current, tag);
+        }
+
+        bool set_hot_path(bool value) {
+            return std::exchange(hot, value);
+        }
+
+        void *allocate(size_t size, size_t alignment) {
+            alignment = std::max(alignment, alignof(std::max_align_t));
+            auto base = std::malloc(size + sizeof(Header) + alignment);
+            if (!base)
+                return nullptr;
+            auto address = reinterpret_cast<uintptr_t>(base) + sizeof(Header);
+            auto p = reinterpret_cast<void *>((address + alignment - 1) / alignment * alignment);
+            auto header = static_cast<Header *>(p) - 1;
+            *header = {base, size, current};
+
+            auto &c = counters[static_cast<size_t>(current)];
+            c.allocations.fetch_add(1, std::memory_order_relaxed);
+            c.bytes.fetch_add(size, std::memory_order_relaxed);
+            auto live = c.live_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) +
+                        static_cast<int64_t>(size);
+            raise_peak(c.peak_bytes, live);
+            raise_peak(c.frame_peak_bytes, live);
+            if (hot) {
+                hot_allocations.fetch_add(1, std::memory_order_relaxed);
+                last_hot_size.store(size, std::memory_order_relaxed);
+                last_hot_tag.store(static_cast<uint8_t>(current), std::memory_order_relaxed);
+            }
+            return p;
+        }
+
+        void free(void *p) {
+            if (!p)
+                return;
+            auto header = static_cast<Header *>(p) - 1;
+            auto &c = counters[static_cast<size_t>(header->tag)];
+            c.frees.fetch_add(1, std::memory_order_relaxed);
+            c.live_bytes.fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+            std::free(header->base);
+        }
+
+        void record_arena(size_t bytes) {
+            counters[static_cast<size_t>(current)].arena_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    AllocationTracker *AllocationTracker::instance_ = nullptr;
+
+    AllocationTracker &AllocationTracker::instance() {
+        if (!instance_)
+            instance_ = new AllocationTracker;
+        return *instance_;
+    }
+
+    AllocationTracker::AllocationTracker() {
+        if (available())
+            overlay_panel_ = overlay::add_panel("Allocations", [this]() { draw_overlay(); });
+    }
+
+    AllocationTracker::~AllocationTracker() {
+        if (overlay_panel_ >= 0)
+            overlay::remove_panel(overlay_panel_);
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    bool AllocationTracker::available() {
+#ifdef XE_TRACK_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    AllocationTracker::Counters AllocationTracker::total(AllocTag tag) const {
+        auto &c = counters[static_cast<size_t>(tag)];
+        Counters t;
+        t.allocations = c.allocations.load(std::memory_order_relaxed);
+        t.frees = c.frees.load(std::memory_order_relaxed);
+        t.bytes = c.bytes.load(std::memory_order_relaxed);
+        t.live_bytes = c.live_bytes.load(std::memory_order_relaxed);
+        t.peak_bytes = c.peak_bytes.load(std::memory_order_relaxed);
+        t.arena_bytes = c.arena_bytes.load(std::memory_order_relaxed);
+        return t;
+    }
+
+    uint64_t AllocationTracker::hot_allocations() const {
+        return ::hot_allocations.load(std::memory_order_relaxed);
+    }
+
+    void AllocationTracker::end_frame() {
+        for (size_t i = 0; i < N_TAGS; i++) {
+            auto t = total(static_cast<AllocTag>(i));
+            auto &previous = previous_total_[i];
+            auto &frame = last_frame_[i];
+            frame.allocations = t.allocations - previous.allocations;
+            frame.frees = t.frees - previous.frees;
+            frame.bytes = t.bytes - previous.bytes;
+            frame.arena_bytes = t.arena_bytes - previous.arena_bytes;
+            frame.live_bytes = t.live_bytes;
+            frame.peak_bytes = counters[i].frame_peak_bytes.exchange(t.live_bytes, std::memory_order_relaxed);
+            previous = t;
+        }
+
+        auto hot = hot_allocations();
+        auto hot_frame = hot - previous_hot_;
+        previous_hot_ = hot;
+        // The first few frames are reported, the rest only in the summary.
+        if (hot_frame > 0 && reported_hot_frames_ < 10) {
+            reported_hot_frames_++;
+            SPDLOG_WARN("{} allocations on the hot path in frame {}, the last one {} bytes tagged {}", hot_frame,
+                        frames_, last_hot_size.load(),
+                        alloc_tag_name(static_cast<AllocTag>(last_hot_tag.load())));
+        }
+        frames_++;
+    }
+
+    void AllocationTracker::log_summary() const {
+        if (!available())
+            return;
+        SPDLOG_INFO("Allocations after {} frames:", frames_);
+        for (size_t i = 0; i < N_TAGS; i++) {
+            auto t = total(static_cast<AllocTag>(i));
+            if (t.allocations == 0 && t.arena_bytes == 0)
+                continue;
+            auto &f = last_frame_[i];
+            SPDLOG_INFO("  {:<12} {:>10} allocations {:>10.1f} MB, live {:>8.1f} MB, peak {:>8.1f} MB, "
+                        "last frame {} allocations {:.1f} kB, arena {:.1f} MB",
+                        alloc_tag_name(static_cast<AllocTag>(i)), t.allocations, t.bytes / 1048576.0,
+                        t.live_bytes / 1048576.0, t.peak_bytes / 1048576.0, f.allocations, f.bytes / 1024.0,
+                        t.arena_bytes / 1048576.0);
+        }
+        auto hot = hot_allocations();
+        if (hot > 0)
+            SPDLOG_WARN("  {} allocations on the hot path after the warm-up", hot);
+        else
+            SPDLOG_INFO("  no allocations on the hot path after the warm-up");
+    }
+
+    void AllocationTracker::draw_overlay() {
+        ImGui::Text("Hot path allocations: %llu%s", (unsigned long long) hot_allocations(),
+                    warm() ? "" : " (warming up)");
+        if (ImGui::BeginTable("allocations", 5)) {
+            ImGui::TableSetupColumn("tag");
+            ImGui::TableSetupColumn("allocs/frame");
+            ImGui::TableSetupColumn("kB/frame");
+            ImGui::TableSetupColumn("live MB");
+            ImGui::TableSetupColumn("peak MB");
+            ImGui::TableHeadersRow();
+            for (size_t i = 0; i < N_TAGS; i++) {
+                auto &f = last_frame_[i];
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(alloc_tag_name(static_cast<AllocTag>(i)));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long) f.allocations);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", f.bytes / 1024.0);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", f.live_bytes / 1048576.0);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", total(static_cast<AllocTag>(i)).peak_bytes / 1048576.0);
+            }
+            ImGui::EndTable();
+        }
+    }
+}
+
+#ifdef XE_TRACK_ALLOCATIONS
+
+namespace {
+    void *allocate_or_throw(size_t size, size_t alignment) {
+        while (true) {
+            if (auto p = xe::alloc_tracker::allocate(size, alignment))
+                return p;
+            auto handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+}
+
+void *operator new(size_t size) { return allocate_or_throw(size, 0); }
+
+void *operator new[](size_t size) { return allocate_or_throw(size, 0); }
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, static_cast<size_t>(alignment));
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return xe::alloc_tracker::allocate(size, 0); }
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return xe::alloc_tracker::allocate(size, 0); }
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return xe::alloc_tracker::allocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return xe::alloc_tracker::allocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *p) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete[](void *p) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete(void *p, size_t) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete[](void *p, size_t) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete(void *p, std::align_val_t) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete[](void *p, std::align_val_t) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { xe::alloc_tracker::free(p); }
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { xe::alloc_tracker::free(p); }
+
+#endif
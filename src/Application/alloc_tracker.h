@@ -0,0 +1,140 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "RegisteredObject.h"
+
+namespace xe {
+
+    enum class AllocTag : uint8_t {
+        untagged,
+        application,
+        engine,
+        object_reader,
+        imgui,
+        count
+    };
+
+    const char *alloc_tag_name(AllocTag tag);
+
+    /**
+     * @brief Counts the heap allocations per subsystem tag and per frame.
+     *
+     * Compiled in with -DXE_TRACK_ALLOCATIONS=ON, which replaces the global operator new and delete. Every
+     * allocation is attributed to the innermost XE_ALLOC_TAG scope of the allocating thread and carries a
+     * small header with its size and tag, so the frees are attributed to the same tag. ImGui is routed
+     * through the tracked operator new by the application, LinearArena allocations are counted separately.
+     *
+     * After the warm-up frames the application marks its frame loop as the hot path with XE_ALLOC_HOT_PATH,
+     * every allocation made in it is counted and reported, the goal is none.
+     *
+     * The counters are plain atomics living outside of the object, allocations can happen before main and
+     * after the cleanup. The object only keeps the per frame snapshots and the overlay panel.
+     */
+    class AllocationTracker : public RegisteredObject {
+    public:
+        struct Counters {
+            uint64_t allocations = 0;
+            uint64_t frees = 0;
+            uint64_t bytes = 0;
+            int64_t live_bytes = 0;
+            int64_t peak_bytes = 0;
+            uint64_t arena_bytes = 0;
+        };
+
+        static const int DEFAULT_WARM_UP_FRAMES = 60;
+
+        static AllocationTracker &instance();
+
+        ~AllocationTracker() override;
+
+        static bool available();
+
+        void set_warm_up_frames(int n) { warm_up_frames_ = n; }
+
+        bool warm() const { return frames_ >= static_cast<uint64_t>(warm_up_frames_); }
+
+        // Called by the application after every frame.
+        void end_frame();
+
+        // Totals since the start of the program.
+        Counters total(AllocTag tag) const;
+
+        // Allocations, bytes and arena bytes of the last frame, live and peak bytes at its end.
+        const Counters &last_frame(AllocTag tag) const { return last_frame_[static_cast<size_t>(tag)]; }
+
+        uint64_t hot_allocations() const;
+
+        void log_summary() const;
+
+        void draw_overlay();
+
+    private:
+        AllocationTracker();
+
+        static AllocationTracker *instance_;
+
+        std::array<Counters, static_cast<size_t>(AllocTag::count)> last_frame_ = {};
+        std::array<Counters, static_cast<size_t>(AllocTag::count)> previous_total_ = {};
+        uint64_t previous_hot_ = 0;
+        uint64_t frames_ = 0;
+        int warm_up_frames_ = DEFAULT_WARM_UP_FRAMES;
+        int reported_hot_frames_ = 0;
+        int overlay_panel_ = -1;
+    };
+
+    namespace alloc_tracker {
+        AllocTag current_tag();
+
+        AllocTag set_tag(AllocTag tag);
+
+        bool set_hot_path(bool hot);
+
+        void *allocate(size_t size, size_t alignment);
+
+        void free(void *p);
+
+        // LinearArena allocations, they do not go through operator new.
+        void record_arena(size_t bytes);
+    }
+
+    class AllocTagScope {
+    public:
+        explicit AllocTagScope(AllocTag tag) : previous_(alloc_tracker::set_tag(tag)) {}
+
+        ~AllocTagScope() { alloc_tracker::set_tag(previous_); }
+
+    private:
+        AllocTag previous_;
+    };
+
+    class AllocHotPathScope {
+    public:
+        explicit AllocHotPathScope(bool hot) : previous_(alloc_tracker::set_hot_path(hot)) {}
+
+        ~AllocHotPathScope() { alloc_tracker::set_hot_path(previous_); }
+
+    private:
+        bool previous_;
+    };
+}
+
+#define XE_ALLOC_CONCAT_(a, b) a##b
+#define XE_ALLOC_CONCAT(a, b) XE_ALLOC_CONCAT_(a, b)
+
+#ifdef XE_TRACK_ALLOCATIONS
+// Attributes the allocations of the enclosing scope on this thread to the tag.
+#define XE_ALLOC_TAG(tag) xe::AllocTagScope XE_ALLOC_CONCAT(xe_alloc_tag_, __LINE__)(xe::AllocTag::tag)
+// Allocations in the enclosing scope are reported once the tracker is warm.
+#define XE_ALLOC_HOT_PATH() \
+    xe::AllocHotPathScope XE_ALLOC_CONCAT(xe_alloc_hot_, __LINE__)(xe::AllocationTracker::instance().warm())
+#else
+#define XE_ALLOC_TAG(tag)
+#define XE_ALLOC_HOT_PATH()
+#endif
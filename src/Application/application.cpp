@@ -15,17 +15,31 @@
 
 #include "Application/application.h"
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
+#include <thread>
 
 #include "spdlog/spdlog.h"
 #include "glad/gl.h"
 #include "cxxopts.hpp"
 
 #include "utils.h"
+#include "alloc_tracker.h"
+#include "arena.h"
 #include "debug.h"
-
-#include "stb/stb_image_write.h"
+#include "deletion_queue.h"
+#include "file_watcher.h"
+#include "frame_pacer.h"
+#include "gl_api_profiler.h"
+#include "gl_trace.h"
+#include "job_system.h"
+#include "overlay.h"
+#include "perf_counters.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "startup_timeline.h"
 
 /**
  * @brief Predefined debugging callbacks.
@@ -33,14 +47,32 @@
  * If generated with debug option GLAD  permits to register callbacks that will be called before and after each OpenGL function call. 
  * This is switched off by default by me, as not to interfere with my error reporting code.  GLAD debuging can be enabled in the CMakeLists.txt file.
  * 
- * This unnamed namespace contains two predefined post-call callbacks making them local to this file.
+ * This unnamed namespace contains the pre-call callback and two predefined post-call callbacks making them local to this file.
+ * All of them feed the GL call profiler and the GL call capture when they are enabled.
  * 
  */
 namespace {
     void _pre_call_callback(const char *name, GLADapiproc apiproc, int len_args, ...) {
+        if (xe::gl_trace::Capture::active()) {
+            va_list args;
+            va_start(args, len_args);
+            xe::gl_trace::Capture::instance().pre_call(name, args);
+            va_end(args);
+        }
+        if (xe::GlApiProfiler::enabled()) {
+            va_list args;
+            va_start(args, len_args);
+            xe::GlApiProfiler::instance().pre_call(name, args);
+            va_end(args);
+        }
     };
 
     void _post_call_callback_default(void *ret, const char *name, GLADapiproc apiproc, int len_args, ...) {
+        if (xe::GlApiProfiler::enabled())
+            xe::GlApiProfiler::instance().post_call(name);
+        if (xe::gl_trace::Capture::active())
+            xe::gl_trace::Capture::instance().post_call(name, ret);
+
         GLenum error_code;
         error_code = glad_glGetError();
 
@@ -50,6 +82,10 @@ namespace {
     }
 
     void _post_call_callback_no_debug(void *ret, const char *name, GLADapiproc apiproc, int len_args, ...) {
+        if (xe::GlApiProfiler::enabled())
+            xe::GlApiProfiler::instance().post_call(name);
+        if (xe::gl_trace::Capture::active())
+            xe::gl_trace::Capture::instance().post_call(name, ret);
     }
 }
 
@@ -64,15 +100,43 @@ namespace {
  *              has efect only if compiled with debug version of glad.     
  */
 xe::Application::Application(int width, int height, std::string title, bool debug, int swap_interval)
-        : screenshot_n_(0) {
+        : window_(nullptr), width_(width), height_(height), title_(std::move(title)), debug_(debug),
+          swap_interval_(swap_interval), screenshot_n_(0) {
     SPDLOG_INFO("Application::Application(window size = {}x{}, {}, debug = {}, swap interval = {})", width, height,
-                title, debug, swap_interval);
+                title_, debug, swap_interval);
+}
+
+GLFWwindow *xe::Application::create_window() {
+    if (glfwGetPlatform() != GLFW_PLATFORM_NULL)
+        return glfwCreateWindow(width_, height_, title_.c_str(), nullptr, nullptr);
+
+    // The null platform has no native contexts, surfaceless EGL is tried first and OSMesa next.
+    for (auto api: {GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API}) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+        auto window = glfwCreateWindow(width_, height_, title_.c_str(), nullptr, nullptr);
+        if (window) {
+            SPDLOG_INFO("Created {} context", api == GLFW_EGL_CONTEXT_API ? "EGL" : "OSMesa");
+            return window;
+        }
+    }
+    return nullptr;
+}
 
+void xe::Application::create_context() {
     int glfw_major, glfw_minor, glfw_revision;
     glfwGetVersion(&glfw_major, &glfw_minor, &glfw_revision);
 
+#ifdef __linux__
+    if (headless_ && !std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY")) {
+        SPDLOG_INFO("No display, using the GLFW null platform");
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
+#endif
 
-    if (glfwInit()) {
+    auto init_phase = startup::begin("glfwInit");
+    auto initialized = glfwInit();
+    startup::end(init_phase);
+    if (initialized) {
 
         SPDLOG_INFO("GLFW version {}.{}.{} platform = {}", glfw_major, glfw_minor, glfw_revision,
                     xe::utils::glfw::platform_name(glfwGetPlatform()));
@@ -82,10 +146,15 @@ xe::Application::Application(int width, int height, std::string title, bool debu
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
         glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, true);
         glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
-        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
-        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+        // Debug contexts can be slower, one is only requested when its output is used.
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, gl_check::level() >= gl_check::Level::debug);
+        if (headless_)
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-        window_ = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
+        {
+            XE_STARTUP_PHASE("create window");
+            window_ = create_window();
+        }
         if (!window_) {
             const char *error_desc;
             auto err_code = glfwGetError(&error_desc);
@@ -107,9 +176,10 @@ xe::Application::Application(int width, int height, std::string title, bool debu
         SPDLOG_INFO("GLAD_OPTION_GL_DEBUG is ON");
         // Additionally if GLAD debugging is on, the we can still switch it off via debug variable.
         // This works by registering an empty predefined above callback.
-        if (debug) {
+        // The pre-call callback only feeds the GL call profiler, it replaces the glad one calling glGetError.
+        gladSetGLPreCallback(_pre_call_callback);
+        if (debug_) {
             SPDLOG_INFO("DEBUG is ON, setting callbacks");
-            gladSetGLPreCallback(_pre_call_callback);
             gladSetGLPostCallback(_post_call_callback_default);
         }
         else {
@@ -118,35 +188,91 @@ xe::Application::Application(int width, int height, std::string title, bool debu
         }
 #endif
 
+        auto load_phase = startup::begin("load GL");
         if (!gladLoadGL(glfwGetProcAddress)) {
             SPDLOG_CRITICAL("Failed to initialize OpenGL {}.{} context", MAJOR, MINOR);
             exit(-1);
         }
+        startup::end(load_phase);
+
+        if (headless_)
+            create_offscreen_framebuffer();
 
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glfwSwapInterval(swap_interval);
-
-        IMGUI_CHECKVERSION();
-        ImGui::CreateContext();
-        ImGuiIO &io = ImGui::GetIO();
+        // Frames are not presented in the headless mode, the swap interval would only throttle them.
+        glfwSwapInterval(headless_ ? 0 : swap_interval_);
 
-        ImGui_ImplGlfw_InitForOpenGL(window_, true);
-        const char *glsl_version = "#version 410";
-        ImGui_ImplOpenGL3_Init(glsl_version);
     } else {
         SPDLOG_CRITICAL("Cannot initialize GLFW");
         exit(-1);
     }
 }
 
+void xe::Application::init_imgui() {
+    if (imgui_ready_)
+        return;
+    XE_STARTUP_PHASE("ImGui");
+    IMGUI_CHECKVERSION();
+#ifdef XE_TRACK_ALLOCATIONS
+    // ImGui uses malloc by default, which is not tracked.
+    ImGui::SetAllocatorFunctions(
+            [](size_t size, void *) {
+                XE_ALLOC_TAG(imgui);
+                return ::operator new(size, std::nothrow);
+            },
+            [](void *p, void *) { ::operator delete(p); });
+#endif
+    ImGui::CreateContext();
+
+    // The backend chains the callbacks installed in create_context.
+    ImGui_ImplGlfw_InitForOpenGL(window_, true);
+    const char *glsl_version = "#version 410";
+    ImGui_ImplOpenGL3_Init(glsl_version);
+    imgui_ready_ = true;
+}
+
+void xe::Application::create_offscreen_framebuffer() {
+    OGL_CALL(glCreateRenderbuffers(1, &fbo_color_));
+    OGL_CALL(glNamedRenderbufferStorage(fbo_color_, GL_RGBA8, width_, height_));
+    OGL_CALL(glCreateRenderbuffers(1, &fbo_depth_));
+    OGL_CALL(glNamedRenderbufferStorage(fbo_depth_, GL_DEPTH24_STENCIL8, width_, height_));
+
+    OGL_CALL(glCreateFramebuffers(1, &fbo_));
+    OGL_CALL(glNamedFramebufferRenderbuffer(fbo_, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, fbo_color_));
+    OGL_CALL(glNamedFramebufferRenderbuffer(fbo_, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, fbo_depth_));
+    auto status = glCheckNamedFramebufferStatus(fbo_, GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        SPDLOG_CRITICAL("Offscreen framebuffer is not complete: {:#x}", status);
+        exit(-1);
+    }
+    OGL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fbo_));
+    OGL_CALL(glViewport(0, 0, width_, height_));
+    SPDLOG_INFO("Rendering offscreen into {}x{} framebuffer", width_, height_);
+}
+
 /**
- * @brief This starts the main event loop. 
+ * @brief Creates the context and reports on it. 
  * 
- * @param verbose unused parameter. 
+ * @param verbose if greater than zero prints the OpenGL vendor and version.
  */
-void xe::Application::run(int verbose) {
+void xe::Application::start(int verbose) {
+    verbose_ = verbose;
+    {
+        XE_STARTUP_PHASE("create context");
+        create_context();
+    }
+    // After the offscreen framebuffer is created, the replay makes its own.
+    if (!gl_capture_path_.empty()) {
+        auto &capture = gl_trace::Capture::instance();
+        capture.set_default_framebuffer(fbo_);
+        capture.start(gl_capture_path_, width_, height_, gl_capture_start_, gl_capture_frames_);
+    }
+    FramePacer::instance().set_frames_in_flight(frames_in_flight_);
+    if ((!profile_trace_path_.empty() || benchmark_.active()) && max_frames_ > 0)
+        Profiler::instance().set_history_size(max_frames_);
+
     if (verbose > 0) {
         SPDLOG_INFO("{} {}", utils::get_gl_vendor(), utils::get_gl_renderer());
         SPDLOG_INFO("OpenGL {} GLSL {}", utils::get_gl_version(), utils::get_glsl_version());
@@ -160,25 +286,72 @@ void xe::Application::run(int verbose) {
         SPDLOG_WARN("OpenGL version {}.{} is not supported. Minimum required version is 4.5", major, minor);
     }
 
+    SPDLOG_INFO("GL error checking: {}", gl_check::level_name(gl_check::level()));
     int flags;
     glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
     if (flags & GL_CONTEXT_FLAG_DEBUG_BIT) {
         SPDLOG_INFO("OpenGL context has debug flag enabled");
-        if (flags & GL_CONTEXT_FLAG_DEBUG_BIT) {
-            setup_debug_output();
+        if (gl_check::level() >= gl_check::Level::debug) {
+            XE_STARTUP_PHASE("debug output");
+            setup_debug_output(gl_check::per_call());
         }
     }
+}
 
+void xe::Application::finish() {
+    capture_.flush();
+    FramePacer::instance().wait_idle();
+    DeletionQueue::instance().collect();
+    Profiler::instance().collect_pending_gpu();
+    if (benchmark_.active()) {
+        auto [w, h] = frame_buffer_size();
+        benchmark_.finish(frame_stats_.samples(), Profiler::instance(), w, h);
+    }
+    if (frame_stats_.size() > 0 && (headless_ || !frame_stats_path_.empty()))
+        frame_stats_.log_summary("Frame times");
+    if (!frame_stats_path_.empty())
+        frame_stats_.write_csv(frame_stats_path_);
+    if (!profile_trace_path_.empty())
+        Profiler::instance().write_chrome_trace(profile_trace_path_);
+    if (!gl_profile_csv_path_.empty())
+        GlApiProfiler::instance().write_csv(gl_profile_csv_path_);
+    GlApiProfiler::set_enabled(false);
+    gl_trace::Capture::instance().stop();
+    AllocationTracker::instance().log_summary();
+    if (PerfCounters::enabled())
+        PerfCounters::instance().log_summary();
+
+    if (imgui_ready_) {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
+    cleanup();
+    if (fbo_) {
+        glDeleteFramebuffers(1, &fbo_);
+        glDeleteRenderbuffers(1, &fbo_color_);
+        glDeleteRenderbuffers(1, &fbo_depth_);
+    }
+    glfwTerminate();
+}
+
+/**
+ * @brief This starts the main event loop. 
+ * 
+ * @param verbose if greater than zero prints the OpenGL vendor and version.
+ */
+void xe::Application::run(int verbose) {
+    XE_ALLOC_TAG(application);
+    start(verbose);
 
-    init();
+    {
+        XE_STARTUP_PHASE("init");
+        init();
+    }
 
     loop();
 
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-    cleanup();
-    glfwTerminate();
+    finish();
 }
 
 char *convert(const std::string &s) {
@@ -192,6 +365,49 @@ void xe::Application::run_cli(int argc, char **argv) {
     cxxopts::Options options("xe::Application", "Simple OpenGL Application");
     options.add_options()("v,verbose", "Verbose output",
                           cxxopts::value<int>()->default_value("1"));
+    options.add_options()("hot-reload", "Reload shaders, meshes and textures when their files change");
+    options.add_options()("headless", "Render offscreen without a window, needs no display");
+    options.add_options()("frames", "Number of frames to render, 0 runs until the window is closed",
+                          cxxopts::value<int>()->default_value("0"));
+    options.add_options()("dump-frames", "Save every frame as a PNG file into this directory",
+                          cxxopts::value<std::string>());
+    options.add_options()("capture", "Record every frame into this Y4M video file",
+                          cxxopts::value<std::string>());
+    options.add_options()("capture-fps", "Frame rate written into the Y4M header",
+                          cxxopts::value<int>()->default_value("60"));
+    options.add_options()("frame-stats", "Write frame times in milliseconds into this CSV file",
+                          cxxopts::value<std::string>());
+    options.add_options()("gl-check", "GL error checking: off, debug (KHR_debug output), frame (glGetError once "
+                                      "per frame) or call (after every OGL_CALL)",
+                          cxxopts::value<std::string>());
+    options.add_options()("gl-profile", "Count the GL calls and the time spent in them, needs the debug glad");
+    options.add_options()("gl-profile-csv", "Profile the GL calls and write the statistics into this CSV file",
+                          cxxopts::value<std::string>());
+    options.add_options()("gl-capture", "Record the GL calls into this trace for the gl_replay tool, needs the debug glad",
+                          cxxopts::value<std::string>());
+    options.add_options()("gl-capture-start", "Frames recorded as a part of the setup before the captured ones",
+                          cxxopts::value<int>()->default_value("0"));
+    options.add_options()("gl-capture-frames", "Number of frames to capture",
+                          cxxopts::value<int>()->default_value("10"));
+    options.add_options()("frames-in-flight",
+                          "Frames the CPU may run ahead of the GPU, 1 for the lowest latency, 2 or 3 for throughput",
+                          cxxopts::value<int>()->default_value("2"));
+    options.add_options()("render-thread", "Record the frames into command lists executed by a separate render thread");
+    options.add_options()("job-threads", "Worker threads of the job system, 0 uses all cores but one",
+                          cxxopts::value<unsigned>()->default_value("0"));
+    options.add_options()("no-overlay", "Do not show the overlay, ImGui is then never initialized");
+    options.add_options()("perf-counters", "Read the hardware performance counters in the XE_PERF_SCOPE scopes (Linux)");
+    options.add_options()("profile-trace", "Write the profiled frames as a Chrome trace into this JSON file",
+                          cxxopts::value<std::string>());
+    options.add_options()("benchmark", "Measure --frames frames and write the results into PREFIX.csv and PREFIX.json",
+                          cxxopts::value<std::string>());
+    options.add_options()("warmup", "Frames rendered before the benchmark measures",
+                          cxxopts::value<int>()->default_value("60"));
+    options.add_options()("camera-path", "Camera keyframes the benchmark moves along",
+                          cxxopts::value<std::string>());
+    options.add_options()("scene", "Scene loaded after the initialization", cxxopts::value<std::string>());
+    options.add_options()("vsync", "Wait for the v-sync when presenting: on or off, the benchmark defaults to off",
+                          cxxopts::value<std::string>());
 
     options.allow_unrecognised_options();
     auto result = options.parse(argc, argv);
@@ -202,85 +418,399 @@ void xe::Application::run_cli(int argc, char **argv) {
 
 
     verbose = result["verbose"].as<int>();
+    if (result.count("hot-reload"))
+        FileWatcher::instance().set_enabled(true);
+
+    headless_ = result.count("headless") > 0;
+    max_frames_ = result["frames"].as<int>();
+    if (result.count("vsync")) {
+        auto vsync = result["vsync"].as<std::string>();
+        if (vsync == "on" || vsync == "off")
+            swap_interval_ = vsync == "on" ? 1 : 0;
+        else
+            SPDLOG_WARN("Unknown --vsync `{}', expected on or off", vsync);
+    }
+    std::string scene;
+    if (result.count("scene"))
+        scene = result["scene"].as<std::string>();
+    if (result.count("benchmark")) {
+        Benchmark::Config config;
+        if (max_frames_ > 0)
+            config.frames = max_frames_;
+        config.warmup = std::max(result["warmup"].as<int>(), 0);
+        // With the v-sync the benchmark would measure the refresh rate.
+        if (!result.count("vsync"))
+            swap_interval_ = 0;
+        config.vsync = swap_interval_ != 0 && !headless_;
+        if (result.count("camera-path"))
+            config.camera_path = result["camera-path"].as<std::string>();
+        config.scene = scene;
+        if (!benchmark_.start(result["benchmark"].as<std::string>(), config))
+            exit(-1);
+        max_frames_ = benchmark_.total_frames();
+        Profiler::set_enabled(true);
+        // Draw calls and triangles are counted by the debug glad only.
+        if (GlApiProfiler::available())
+            GlApiProfiler::set_enabled(true);
+    } else if (result.count("camera-path")) {
+        SPDLOG_WARN("--camera-path is used by --benchmark only");
+    }
+    if (headless_ && max_frames_ <= 0) {
+        SPDLOG_WARN("Headless mode needs a number of frames, rendering 100");
+        max_frames_ = 100;
+    }
+    // FrameCapture records a single sequence, starting the second one would stop the first.
+    if (result.count("dump-frames") && result.count("capture")) {
+        SPDLOG_CRITICAL("--dump-frames and --capture cannot be used together");
+        exit(-1);
+    }
+    if (result.count("dump-frames"))
+        capture_.start_sequence(result["dump-frames"].as<std::string>(), FrameCapture::Format::png);
+    if (result.count("capture"))
+        capture_.start_sequence(result["capture"].as<std::string>(), FrameCapture::Format::y4m,
+                                result["capture-fps"].as<int>());
+    recording_ = capture_.recording();
+    frames_in_flight_ = result["frames-in-flight"].as<int>();
+    render_thread_ = result.count("render-thread") > 0;
+    // The overlay changes from run to run, headless frames are compared with reference images.
+    overlay_ = !headless_ && !benchmark_.active() && result.count("no-overlay") == 0;
+    JobSystem::set_worker_count(result["job-threads"].as<unsigned>());
+    if (result.count("gl-profile-csv"))
+        gl_profile_csv_path_ = result["gl-profile-csv"].as<std::string>();
+    if (result.count("gl-profile") || !gl_profile_csv_path_.empty())
+        GlApiProfiler::set_enabled(true);
+    if (result.count("gl-capture"))
+        gl_capture_path_ = result["gl-capture"].as<std::string>();
+    gl_capture_start_ = result["gl-capture-start"].as<int>();
+    gl_capture_frames_ = result["gl-capture-frames"].as<int>();
+    if (result.count("gl-check")) {
+        gl_check::Level level;
+        if (gl_check::parse_level(result["gl-check"].as<std::string>(), level))
+            gl_check::set_level(level);
+        else
+            SPDLOG_WARN("Unknown GL check level `{}', keeping {}", result["gl-check"].as<std::string>(),
+                        gl_check::level_name(gl_check::level()));
+    }
+    if (result.count("frame-stats"))
+        frame_stats_path_ = result["frame-stats"].as<std::string>();
+    if (result.count("profile-trace"))
+        profile_trace_path_ = result["profile-trace"].as<std::string>();
+    if (result.count("perf-counters"))
+        PerfCounters::set_enabled(true);
+
+    start(verbose);
+
+    {
+        XE_STARTUP_PHASE("init");
+        init_cli(vc.size(), vc.data());
+        init();
+        if (!scene.empty()) {
+            XE_STARTUP_PHASE("load scene");
+            if (!load_scene(scene)) {
+                SPDLOG_CRITICAL("Cannot load the scene `{}'", scene);
+                exit(-1);
+            }
+        }
+    }
 
-    if (verbose > 0) {
-        SPDLOG_INFO("{} {}", utils::get_gl_vendor(), utils::get_gl_renderer());
-        SPDLOG_INFO("OpenGL {} GLSL {}", utils::get_gl_version(), utils::get_glsl_version());
+    loop();
+
+    finish();
+}
+
+void xe::Application::begin_gl_frame() {
+    // Waits until the GPU is done with the frame that used this frame's slot before.
+    FramePacer::instance().begin_frame();
+    DeletionQueue::instance().collect();
+    if (fbo_)
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+
+    // Clears the framebuffer by filling it with color set using the glClearColor function.
+    // Also clears the depth buffer.
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    {
+        // Swaps in the assets changed on the disk and finishes the programs compiling in the background.
+        // The render thread does it only when there is something to swap, and waits for the app thread to
+        // leave record(), which may use the same meshes and programs.
+        XE_PROFILE_SCOPE("assets");
+        auto &watcher = FileWatcher::instance();
+        auto &programs = ProgramCache::instance();
+        if (!render_thread_) {
+            watcher.poll();
+            programs.update();
+        } else if (watcher.ready() || programs.busy()) {
+            std::lock_guard<std::mutex> lock(assets_mutex_);
+            watcher.poll();
+            programs.update();
+        }
     }
+}
 
-    init_cli(vc.size(), vc.data());
-    init();
+void xe::Application::end_gl_frame(int width, int height) {
+    // Not swapped yet, the back buffer is read.
+    capture_.capture(fbo_, width, height);
+    capture_.poll();
+
+    /* Swap front and back buffers
+       The rendering is done into the BACK buffer, swapping it with front buffer displays it on the screen.
+       This is done after n screen updates where n is the number set by the glfwSwapInterwal.
+       Setting it to one as I did set the swap rate to v-sync rate.
+       Setting it to zero disables v-sync.
+       Nothing is presented in the headless mode.
+    */
+    if (!headless_) {
+        XE_PROFILE_SCOPE("swap");
+        glfwSwapBuffers(window_);
+    }
+    FramePacer::instance().end_frame();
+    if (startup::open()) {
+        startup::first_frame();
+        startup::log_report(verbose_);
+    }
 
-    loop();
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    // The overlay of the app thread reads the statistics.
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    gl_check::end_frame();
+    if (GlApiProfiler::enabled()) {
+        auto &gl_profiler = GlApiProfiler::instance();
+        gl_profiler.end_frame();
+        if (benchmark_.active() && GlApiProfiler::available())
+            benchmark_.add_gl_frame(gl_profiler.last_frame().draw_calls, gl_profiler.last_frame().triangles);
+    }
+    if (gl_trace::Capture::active())
+        gl_trace::Capture::instance().end_frame();
+    if (AllocationTracker::available())
+        AllocationTracker::instance().end_frame();
+}
 
-    cleanup();
-    glfwTerminate();
+void xe::Application::build_overlay() {
+    XE_ALLOC_TAG(imgui);
+    ImGuiIO &io = ImGui::GetIO();
+    ImGuiWindowFlags window_flags =
+            ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+            ImGuiWindowFlags_NoSavedSettings |
+            ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
+    ImGui::SetNextWindowBgAlpha(0.35f);
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always, ImVec2(0.0, 0.0));
+    ImGui::PushStyleVar(ImGuiStyleVar_WindowRounding, 0.0f);
+    ImGui::Begin("data", nullptr,
+                 window_flags);                          // Create a window called "Hello, world!" and append into it.
+
+    ImGui::Text("FPS: %.1f", io.Framerate);
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        ImGui::Text("GPU wait: %.2f ms (%d in flight)", FramePacer::instance().last_wait_ms(),
+                    FramePacer::instance().frames_in_flight());
+        if (render_thread_)
+            ImGui::Text("Render thread: %zu commands, %.1f kB", last_commands_, last_command_bytes_ / 1024.0);
+        ImGui::Text("Frame arena: %.1f kB peak, %zu blocks allocated", frame_arena().high_water() / 1024.0,
+                    frame_arena().block_allocations());
+        overlay::draw_panels();
+    }
+    ImGui::End();
+    ImGui::PopStyleVar();
+
+    ImGui::Render();
 }
 
-void xe::Application::loop() {
+void xe::Application::end_loop_iteration() {
 #ifdef __APPLE__
-    auto macMoved = false;
+    // A hack to fix bug in apple implementation.
+    // maybe not needed now. Didn't check :(
+    if (!mac_moved_)
+    {
+        int x, y;
+        glfwGetWindowPos(window_, &x, &y);
+        glfwSetWindowPos(window_, ++x, y);
+        glfwSetWindowPos(window_, --x, y);
+        mac_moved_ = true;
+    }
 #endif
+}
 
-    while (!glfwWindowShouldClose(window_)) {
-        // Clears the framebuffer by filling it with color set using the glClearColor function.
-        // Also clears the depth buffer.
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void xe::Application::loop() {
+    if (render_thread_ && split_loop())
+        return;
+    render_thread_ = false;
+
+    for (int frame_n = 0; !glfwWindowShouldClose(window_) && (max_frames_ <= 0 || frame_n < max_frames_);
+         frame_n++) {
+        auto frame_start = std::chrono::steady_clock::now();
+        Profiler::instance().begin_frame();
+        XE_ALLOC_HOT_PATH();
+        begin_gl_frame();
+
+        if (overlay_) {
+            init_imgui();
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+        }
 
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
-
-        //This method should be overridden by you and will contain the rendering code.
-        frame();
-
-        ImGuiIO &io = ImGui::GetIO();
-        ImGuiWindowFlags window_flags =
-                ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
-                ImGuiWindowFlags_NoSavedSettings |
-                ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
-        ImGui::SetNextWindowBgAlpha(0.35f);
-        ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always, ImVec2(0.0, 0.0));
-        ImGui::PushStyleVar(ImGuiStyleVar_WindowRounding, 0.0f);
-        ImGui::Begin("data", nullptr,
-                     window_flags);                          // Create a window called "Hello, world!" and append into it.
-
-        ImGui::Text("FPS: %.1f", io.Framerate);
-        ImGui::End();
-        ImGui::PopStyleVar();
-
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        glFinish();
-
-        /* Swap front and back buffers
-           The rendering is done into the BACK buffer, swapping it with front buffer displays it on the screen.
-           This is done after n screen updates where n is the number set by the glfwSwapInterwal.
-           Setting it to one as I did set the swap rate to v-sync rate.
-           Setting it to zero disables v-sync.
-        */
-        glfwSwapBuffers(window_);
+        if (benchmark_.has_camera_path())
+            set_camera_pose(benchmark_.camera_pose(frame_n));
+
+        {
+            //This method should be overridden by you and will contain the rendering code.
+            XE_PROFILE_GPU_SCOPE("frame");
+            frame();
+        }
+
+        if (overlay_) {
+            build_overlay();
+            XE_PROFILE_GPU_SCOPE("overlay");
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        auto [w, h] = frame_buffer_size();
+        end_gl_frame(w, h);
 
         /* Poll for and process events */
         glfwPollEvents();
-#ifdef __APPLE__
-        // A hack to fix bug in apple implementation.
-        // maybe not needed now. Didn't check :(
-        if (!macMoved)
+        end_loop_iteration();
+        Profiler::instance().end_frame();
+        reset_frame_arena();
+        // The CPU time of the whole frame including the waits for the GPU (and the v-sync).
+        frame_stats_.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start)
+                                 .count());
+    }
+}
+
+namespace {
+    // ImGui builds the next frame on the app thread while the render thread draws this one.
+    struct OverlayCopy {
+        explicit OverlayCopy(const ImDrawData *draw_data) : data(*draw_data) {
+            for (int i = 0; i < data.CmdLists.Size; i++)
+                data.CmdLists[i] = data.CmdLists[i]->CloneOutput();
+        }
+
+        ~OverlayCopy() {
+            for (int i = 0; i < data.CmdLists.Size; i++)
+                IM_DELETE(data.CmdLists[i]);
+        }
+
+        ImDrawData data;
+    };
+}
+
+bool xe::Application::split_loop() {
+    std::thread renderer;
+    for (int frame_n = 0; !glfwWindowShouldClose(window_) && (max_frames_ <= 0 || frame_n < max_frames_);
+         frame_n++) {
+        auto frame_start = std::chrono::steady_clock::now();
+        // Until the render thread starts, the context is still current here and the backend can create its objects.
+        if (overlay_) {
+            if (frame_n == 0) {
+                init_imgui();
+                ImGui_ImplOpenGL3_NewFrame();
+            }
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+        }
+
+        if (benchmark_.has_camera_path())
+            set_camera_pose(benchmark_.camera_pose(frame_n));
+
+        CommandList *commands;
         {
-            int x, y;
-            glfwGetWindowPos(window_, &x, &y);
-            glfwSetWindowPos(window_, ++x, y);
-            glfwSetWindowPos(window_, --x, y);
-            macMoved = true;
+            XE_PROFILE_SCOPE("wait for render thread");
+            commands = exchange_.begin_record();
         }
-#endif
+        {
+            XE_PROFILE_SCOPE("record");
+            XE_ALLOC_HOT_PATH();
+            std::lock_guard<std::mutex> lock(assets_mutex_);
+            records_ = true;
+            record(*commands);
+        }
+        if (!records_) {
+            SPDLOG_WARN("The application does not record command lists, rendering on the main thread");
+            if (overlay_)
+                ImGui::EndFrame();
+            return false;
+        }
+
+        if (overlay_) {
+            build_overlay();
+            auto overlay = std::make_shared<OverlayCopy>(ImGui::GetDrawData());
+            commands->call([overlay]() {
+                XE_PROFILE_GPU_SCOPE("overlay");
+                ImGui_ImplOpenGL3_RenderDrawData(&overlay->data);
+            });
+        }
+        for (auto &task: render_tasks_)
+            commands->call(std::move(task));
+        render_tasks_.clear();
+        auto [w, h] = frame_buffer_size();
+        commands->call([this, w = w, h = h]() { end_gl_frame(w, h); });
+        last_commands_ = commands->n_commands();
+        last_command_bytes_ = commands->size();
+        exchange_.end_record();
+
+        if (frame_n == 0) {
+            glfwMakeContextCurrent(nullptr);
+            renderer = std::thread(&Application::render_loop, this);
+        }
+
+        glfwPollEvents();
+        end_loop_iteration();
+        // Recorded commands own their data, the render thread does not read the app thread's arena.
+        reset_frame_arena();
+        // The CPU time of the app thread, it runs a frame ahead of the render thread.
+        frame_stats_.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start)
+                                 .count());
+    }
+    exchange_.close();
+    if (renderer.joinable()) {
+        renderer.join();
+        glfwMakeContextCurrent(window_);
+    }
+    return true;
+}
+
+void xe::Application::render_loop() {
+    XE_ALLOC_TAG(application);
+    glfwMakeContextCurrent(window_);
+    while (auto commands = exchange_.begin_execute()) {
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            Profiler::instance().begin_frame();
+        }
+        begin_gl_frame();
+        {
+            XE_PROFILE_GPU_SCOPE("frame");
+            XE_ALLOC_HOT_PATH();
+            commands->execute();
+        }
+        exchange_.end_execute();
+        reset_frame_arena();
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        Profiler::instance().end_frame();
+    }
+    glfwMakeContextCurrent(nullptr);
+}
+
+void xe::Application::set_camera_pose(const CameraPose &) {
+    static bool warned = false;
+    if (!warned) {
+        SPDLOG_WARN("The application does not set the camera, the camera path is ignored");
+        warned = true;
     }
 }
 
+bool xe::Application::load_scene(const std::string &) {
+    SPDLOG_ERROR("The application does not load scenes");
+    return false;
+}
+
+void xe::Application::on_render_thread(std::function<void()> task) {
+    if (render_thread_)
+        render_tasks_.push_back(std::move(task));
+    else
+        task();
+}
+
 void xe::Application::glfw_framebuffer_size_callback(GLFWwindow *window_ptr, int w, int h) {
     auto app_ptr = reinterpret_cast<Application *>(glfwGetWindowUserPointer(window_ptr));
     if (app_ptr) {
@@ -323,6 +853,9 @@ void xe::Application::key_callback(int key, int scancode, int action, int mods)
     if (key == GLFW_KEY_S && action == GLFW_PRESS) {
         save_frame_buffer();
     }
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        toggle_recording();
+    }
 }
 
 void xe::Application::glfw_window_refresh_callback(GLFWwindow *window) {
@@ -333,19 +866,19 @@ void xe::Application::glfw_window_refresh_callback(GLFWwindow *window) {
 }
 
 void xe::Application::save_frame_buffer() {
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadBuffer(GL_FRONT);
-    if (glGetError() == GL_INVALID_OPERATION)
-        SPDLOG_WARN("Saving Frame buffer error: Front buffer does not exist.");
-
-    auto [w, h] = frame_buffer_size();
-    auto data = (GLubyte *) malloc(w * h * 3);
-    OGL_CALL(glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, data));
-
-    stbi_flip_vertically_on_write(1);
-    std::stringstream ss;
-    ss << "screenshot_" << screenshot_n_ << ".png";
-    spdlog::info("Saving screenshot to {}", ss.str());
-    stbi_write_png(ss.str().c_str(), w, h, 3, data, w * 3);
+    auto path = fmt::format("screenshot_{}.png", screenshot_n_);
+    spdlog::info("Saving screenshot to {}", path);
+    on_render_thread([this, path = std::move(path)]() { capture_.screenshot(path); });
     ++screenshot_n_;
 }
+
+void xe::Application::toggle_recording() {
+    recording_ = !recording_;
+    if (!recording_) {
+        on_render_thread([this]() { capture_.stop_sequence(); });
+        return;
+    }
+    on_render_thread([this, path = fmt::format("recording_{}.y4m", recording_n_++)]() {
+        capture_.start_sequence(path, FrameCapture::Format::y4m);
+    });
+}
@@ -3,19 +3,53 @@
 //
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <iomanip>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #define GLFW_INCLUDE_NONE
 
+#include "glad/gl.h"
 #include <GLFW/glfw3.h>
 #include "RegisteredObject.h"
+#include "benchmark.h"
+#include "command_list.h"
+#include "frame_capture.h"
+#include "frame_stats.h"
 
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_opengl3.h"
 
 namespace xe {
+    /**
+     * @brief Base class of the applications.
+     *
+     * The window and the OpenGL context are created when the application starts running, so run_cli() can
+     * choose how. With --headless the application renders into an offscreen framebuffer of the requested size
+     * for --frames frames without showing a window. On Linux without a display GLFW is initialized on its
+     * null platform and the context comes from EGL or OSMesa (software rendering with llvmpipe), so
+     * this works on build machines without a GPU. Frames can be dumped as PNG files (--dump-frames) or
+     * recorded into a Y4M video (--capture, or the C key) and frame times are written with --frame-stats.
+     * Frames are read back and encoded asynchronously, see FrameCapture.
+     *
+     * The loop does not wait for the GPU to finish a frame, the CPU may run --frames-in-flight frames
+     * ahead, see FramePacer.
+     *
+     * With --render-thread the frames are split between two threads: the main (app) thread handles the input,
+     * calls record() and builds the overlay, a render thread owning the context executes the recorded
+     * command lists, so the app thread works on the frame N + 1 while the frame N is submitted. Applications
+     * that do not override record() run on one thread as before. In this mode the callbacks and record() must
+     * not call GL, on_render_thread() queues such work for the render thread; the asset reloads and
+     * continuations of FileWatcher run there as well, but only while the app thread is outside record().
+     *
+     * With --benchmark the application renders --warmup and then --frames frames without the overlay,
+     * moving the camera along --camera-path, and writes the per frame times with their percentiles,
+     * see Benchmark.
+     */
     class Application {
     public:
         Application(int width, int height, std::string title, bool debug, int swap_interval=1);
@@ -25,20 +59,49 @@ namespace xe {
         void run_cli(int argc, char **argv);
 
         auto frame_buffer_size() const {
-            int w, h;
-            glfwGetFramebufferSize(window_, &w, &h);
+            int w = width_, h = height_;
+            if (!headless_)
+                glfwGetFramebufferSize(window_, &w, &h);
             return std::make_pair(w, h);
         }
 
+        bool headless() const { return headless_; }
+
+        // Framebuffer the frames are rendered into: 0 for the window, the offscreen one in the headless mode.
+        GLuint default_framebuffer() const { return fbo_; }
+
+        const FrameStats &frame_stats() const { return frame_stats_; }
+
+        FrameCapture &frame_capture() { return capture_; }
+
+        // Saves the next frame as screenshot_N.png, without waiting for it.
         void save_frame_buffer();
 
+        // Starts or stops recording the frames into recording_N.y4m.
+        void toggle_recording();
+
         virtual void init() {};
 
         virtual void init_cli(int argc, char **argv) {}
 
+        // Moves the camera along the --camera-path of a benchmark, applications with a camera override it.
+        virtual void set_camera_pose(const CameraPose &pose);
+
+        // Loads the --scene after init(), false when it cannot be loaded. Only applications with scenes override it.
+        virtual bool load_scene(const std::string &path);
+
         virtual void frame() {
         }
 
+        // Records the commands of a frame, used instead of frame() with the render thread.
+        virtual void record(CommandList &/*commands*/) { records_ = false; }
+
+        // True when the frames are recorded and executed by the render thread.
+        bool render_thread() const { return render_thread_; }
+
+        // Runs task on the thread owning the context, before the current frame is presented.
+        void on_render_thread(std::function<void()> task);
+
         virtual void cleanup() {
             RegisteredObject::cleanup();
         }
@@ -61,9 +124,78 @@ namespace xe {
 
     private:
 
+        void create_context();
+
+        GLFWwindow *create_window();
+
+        void create_offscreen_framebuffer();
+
+        // Created before the first frame that shows the overlay, never with --no-overlay or headless.
+        void init_imgui();
+
+        void start(int verbose);
+
+        void finish();
+
         void loop(); // main loop
 
+        // Runs when the application records command lists, false otherwise.
+        bool split_loop();
+
+        void render_loop();
+
+        void begin_gl_frame();
+
+        void end_gl_frame(int width, int height);
+
+        void build_overlay();
+
+        void end_loop_iteration();
+
+        int width_;
+        int height_;
+        std::string title_;
+        bool debug_;
+        int swap_interval_;
+
+        bool headless_ = false;
+        bool overlay_ = true;
+        bool imgui_ready_ = false;
+        int verbose_ = 0;
+        int max_frames_ = 0; // 0 runs until the window is closed
+        int frames_in_flight_ = 2;
+        std::string frame_stats_path_;
+        std::string profile_trace_path_;
+        std::string gl_profile_csv_path_;
+        std::string gl_capture_path_;
+        int gl_capture_start_ = 0;
+        int gl_capture_frames_ = 10;
+        FrameStats frame_stats_;
+        Benchmark benchmark_;
+        FrameCapture capture_;
+
+        bool render_thread_ = false;
+        bool records_ = true;
+        CommandListExchange exchange_;
+        std::vector<std::function<void()>> render_tasks_;
+        // Guards the statistics written by the render thread and shown by the overlay.
+        std::mutex stats_mutex_;
+        // Held by the app thread in record() and by the render thread while it swaps in changed assets.
+        std::mutex assets_mutex_;
+        size_t last_commands_ = 0;
+        size_t last_command_bytes_ = 0;
+#ifdef __APPLE__
+        bool mac_moved_ = false;
+#endif
+
+        GLuint fbo_ = 0u;
+        GLuint fbo_color_ = 0u;
+        GLuint fbo_depth_ = 0u;
+
         unsigned int screenshot_n_;
+        // App thread only, the render thread starts and stops the recordings.
+        unsigned int recording_n_ = 0;
+        bool recording_ = false;
 
         static void glfw_framebuffer_size_callback(GLFWwindow *window_ptr, int w, int h);
 
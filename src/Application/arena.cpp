@@ -0,0 +1,100 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+#include "alloc_tracker.h"
+
+namespace {
+    const size_t BLOCK_ALIGNMENT = 64; // a cache line
+
+    std::byte *align(std::byte *p, size_t alignment) {
+        auto address = reinterpret_cast<uintptr_t>(p);
+        return p + ((alignment - address % alignment) % alignment);
+    }
+}
+
+namespace xe {
+
+    LinearArena::~LinearArena() {
+        for (auto &block: blocks_)
+            ::operator delete(block.data, std::align_val_t(BLOCK_ALIGNMENT));
+    }
+
+    void LinearArena::add_block(size_t size) {
+        auto data = static_cast<std::byte *>(::operator new(size, std::align_val_t(BLOCK_ALIGNMENT)));
+        blocks_.push_back({data, size});
+        capacity_ += size;
+        block_allocations_++;
+    }
+
+    void *LinearArena::do_allocate(size_t bytes, size_t alignment) {
+        while (true) {
+            if (block_ < blocks_.size()) {
+                auto &block = blocks_[block_];
+                auto p = align(block.data + offset_, alignment);
+                if (p + bytes <= block.data + block.size) {
+#ifdef XE_TRACK_ALLOCATIONS
+                    alloc_tracker::record_arena(bytes);
+#endif
+                    offset_ = p + bytes - block.data;
+                    high_water_ = std::max(high_water_, used());
+                    return p;
+                }
+                if (block_ + 1 < blocks_.size()) {
+                    block_++;
+                    offset_ = 0;
+                    continue;
+                }
+            }
+            // Blocks are kept in order, the new one always goes last.
+            add_block(std::max(block_size_, bytes + alignment));
+            block_ = blocks_.size() - 1;
+            offset_ = 0;
+        }
+    }
+
+    void LinearArena::rewind(Marker marker) {
+        block_ = marker.block;
+        offset_ = marker.offset;
+    }
+
+    void LinearArena::reset() {
+        if (blocks_.size() > 1) {
+            auto size = capacity_;
+            for (auto &block: blocks_)
+                ::operator delete(block.data, std::align_val_t(BLOCK_ALIGNMENT));
+            blocks_.clear();
+            capacity_ = 0;
+            add_block(size);
+        }
+        block_ = 0;
+        offset_ = 0;
+    }
+
+    size_t LinearArena::used() const {
+        size_t bytes = offset_;
+        for (size_t i = 0; i < block_ && i < blocks_.size(); i++)
+            bytes += blocks_[i].size;
+        return bytes;
+    }
+
+    LinearArena &frame_arena() {
+        thread_local LinearArena arena;
+        return arena;
+    }
+
+    void reset_frame_arena() {
+        frame_arena().reset();
+    }
+
+    LinearArena &load_arena() {
+        thread_local LinearArena arena;
+        return arena;
+    }
+}
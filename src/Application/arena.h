@@ -0,0 +1,113 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace xe {
+
+    /**
+     * @brief Bump allocator for data that dies all at once.
+     *
+     * Allocation moves a pointer through a list of blocks, deallocation does nothing: the memory is given
+     * back by rewind() to an earlier mark() or by reset(). reset() merges the blocks into one as big as all
+     * of them, so after a few frames of warm-up the arena does not touch the heap anymore.
+     *
+     * It is a std::pmr::memory_resource, std::pmr containers take it as their allocator. The containers must
+     * not outlive the rewind or reset that frees their memory. Not thread safe.
+     */
+    class LinearArena : public std::pmr::memory_resource {
+    public:
+        static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+        struct Marker {
+            size_t block;
+            size_t offset;
+        };
+
+        explicit LinearArena(size_t block_size = DEFAULT_BLOCK_SIZE) : block_size_(block_size) {}
+
+        ~LinearArena() override;
+
+        LinearArena(const LinearArena &) = delete;
+
+        LinearArena &operator=(const LinearArena &) = delete;
+
+        Marker mark() const { return {block_, offset_}; }
+
+        // Frees everything allocated after the mark.
+        void rewind(Marker marker);
+
+        void reset();
+
+        // Bytes allocated since the last reset, including the alignment padding.
+        size_t used() const;
+
+        size_t capacity() const { return capacity_; }
+
+        // Most bytes ever used at once.
+        size_t high_water() const { return high_water_; }
+
+        // Blocks taken from the heap, stops growing once the arena is warm.
+        size_t block_allocations() const { return block_allocations_; }
+
+    private:
+        struct Block {
+            std::byte *data;
+            size_t size;
+        };
+
+        void *do_allocate(size_t bytes, size_t alignment) override;
+
+        void do_deallocate(void *, size_t, size_t) override {}
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+        void add_block(size_t size);
+
+        size_t block_size_;
+        std::vector<Block> blocks_;
+        size_t block_ = 0;
+        size_t offset_ = 0;
+        size_t capacity_ = 0;
+        size_t high_water_ = 0;
+        size_t block_allocations_ = 0;
+    };
+
+    /**
+     * @brief Gives back everything allocated from the arena during its lifetime.
+     *
+     * For load time work and for job bodies using frame_arena() on a worker thread.
+     */
+    class ArenaScope {
+    public:
+        explicit ArenaScope(LinearArena &arena) : arena_(arena), marker_(arena.mark()) {}
+
+        ~ArenaScope() { arena_.rewind(marker_); }
+
+        ArenaScope(const ArenaScope &) = delete;
+
+        ArenaScope &operator=(const ArenaScope &) = delete;
+
+        LinearArena &arena() const { return arena_; }
+
+    private:
+        LinearArena &arena_;
+        LinearArena::Marker marker_;
+    };
+
+    // Arena of the calling thread for data that lives at most until the end of the frame. The application
+    // resets it at the end of every frame on the threads running the frame loop (the main thread and the
+    // render thread), other threads have to use it inside an ArenaScope.
+    LinearArena &frame_arena();
+
+    void reset_frame_arena();
+
+    // Arena of the calling thread for scratch data of asset loading, which may run on a worker thread. It is
+    // never reset, so it is only used inside an ArenaScope; its blocks stay around for the next load.
+    LinearArena &load_arena();
+}
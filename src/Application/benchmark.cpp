@@ -0,0 +1,252 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "benchmark.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#include "glm/gtc/constants.hpp"
+#include "spdlog/spdlog.h"
+
+#include "frame_stats.h"
+#include "profiler.h"
+#include "utils.h"
+
+namespace {
+    void write_json_string(std::ostream &out, const std::string &s) {
+        out << '"';
+        for (auto c: s) {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+
+    // Percentiles of one column, null when no frame has the value.
+    void write_summary(std::ostream &out, const char *name, const xe::FrameStats &stats) {
+        out << "  \"" << name << "\": ";
+        if (stats.size() == 0) {
+            out << "null";
+            return;
+        }
+        auto s = stats.summary();
+        out << "{\"n\": " << s.n << ", \"mean\": " << s.mean << ", \"min\": " << s.min << ", \"p50\": " << s.median
+            << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}";
+    }
+
+    const char *compiler() {
+#if defined(__clang__)
+        return "clang " __clang_version__;
+#elif defined(__GNUC__)
+        return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+        return "msvc";
+#else
+        return "unknown";
+#endif
+    }
+}
+
+namespace xe {
+
+    bool CameraPath::load(const std::string &path) {
+        std::ifstream in(path);
+        if (!in) {
+            SPDLOG_ERROR("Cannot read the camera path `{}'", path);
+            return false;
+        }
+        keys_.clear();
+        orbit_ = false;
+        std::string line;
+        int line_n = 0;
+        while (std::getline(in, line)) {
+            line_n++;
+            std::istringstream fields(line);
+            std::string first;
+            if (!(fields >> first) || first[0] == '#')
+                continue;
+            if (first == "orbit") {
+                auto &c = orbit_center_;
+                if (!(fields >> c.x >> c.y >> c.z >> orbit_radius_ >> orbit_height_ >> orbit_period_) ||
+                    orbit_period_ <= 0.0) {
+                    SPDLOG_ERROR("{}:{}: expected `orbit cx cy cz radius height period'", path, line_n);
+                    return false;
+                }
+                orbit_ = true;
+                continue;
+            }
+            Key key{};
+            auto &pose = key.pose;
+            std::istringstream t(first);
+            if (!(t >> key.t) || !(fields >> pose.eye.x >> pose.eye.y >> pose.eye.z >> pose.center.x >> pose.center.y
+                                           >> pose.center.z)) {
+                SPDLOG_ERROR("{}:{}: expected `t ex ey ez cx cy cz [ux uy uz]'", path, line_n);
+                return false;
+            }
+            if (!(fields >> pose.up.x >> pose.up.y >> pose.up.z))
+                pose.up = glm::vec3(0.0f, 0.0f, 1.0f);
+            if (!keys_.empty() && key.t < keys_.back().t) {
+                SPDLOG_ERROR("{}:{}: keyframe times must not decrease", path, line_n);
+                return false;
+            }
+            keys_.push_back(key);
+        }
+        if (empty())
+            SPDLOG_WARN("The camera path `{}' has no keyframes", path);
+        return true;
+    }
+
+    CameraPose CameraPath::at(double t) const {
+        if (orbit_) {
+            auto angle = static_cast<float>(glm::two_pi<double>() * t / orbit_period_);
+            auto offset = glm::vec3(orbit_radius_ * std::cos(angle), orbit_radius_ * std::sin(angle), orbit_height_);
+            return {orbit_center_ + offset, orbit_center_, glm::vec3(0.0f, 0.0f, 1.0f)};
+        }
+        if (keys_.empty())
+            return {glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)};
+        if (t <= keys_.front().t)
+            return keys_.front().pose;
+        for (size_t i = 1; i < keys_.size(); i++) {
+            auto &a = keys_[i - 1];
+            auto &b = keys_[i];
+            if (t > b.t)
+                continue;
+            auto s = b.t > a.t ? static_cast<float>((t - a.t) / (b.t - a.t)) : 1.0f;
+            return {glm::mix(a.pose.eye, b.pose.eye, s), glm::mix(a.pose.center, b.pose.center, s),
+                    glm::normalize(glm::mix(a.pose.up, b.pose.up, s))};
+        }
+        return keys_.back().pose;
+    }
+
+    bool Benchmark::start(std::string prefix, Config config) {
+        prefix_ = std::move(prefix);
+        config_ = std::move(config);
+        draw_calls_.reserve(total_frames());
+        triangles_.reserve(total_frames());
+        return config_.camera_path.empty() || path_.load(config_.camera_path);
+    }
+
+    void Benchmark::add_gl_frame(uint64_t draw_calls, uint64_t triangles) {
+        draw_calls_.push_back(draw_calls);
+        triangles_.push_back(triangles);
+    }
+
+    void Benchmark::finish(const std::vector<double> &cpu_ms, const Profiler &profiler, int width, int height) {
+        // Profiler frames are counted from the first frame of the loop, as the CPU times.
+        std::unordered_map<uint64_t, double> gpu_ms;
+        for (const auto &frame: profiler.frames()) {
+            for (const auto &event: frame.gpu) {
+                if (event.depth == 0 && std::strcmp(event.name, "frame") == 0)
+                    gpu_ms[frame.index] += (event.end_ns - event.start_ns) * 1e-6;
+            }
+        }
+
+        samples_.clear();
+        for (size_t i = config_.warmup; i < cpu_ms.size(); i++) {
+            Sample sample;
+            sample.cpu_ms = cpu_ms[i];
+            auto gpu = gpu_ms.find(i);
+            sample.gpu_ms = gpu != gpu_ms.end() ? gpu->second : std::numeric_limits<double>::quiet_NaN();
+            if (i < draw_calls_.size()) {
+                sample.draw_calls = static_cast<int64_t>(draw_calls_[i]);
+                sample.triangles = static_cast<int64_t>(triangles_[i]);
+            }
+            samples_.push_back(sample);
+        }
+        if (samples_.size() < static_cast<size_t>(config_.frames))
+            SPDLOG_WARN("Benchmark: measured {} of {} frames, the window was closed", samples_.size(),
+                        config_.frames);
+
+        write_csv(prefix_ + ".csv");
+        write_json(prefix_ + ".json", width, height);
+    }
+
+    bool Benchmark::write_csv(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out) {
+            SPDLOG_ERROR("Cannot write benchmark results to `{}'", path);
+            return false;
+        }
+        out << "frame,cpu_ms,gpu_ms,draw_calls,triangles\n";
+        for (size_t i = 0; i < samples_.size(); i++) {
+            auto &s = samples_[i];
+            out << i << ',' << s.cpu_ms << ',';
+            if (!std::isnan(s.gpu_ms))
+                out << s.gpu_ms;
+            out << ',';
+            if (s.draw_calls >= 0)
+                out << s.draw_calls << ',' << s.triangles;
+            else
+                out << ',';
+            out << '\n';
+        }
+        return true;
+    }
+
+    bool Benchmark::write_json(const std::string &path, int width, int height) const {
+        std::ofstream out(path);
+        if (!out) {
+            SPDLOG_ERROR("Cannot write benchmark results to `{}'", path);
+            return false;
+        }
+        FrameStats cpu, gpu, draw_calls, triangles;
+        for (auto &s: samples_) {
+            cpu.add(s.cpu_ms);
+            if (!std::isnan(s.gpu_ms))
+                gpu.add(s.gpu_ms);
+            if (s.draw_calls >= 0) {
+                draw_calls.add(static_cast<double>(s.draw_calls));
+                triangles.add(static_cast<double>(s.triangles));
+            }
+        }
+
+        out << "{\n  \"gl_vendor\": ";
+        write_json_string(out, utils::get_gl_vendor());
+        out << ",\n  \"gl_renderer\": ";
+        write_json_string(out, utils::get_gl_renderer());
+        out << ",\n  \"gl_version\": ";
+        write_json_string(out, utils::get_gl_version());
+        out << ",\n  \"compiler\": ";
+        write_json_string(out, compiler());
+#ifdef NDEBUG
+        out << ",\n  \"assertions\": false";
+#else
+        out << ",\n  \"assertions\": true";
+#endif
+        // Counting the GL calls slows the CPU side down.
+        out << ",\n  \"gl_profiler\": " << (draw_calls.size() > 0 ? "true" : "false");
+        out << ",\n  \"width\": " << width << ",\n  \"height\": " << height;
+        out << ",\n  \"vsync\": " << (config_.vsync ? "true" : "false");
+        out << ",\n  \"warmup\": " << config_.warmup << ",\n  \"frames\": " << samples_.size();
+        out << ",\n  \"path_fps\": " << PATH_FPS;
+        out << ",\n  \"camera_path\": ";
+        write_json_string(out, config_.camera_path);
+        out << ",\n  \"scene\": ";
+        write_json_string(out, config_.scene);
+        out << ",\n";
+        write_summary(out, "cpu_ms", cpu);
+        out << ",\n";
+        write_summary(out, "gpu_ms", gpu);
+        out << ",\n";
+        write_summary(out, "draw_calls", draw_calls);
+        out << ",\n";
+        write_summary(out, "triangles", triangles);
+        out << "\n}\n";
+
+        auto c = cpu.summary();
+        SPDLOG_INFO("Benchmark: {} frames, CPU p50 {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms, written to {}.csv/.json",
+                    c.n, c.median, c.p95, c.p99, prefix_);
+        if (gpu.size() > 0) {
+            auto g = gpu.summary();
+            SPDLOG_INFO("Benchmark: GPU p50 {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms", g.median, g.p95, g.p99);
+        }
+        return true;
+    }
+}
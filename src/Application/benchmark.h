@@ -0,0 +1,124 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+namespace xe {
+
+    class Profiler;
+
+    struct CameraPose {
+        glm::vec3 eye;
+        glm::vec3 center;
+        glm::vec3 up;
+    };
+
+    /**
+     * @brief A camera path the benchmark replays, read from a text file.
+     *
+     * Every line is a keyframe `t ex ey ez cx cy cz [ux uy uz]`: the time in seconds, the eye, the point
+     * looked at and the up vector (z by default), the poses in between are interpolated linearly and the
+     * path stops at the last keyframe. A line `orbit cx cy cz radius height period` replaces the keyframes
+     * by a circle around the center. Empty lines and lines starting with # are skipped.
+     */
+    class CameraPath {
+    public:
+        bool load(const std::string &path);
+
+        bool empty() const { return keys_.empty() && !orbit_; }
+
+        CameraPose at(double t) const;
+
+    private:
+        struct Key {
+            double t;
+            CameraPose pose;
+        };
+
+        std::vector<Key> keys_;
+        bool orbit_ = false;
+        glm::vec3 orbit_center_ = glm::vec3(0.0f);
+        float orbit_radius_ = 1.0f;
+        float orbit_height_ = 0.0f;
+        double orbit_period_ = 1.0;
+    };
+
+    /**
+     * @brief Per frame measurements of a benchmark run (--benchmark) and their summary.
+     *
+     * The run renders the warmup frames first and measures the next ones. The camera path is sampled at a
+     * fixed step of 1/PATH_FPS seconds per measured frame and not at the wall time, so every machine and
+     * build renders the same frames and only the time they take differs. Per frame it keeps the CPU time
+     * of the frame (of the app thread with --render-thread), the GPU time of the "frame" profiler scope and,
+     * with the debug glad, the draw calls and triangles counted by GlApiProfiler.
+     *
+     * The results go into <prefix>.csv, one line per measured frame, and <prefix>.json with the p50, p95 and
+     * p99 of every column together with the GL renderer, the resolution and the build, which has to match
+     * for two runs to be comparable. Missing values are left empty in the CSV and null in the JSON.
+     */
+    class Benchmark {
+    public:
+        static constexpr double PATH_FPS = 60.0;
+
+        struct Sample {
+            double cpu_ms = 0.0;
+            double gpu_ms = 0.0; // NaN without the timestamp queries
+            int64_t draw_calls = -1; // -1 without the debug glad
+            int64_t triangles = -1;
+        };
+
+        struct Config {
+            int frames = 600;
+            int warmup = 60;
+            bool vsync = false;
+            std::string camera_path;
+            std::string scene;
+        };
+
+        bool active() const { return !prefix_.empty(); }
+
+        // Loads the camera path, false when it cannot be read.
+        bool start(std::string prefix, Config config);
+
+        const Config &config() const { return config_; }
+
+        int total_frames() const { return config_.warmup + config_.frames; }
+
+        bool has_camera_path() const { return !path_.empty(); }
+
+        // The warmup frames stay at the start of the path.
+        CameraPose camera_pose(int frame_n) const {
+            return path_.at(frame_n < config_.warmup ? 0.0 : (frame_n - config_.warmup) / PATH_FPS);
+        }
+
+        // Called once per frame after GlApiProfiler::end_frame.
+        void add_gl_frame(uint64_t draw_calls, uint64_t triangles);
+
+        /**
+         * @brief Combines the CPU times of all the frames with the GPU times kept by the profiler and writes
+         * the results. The profiler history has to hold all the frames.
+         */
+        void finish(const std::vector<double> &cpu_ms, const Profiler &profiler, int width, int height);
+
+        const std::vector<Sample> &samples() const { return samples_; }
+
+        bool write_csv(const std::string &path) const;
+
+        bool write_json(const std::string &path, int width, int height) const;
+
+    private:
+        std::string prefix_;
+        Config config_;
+        CameraPath path_;
+        std::vector<uint64_t> draw_calls_;
+        std::vector<uint64_t> triangles_;
+        std::vector<Sample> samples_;
+    };
+}
@@ -0,0 +1,313 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "command_list.h"
+
+#include "utils.h"
+
+namespace {
+    struct Viewport {
+        GLint x, y;
+        GLsizei width, height;
+    };
+
+    struct Color {
+        GLfloat r, g, b, a;
+    };
+
+    struct Pair {
+        GLenum first, second;
+    };
+
+    struct BufferBase {
+        GLenum target;
+        GLuint index;
+        GLuint buffer;
+    };
+
+    struct BufferRange {
+        GLenum target;
+        GLuint index;
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    struct SubData {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+        size_t data; // offset into the data arena
+    };
+
+    struct DrawArrays {
+        GLenum mode;
+        GLint first;
+        GLsizei count;
+        GLsizei instances;
+    };
+
+    struct DrawElements {
+        GLenum mode;
+        GLsizei count;
+        GLenum type;
+        GLsizei instances;
+        GLint base_vertex;
+        size_t offset;
+    };
+
+    template<typename T>
+    T get(const uint8_t *p) {
+        T args;
+        std::memcpy(&args, p, sizeof(T));
+        return args;
+    }
+}
+
+namespace xe {
+
+    void CommandList::reset() {
+        commands_.clear();
+        data_.clear();
+        calls_.clear();
+        n_commands_ = 0;
+    }
+
+    void CommandList::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+        put(Op::viewport, Viewport{x, y, width, height});
+    }
+
+    void CommandList::clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+        put(Op::clear_color, Color{r, g, b, a});
+    }
+
+    void CommandList::clear(GLbitfield mask) {
+        put(Op::clear, mask);
+    }
+
+    void CommandList::enable(GLenum capability) {
+        put(Op::enable, capability);
+    }
+
+    void CommandList::disable(GLenum capability) {
+        put(Op::disable, capability);
+    }
+
+    void CommandList::depth_func(GLenum func) {
+        put(Op::depth_func, func);
+    }
+
+    void CommandList::blend_func(GLenum src, GLenum dst) {
+        put(Op::blend_func, Pair{src, dst});
+    }
+
+    void CommandList::bind_framebuffer(GLenum target, GLuint framebuffer) {
+        put(Op::bind_framebuffer, Pair{target, framebuffer});
+    }
+
+    void CommandList::use_program(GLuint program) {
+        put(Op::use_program, program);
+    }
+
+    void CommandList::bind_vertex_array(GLuint vao) {
+        put(Op::bind_vertex_array, vao);
+    }
+
+    void CommandList::bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+        put(Op::bind_buffer_base, BufferBase{target, index, buffer});
+    }
+
+    void CommandList::bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+                                        GLsizeiptr size) {
+        put(Op::bind_buffer_range, BufferRange{target, index, buffer, offset, size});
+    }
+
+    void CommandList::bind_texture_unit(GLuint unit, GLuint texture) {
+        put(Op::bind_texture_unit, Pair{unit, texture});
+    }
+
+    void CommandList::bind_sampler(GLuint unit, GLuint sampler) {
+        put(Op::bind_sampler, Pair{unit, sampler});
+    }
+
+    void CommandList::buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data) {
+        auto at = data_.size();
+        data_.resize(at + size);
+        std::memcpy(data_.data() + at, data, size);
+        put(Op::buffer_sub_data, SubData{buffer, offset, size, at});
+    }
+
+    void CommandList::draw_arrays(GLenum mode, GLint first, GLsizei count, GLsizei instances) {
+        put(Op::draw_arrays, DrawArrays{mode, first, count, instances});
+    }
+
+    void CommandList::draw_elements(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instances,
+                                    GLint base_vertex) {
+        put(Op::draw_elements, DrawElements{mode, count, type, instances, base_vertex, offset});
+    }
+
+    void CommandList::call(std::function<void()> function) {
+        put(Op::call, calls_.size());
+        calls_.push_back(std::move(function));
+    }
+
+    void CommandList::execute() const {
+        for (size_t at = 0; at < commands_.size();) {
+            auto op = static_cast<Op>(commands_[at]);
+            auto p = commands_.data() + at + ALIGNMENT;
+            size_t size = 0;
+            switch (op) {
+                case Op::viewport: {
+                    auto a = get<Viewport>(p);
+                    OGL_CALL(glViewport(a.x, a.y, a.width, a.height));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::clear_color: {
+                    auto a = get<Color>(p);
+                    OGL_CALL(glClearColor(a.r, a.g, a.b, a.a));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::clear:
+                    OGL_CALL(glClear(get<GLbitfield>(p)));
+                    size = sizeof(GLbitfield);
+                    break;
+                case Op::enable:
+                    OGL_CALL(glEnable(get<GLenum>(p)));
+                    size = sizeof(GLenum);
+                    break;
+                case Op::disable:
+                    OGL_CALL(glDisable(get<GLenum>(p)));
+                    size = sizeof(GLenum);
+                    break;
+                case Op::depth_func:
+                    OGL_CALL(glDepthFunc(get<GLenum>(p)));
+                    size = sizeof(GLenum);
+                    break;
+                case Op::blend_func: {
+                    auto a = get<Pair>(p);
+                    OGL_CALL(glBlendFunc(a.first, a.second));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::bind_framebuffer: {
+                    auto a = get<Pair>(p);
+                    OGL_CALL(glBindFramebuffer(a.first, a.second));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::use_program:
+                    OGL_CALL(glUseProgram(get<GLuint>(p)));
+                    size = sizeof(GLuint);
+                    break;
+                case Op::bind_vertex_array:
+                    OGL_CALL(glBindVertexArray(get<GLuint>(p)));
+                    size = sizeof(GLuint);
+                    break;
+                case Op::bind_buffer_base: {
+                    auto a = get<BufferBase>(p);
+                    OGL_CALL(glBindBufferBase(a.target, a.index, a.buffer));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::bind_buffer_range: {
+                    auto a = get<BufferRange>(p);
+                    OGL_CALL(glBindBufferRange(a.target, a.index, a.buffer, a.offset, a.size));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::bind_texture_unit: {
+                    auto a = get<Pair>(p);
+                    OGL_CALL(glBindTextureUnit(a.first, a.second));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::bind_sampler: {
+                    auto a = get<Pair>(p);
+                    OGL_CALL(glBindSampler(a.first, a.second));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::buffer_sub_data: {
+                    auto a = get<SubData>(p);
+                    OGL_CALL(glNamedBufferSubData(a.buffer, a.offset, a.size, data_.data() + a.data));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::draw_arrays: {
+                    auto a = get<DrawArrays>(p);
+                    OGL_CALL(glDrawArraysInstanced(a.mode, a.first, a.count, a.instances));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::draw_elements: {
+                    auto a = get<DrawElements>(p);
+                    OGL_CALL(glDrawElementsInstancedBaseVertex(a.mode, a.count, a.type,
+                                                               reinterpret_cast<const void *>(a.offset),
+                                                               a.instances, a.base_vertex));
+                    size = sizeof(a);
+                    break;
+                }
+                case Op::call:
+                    calls_[get<size_t>(p)]();
+                    size = sizeof(size_t);
+                    break;
+            }
+            at += ALIGNMENT + (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        }
+    }
+
+    // Spins for a while before sleeping, the other thread is usually close.
+    template<typename P>
+    void CommandListExchange::wait_until(P ready) {
+        for (int spins = 0; spins < 64; spins++) {
+            if (ready())
+                return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, ready);
+    }
+
+    void CommandListExchange::notify() {
+        // Under the lock, so the change cannot fall between the check and the wait of a sleeping thread.
+        std::lock_guard<std::mutex> lock(mutex_);
+        changed_.notify_all();
+    }
+
+    CommandList *CommandListExchange::begin_record() {
+        auto &state = states_[record_];
+        wait_until([&] { return state.load(std::memory_order_acquire) == free || closed_.load(); });
+        if (closed_.load())
+            return nullptr;
+        lists_[record_].reset();
+        return &lists_[record_];
+    }
+
+    void CommandListExchange::end_record() {
+        states_[record_].store(recorded, std::memory_order_release);
+        record_ ^= 1;
+        notify();
+    }
+
+    CommandList *CommandListExchange::begin_execute() {
+        auto &state = states_[execute_];
+        wait_until([&] { return state.load(std::memory_order_acquire) == recorded || closed_.load(); });
+        if (state.load(std::memory_order_acquire) != recorded)
+            return nullptr;
+        state.store(executing, std::memory_order_relaxed);
+        return &lists_[execute_];
+    }
+
+    void CommandListExchange::end_execute() {
+        states_[execute_].store(free, std::memory_order_release);
+        execute_ ^= 1;
+        notify();
+    }
+
+    void CommandListExchange::close() {
+        closed_.store(true);
+        notify();
+    }
+}
@@ -0,0 +1,154 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "glad/gl.h"
+
+namespace xe {
+
+    /**
+     * @brief GL commands recorded on one thread and executed on the thread owning the context.
+     *
+     * Commands are packed into a byte stream (an opcode followed by its arguments), buffer updates copy
+     * their data into a separate arena, so recording allocates only while the list grows and a list reused
+     * every frame settles at its peak size. call() records anything not covered by the other commands, it
+     * is executed on the render thread like the rest.
+     *
+     * Only GL object names are recorded, the objects themselves have to stay alive until the list has been
+     * executed.
+     */
+    class CommandList {
+    public:
+        // Empties the list, keeps the memory.
+        void reset();
+
+        bool empty() const { return commands_.empty(); }
+
+        size_t n_commands() const { return n_commands_; }
+
+        // Bytes used by the commands and their data.
+        size_t size() const { return commands_.size() + data_.size(); }
+
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+        void clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+        void clear(GLbitfield mask);
+
+        void enable(GLenum capability);
+
+        void disable(GLenum capability);
+
+        void depth_func(GLenum func);
+
+        void blend_func(GLenum src, GLenum dst);
+
+        void bind_framebuffer(GLenum target, GLuint framebuffer);
+
+        void use_program(GLuint program);
+
+        void bind_vertex_array(GLuint vao);
+
+        void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+
+        void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+        void bind_texture_unit(GLuint unit, GLuint texture);
+
+        void bind_sampler(GLuint unit, GLuint sampler);
+
+        // The data is copied, it can be changed as soon as the call returns.
+        void buffer_sub_data(GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+
+        void draw_arrays(GLenum mode, GLint first, GLsizei count, GLsizei instances = 1);
+
+        void draw_elements(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instances = 1,
+                           GLint base_vertex = 0);
+
+        void call(std::function<void()> function);
+
+        // On the thread owning the context.
+        void execute() const;
+
+    private:
+        enum class Op : uint8_t {
+            viewport, clear_color, clear, enable, disable, depth_func, blend_func, bind_framebuffer, use_program,
+            bind_vertex_array, bind_buffer_base, bind_buffer_range, bind_texture_unit, bind_sampler,
+            buffer_sub_data, draw_arrays, draw_elements, call
+        };
+
+        // Arguments are stored at 8 byte boundaries, the widest of them are 64 bit offsets.
+        static constexpr size_t ALIGNMENT = 8;
+
+        template<typename T>
+        void put(Op op, const T &args) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            auto at = commands_.size();
+            commands_.resize(at + ALIGNMENT + (sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+            commands_[at] = static_cast<uint8_t>(op);
+            std::memcpy(commands_.data() + at + ALIGNMENT, &args, sizeof(T));
+            n_commands_++;
+        }
+
+        std::vector<uint8_t> commands_;
+        std::vector<uint8_t> data_;
+        std::vector<std::function<void()>> calls_;
+        size_t n_commands_ = 0;
+    };
+
+    /**
+     * @brief Two command lists passed between a recording and an executing thread without locks.
+     *
+     * Each list is free, recorded or executing and only the thread whose turn it is touches it. The
+     * recording thread can fill one list while the other is executed, so it runs at most one frame ahead.
+     * The waits spin briefly, the other side is often just finishing, and then sleep on a condition variable
+     * (e.g. while the render thread waits for the v-sync).
+     */
+    class CommandListExchange {
+    public:
+        // Waits for a free list, nullptr once closed.
+        CommandList *begin_record();
+
+        void end_record();
+
+        // Waits for a recorded list, nullptr once closed and all recorded lists were executed.
+        CommandList *begin_execute();
+
+        void end_execute();
+
+        // Wakes up both sides, begin_record() returns nullptr from now on.
+        void close();
+
+    private:
+        enum State : int {
+            free, recorded, executing
+        };
+
+        template<typename P>
+        void wait_until(P ready);
+
+        // Wakes the other side after a state change.
+        void notify();
+
+        std::array<CommandList, 2> lists_;
+        std::array<std::atomic<int>, 2> states_ = {free, free};
+        std::atomic<bool> closed_{false};
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        int record_ = 0; // touched by the recording thread only
+        int execute_ = 0; // touched by the executing thread only
+    };
+}
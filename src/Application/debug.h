@@ -7,4 +7,5 @@
 #include "GLFW/glfw3.h"
 
 
-void setup_debug_output();
+// Synchronous output reports the errors inside the offending call, at a cost.
+void setup_debug_output(bool synchronous = true);
@@ -0,0 +1,98 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "deletion_queue.h"
+
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "frame_pacer.h"
+
+namespace {
+    void delete_objects(GLenum type, GLsizei n, const GLuint *names) {
+        switch (type) {
+            case GL_BUFFER:
+                glDeleteBuffers(n, names);
+                break;
+            case GL_TEXTURE:
+                glDeleteTextures(n, names);
+                break;
+            case GL_VERTEX_ARRAY:
+                glDeleteVertexArrays(n, names);
+                break;
+            case GL_FRAMEBUFFER:
+                glDeleteFramebuffers(n, names);
+                break;
+            case GL_RENDERBUFFER:
+                glDeleteRenderbuffers(n, names);
+                break;
+            case GL_SAMPLER:
+                glDeleteSamplers(n, names);
+                break;
+            case GL_QUERY:
+                glDeleteQueries(n, names);
+                break;
+            case GL_PROGRAM:
+                for (GLsizei i = 0; i < n; i++)
+                    glDeleteProgram(names[i]);
+                break;
+            case GL_SHADER:
+                for (GLsizei i = 0; i < n; i++)
+                    glDeleteShader(names[i]);
+                break;
+            default:
+                SPDLOG_ERROR("Cannot delete GL objects of type {:#x}", type);
+                break;
+        }
+    }
+}
+
+namespace xe {
+
+    DeletionQueue *DeletionQueue::instance_ = nullptr;
+
+    DeletionQueue &DeletionQueue::instance() {
+        if (!instance_)
+            instance_ = new DeletionQueue;
+        return *instance_;
+    }
+
+    DeletionQueue::~DeletionQueue() {
+        destroy(queue_.size());
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    void DeletionQueue::release(GLenum type, GLuint name) {
+        if (!name)
+            return;
+        if (instance_)
+            instance_->queue_.push_back({FramePacer::instance().frame_index(), type, name});
+        else
+            delete_objects(type, 1, &name);
+    }
+
+    void DeletionQueue::collect() {
+        auto completed = FramePacer::instance().completed_frames();
+        size_t n = 0;
+        while (n < queue_.size() && queue_[n].frame < completed)
+            n++;
+        destroy(n);
+    }
+
+    void DeletionQueue::destroy(size_t n) {
+        static std::vector<GLuint> names;
+        size_t i = 0;
+        while (i < n) {
+            auto type = queue_[i].type;
+            names.clear();
+            for (; i < n && queue_[i].type == type; i++)
+                names.push_back(queue_[i].name);
+            delete_objects(type, static_cast<GLsizei>(names.size()), names.data());
+        }
+        queue_.erase(queue_.begin(), queue_.begin() + n);
+        deleted_ += n;
+    }
+}
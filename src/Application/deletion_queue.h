@@ -0,0 +1,63 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+#include "glad/gl.h"
+
+#include "RegisteredObject.h"
+
+namespace xe {
+
+    /**
+     * @brief Deletes GL objects once the frames that could use them have retired.
+     *
+     * release() tags the object with the frame being recorded. collect(), called by the application at the
+     * start of every frame after FramePacer has waited for its fence, deletes the objects of the frames the
+     * GPU has finished, with one glDelete* call per run of objects of the same type. So the names are not
+     * reused and the memory is not given back while a frame in flight still refers to them.
+     *
+     * Objects are identified by their GL_BUFFER, GL_TEXTURE, GL_VERTEX_ARRAY, GL_FRAMEBUFFER,
+     * GL_RENDERBUFFER, GL_SAMPLER, GL_QUERY, GL_PROGRAM or GL_SHADER type. GL thread only. The objects
+     * still queued when the queue is destroyed (at RegisteredObject::cleanup) are deleted right away.
+     *
+     * release() is static, so destructors can call it anytime: without a queue (before the first frame
+     * or after the cleanup) nothing can be in flight and the object is deleted right away.
+     */
+    class DeletionQueue : public RegisteredObject {
+    public:
+        static DeletionQueue &instance();
+
+        ~DeletionQueue() override;
+
+        static void release(GLenum type, GLuint name);
+
+        void collect();
+
+        size_t pending() const { return queue_.size(); }
+
+        uint64_t deleted() const { return deleted_; }
+
+    private:
+        struct Entry {
+            uint64_t frame;
+            GLenum type;
+            GLuint name;
+        };
+
+        DeletionQueue() = default;
+
+        // Deletes the first n entries.
+        void destroy(size_t n);
+
+        static DeletionQueue *instance_;
+
+        std::deque<Entry> queue_;
+        uint64_t deleted_ = 0;
+    };
+}
@@ -0,0 +1,206 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "file_watcher.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    std::string normalize(const std::string &path) {
+        std::error_code ec;
+        auto absolute = fs::absolute(path, ec);
+        return (ec ? fs::path(path) : absolute).lexically_normal().generic_string();
+    }
+
+    fs::file_time_type modification_time(const std::string &path) {
+        std::error_code ec;
+        auto time = fs::last_write_time(path, ec);
+        return ec ? fs::file_time_type{} : time;
+    }
+}
+
+namespace xe {
+
+    FileWatcher *FileWatcher::instance_ = nullptr;
+
+    FileWatcher &FileWatcher::instance() {
+        if (!instance_)
+            instance_ = new FileWatcher;
+        return *instance_;
+    }
+
+    FileWatcher::~FileWatcher() {
+        for (auto &job: jobs_)
+            job.result.wait();
+#ifdef __linux__
+        if (inotify_fd_ >= 0)
+            close(inotify_fd_);
+#endif
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    int FileWatcher::watch(const std::string &path, callback_t callback) {
+        auto file_path = normalize(path);
+        auto id = next_id_++;
+        auto &file = files_[file_path];
+        file.watches.push_back({id, std::move(callback)});
+        file.mtime = modification_time(file_path);
+
+#ifdef __linux__
+        if (inotify_fd_ < 0) {
+            inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (inotify_fd_ < 0)
+                SPDLOG_WARN("inotify is not available, falling back to polling file modification times");
+        }
+        if (inotify_fd_ >= 0) {
+            // Directories are watched instead of files, editors often replace a file instead of writing it.
+            auto dir = fs::path(file_path).parent_path().generic_string();
+            auto wd = inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+            if (wd >= 0)
+                watched_dirs_[wd] = dir;
+            else
+                SPDLOG_WARN("Cannot watch directory `{}'", dir);
+        }
+#endif
+        SPDLOG_DEBUG("Watching `{}'", file_path);
+        return id;
+    }
+
+    void FileWatcher::unwatch(int id) {
+        for (auto it = files_.begin(); it != files_.end(); ++it) {
+            auto &watches = it->second.watches;
+            auto watch = std::find_if(watches.begin(), watches.end(), [id](const Watch &w) { return w.id == id; });
+            if (watch != watches.end()) {
+                watches.erase(watch);
+                if (watches.empty())
+                    files_.erase(it);
+                return;
+            }
+        }
+    }
+
+    void FileWatcher::background(std::function<continuation_t()> job, const std::string &key) {
+        uint64_t generation = key.empty() ? 0 : ++generations_[key];
+        jobs_.push_back({key, generation, std::async(std::launch::async, std::move(job))});
+    }
+
+    void FileWatcher::read_events() {
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+            auto length = read(inotify_fd_, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+            for (char *p = buffer; p < buffer + length;) {
+                auto event = reinterpret_cast<const inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+                auto dir = watched_dirs_.find(event->wd);
+                if (dir == watched_dirs_.end() || event->len == 0)
+                    continue;
+                auto it = files_.find(dir->second + "/" + event->name);
+                if (it != files_.end()) {
+                    it->second.dirty = true;
+                    it->second.changed = clock::now();
+                }
+            }
+        }
+#endif
+    }
+
+    void FileWatcher::poll_mtimes() {
+        auto now = clock::now();
+        if (now - last_mtime_poll_ < std::chrono::milliseconds(250))
+            return;
+        last_mtime_poll_ = now;
+        for (auto &[path, file]: files_) {
+            auto mtime = modification_time(path);
+            if (mtime != file.mtime) {
+                file.mtime = mtime;
+                file.dirty = true;
+                file.changed = now;
+            }
+        }
+    }
+
+    bool FileWatcher::ready() {
+        for (auto &job: jobs_) {
+            if (job.result.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                return true;
+        }
+        if (files_.empty())
+            return false;
+        if (inotify_fd_ >= 0)
+            read_events();
+        else
+            poll_mtimes();
+        auto now = clock::now();
+        for (auto &[path, file]: files_) {
+            if (file.dirty && now - file.changed >= settle_time_)
+                return true;
+        }
+        return false;
+    }
+
+    void FileWatcher::poll() {
+        if (!jobs_.empty()) {
+            // Continuations are collected first, they may start new background jobs.
+            std::vector<continuation_t> continuations;
+            for (auto it = jobs_.begin(); it != jobs_.end();) {
+                if (it->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    ++it;
+                    continue;
+                }
+                try {
+                    auto continuation = it->result.get();
+                    if (it->key.empty() || it->generation == generations_[it->key])
+                        continuations.push_back(std::move(continuation));
+                    else
+                        SPDLOG_DEBUG("Dropping an outdated reload of `{}'", it->key);
+                } catch (const std::exception &e) {
+                    SPDLOG_ERROR("Background job failed: {}", e.what());
+                } catch (...) {
+                    SPDLOG_ERROR("Background job failed");
+                }
+                it = jobs_.erase(it);
+            }
+            for (auto &continuation: continuations) {
+                if (continuation)
+                    continuation();
+            }
+        }
+
+        if (files_.empty())
+            return;
+        if (inotify_fd_ >= 0)
+            read_events();
+        else
+            poll_mtimes();
+
+        auto now = clock::now();
+        std::vector<callback_t> callbacks;
+        for (auto &[path, file]: files_) {
+            if (file.dirty && now - file.changed >= settle_time_) {
+                file.dirty = false;
+                SPDLOG_INFO("`{}' changed, reloading", path);
+                for (auto &watch: file.watches)
+                    callbacks.push_back(watch.callback);
+            }
+        }
+        // Callbacks may watch or unwatch files.
+        for (auto &callback: callbacks)
+            callback();
+    }
+}
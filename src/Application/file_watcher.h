@@ -0,0 +1,115 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "RegisteredObject.h"
+
+namespace xe {
+
+    /**
+     * @brief Watches asset files and runs callbacks on the main thread when they change.
+     *
+     * On Linux the directories containing the watched files are watched with inotify, elsewhere the
+     * modification times are polled. Editors usually write a file in several steps (or replace it by renaming),
+     * so a callback runs only once the file has been quiet for settle_time().
+     *
+     * Reloading itself should not stall the frame: background() runs the slow part (parsing, decoding) on
+     * a worker thread and the returned continuation, which swaps the new version in, on the main thread
+     * in the next poll(), i.e. between two frames.
+     *
+     * Watching is only active when enabled, see Application::run_cli (--hot-reload).
+     */
+    class FileWatcher : public RegisteredObject {
+    public:
+        using callback_t = std::function<void()>;
+        using continuation_t = std::function<void()>;
+
+        static FileWatcher &instance();
+
+        // Destructors unwatching their files must not create the watcher again after the cleanup.
+        static bool exists() { return instance_ != nullptr; }
+
+        ~FileWatcher() override;
+
+        bool enabled() const { return enabled_; }
+
+        void set_enabled(bool enabled) { enabled_ = enabled; }
+
+        // Returns an id for unwatch(). Several callbacks can watch the same file.
+        int watch(const std::string &path, callback_t callback);
+
+        void unwatch(int id);
+
+        /**
+         * @brief Runs job on a worker thread and the continuation it returns on the main thread.
+         *
+         * Jobs with the same non-empty key (e.g. the reloaded file) supersede each other, the continuation
+         * runs only if no newer job with the key was started, so an older parse finishing last does not
+         * overwrite a newer one. A job that throws is logged and its continuation skipped.
+         */
+        void background(std::function<continuation_t()> job, const std::string &key = "");
+
+        // Called by the application once per frame, runs the callbacks and continuations.
+        void poll();
+
+        // True when the next poll() has callbacks or continuations to run.
+        bool ready();
+
+        std::chrono::milliseconds settle_time() const { return settle_time_; }
+
+        void set_settle_time(std::chrono::milliseconds settle_time) { settle_time_ = settle_time; }
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct Watch {
+            int id;
+            callback_t callback;
+        };
+
+        struct Job {
+            std::string key;
+            uint64_t generation;
+            std::future<continuation_t> result;
+        };
+
+        struct File {
+            std::vector<Watch> watches;
+            clock::time_point changed;
+            bool dirty = false;
+            std::filesystem::file_time_type mtime{};
+        };
+
+        FileWatcher() = default;
+
+        void read_events();
+
+        void poll_mtimes();
+
+        static FileWatcher *instance_;
+
+        bool enabled_ = false;
+        int next_id_ = 0;
+        std::chrono::milliseconds settle_time_{100};
+        std::unordered_map<std::string, File> files_;
+
+        int inotify_fd_ = -1;
+        std::unordered_map<int, std::string> watched_dirs_;
+        clock::time_point last_mtime_poll_;
+
+        std::vector<Job> jobs_;
+        // Newest job started for every key.
+        std::unordered_map<std::string, uint64_t> generations_;
+    };
+}
@@ -0,0 +1,247 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "frame_capture.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+#include "spdlog/spdlog.h"
+#include "stb/stb_image_write.h"
+
+#include "profiler.h"
+#include "utils.h"
+
+namespace xe {
+
+    FrameCapture::~FrameCapture() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        queued_.notify_all();
+        if (encoder_.joinable())
+            encoder_.join();
+    }
+
+    void FrameCapture::screenshot(const std::string &path) {
+        screenshots_.push_back(path);
+    }
+
+    void FrameCapture::start_sequence(const std::string &path, Format format, int fps) {
+        if (sequence_)
+            stop_sequence();
+        format_ = format;
+        sequence_path_ = path;
+        sequence_n_ = 0;
+        std::error_code ec;
+        if (format == Format::png) {
+            std::filesystem::create_directories(path, ec);
+        } else {
+            auto parent = std::filesystem::path(path).parent_path();
+            if (!parent.empty())
+                std::filesystem::create_directories(parent, ec);
+            std::lock_guard<std::mutex> lock(mutex_);
+            stream_.open(path, std::ios::binary | std::ios::trunc);
+            if (!stream_) {
+                SPDLOG_ERROR("Cannot open `{}'", path);
+                return;
+            }
+            stream_width_ = stream_height_ = 0;
+            fps_ = fps;
+        }
+        sequence_ = true;
+        SPDLOG_INFO("Capturing frames into {}", path);
+    }
+
+    void FrameCapture::stop_sequence() {
+        if (!sequence_)
+            return;
+        sequence_ = false;
+        if (format_ == Format::y4m) {
+            // The frames still in the ring belong to the stream.
+            for (size_t i = 0; i < ring_.size(); i++)
+                read_back(ring_[(next_slot_ + i) % ring_.size()], true);
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this] { return jobs_.empty() && !busy_; });
+            stream_.close();
+        }
+        SPDLOG_INFO("Captured {} frames into {}", sequence_n_, sequence_path_);
+    }
+
+    void FrameCapture::capture(GLuint framebuffer, int width, int height) {
+        if (!capturing())
+            return;
+        XE_PROFILE_SCOPE("capture");
+
+        auto &slot = ring_[next_slot_];
+        next_slot_ = (next_slot_ + 1) % ring_.size();
+        // Only when the GPU is RING_SIZE frames behind.
+        read_back(slot, true);
+
+        auto size = static_cast<size_t>(width) * height * 4;
+        if (size > slot.capacity) {
+            if (slot.buffer)
+                glDeleteBuffers(1, &slot.buffer);
+            OGL_CALL(glCreateBuffers(1, &slot.buffer));
+            OGL_CALL(glNamedBufferStorage(slot.buffer, size, nullptr, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT));
+            slot.capacity = size;
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        // With a pack buffer bound this only queues the copy.
+        OGL_CALL(glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        slot.width = width;
+        slot.height = height;
+        slot.paths = std::move(screenshots_);
+        screenshots_.clear();
+        slot.stream = false;
+        if (sequence_) {
+            if (format_ == Format::png) {
+                char name[32];
+                std::snprintf(name, sizeof(name), "/frame_%05d.png", sequence_n_);
+                slot.paths.push_back(sequence_path_ + name);
+            } else {
+                slot.stream = true;
+            }
+            sequence_n_++;
+        }
+    }
+
+    void FrameCapture::poll() {
+        // Oldest first, so the frames are queued in order.
+        for (size_t i = 0; i < ring_.size(); i++) {
+            auto &slot = ring_[(next_slot_ + i) % ring_.size()];
+            if (slot.fence && glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                break;
+            read_back(slot, false);
+        }
+    }
+
+    void FrameCapture::flush() {
+        stop_sequence();
+        for (size_t i = 0; i < ring_.size(); i++)
+            read_back(ring_[(next_slot_ + i) % ring_.size()], true);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this] { return jobs_.empty() && !busy_; });
+        }
+        for (auto &slot: ring_) {
+            if (slot.buffer)
+                glDeleteBuffers(1, &slot.buffer);
+            slot.buffer = 0u;
+            slot.capacity = 0;
+        }
+    }
+
+    void FrameCapture::read_back(Slot &slot, bool wait) {
+        if (!slot.fence)
+            return;
+        if (wait) {
+            while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000u) == GL_TIMEOUT_EXPIRED)
+                SPDLOG_WARN("Frame readback has not finished for a second");
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+
+        Job job{{}, slot.width, slot.height, std::move(slot.paths), slot.stream};
+        slot.paths.clear();
+        auto size = static_cast<size_t>(slot.width) * slot.height * 4;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // A frame sequence must not lose frames, the renderer waits when the encoder is too far behind.
+            done_.wait(lock, [this] { return jobs_.size() < MAX_QUEUED; });
+            if (!free_buffers_.empty()) {
+                job.rgba = std::move(free_buffers_.back());
+                free_buffers_.pop_back();
+            }
+        }
+        job.rgba.resize(size);
+
+        auto data = glMapNamedBufferRange(slot.buffer, 0, size, GL_MAP_READ_BIT);
+        if (!data) {
+            SPDLOG_ERROR("Cannot map the frame readback buffer");
+            return;
+        }
+        std::copy_n(static_cast<const uint8_t *>(data), size, job.rgba.data());
+        glUnmapNamedBuffer(slot.buffer);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!encoder_.joinable())
+            encoder_ = std::thread(&FrameCapture::encode_loop, this);
+        jobs_.push_back(std::move(job));
+        queued_.notify_one();
+    }
+
+    void FrameCapture::encode_loop() {
+        std::vector<uint8_t> rgb, yuv;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            queued_.wait(lock, [this] { return quit_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                return;
+            auto job = std::move(jobs_.front());
+            jobs_.pop_front();
+            busy_ = true;
+            lock.unlock();
+
+            if (job.stream)
+                write_y4m(job, yuv);
+            if (!job.paths.empty()) {
+                // The overlay may leave the alpha below one, screenshots are opaque.
+                rgb.resize(static_cast<size_t>(job.width) * job.height * 3);
+                for (size_t i = 0, n = static_cast<size_t>(job.width) * job.height; i < n; i++)
+                    std::copy_n(&job.rgba[4 * i], 3, &rgb[3 * i]);
+                stbi_flip_vertically_on_write(1);
+                for (auto &path: job.paths) {
+                    if (!stbi_write_png(path.c_str(), job.width, job.height, 3, rgb.data(), job.width * 3))
+                        SPDLOG_ERROR("Cannot write `{}'", path);
+                }
+            }
+
+            lock.lock();
+            free_buffers_.push_back(std::move(job.rgba));
+            busy_ = false;
+            done_.notify_all();
+        }
+    }
+
+    // The stream is only used by this thread while there are stream jobs queued.
+    void FrameCapture::write_y4m(const Job &job, std::vector<uint8_t> &planes) {
+        if (!stream_)
+            return;
+        if (stream_width_ == 0) {
+            stream_width_ = job.width;
+            stream_height_ = job.height;
+            stream_ << "YUV4MPEG2 W" << job.width << " H" << job.height << " F" << fps_ << ":1 Ip A1:1 C444\n";
+        } else if (job.width != stream_width_ || job.height != stream_height_) {
+            SPDLOG_WARN("Frame size changed to {}x{}, skipping it in the {}x{} stream", job.width, job.height,
+                        stream_width_, stream_height_);
+            return;
+        }
+
+        // BT.601 limited range planes, rows from the top.
+        auto n = static_cast<size_t>(job.width) * job.height;
+        planes.resize(3 * n);
+        for (int y = 0; y < job.height; y++) {
+            auto src = &job.rgba[static_cast<size_t>(job.height - 1 - y) * job.width * 4];
+            for (int x = 0; x < job.width; x++, src += 4) {
+                float r = src[0], g = src[1], b = src[2];
+                auto i = static_cast<size_t>(y) * job.width + x;
+                planes[i] = static_cast<uint8_t>(16.0f + 0.257f * r + 0.504f * g + 0.098f * b + 0.5f);
+                planes[n + i] = static_cast<uint8_t>(128.0f - 0.148f * r - 0.291f * g + 0.439f * b + 0.5f);
+                planes[2 * n + i] = static_cast<uint8_t>(128.0f + 0.439f * r - 0.368f * g - 0.071f * b + 0.5f);
+            }
+        }
+        stream_ << "FRAME\n";
+        stream_.write(reinterpret_cast<const char *>(planes.data()), static_cast<std::streamsize>(planes.size()));
+    }
+}
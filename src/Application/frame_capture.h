@@ -0,0 +1,120 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glad/gl.h"
+
+namespace xe {
+
+    /**
+     * @brief Reads frames back without stalling the pipeline and encodes them on a worker thread.
+     *
+     * capture() only issues glReadPixels into a pixel pack buffer and puts a fence after it. The buffers form
+     * a ring, poll() maps those whose fence has signalled, copies the pixels out and hands them to the
+     * encoder thread, which writes PNG files or appends to a YUV4MPEG2 (Y4M) stream. The GPU is waited for
+     * only when the whole ring is still in flight, and the renderer only when the encoder falls
+     * MAX_QUEUED frames behind (a frame sequence must not lose frames).
+     *
+     * Screenshots (screenshot()) and sequences (start_sequence()) share the ring, frames are encoded in
+     * the order they were captured.
+     */
+    class FrameCapture {
+    public:
+        enum class Format {
+            png, y4m
+        };
+
+        static const int RING_SIZE = 4;
+        static const size_t MAX_QUEUED = 16;
+
+        FrameCapture() = default;
+
+        FrameCapture(const FrameCapture &) = delete;
+
+        FrameCapture &operator=(const FrameCapture &) = delete;
+
+        ~FrameCapture();
+
+        // The next captured frame is saved as a PNG file.
+        void screenshot(const std::string &path);
+
+        // PNG: frame_%05d.png files in the directory, Y4M: a single stream file with the given frame rate.
+        void start_sequence(const std::string &path, Format format, int fps = 60);
+
+        void stop_sequence();
+
+        bool recording() const { return sequence_; }
+
+        bool capturing() const { return sequence_ || !screenshots_.empty(); }
+
+        // Reads the framebuffer (the color attachment 0, or the back buffer of the window) if anything is
+        // requested. Called by the application once per frame, after all rendering.
+        void capture(GLuint framebuffer, int width, int height);
+
+        // Passes the frames read back so far to the encoder, never waits for the GPU.
+        void poll();
+
+        // Waits for all captured frames to be read back and encoded, then releases the GL buffers.
+        void flush();
+
+    private:
+        struct Slot {
+            GLuint buffer = 0u;
+            size_t capacity = 0;
+            GLsync fence = nullptr;
+            int width = 0;
+            int height = 0;
+            std::vector<std::string> paths; // PNG files
+            bool stream = false; // appended to the Y4M stream
+        };
+
+        struct Job {
+            std::vector<uint8_t> rgba;
+            int width;
+            int height;
+            std::vector<std::string> paths;
+            bool stream;
+        };
+
+        void read_back(Slot &slot, bool wait);
+
+        void encode_loop();
+
+        void write_y4m(const Job &job, std::vector<uint8_t> &planes);
+
+        std::array<Slot, RING_SIZE> ring_;
+        size_t next_slot_ = 0;
+
+        std::vector<std::string> screenshots_;
+        bool sequence_ = false;
+        Format format_ = Format::png;
+        std::string sequence_path_;
+        int sequence_n_ = 0;
+
+        // Guarded by mutex_, the stream is opened on the main thread before the first frame is queued.
+        std::mutex mutex_;
+        std::condition_variable queued_;
+        std::condition_variable done_;
+        std::deque<Job> jobs_;
+        std::vector<std::vector<uint8_t>> free_buffers_;
+        bool busy_ = false;
+        bool quit_ = false;
+        std::ofstream stream_;
+        int stream_width_ = 0;
+        int stream_height_ = 0;
+        int fps_ = 60;
+        std::thread encoder_;
+    };
+}
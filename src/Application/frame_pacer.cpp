@@ -0,0 +1,83 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "frame_pacer.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "spdlog/spdlog.h"
+
+#include "profiler.h"
+
+namespace xe {
+
+    FramePacer *FramePacer::instance_ = nullptr;
+
+    FramePacer &FramePacer::instance() {
+        if (!instance_)
+            instance_ = new FramePacer;
+        return *instance_;
+    }
+
+    FramePacer::~FramePacer() {
+        for (auto &fence: fences_) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    void FramePacer::set_frames_in_flight(int n) {
+        auto clamped = std::clamp(n, 1, MAX_FRAMES_IN_FLIGHT);
+        if (clamped != n)
+            SPDLOG_WARN("{} frames in flight are not supported, using {}", n, clamped);
+        // The slots are renumbered, so no fence may be left behind.
+        wait_idle();
+        frames_in_flight_ = clamped;
+    }
+
+    void FramePacer::begin_frame() {
+        slot_ = static_cast<int>(frame_index_ % frames_in_flight_);
+        XE_PROFILE_SCOPE("wait for GPU");
+        auto start = std::chrono::steady_clock::now();
+        wait(slot_);
+        last_wait_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void FramePacer::end_frame() {
+        fences_[slot_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fence_frames_[slot_] = frame_index_;
+        frame_index_++;
+    }
+
+    void FramePacer::wait_idle() {
+        for (int slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++)
+            wait(slot);
+        completed_frames_ = frame_index_;
+    }
+
+    void FramePacer::wait(int slot) {
+        auto &fence = fences_[slot];
+        if (!fence)
+            return;
+        // The first wait flushes, so the fence is guaranteed to be signalled eventually.
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        for (;;) {
+            auto status = glClientWaitSync(fence, flags, 1000000000u);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+                break;
+            if (status == GL_WAIT_FAILED) {
+                SPDLOG_ERROR("Waiting for the frame fence failed");
+                break;
+            }
+            SPDLOG_WARN("GPU has not finished a frame for a second");
+            flags = 0;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+        completed_frames_ = std::max(completed_frames_, fence_frames_[slot] + 1);
+    }
+}
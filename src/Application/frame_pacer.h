@@ -0,0 +1,75 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "glad/gl.h"
+
+#include "RegisteredObject.h"
+
+namespace xe {
+
+    /**
+     * @brief Lets the CPU prepare the next frames while the GPU is still drawing the previous ones.
+     *
+     * Every frame gets a fence when it is submitted. With n frames in flight the frame i uses the slot
+     * i % n, and begin_frame() waits only for the fence of the frame that used the slot before, i.e. the
+     * frame i - n. One frame in flight favours latency (the input is never more than one frame old),
+     * two or three favour throughput, the CPU and GPU then work in parallel.
+     *
+     * Resources written by the CPU every frame (e.g. uniform buffers, see BlockBuffer) should have
+     * MAX_FRAMES_IN_FLIGHT copies indexed by slot(), then they are never overwritten while the GPU reads them.
+     * FrameCapture keeps its own ring of readback buffers and does not use the slots.
+     */
+    class FramePacer : public RegisteredObject {
+    public:
+        static const int MAX_FRAMES_IN_FLIGHT = 3;
+
+        static FramePacer &instance();
+
+        ~FramePacer() override;
+
+        int frames_in_flight() const { return frames_in_flight_; }
+
+        // Clamped to 1..MAX_FRAMES_IN_FLIGHT, waits for the frames submitted so far.
+        void set_frames_in_flight(int n);
+
+        // Called by the application around every frame, on the GL thread.
+        void begin_frame();
+
+        void end_frame();
+
+        // Slot of the current frame, in 0..frames_in_flight() - 1.
+        int slot() const { return slot_; }
+
+        uint64_t frame_index() const { return frame_index_; }
+
+        // Frames the GPU is known to have finished, all the frames with a lower index are retired.
+        uint64_t completed_frames() const { return completed_frames_; }
+
+        // Waits until the GPU has finished all submitted frames.
+        void wait_idle();
+
+        // Time the CPU waited for the GPU in the last begin_frame().
+        double last_wait_ms() const { return last_wait_ms_; }
+
+    private:
+        FramePacer() = default;
+
+        void wait(int slot);
+
+        static FramePacer *instance_;
+
+        int frames_in_flight_ = 2;
+        int slot_ = 0;
+        uint64_t frame_index_ = 0;
+        std::array<GLsync, MAX_FRAMES_IN_FLIGHT> fences_ = {};
+        std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> fence_frames_ = {};
+        uint64_t completed_frames_ = 0;
+        double last_wait_ms_ = 0.0;
+    };
+}
@@ -0,0 +1,58 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+
+#include "spdlog/spdlog.h"
+
+namespace xe {
+
+    namespace {
+        // Nearest rank on sorted samples.
+        double percentile(const std::vector<double> &sorted, double p) {
+            auto rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+            return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+        }
+    }
+
+    FrameStats::Summary FrameStats::summary() const {
+        Summary summary;
+        summary.n = samples_.size();
+        if (samples_.empty())
+            return summary;
+
+        auto sorted = samples_;
+        std::sort(sorted.begin(), sorted.end());
+        summary.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+        summary.min = sorted.front();
+        summary.max = sorted.back();
+        summary.median = percentile(sorted, 50.0);
+        summary.p95 = percentile(sorted, 95.0);
+        summary.p99 = percentile(sorted, 99.0);
+        return summary;
+    }
+
+    void FrameStats::log_summary(const std::string &label) const {
+        auto s = summary();
+        SPDLOG_INFO("{}: {} frames, mean {:.3f} ms, median {:.3f} ms, p95 {:.3f} ms, p99 {:.3f} ms, "
+                    "min {:.3f} ms, max {:.3f} ms", label, s.n, s.mean, s.median, s.p95, s.p99, s.min, s.max);
+    }
+
+    bool FrameStats::write_csv(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out) {
+            SPDLOG_ERROR("Cannot write frame statistics to `{}'", path);
+            return false;
+        }
+        out << "frame,ms\n";
+        for (size_t i = 0; i < samples_.size(); i++)
+            out << i << ',' << samples_[i] << '\n';
+        return true;
+    }
+}
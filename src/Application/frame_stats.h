@@ -0,0 +1,45 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace xe {
+
+    /**
+     * @brief Frame times collected over a run, with the usual summary statistics.
+     */
+    class FrameStats {
+    public:
+        struct Summary {
+            size_t n = 0;
+            double mean = 0.0;
+            double min = 0.0;
+            double max = 0.0;
+            double median = 0.0;
+            double p95 = 0.0;
+            double p99 = 0.0;
+        };
+
+        void add(double ms) { samples_.push_back(ms); }
+
+        void clear() { samples_.clear(); }
+
+        size_t size() const { return samples_.size(); }
+
+        const std::vector<double> &samples() const { return samples_; }
+
+        Summary summary() const;
+
+        void log_summary(const std::string &label) const;
+
+        // One line per frame: frame number and time in milliseconds.
+        bool write_csv(const std::string &path) const;
+
+    private:
+        std::vector<double> samples_;
+    };
+}
@@ -0,0 +1,276 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "gl_api_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+#include "glad/gl.h"
+#include "imgui.h"
+
+#include "overlay.h"
+
+namespace {
+    uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool starts_with(const char *name, const char *prefix) {
+        return std::strncmp(name, prefix, std::strlen(prefix)) == 0;
+    }
+
+    xe::GlApiProfiler::Category categorize(const char *name) {
+        using Category = xe::GlApiProfiler::Category;
+        for (auto prefix: {"glDrawArrays", "glDrawElements", "glDrawRangeElements", "glDrawTransformFeedback",
+                           "glMultiDraw"}) {
+            if (starts_with(name, prefix))
+                return Category::draw;
+        }
+        if (starts_with(name, "glBufferData") || starts_with(name, "glBufferSubData") ||
+            starts_with(name, "glBufferStorage") || starts_with(name, "glNamedBufferData") ||
+            starts_with(name, "glNamedBufferSubData") || starts_with(name, "glNamedBufferStorage"))
+            return Category::upload;
+        for (auto prefix: {"glBind", "glUseProgram", "glEnable", "glDisable", "glBlend", "glDepth", "glCull",
+                           "glFrontFace", "glPolygonMode", "glViewport", "glScissor", "glStencil", "glColorMask",
+                           "glActiveTexture", "glPixelStore", "glClearColor", "glLineWidth", "glPointSize",
+                           "glDrawBuffer", "glReadBuffer"}) {
+            if (starts_with(name, prefix))
+                return Category::state;
+        }
+        return Category::other;
+    }
+
+    uint64_t triangles(GLenum mode, GLsizei count) {
+        switch (mode) {
+            case GL_TRIANGLES:
+                return count / 3;
+            case GL_TRIANGLE_STRIP:
+            case GL_TRIANGLE_FAN:
+                return count > 2 ? count - 2 : 0;
+            default:
+                return 0;
+        }
+    }
+
+    // Triangles of a draw call, the arguments are decoded by the signature of the entry point.
+    uint64_t draw_triangles(const char *name, va_list args) {
+        auto mode = va_arg(args, GLenum);
+        if (starts_with(name, "glMultiDraw"))
+            return 0; // the counts are in arrays, possibly on the GPU
+        GLsizei count = 0;
+        if (starts_with(name, "glDrawArrays")) {
+            if (std::strcmp(name, "glDrawArraysIndirect") == 0)
+                return 0;
+            va_arg(args, GLint); // first
+            count = va_arg(args, GLsizei);
+            if (std::strcmp(name, "glDrawArraysInstanced") == 0 ||
+                std::strcmp(name, "glDrawArraysInstancedBaseInstance") == 0)
+                return triangles(mode, count) * va_arg(args, GLsizei);
+            return triangles(mode, count);
+        }
+        if (starts_with(name, "glDrawRangeElements")) {
+            va_arg(args, GLuint); // start
+            va_arg(args, GLuint); // end
+            return triangles(mode, va_arg(args, GLsizei));
+        }
+        if (starts_with(name, "glDrawElements")) {
+            if (std::strcmp(name, "glDrawElementsIndirect") == 0)
+                return 0;
+            count = va_arg(args, GLsizei);
+            if (std::strstr(name, "Instanced")) {
+                va_arg(args, GLenum); // type
+                va_arg(args, const void *); // indices
+                return triangles(mode, count) * va_arg(args, GLsizei);
+            }
+            return triangles(mode, count);
+        }
+        return 0; // glDrawTransformFeedback*
+    }
+
+    uint64_t upload_bytes(const char *name, va_list args) {
+        va_arg(args, GLuint); // target or buffer
+        if (std::strstr(name, "SubData"))
+            va_arg(args, GLintptr); // offset
+        auto size = va_arg(args, GLsizeiptr);
+        return size > 0 ? static_cast<uint64_t>(size) : 0;
+    }
+}
+
+namespace xe {
+
+    GlApiProfiler *GlApiProfiler::instance_ = nullptr;
+    bool GlApiProfiler::enabled_ = false;
+
+    GlApiProfiler &GlApiProfiler::instance() {
+        if (!instance_)
+            instance_ = new GlApiProfiler;
+        return *instance_;
+    }
+
+    GlApiProfiler::GlApiProfiler() {
+        overlay_panel_ = overlay::add_panel("GL calls", [this]() { draw_overlay(); });
+    }
+
+    GlApiProfiler::~GlApiProfiler() {
+        overlay::remove_panel(overlay_panel_);
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    bool GlApiProfiler::available() {
+#ifdef GLAD_OPTION_GL_DEBUG
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void GlApiProfiler::set_enabled(bool enabled) {
+        if (enabled && !available())
+            SPDLOG_WARN("GL calls can only be profiled with the debug glad, configure with -DGLAD_DEBUG=ON");
+        enabled_ = enabled;
+    }
+
+    GlApiProfiler::Function &GlApiProfiler::function(const char *name) {
+        auto it = functions_.find(name);
+        if (it == functions_.end())
+            it = functions_.emplace(name, Function{name, categorize(name)}).first;
+        return it->second;
+    }
+
+    void GlApiProfiler::pre_call(const char *name, va_list args) {
+        current_ = &function(name);
+        switch (current_->category) {
+            case Category::draw:
+                frame_.draw_calls++;
+                frame_.triangles += draw_triangles(name, args);
+                break;
+            case Category::upload:
+                frame_.buffer_bytes += upload_bytes(name, args);
+                break;
+            case Category::state:
+                frame_.state_changes++;
+                break;
+            case Category::other:
+                break;
+        }
+        // Last, so the bookkeeping above is not counted.
+        start_ns_ = now_ns();
+    }
+
+    void GlApiProfiler::post_call(const char *name) {
+        auto ns = now_ns() - start_ns_;
+        // Enabled between the callbacks, or a call the pre callback did not see.
+        if (!current_ || current_->name != name)
+            return;
+        current_->frame_calls++;
+        current_->frame_ns += ns;
+        frame_.calls++;
+        frame_.ns += ns;
+        current_ = nullptr;
+    }
+
+    void GlApiProfiler::end_frame() {
+        for (auto &[name, f]: functions_) {
+            f.calls += f.frame_calls;
+            f.ns += f.frame_ns;
+            f.last_calls = f.frame_calls;
+            f.last_ns = f.frame_ns;
+            f.frame_calls = f.frame_ns = 0;
+        }
+        last_frame_ = frame_;
+        total_.calls += frame_.calls;
+        total_.ns += frame_.ns;
+        total_.draw_calls += frame_.draw_calls;
+        total_.triangles += frame_.triangles;
+        total_.buffer_bytes += frame_.buffer_bytes;
+        total_.state_changes += frame_.state_changes;
+        frame_ = Counters{};
+        frames_++;
+
+        overlay_frame_ = last_frame_;
+        overlay_top_.clear();
+        for (auto function: top(top_n_))
+            overlay_top_.push_back(*function);
+        if (std::exchange(csv_requested_, false))
+            write_csv("gl_calls_" + std::to_string(csv_n_++) + ".csv");
+    }
+
+    std::vector<const GlApiProfiler::Function *> GlApiProfiler::top(size_t n) const {
+        std::vector<const Function *> result;
+        for (auto &[name, f]: functions_) {
+            if (f.last_calls > 0)
+                result.push_back(&f);
+        }
+        n = std::min(n, result.size());
+        std::partial_sort(result.begin(), result.begin() + n, result.end(),
+                          [](const Function *a, const Function *b) { return a->last_ns > b->last_ns; });
+        result.resize(n);
+        return result;
+    }
+
+    bool GlApiProfiler::write_csv(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out) {
+            SPDLOG_ERROR("Cannot open `{}'", path);
+            return false;
+        }
+        std::vector<const Function *> sorted;
+        for (auto &[name, f]: functions_)
+            sorted.push_back(&f);
+        std::sort(sorted.begin(), sorted.end(), [](const Function *a, const Function *b) { return a->ns > b->ns; });
+
+        auto frames = std::max<uint64_t>(frames_, 1);
+        out << "function,calls,total_ms,calls_per_frame,ms_per_frame,us_per_call\n";
+        for (auto f: sorted) {
+            out << f->name << ',' << f->calls << ',' << f->ns * 1e-6 << ',' << double(f->calls) / frames << ','
+                << f->ns * 1e-6 / frames << ',' << (f->calls ? f->ns * 1e-3 / f->calls : 0.0) << '\n';
+        }
+        SPDLOG_INFO("Wrote GL call statistics of {} frames to {}", frames_, path);
+        return true;
+    }
+
+    void GlApiProfiler::draw_overlay() {
+        bool enabled = enabled_;
+        if (ImGui::Checkbox("Profile GL calls", &enabled))
+            set_enabled(enabled);
+        if (!available()) {
+            ImGui::TextUnformatted("Needs the debug glad (GLAD_DEBUG)");
+            return;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Save CSV"))
+            csv_requested_ = true;
+
+        auto &f = overlay_frame_;
+        ImGui::Text("%llu calls %.3f ms", (unsigned long long) f.calls, f.ns * 1e-6);
+        ImGui::Text("%llu draws %llu triangles", (unsigned long long) f.draw_calls,
+                    (unsigned long long) f.triangles);
+        ImGui::Text("%.1f KB uploaded %llu state changes", f.buffer_bytes / 1024.0,
+                    (unsigned long long) f.state_changes);
+
+        if (ImGui::BeginTable("gl_calls", 3)) {
+            ImGui::TableSetupColumn("function");
+            ImGui::TableSetupColumn("calls");
+            ImGui::TableSetupColumn("us");
+            ImGui::TableHeadersRow();
+            for (auto &function: overlay_top_) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(function.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long) function.last_calls);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", function.last_ns * 1e-3);
+            }
+            ImGui::EndTable();
+        }
+    }
+}
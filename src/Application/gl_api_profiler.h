@@ -0,0 +1,117 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "RegisteredObject.h"
+
+namespace xe {
+
+    /**
+     * @brief Counts the GL calls and the CPU time spent in them, per entry point and per frame.
+     *
+     * Calls are intercepted by the glad pre/post call callbacks, so the profiler only sees anything when the
+     * debug variant of glad is used (the GLAD_DEBUG CMake option). Draw calls are decoded to count the
+     * triangles submitted, buffer uploads to count the bytes, binds and fixed function state setters are
+     * counted as state changes. Profiling is off until enabled (--gl-profile or the overlay), then it costs
+     * two clock reads per call.
+     *
+     * The callbacks run on the GL thread, which with --render-thread is not the thread drawing the overlay.
+     * end_frame() copies what the overlay shows into a snapshot, so draw_overlay() never touches the table
+     * the callbacks insert into; both have to be called under the same lock (Application::stats_mutex_).
+     */
+    class GlApiProfiler : public RegisteredObject {
+    public:
+        enum class Category {
+            other, draw, upload, state
+        };
+
+        struct Function {
+            const char *name;
+            Category category;
+            uint64_t calls = 0; // whole run
+            uint64_t ns = 0;
+            uint64_t frame_calls = 0; // current frame
+            uint64_t frame_ns = 0;
+            uint64_t last_calls = 0; // last finished frame
+            uint64_t last_ns = 0;
+        };
+
+        struct Counters {
+            uint64_t calls = 0;
+            uint64_t ns = 0;
+            uint64_t draw_calls = 0;
+            uint64_t triangles = 0;
+            uint64_t buffer_bytes = 0;
+            uint64_t state_changes = 0;
+        };
+
+        static GlApiProfiler &instance();
+
+        ~GlApiProfiler() override;
+
+        // True when glad calls the callbacks.
+        static bool available();
+
+        static bool enabled() { return enabled_; }
+
+        static void set_enabled(bool enabled);
+
+        // Called by the glad callbacks, args are the arguments of the call.
+        void pre_call(const char *name, va_list args);
+
+        void post_call(const char *name);
+
+        // Called by the application after every frame.
+        void end_frame();
+
+        const Counters &last_frame() const { return last_frame_; }
+
+        const Counters &total() const { return total_; }
+
+        uint64_t frames() const { return frames_; }
+
+        // The n functions with the highest CPU time in the last frame, on the GL thread.
+        std::vector<const Function *> top(size_t n) const;
+
+        // One line per function: totals over the run and averages per frame, on the GL thread.
+        bool write_csv(const std::string &path) const;
+
+        void draw_overlay();
+
+    private:
+        GlApiProfiler();
+
+        Function &function(const char *name);
+
+        static GlApiProfiler *instance_;
+        static bool enabled_;
+
+        // Keyed by the name pointer, glad passes the same string literal on every call.
+        std::unordered_map<const char *, Function> functions_;
+        Function *current_ = nullptr;
+        uint64_t start_ns_ = 0;
+
+        Counters frame_;
+        Counters last_frame_;
+        Counters total_;
+        uint64_t frames_ = 0;
+
+        // Taken by end_frame() for the overlay.
+        Counters overlay_frame_;
+        std::vector<Function> overlay_top_;
+        // The overlay asks for the CSV, end_frame() writes it on the GL thread.
+        bool csv_requested_ = false;
+
+        int overlay_panel_ = -1;
+        int top_n_ = 15;
+        int csv_n_ = 0;
+    };
+}
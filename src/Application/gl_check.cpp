@@ -0,0 +1,75 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "gl_check.h"
+
+#include <cstdlib>
+
+#include "spdlog/spdlog.h"
+
+#include "utils.h"
+
+namespace xe::gl_check {
+
+    Level current_level = static_cast<Level>(XE_GL_CHECK_DEFAULT_LEVEL);
+
+    void set_level(Level level) {
+#if XE_GL_CHECK_LEVEL < XE_GL_CHECK_CALL
+        // debug and frame are runtime checks, but OGL_CALL checks only exist where they were compiled in.
+        if (level == Level::call)
+            SPDLOG_WARN("GL check level call requested, but this build compiles OGL_CALL checks only up to {}; "
+                        "calls are checked only in files raising XE_GL_CHECK_LEVEL",
+                        level_name(static_cast<Level>(XE_GL_CHECK_LEVEL)));
+#endif
+        current_level = level;
+    }
+
+    bool parse_level(const std::string &name, Level &level) {
+        for (auto l: {Level::off, Level::debug, Level::frame, Level::call}) {
+            if (name == level_name(l)) {
+                level = l;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char *level_name(Level level) {
+        switch (level) {
+            case Level::off:
+                return "off";
+            case Level::debug:
+                return "debug";
+            case Level::frame:
+                return "frame";
+            case Level::call:
+                return "call";
+        }
+        return "unknown";
+    }
+
+    void end_frame() {
+        if (current_level < Level::frame)
+            return;
+        // Errors are sticky, but an implementation may keep several flags, so all are collected.
+        for (int i = 0; i < 8; i++) {
+            auto error = glGetError();
+            if (error == GL_NO_ERROR)
+                break;
+            SPDLOG_ERROR("OpenGL error: {} during the frame", utils::error_msg(error));
+        }
+    }
+
+    GLenum check(const char *call, const char *file, int line, bool critical) {
+        auto error = glGetError();
+        if (error == GL_NO_ERROR)
+            return error;
+        if (critical) {
+            SPDLOG_CRITICAL("OpenGL error: {}  {} {}:{}", utils::error_msg(error), call, file, line);
+            exit(-1);
+        }
+        SPDLOG_ERROR("OpenGL error: {}  {} {}:{}", utils::error_msg(error), call, file, line);
+        return error;
+    }
+}
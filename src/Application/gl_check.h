@@ -0,0 +1,97 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <string>
+
+#include "glad/gl.h"
+
+/**
+ * @brief GL error checking tiers.
+ *
+ *  - off: nothing is checked.
+ *  - debug: errors are reported by the KHR_debug callback (asynchronous, without the call site).
+ *  - frame: additionally glGetError is swept once per frame, see xe::gl_check::end_frame().
+ *  - call: every OGL_CALL is followed by glGetError and reports the call and its file and line.
+ *    The debug output is then synchronous.
+ *
+ * The tier is selected at runtime (xe::gl_check::set_level(), the --gl-check option of the application),
+ * starting from XE_GL_CHECK_DEFAULT_LEVEL set by CMake: call in Debug builds, frame in RelWithDebInfo and
+ * off in Release builds. XE_GL_CHECK_LEVEL is the highest tier compiled into a translation unit. Below call,
+ * OGL_CALL expands to the bare call, so the checks cost nothing. It defaults to XE_GL_CHECK_DEFAULT_LEVEL
+ * and can be set per translation unit, e.g. `#define XE_GL_CHECK_LEVEL XE_GL_CHECK_CALL` before the first
+ * include keeps full checking in a file being debugged.
+ *
+ * OGL_CALL_SAMPLED(call, n) checks only every n-th execution of the call site, for hot loops.
+ */
+#define XE_GL_CHECK_OFF 0
+#define XE_GL_CHECK_DEBUG 1
+#define XE_GL_CHECK_FRAME 2
+#define XE_GL_CHECK_CALL 3
+
+#ifndef XE_GL_CHECK_DEFAULT_LEVEL
+#define XE_GL_CHECK_DEFAULT_LEVEL XE_GL_CHECK_CALL
+#endif
+
+#ifndef XE_GL_CHECK_LEVEL
+#ifdef NO_OGL_CALL
+#define XE_GL_CHECK_LEVEL XE_GL_CHECK_OFF
+#else
+#define XE_GL_CHECK_LEVEL XE_GL_CHECK_DEFAULT_LEVEL
+#endif
+#endif
+
+namespace xe::gl_check {
+
+    enum class Level {
+        off = XE_GL_CHECK_OFF,
+        debug = XE_GL_CHECK_DEBUG,
+        frame = XE_GL_CHECK_FRAME,
+        call = XE_GL_CHECK_CALL
+    };
+
+    extern Level current_level;
+
+    inline Level level() { return current_level; }
+
+    // Takes effect for the debug output only when the context is created afterwards. Warns when call is
+    // requested in a build whose OGL_CALL checks are compiled out.
+    void set_level(Level level);
+
+    // off, debug, frame or call; returns false for other names.
+    bool parse_level(const std::string &name, Level &level);
+
+    const char *level_name(Level level);
+
+    inline bool per_call() { return current_level >= Level::call; }
+
+    // Reports all pending errors without a call site, the application calls it once per frame.
+    void end_frame();
+
+    // Reports the pending error with the call site, exits when critical.
+    GLenum check(const char *call, const char *file, int line, bool critical);
+}
+
+#ifdef DEBUG_NO_ABORT
+#define CRITICAL__  false
+#else
+#define CRITICAL__  true
+#endif
+
+#if XE_GL_CHECK_LEVEL >= XE_GL_CHECK_CALL
+#define OGL_CALL(call)                                              \
+        call;                                                       \
+        (void) (xe::gl_check::per_call() && xe::gl_check::check(#call, __FILE__, __LINE__, CRITICAL__));
+#define OGL_CALL_SAMPLED(call, n)                                   \
+        call;                                                       \
+        {                                                           \
+            static unsigned xe_gl_check_count_ = 0;                 \
+            if (xe::gl_check::per_call() && ++xe_gl_check_count_ % (n) == 0) \
+                xe::gl_check::check(#call, __FILE__, __LINE__, CRITICAL__); \
+        }
+#else
+#define OGL_CALL(call) call;
+#define OGL_CALL_SAMPLED(call, n) call;
+#endif
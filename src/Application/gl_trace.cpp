@@ -0,0 +1,496 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+    using xe::gl_trace::Function;
+
+    // Inside the callbacks GL is called through the glad pointers directly, the debug wrappers would recurse.
+    GLint get_integer(GLenum pname) {
+        GLint value = 0;
+        glad_glGetIntegerv(pname, &value);
+        return value;
+    }
+
+    GLuint bound_buffer(GLenum target) {
+        switch (target) {
+            case GL_ARRAY_BUFFER:
+                return get_integer(GL_ARRAY_BUFFER_BINDING);
+            case GL_ELEMENT_ARRAY_BUFFER:
+                return get_integer(GL_ELEMENT_ARRAY_BUFFER_BINDING);
+            case GL_PIXEL_PACK_BUFFER:
+                return get_integer(GL_PIXEL_PACK_BUFFER_BINDING);
+            case GL_PIXEL_UNPACK_BUFFER:
+                return get_integer(GL_PIXEL_UNPACK_BUFFER_BINDING);
+            case GL_UNIFORM_BUFFER:
+                return get_integer(GL_UNIFORM_BUFFER_BINDING);
+            case GL_SHADER_STORAGE_BUFFER:
+                return get_integer(GL_SHADER_STORAGE_BUFFER_BINDING);
+            case GL_COPY_READ_BUFFER:
+                return get_integer(GL_COPY_READ_BUFFER_BINDING);
+            case GL_COPY_WRITE_BUFFER:
+                return get_integer(GL_COPY_WRITE_BUFFER_BINDING);
+            default:
+                return 0u;
+        }
+    }
+
+    GLsizeiptr buffer_size(GLuint buffer) {
+        GLint64 size = 0;
+        glad_glGetNamedBufferParameteri64v(buffer, GL_BUFFER_SIZE, &size);
+        return size;
+    }
+
+    size_t pixel_size(GLenum format, GLenum type) {
+        switch (type) {
+            case GL_UNSIGNED_SHORT_5_6_5:
+            case GL_UNSIGNED_SHORT_5_6_5_REV:
+            case GL_UNSIGNED_SHORT_4_4_4_4:
+            case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+            case GL_UNSIGNED_SHORT_5_5_5_1:
+            case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+                return 2;
+            case GL_UNSIGNED_INT_8_8_8_8:
+            case GL_UNSIGNED_INT_8_8_8_8_REV:
+            case GL_UNSIGNED_INT_10_10_10_2:
+            case GL_UNSIGNED_INT_2_10_10_10_REV:
+            case GL_UNSIGNED_INT_24_8:
+            case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            case GL_UNSIGNED_INT_5_9_9_9_REV:
+                return 4;
+            case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+                return 8;
+            default:
+                break;
+        }
+        size_t component = 1;
+        switch (type) {
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT:
+            case GL_HALF_FLOAT:
+                component = 2;
+                break;
+            case GL_INT:
+            case GL_UNSIGNED_INT:
+            case GL_FLOAT:
+                component = 4;
+                break;
+            default:
+                break;
+        }
+        switch (format) {
+            case GL_RG:
+            case GL_RG_INTEGER:
+            case GL_DEPTH_STENCIL:
+                return 2 * component;
+            case GL_RGB:
+            case GL_BGR:
+            case GL_RGB_INTEGER:
+            case GL_BGR_INTEGER:
+                return 3 * component;
+            case GL_RGBA:
+            case GL_BGRA:
+            case GL_RGBA_INTEGER:
+            case GL_BGRA_INTEGER:
+                return 4 * component;
+            default:
+                return component;
+        }
+    }
+
+    struct ImageArgs {
+        const char *name;
+        int width, height, depth; // argument indices, depth -1 for 2D
+    };
+
+    const ImageArgs image_args[] = {
+            {"glTexImage2D",        3, 4, -1},
+            {"glTexSubImage2D",     4, 5, -1},
+            {"glTextureSubImage2D", 4, 5, -1},
+            {"glTextureSubImage3D", 5, 6, 7},
+            {"glReadPixels",        2, 3, -1},
+    };
+
+    // Bytes read from (or written to) the client memory, the format and type are the two arguments before.
+    size_t image_size(const char *name, const uint64_t *values, size_t index, bool pack) {
+        for (auto &args: image_args) {
+            if (std::strcmp(args.name, name) != 0)
+                continue;
+            auto width = static_cast<size_t>(values[args.width]);
+            auto height = static_cast<size_t>(values[args.height]);
+            auto depth = args.depth < 0 ? size_t(1) : static_cast<size_t>(values[args.depth]);
+            if (width == 0 || height == 0 || depth == 0)
+                return 0;
+            auto bpp = pixel_size(static_cast<GLenum>(values[index - 2]), static_cast<GLenum>(values[index - 1]));
+            auto state = [pack](GLenum pack_name, GLenum unpack_name) {
+                return static_cast<size_t>(get_integer(pack ? pack_name : unpack_name));
+            };
+            auto row_length = state(GL_PACK_ROW_LENGTH, GL_UNPACK_ROW_LENGTH);
+            auto alignment = state(GL_PACK_ALIGNMENT, GL_UNPACK_ALIGNMENT);
+            auto skip_pixels = state(GL_PACK_SKIP_PIXELS, GL_UNPACK_SKIP_PIXELS);
+            auto skip_rows = state(GL_PACK_SKIP_ROWS, GL_UNPACK_SKIP_ROWS);
+            auto stride = ((row_length ? row_length : width) * bpp + alignment - 1) / alignment * alignment;
+            // The skipped pixels, rows and images come before the data in the same client memory.
+            auto size = skip_rows * stride + skip_pixels * bpp + (height - 1) * stride + width * bpp;
+            if (args.depth >= 0) {
+                auto image_height = state(GL_PACK_IMAGE_HEIGHT, GL_UNPACK_IMAGE_HEIGHT);
+                auto skip_images = state(GL_PACK_SKIP_IMAGES, GL_UNPACK_SKIP_IMAGES);
+                size += (skip_images + depth - 1) * (image_height ? image_height : height) * stride;
+            }
+            return size;
+        }
+        return 0;
+    }
+
+    size_t uniform_components(const char *name) {
+        if (std::strstr(name, "Matrix4"))
+            return 16;
+        if (std::strstr(name, "Matrix3"))
+            return 9;
+        if (std::strstr(name, "Matrix2"))
+            return 4;
+        auto uniform = std::strstr(name, "Uniform");
+        return uniform ? static_cast<size_t>(uniform[7] - '0') : 1;
+    }
+
+    size_t blob_size(const char *name, const uint64_t *values, size_t index) {
+        if (std::strstr(name, "BufferSubData"))
+            return values[2];
+        if (std::strstr(name, "BufferData") || std::strstr(name, "BufferStorage"))
+            return values[1];
+        if (std::strcmp(name, "glProgramBinary") == 0)
+            return values[3];
+        if (std::strcmp(name, "glClearNamedFramebufferfv") == 0)
+            return values[1] == GL_COLOR ? 4 * sizeof(GLfloat) : sizeof(GLfloat);
+        if (std::strstr(name, "Uniform")) {
+            // The count precedes the data, matrices have the transpose flag in between.
+            auto count = values[std::strstr(name, "Matrix") ? index - 2 : index - 1];
+            return count * uniform_components(name) * 4;
+        }
+        SPDLOG_ERROR("Unknown data size of {}", name);
+        return 0;
+    }
+}
+
+namespace xe::gl_trace {
+
+    Signature parse_signature(const char *signature) {
+        Signature result;
+        if (auto colon = std::strchr(signature, ':')) {
+            result.ret = signature[0];
+            signature = colon + 1;
+        }
+        for (auto c = signature; *c; c++) {
+            if (*c == '[' || *c == ']') {
+                result.args.push_back({*c, c[1]});
+                c++;
+            } else {
+                result.args.push_back({*c, 0});
+            }
+        }
+        return result;
+    }
+
+    bool operator<(const Function &a, const Function &b) {
+        return std::strcmp(a.name, b.name) < 0;
+    }
+
+    const std::vector<Function> &functions() {
+        static const std::vector<Function> functions_ = [] {
+            std::vector<Function> f = {
+#define XE_GL_TRACE(name, signature, replay) {#name, signature},
+
+#include "gl_trace_functions.h"
+
+#undef XE_GL_TRACE
+            };
+            std::sort(f.begin(), f.end());
+            return f;
+        }();
+        return functions_;
+    }
+
+    const Function *find_function(const char *name) {
+        auto &f = functions();
+        auto it = std::lower_bound(f.begin(), f.end(), name, [](const Function &function, const char *name) {
+            return std::strcmp(function.name, name) < 0;
+        });
+        return it != f.end() && std::strcmp(it->name, name) == 0 ? &*it : nullptr;
+    }
+
+    bool Capture::active_ = false;
+
+    Capture &Capture::instance() {
+        static Capture capture;
+        return capture;
+    }
+
+    bool Capture::start(const std::string &path, int width, int height, int start_frame, int n_frames) {
+#ifndef GLAD_OPTION_GL_DEBUG
+        SPDLOG_ERROR("GL calls can only be captured with the debug glad, configure with -DGLAD_DEBUG=ON");
+        return false;
+#endif
+        out_.open(path, std::ios::binary | std::ios::trunc);
+        if (!out_) {
+            SPDLOG_ERROR("Cannot open `{}'", path);
+            return false;
+        }
+        path_ = path;
+        out_.write(MAGIC, sizeof(MAGIC));
+        auto version = VERSION;
+        auto w = static_cast<uint32_t>(width), h = static_cast<uint32_t>(height);
+        out_.write(reinterpret_cast<const char *>(&version), sizeof(version));
+        out_.write(reinterpret_cast<const char *>(&w), sizeof(w));
+        out_.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+        frame_ = 0;
+        start_frame_ = start_frame;
+        end_frame_ = start_frame + n_frames;
+        if (start_frame_ == 0)
+            out_.put(static_cast<char>(Tag::start));
+        active_ = true;
+        SPDLOG_INFO("Capturing GL calls into {}, frames {}-{}", path, start_frame_, end_frame_ - 1);
+        return true;
+    }
+
+    void Capture::stop() {
+        if (!active_)
+            return;
+        active_ = false;
+        out_.close();
+        SPDLOG_INFO("Captured {} GL calls ({:.1f} MB of data) in {} frames into {}", calls_, bytes_ / 1048576.0,
+                    std::max(0, frame_ - start_frame_), path_);
+    }
+
+    void Capture::end_frame() {
+        out_.put(static_cast<char>(Tag::frame));
+        frame_++;
+        if (frame_ == start_frame_)
+            out_.put(static_cast<char>(Tag::start));
+        if (frame_ >= end_frame_)
+            stop();
+    }
+
+    Capture::Entry &Capture::entry(const Function *function) {
+        auto it = entries_.find(function);
+        if (it != entries_.end())
+            return it->second;
+        auto id = static_cast<uint16_t>(entries_.size());
+        auto length = static_cast<uint16_t>(std::strlen(function->name));
+        out_.put(static_cast<char>(Tag::function));
+        out_.write(reinterpret_cast<const char *>(&id), sizeof(id));
+        out_.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        out_.write(function->name, length);
+        return entries_.emplace(function, Entry{id, parse_signature(function->signature)}).first->second;
+    }
+
+    void Capture::put_data(const void *data, size_t size) {
+        if (!data) {
+            put(NULL_DATA);
+            return;
+        }
+        put(static_cast<uint32_t>(size));
+        auto p = static_cast<const uint8_t *>(data);
+        record_.insert(record_.end(), p, p + size);
+        bytes_ += size;
+    }
+
+    void Capture::pre_call(const char *name, va_list args) {
+        current_ = nullptr;
+
+        // Mapped buffers are written by the application directly, their contents are taken when unmapped.
+        if (std::strncmp(name, "glMap", 5) == 0) {
+            GLuint buffer;
+            GLenum access;
+            GLintptr offset = 0;
+            GLsizeiptr length = -1;
+            bool named = std::strncmp(name, "glMapNamed", 10) == 0;
+            buffer = named ? va_arg(args, GLuint) : bound_buffer(va_arg(args, GLenum));
+            if (std::strstr(name, "Range")) {
+                offset = va_arg(args, GLintptr);
+                length = va_arg(args, GLsizeiptr);
+                access = va_arg(args, GLbitfield);
+                mappings_[buffer] = {offset, length, (access & GL_MAP_WRITE_BIT) != 0};
+            } else {
+                access = va_arg(args, GLenum);
+                mappings_[buffer] = {offset, length, access != GL_READ_ONLY};
+            }
+            return;
+        }
+        if (std::strncmp(name, "glUnmap", 7) == 0) {
+            unmapped_ = std::strncmp(name, "glUnmapNamed", 12) == 0 ? va_arg(args, GLuint)
+                                                                      : bound_buffer(va_arg(args, GLenum));
+            return;
+        }
+
+        auto function = find_function(name);
+        if (!function) {
+            if (std::strncmp(name, "glGet", 5) != 0 && std::strncmp(name, "glIs", 4) != 0 &&
+                std::strncmp(name, "glCheck", 7) != 0 && std::strncmp(name, "glDebug", 7) != 0 &&
+                std::strncmp(name, "glFlushMapped", 13) != 0 && skipped_.insert(name).second)
+                SPDLOG_WARN("{} cannot be captured, the replay will differ", name);
+            return;
+        }
+        auto &e = entry(function);
+        auto &sig = e.signature;
+
+        // All arguments are read first, data sizes can depend on the following ones.
+        uint64_t values[MAX_ARGS] = {};
+        // Float arguments keep their own type, squeezing them through a 64 bit slot depends on the byte order.
+        float floats[MAX_ARGS] = {};
+        const void *pointers[MAX_ARGS] = {};
+        GLsizei n_strings = 0;
+        const GLint *lengths = nullptr;
+        for (size_t i = 0; i < sig.args.size(); i++) {
+            switch (sig.args[i].kind) {
+                case 'l':
+                    values[i] = va_arg(args, uint64_t);
+                    break;
+                case 'f':
+                    floats[i] = static_cast<float>(va_arg(args, double));
+                    break;
+                case 'd': {
+                    auto d = va_arg(args, double);
+                    std::memcpy(&values[i], &d, sizeof(d));
+                    break;
+                }
+                case 'p':
+                case 'Y':
+                case 'b':
+                case 'x':
+                case '[':
+                case ']':
+                    pointers[i] = va_arg(args, const void *);
+                    values[i] = reinterpret_cast<uintptr_t>(pointers[i]);
+                    break;
+                case 's':
+                    n_strings = va_arg(args, GLsizei);
+                    pointers[i] = va_arg(args, const GLchar *const *);
+                    lengths = va_arg(args, const GLint *);
+                    break;
+                default:
+                    values[i] = va_arg(args, GLuint);
+                    break;
+            }
+        }
+
+        record_.clear();
+        put(Tag::call);
+        put(e.id);
+        for (size_t i = 0; i < sig.args.size(); i++) {
+            auto kind = sig.args[i].kind;
+            switch (kind) {
+                case 'l':
+                case 'p':
+                case 'Y':
+                case 'd':
+                    put(values[i]);
+                    break;
+                case 'f':
+                    put(floats[i]);
+                    break;
+                case 'b':
+                    put_data(pointers[i], blob_size(name, values, i));
+                    break;
+                case 'x': {
+                    bool pack = std::strcmp(name, "glReadPixels") == 0;
+                    bool buffer = get_integer(pack ? GL_PIXEL_PACK_BUFFER_BINDING : GL_PIXEL_UNPACK_BUFFER_BINDING);
+                    if (pack && !buffer)
+                        return; // read into the client memory, nothing to replay
+                    put(static_cast<uint8_t>(buffer ? 0 : 1));
+                    if (buffer)
+                        put(values[i]);
+                    else
+                        put_data(pointers[i], image_size(name, values, i, pack));
+                    break;
+                }
+                case 's': {
+                    std::string source;
+                    auto strings = static_cast<const GLchar *const *>(pointers[i]);
+                    for (GLsizei j = 0; j < n_strings; j++)
+                        source.append(strings[j], lengths && lengths[j] >= 0 ? lengths[j] : std::strlen(strings[j]));
+                    put_data(source.data(), source.size());
+                    break;
+                }
+                case '[': {
+                    auto count = static_cast<uint32_t>(values[i - 1]);
+                    auto names = static_cast<const GLuint *>(pointers[i]);
+                    put(count);
+                    for (uint32_t j = 0; j < count; j++)
+                        put(sig.args[i].element == 'F' && names[j] == default_framebuffer_ ? 0u : names[j]);
+                    break;
+                }
+                case ']':
+                    outputs_ = static_cast<GLuint *>(const_cast<void *>(pointers[i]));
+                    n_outputs_ = static_cast<GLsizei>(values[i - 1]);
+                    break;
+                case 'F':
+                    put(static_cast<uint32_t>(values[i] == default_framebuffer_ ? 0u : values[i]));
+                    break;
+                default:
+                    put(static_cast<uint32_t>(values[i]));
+                    break;
+            }
+        }
+        ret_ = sig.ret;
+        current_ = &e;
+    }
+
+    void Capture::post_call(const char *, void *ret) {
+        if (unmapped_) {
+            write_unmapped(unmapped_);
+            unmapped_ = 0u;
+            return;
+        }
+        if (!current_)
+            return;
+        if (outputs_) {
+            put(static_cast<uint32_t>(n_outputs_));
+            for (GLsizei i = 0; i < n_outputs_; i++)
+                put(outputs_[i]);
+            outputs_ = nullptr;
+        }
+        if (ret_ == 'Y')
+            put(reinterpret_cast<uint64_t>(*static_cast<GLsync *>(ret)));
+        else if (ret_)
+            put(*static_cast<GLuint *>(ret));
+        write_record();
+        current_ = nullptr;
+    }
+
+    void Capture::write_record() {
+        out_.write(reinterpret_cast<const char *>(record_.data()), static_cast<std::streamsize>(record_.size()));
+        calls_++;
+    }
+
+    void Capture::write_unmapped(GLuint buffer) {
+        auto it = mappings_.find(buffer);
+        if (it == mappings_.end())
+            return;
+        auto mapping = it->second;
+        mappings_.erase(it);
+        if (!mapping.write)
+            return;
+        if (mapping.length < 0)
+            mapping.length = buffer_size(buffer);
+
+        static const Function *sub_data = find_function("glNamedBufferSubData");
+        std::vector<uint8_t> data(mapping.length);
+        glad_glGetNamedBufferSubData(buffer, mapping.offset, mapping.length, data.data());
+        record_.clear();
+        put(Tag::call);
+        put(entry(sub_data).id);
+        put(buffer);
+        put(static_cast<uint64_t>(mapping.offset));
+        put(static_cast<uint64_t>(mapping.length));
+        put_data(data.data(), data.size());
+        write_record();
+    }
+}
@@ -0,0 +1,149 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "glad/gl.h"
+
+namespace xe::gl_trace {
+
+    /**
+     * Binary trace of GL calls, replayed by the gl_replay tool.
+     *
+     * The file starts with MAGIC, VERSION and the framebuffer width and height (uint32), followed by
+     * records, each starting with a Tag byte:
+     *  - function: uint16 id, uint16 length and the name, before the first call of the function;
+     *  - call: uint16 id and the arguments in the order of the signature (gl_trace_functions.h), except
+     *    the output arrays and the return value, which follow them. Integers and names are 4 bytes,
+     *    64 bit values, pointers and syncs 8, data is a uint32 size (NULL_DATA for a null pointer)
+     *    followed by the bytes; pixels are a byte (1 for data, 0 for an offset) followed by the data
+     *    or an 8 byte offset, arrays are a uint32 count followed by the elements;
+     *  - frame: the end of a frame;
+     *  - start: the calls before it set up the state, the frames after it are the timed workload.
+     *
+     * Values are written in the byte order of the machine, traces are meant to be replayed on it.
+     */
+    inline constexpr char MAGIC[8] = {'X', 'E', 'G', 'L', 'T', 'R', 'C', '\0'};
+    inline constexpr uint32_t VERSION = 1;
+    inline constexpr uint32_t NULL_DATA = 0xffffffffu;
+    inline constexpr size_t MAX_ARGS = 16;
+
+    enum class Tag : uint8_t {
+        function = 1, call = 2, frame = 3, start = 4
+    };
+
+    struct Function {
+        const char *name;
+        const char *signature;
+    };
+
+    struct Arg {
+        char kind;
+        char element; // of arrays
+    };
+
+    struct Signature {
+        char ret = 0;
+        std::vector<Arg> args;
+    };
+
+    Signature parse_signature(const char *signature);
+
+    // nullptr for the functions that cannot be traced.
+    const Function *find_function(const char *name);
+
+    const std::vector<Function> &functions();
+
+    /**
+     * @brief Writes the GL calls made through glad into a trace.
+     *
+     * The calls are seen by the glad pre/post call callbacks, so only the debug glad (GLAD_DEBUG) can
+     * capture. Recording starts when the context is created, so the trace contains the asset uploads and
+     * the replay does not need the files. The first start_frame frames are written as a part of the setup,
+     * the following n_frames frames are the workload.
+     *
+     * Queries (glGet*, glIs*) are not recorded. Writes through mapped buffers are recorded as
+     * glNamedBufferSubData of the mapped range when the buffer is unmapped, buffers mapped persistently are
+     * not captured. Calls missing from gl_trace_functions.h are reported once and skipped, as are the calls
+     * made by ImGui, which has its own loader.
+     */
+    class Capture {
+    public:
+        static Capture &instance();
+
+        static bool active() { return active_; }
+
+        bool start(const std::string &path, int width, int height, int start_frame, int n_frames);
+
+        // The name of the framebuffer standing for the window, recorded as 0.
+        void set_default_framebuffer(GLuint framebuffer) { default_framebuffer_ = framebuffer; }
+
+        void stop();
+
+        void pre_call(const char *name, va_list args);
+
+        void post_call(const char *name, void *ret);
+
+        void end_frame();
+
+    private:
+        struct Mapping {
+            GLintptr offset;
+            GLsizeiptr length;
+            bool write;
+        };
+
+        Capture() = default;
+
+        struct Entry {
+            uint16_t id;
+            Signature signature;
+        };
+
+        Entry &entry(const Function *function);
+
+        void write_record();
+
+        void write_unmapped(GLuint buffer);
+
+        template<typename T>
+        void put(const T &value) {
+            auto p = reinterpret_cast<const uint8_t *>(&value);
+            record_.insert(record_.end(), p, p + sizeof(T));
+        }
+
+        void put_data(const void *data, size_t size);
+
+        static bool active_;
+
+        std::ofstream out_;
+        std::string path_;
+        int frame_ = 0;
+        int start_frame_ = 0;
+        int end_frame_ = 0;
+        GLuint default_framebuffer_ = 0u;
+
+        std::unordered_map<const Function *, Entry> entries_;
+        std::unordered_set<std::string> skipped_;
+        std::unordered_map<GLuint, Mapping> mappings_;
+
+        // The call between the pre and post callback.
+        Entry *current_ = nullptr;
+        char ret_ = 0;
+        std::vector<uint8_t> record_;
+        GLuint *outputs_ = nullptr;
+        GLsizei n_outputs_ = 0;
+        GLuint unmapped_ = 0u;
+        uint64_t calls_ = 0;
+        uint64_t bytes_ = 0;
+    };
+}
@@ -0,0 +1,195 @@
+//
+// Created by agent on 19.10.26.
+//
+
+// No include guard: the list is expanded with different definitions of XE_GL_TRACE, see gl_trace.h.
+//
+// XE_GL_TRACE(name, signature, replay) - signature letters, one per argument:
+//   i 32 bit integer, enum, boolean or bitfield     l 64 bit integer (GLintptr, GLsizeiptr, GLuint64)
+//   f float    d double    p pointer used as an offset into a bound buffer
+//   B T V F R P S M Q  buffer, texture, vertex array, framebuffer, renderbuffer, program, shader, sampler
+//                      and query names, remapped on replay
+//   Y  GLsync, remapped on replay
+//   b  data, its size follows from the other arguments (trace::blob_size)
+//   x  pixels, data or an offset when a pixel buffer is bound (trace::image_size)
+//   s  shader source strings, takes the count, string and length arguments
+//   [k array of k (count is the previous argument), ]k output array of k names
+// A kind followed by ':' is the return value. The replay statement uses the arguments through `a`,
+// see src/Tools/gl_replay.cpp.
+
+XE_GL_TRACE(glActiveTexture, "i", glActiveTexture(a.u(0)))
+XE_GL_TRACE(glAttachShader, "PS", glAttachShader(a.u(0), a.u(1)))
+XE_GL_TRACE(glBeginQuery, "iQ", glBeginQuery(a.u(0), a.u(1)))
+XE_GL_TRACE(glBindBuffer, "iB", glBindBuffer(a.u(0), a.u(1)))
+XE_GL_TRACE(glBindBufferBase, "iiB", glBindBufferBase(a.u(0), a.u(1), a.u(2)))
+XE_GL_TRACE(glBindBufferRange, "iiBll", glBindBufferRange(a.u(0), a.u(1), a.u(2), a.l(3), a.l(4)))
+XE_GL_TRACE(glBindFramebuffer, "iF", glBindFramebuffer(a.u(0), a.u(1)))
+XE_GL_TRACE(glBindImageTexture, "iTiiiii",
+            glBindImageTexture(a.u(0), a.u(1), a.i(2), a.u(3), a.i(4), a.u(5), a.u(6)))
+XE_GL_TRACE(glBindRenderbuffer, "iR", glBindRenderbuffer(a.u(0), a.u(1)))
+XE_GL_TRACE(glBindSampler, "iM", glBindSampler(a.u(0), a.u(1)))
+XE_GL_TRACE(glBindTexture, "iT", glBindTexture(a.u(0), a.u(1)))
+XE_GL_TRACE(glBindTextureUnit, "iT", glBindTextureUnit(a.u(0), a.u(1)))
+XE_GL_TRACE(glBindVertexArray, "V", glBindVertexArray(a.u(0)))
+XE_GL_TRACE(glBlendEquation, "i", glBlendEquation(a.u(0)))
+XE_GL_TRACE(glBlendFunc, "ii", glBlendFunc(a.u(0), a.u(1)))
+XE_GL_TRACE(glBlendFuncSeparate, "iiii", glBlendFuncSeparate(a.u(0), a.u(1), a.u(2), a.u(3)))
+XE_GL_TRACE(glBlitFramebuffer, "iiiiiiiiii",
+            glBlitFramebuffer(a.i(0), a.i(1), a.i(2), a.i(3), a.i(4), a.i(5), a.i(6), a.i(7), a.u(8), a.u(9)))
+XE_GL_TRACE(glBlitNamedFramebuffer, "FFiiiiiiiiii",
+            glBlitNamedFramebuffer(a.u(0), a.u(1), a.i(2), a.i(3), a.i(4), a.i(5), a.i(6), a.i(7), a.i(8), a.i(9),
+                                   a.u(10), a.u(11)))
+XE_GL_TRACE(glBufferData, "ilbi", glBufferData(a.u(0), a.l(1), a.p(2), a.u(3)))
+XE_GL_TRACE(glBufferStorage, "ilbi", glBufferStorage(a.u(0), a.l(1), a.p(2), a.u(3)))
+XE_GL_TRACE(glBufferSubData, "illb", glBufferSubData(a.u(0), a.l(1), a.l(2), a.p(3)))
+XE_GL_TRACE(glClear, "i", glClear(a.u(0)))
+XE_GL_TRACE(glClearColor, "ffff", glClearColor(a.f(0), a.f(1), a.f(2), a.f(3)))
+XE_GL_TRACE(glClearDepth, "d", glClearDepth(a.d(0)))
+XE_GL_TRACE(glClearDepthf, "f", glClearDepthf(a.f(0)))
+XE_GL_TRACE(glClearNamedFramebufferfi, "Fiifi", glClearNamedFramebufferfi(a.u(0), a.u(1), a.i(2), a.f(3), a.i(4)))
+XE_GL_TRACE(glClearNamedFramebufferfv, "Fiib",
+            glClearNamedFramebufferfv(a.u(0), a.u(1), a.i(2), static_cast<const GLfloat *>(a.p(3))))
+XE_GL_TRACE(glClientWaitSync, "Yil", glClientWaitSync(a.y(0), a.u(1), a.l(2)))
+XE_GL_TRACE(glColorMask, "iiii", glColorMask(a.u(0), a.u(1), a.u(2), a.u(3)))
+XE_GL_TRACE(glCompileShader, "S", glCompileShader(a.u(0)))
+XE_GL_TRACE(glCopyImageSubData, "TiiiiiTiiiiiiii",
+            glCopyImageSubData(a.u(0), a.u(1), a.i(2), a.i(3), a.i(4), a.i(5), a.u(6), a.u(7), a.i(8), a.i(9),
+                               a.i(10), a.i(11), a.i(12), a.i(13), a.i(14)))
+XE_GL_TRACE(glCreateBuffers, "i]B", glCreateBuffers(a.i(0), a.o(1)))
+XE_GL_TRACE(glCreateFramebuffers, "i]F", glCreateFramebuffers(a.i(0), a.o(1)))
+XE_GL_TRACE(glCreateProgram, "P:", a.ret(glCreateProgram()))
+XE_GL_TRACE(glCreateQueries, "ii]Q", glCreateQueries(a.u(0), a.i(1), a.o(2)))
+XE_GL_TRACE(glCreateRenderbuffers, "i]R", glCreateRenderbuffers(a.i(0), a.o(1)))
+XE_GL_TRACE(glCreateSamplers, "i]M", glCreateSamplers(a.i(0), a.o(1)))
+XE_GL_TRACE(glCreateShader, "S:i", a.ret(glCreateShader(a.u(0))))
+XE_GL_TRACE(glCreateTextures, "ii]T", glCreateTextures(a.u(0), a.i(1), a.o(2)))
+XE_GL_TRACE(glCreateVertexArrays, "i]V", glCreateVertexArrays(a.i(0), a.o(1)))
+XE_GL_TRACE(glCullFace, "i", glCullFace(a.u(0)))
+XE_GL_TRACE(glDeleteBuffers, "i[B", glDeleteBuffers(a.i(0), a.n(1)))
+XE_GL_TRACE(glDeleteFramebuffers, "i[F", glDeleteFramebuffers(a.i(0), a.n(1)))
+XE_GL_TRACE(glDeleteProgram, "P", glDeleteProgram(a.u(0)))
+XE_GL_TRACE(glDeleteQueries, "i[Q", glDeleteQueries(a.i(0), a.n(1)))
+XE_GL_TRACE(glDeleteRenderbuffers, "i[R", glDeleteRenderbuffers(a.i(0), a.n(1)))
+XE_GL_TRACE(glDeleteSamplers, "i[M", glDeleteSamplers(a.i(0), a.n(1)))
+XE_GL_TRACE(glDeleteShader, "S", glDeleteShader(a.u(0)))
+XE_GL_TRACE(glDeleteSync, "Y", glDeleteSync(a.y(0)))
+XE_GL_TRACE(glDeleteTextures, "i[T", glDeleteTextures(a.i(0), a.n(1)))
+XE_GL_TRACE(glDeleteVertexArrays, "i[V", glDeleteVertexArrays(a.i(0), a.n(1)))
+XE_GL_TRACE(glDepthFunc, "i", glDepthFunc(a.u(0)))
+XE_GL_TRACE(glDepthMask, "i", glDepthMask(a.u(0)))
+XE_GL_TRACE(glDetachShader, "PS", glDetachShader(a.u(0), a.u(1)))
+XE_GL_TRACE(glDisable, "i", glDisable(a.u(0)))
+XE_GL_TRACE(glDisableVertexAttribArray, "i", glDisableVertexAttribArray(a.u(0)))
+XE_GL_TRACE(glDispatchCompute, "iii", glDispatchCompute(a.u(0), a.u(1), a.u(2)))
+XE_GL_TRACE(glDrawArrays, "iii", glDrawArrays(a.u(0), a.i(1), a.i(2)))
+XE_GL_TRACE(glDrawArraysInstanced, "iiii", glDrawArraysInstanced(a.u(0), a.i(1), a.i(2), a.i(3)))
+XE_GL_TRACE(glDrawBuffer, "i", glDrawBuffer(a.u(0)))
+XE_GL_TRACE(glDrawBuffers, "i[i", glDrawBuffers(a.i(0), a.n(1)))
+XE_GL_TRACE(glDrawElements, "iiip", glDrawElements(a.u(0), a.i(1), a.u(2), a.p(3)))
+XE_GL_TRACE(glDrawElementsBaseVertex, "iiipi", glDrawElementsBaseVertex(a.u(0), a.i(1), a.u(2), a.p(3), a.i(4)))
+XE_GL_TRACE(glDrawElementsInstanced, "iiipi", glDrawElementsInstanced(a.u(0), a.i(1), a.u(2), a.p(3), a.i(4)))
+XE_GL_TRACE(glDrawRangeElements, "iiiiip", glDrawRangeElements(a.u(0), a.u(1), a.u(2), a.i(3), a.u(4), a.p(5)))
+XE_GL_TRACE(glEnable, "i", glEnable(a.u(0)))
+XE_GL_TRACE(glEnableVertexArrayAttrib, "Vi", glEnableVertexArrayAttrib(a.u(0), a.u(1)))
+XE_GL_TRACE(glEnableVertexAttribArray, "i", glEnableVertexAttribArray(a.u(0)))
+XE_GL_TRACE(glEndQuery, "i", glEndQuery(a.u(0)))
+XE_GL_TRACE(glFenceSync, "Y:ii", a.ret(glFenceSync(a.u(0), a.u(1))))
+XE_GL_TRACE(glFinish, "", glFinish())
+XE_GL_TRACE(glFlush, "", glFlush())
+XE_GL_TRACE(glFramebufferRenderbuffer, "iiiR", glFramebufferRenderbuffer(a.u(0), a.u(1), a.u(2), a.u(3)))
+XE_GL_TRACE(glFramebufferTexture2D, "iiiTi", glFramebufferTexture2D(a.u(0), a.u(1), a.u(2), a.u(3), a.i(4)))
+XE_GL_TRACE(glFrontFace, "i", glFrontFace(a.u(0)))
+XE_GL_TRACE(glGenBuffers, "i]B", glGenBuffers(a.i(0), a.o(1)))
+XE_GL_TRACE(glGenFramebuffers, "i]F", glGenFramebuffers(a.i(0), a.o(1)))
+XE_GL_TRACE(glGenQueries, "i]Q", glGenQueries(a.i(0), a.o(1)))
+XE_GL_TRACE(glGenRenderbuffers, "i]R", glGenRenderbuffers(a.i(0), a.o(1)))
+XE_GL_TRACE(glGenSamplers, "i]M", glGenSamplers(a.i(0), a.o(1)))
+XE_GL_TRACE(glGenTextures, "i]T", glGenTextures(a.i(0), a.o(1)))
+XE_GL_TRACE(glGenVertexArrays, "i]V", glGenVertexArrays(a.i(0), a.o(1)))
+XE_GL_TRACE(glGenerateMipmap, "i", glGenerateMipmap(a.u(0)))
+XE_GL_TRACE(glGenerateTextureMipmap, "T", glGenerateTextureMipmap(a.u(0)))
+XE_GL_TRACE(glLineWidth, "f", glLineWidth(a.f(0)))
+XE_GL_TRACE(glLinkProgram, "P", glLinkProgram(a.u(0)))
+XE_GL_TRACE(glMemoryBarrier, "i", glMemoryBarrier(a.u(0)))
+XE_GL_TRACE(glNamedBufferData, "Blbi", glNamedBufferData(a.u(0), a.l(1), a.p(2), a.u(3)))
+XE_GL_TRACE(glNamedBufferStorage, "Blbi", glNamedBufferStorage(a.u(0), a.l(1), a.p(2), a.u(3)))
+XE_GL_TRACE(glNamedBufferSubData, "Bllb", glNamedBufferSubData(a.u(0), a.l(1), a.l(2), a.p(3)))
+XE_GL_TRACE(glNamedFramebufferDrawBuffer, "Fi", glNamedFramebufferDrawBuffer(a.u(0), a.u(1)))
+XE_GL_TRACE(glNamedFramebufferDrawBuffers, "Fi[i", glNamedFramebufferDrawBuffers(a.u(0), a.i(1), a.n(2)))
+XE_GL_TRACE(glNamedFramebufferReadBuffer, "Fi", glNamedFramebufferReadBuffer(a.u(0), a.u(1)))
+XE_GL_TRACE(glNamedFramebufferRenderbuffer, "FiiR",
+            glNamedFramebufferRenderbuffer(a.u(0), a.u(1), a.u(2), a.u(3)))
+XE_GL_TRACE(glNamedFramebufferTexture, "FiTi", glNamedFramebufferTexture(a.u(0), a.u(1), a.u(2), a.i(3)))
+XE_GL_TRACE(glNamedRenderbufferStorage, "Riii", glNamedRenderbufferStorage(a.u(0), a.u(1), a.i(2), a.i(3)))
+XE_GL_TRACE(glNamedRenderbufferStorageMultisample, "Riiii",
+            glNamedRenderbufferStorageMultisample(a.u(0), a.i(1), a.u(2), a.i(3), a.i(4)))
+XE_GL_TRACE(glPixelStorei, "ii", glPixelStorei(a.u(0), a.i(1)))
+XE_GL_TRACE(glPointSize, "f", glPointSize(a.f(0)))
+XE_GL_TRACE(glPolygonMode, "ii", glPolygonMode(a.u(0), a.u(1)))
+XE_GL_TRACE(glPolygonOffset, "ff", glPolygonOffset(a.f(0), a.f(1)))
+XE_GL_TRACE(glProgramBinary, "Pibi", glProgramBinary(a.u(0), a.u(1), a.p(2), a.i(3)))
+XE_GL_TRACE(glProgramParameteri, "Pii", glProgramParameteri(a.u(0), a.u(1), a.i(2)))
+XE_GL_TRACE(glProgramUniform1f, "Pif", glProgramUniform1f(a.u(0), a.i(1), a.f(2)))
+XE_GL_TRACE(glProgramUniform2f, "Piff", glProgramUniform2f(a.u(0), a.i(1), a.f(2), a.f(3)))
+XE_GL_TRACE(glProgramUniform3f, "Pifff", glProgramUniform3f(a.u(0), a.i(1), a.f(2), a.f(3), a.f(4)))
+XE_GL_TRACE(glProgramUniform4f, "Piffff", glProgramUniform4f(a.u(0), a.i(1), a.f(2), a.f(3), a.f(4), a.f(5)))
+XE_GL_TRACE(glProgramUniform1i, "Pii", glProgramUniform1i(a.u(0), a.i(1), a.i(2)))
+XE_GL_TRACE(glProgramUniform1ui, "Pii", glProgramUniform1ui(a.u(0), a.i(1), a.u(2)))
+XE_GL_TRACE(glProgramUniform1fv, "Piib", glProgramUniform1fv(a.u(0), a.i(1), a.i(2), a.fv(3)))
+XE_GL_TRACE(glProgramUniform2fv, "Piib", glProgramUniform2fv(a.u(0), a.i(1), a.i(2), a.fv(3)))
+XE_GL_TRACE(glProgramUniform3fv, "Piib", glProgramUniform3fv(a.u(0), a.i(1), a.i(2), a.fv(3)))
+XE_GL_TRACE(glProgramUniform4fv, "Piib", glProgramUniform4fv(a.u(0), a.i(1), a.i(2), a.fv(3)))
+XE_GL_TRACE(glProgramUniform1iv, "Piib", glProgramUniform1iv(a.u(0), a.i(1), a.i(2), a.iv(3)))
+XE_GL_TRACE(glProgramUniformMatrix3fv, "Piiib",
+            glProgramUniformMatrix3fv(a.u(0), a.i(1), a.i(2), a.u(3), a.fv(4)))
+XE_GL_TRACE(glProgramUniformMatrix4fv, "Piiib",
+            glProgramUniformMatrix4fv(a.u(0), a.i(1), a.i(2), a.u(3), a.fv(4)))
+XE_GL_TRACE(glQueryCounter, "Qi", glQueryCounter(a.u(0), a.u(1)))
+XE_GL_TRACE(glReadBuffer, "i", glReadBuffer(a.u(0)))
+XE_GL_TRACE(glReadPixels, "iiiiiix", glReadPixels(a.i(0), a.i(1), a.i(2), a.i(3), a.u(4), a.u(5), a.out_p(6)))
+XE_GL_TRACE(glRenderbufferStorage, "iiii", glRenderbufferStorage(a.u(0), a.u(1), a.i(2), a.i(3)))
+XE_GL_TRACE(glSamplerParameterf, "Mif", glSamplerParameterf(a.u(0), a.u(1), a.f(2)))
+XE_GL_TRACE(glSamplerParameteri, "Mii", glSamplerParameteri(a.u(0), a.u(1), a.i(2)))
+XE_GL_TRACE(glScissor, "iiii", glScissor(a.i(0), a.i(1), a.i(2), a.i(3)))
+XE_GL_TRACE(glShaderSource, "Ss", a.shader_source())
+XE_GL_TRACE(glStencilFunc, "iii", glStencilFunc(a.u(0), a.i(1), a.u(2)))
+XE_GL_TRACE(glStencilMask, "i", glStencilMask(a.u(0)))
+XE_GL_TRACE(glStencilOp, "iii", glStencilOp(a.u(0), a.u(1), a.u(2)))
+XE_GL_TRACE(glTexImage2D, "iiiiiiiix",
+            glTexImage2D(a.u(0), a.i(1), a.i(2), a.i(3), a.i(4), a.i(5), a.u(6), a.u(7), a.p(8)))
+XE_GL_TRACE(glTexParameterf, "iif", glTexParameterf(a.u(0), a.u(1), a.f(2)))
+XE_GL_TRACE(glTexParameteri, "iii", glTexParameteri(a.u(0), a.u(1), a.i(2)))
+XE_GL_TRACE(glTexStorage2D, "iiiii", glTexStorage2D(a.u(0), a.i(1), a.u(2), a.i(3), a.i(4)))
+XE_GL_TRACE(glTexSubImage2D, "iiiiiiiix",
+            glTexSubImage2D(a.u(0), a.i(1), a.i(2), a.i(3), a.i(4), a.i(5), a.u(6), a.u(7), a.p(8)))
+XE_GL_TRACE(glTextureParameterf, "Tif", glTextureParameterf(a.u(0), a.u(1), a.f(2)))
+XE_GL_TRACE(glTextureParameteri, "Tii", glTextureParameteri(a.u(0), a.u(1), a.i(2)))
+XE_GL_TRACE(glTextureStorage2D, "Tiiii", glTextureStorage2D(a.u(0), a.i(1), a.u(2), a.i(3), a.i(4)))
+XE_GL_TRACE(glTextureStorage3D, "Tiiiii", glTextureStorage3D(a.u(0), a.i(1), a.u(2), a.i(3), a.i(4), a.i(5)))
+XE_GL_TRACE(glTextureSubImage2D, "Tiiiiiiix",
+            glTextureSubImage2D(a.u(0), a.i(1), a.i(2), a.i(3), a.i(4), a.i(5), a.u(6), a.u(7), a.p(8)))
+XE_GL_TRACE(glTextureSubImage3D, "Tiiiiiiiiix",
+            glTextureSubImage3D(a.u(0), a.i(1), a.i(2), a.i(3), a.i(4), a.i(5), a.i(6), a.i(7), a.u(8), a.u(9),
+                                a.p(10)))
+XE_GL_TRACE(glUniform1f, "if", glUniform1f(a.i(0), a.f(1)))
+XE_GL_TRACE(glUniform2f, "iff", glUniform2f(a.i(0), a.f(1), a.f(2)))
+XE_GL_TRACE(glUniform3f, "ifff", glUniform3f(a.i(0), a.f(1), a.f(2), a.f(3)))
+XE_GL_TRACE(glUniform4f, "iffff", glUniform4f(a.i(0), a.f(1), a.f(2), a.f(3), a.f(4)))
+XE_GL_TRACE(glUniform1i, "ii", glUniform1i(a.i(0), a.i(1)))
+XE_GL_TRACE(glUniform1fv, "iib", glUniform1fv(a.i(0), a.i(1), a.fv(2)))
+XE_GL_TRACE(glUniform3fv, "iib", glUniform3fv(a.i(0), a.i(1), a.fv(2)))
+XE_GL_TRACE(glUniform4fv, "iib", glUniform4fv(a.i(0), a.i(1), a.fv(2)))
+XE_GL_TRACE(glUniform1iv, "iib", glUniform1iv(a.i(0), a.i(1), a.iv(2)))
+XE_GL_TRACE(glUniformMatrix3fv, "iiib", glUniformMatrix3fv(a.i(0), a.i(1), a.u(2), a.fv(3)))
+XE_GL_TRACE(glUniformMatrix4fv, "iiib", glUniformMatrix4fv(a.i(0), a.i(1), a.u(2), a.fv(3)))
+XE_GL_TRACE(glUseProgram, "P", glUseProgram(a.u(0)))
+XE_GL_TRACE(glVertexArrayAttribBinding, "Vii", glVertexArrayAttribBinding(a.u(0), a.u(1), a.u(2)))
+XE_GL_TRACE(glVertexArrayAttribFormat, "Viiiii",
+            glVertexArrayAttribFormat(a.u(0), a.u(1), a.i(2), a.u(3), a.u(4), a.u(5)))
+XE_GL_TRACE(glVertexArrayElementBuffer, "VB", glVertexArrayElementBuffer(a.u(0), a.u(1)))
+XE_GL_TRACE(glVertexArrayVertexBuffer, "ViBli", glVertexArrayVertexBuffer(a.u(0), a.u(1), a.u(2), a.l(3), a.i(4)))
+XE_GL_TRACE(glVertexAttribDivisor, "ii", glVertexAttribDivisor(a.u(0), a.u(1)))
+XE_GL_TRACE(glVertexAttribIPointer, "iiiip", glVertexAttribIPointer(a.u(0), a.i(1), a.u(2), a.i(3), a.p(4)))
+XE_GL_TRACE(glVertexAttribPointer, "iiiiip",
+            glVertexAttribPointer(a.u(0), a.i(1), a.u(2), a.u(3), a.i(4), a.p(5)))
+XE_GL_TRACE(glViewport, "iiii", glViewport(a.i(0), a.i(1), a.i(2), a.i(3)))
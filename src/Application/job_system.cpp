@@ -0,0 +1,186 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "job_system.h"
+
+#include "spdlog/spdlog.h"
+
+namespace {
+    // Index of the worker running on this thread, -1 for the other threads.
+    thread_local int worker_index = -1;
+}
+
+namespace xe {
+
+    JobSystem *JobSystem::instance_ = nullptr;
+    unsigned JobSystem::requested_workers_ = 0;
+
+    JobSystem &JobSystem::instance() {
+        if (!instance_)
+            instance_ = new JobSystem;
+        return *instance_;
+    }
+
+    void JobSystem::set_worker_count(unsigned n) {
+        if (instance_)
+            SPDLOG_WARN("The job system is already running with {} workers", instance_->worker_count());
+        requested_workers_ = n;
+    }
+
+    JobSystem::JobSystem() {
+        auto n = requested_workers_;
+        if (n == 0)
+            n = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        // A single worker at least, jobs nobody waits for would never run otherwise.
+        n = std::max(n, 1u);
+        for (unsigned i = 0; i < n; i++)
+            queues_.push_back(std::make_unique<Worker>());
+        for (unsigned i = 0; i < n; i++)
+            workers_.emplace_back(&JobSystem::worker_loop, this, i);
+        SPDLOG_DEBUG("JobSystem: {} workers", n);
+    }
+
+    JobSystem::~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto &worker: workers_)
+            worker.join();
+        if (queued_ > 0)
+            SPDLOG_WARN("JobSystem: {} jobs were never run", queued_.load());
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    JobHandle JobSystem::run(job_t job, const JobHandle *first, const JobHandle *last) {
+        auto counter = std::make_shared<jobs::Counter>(1);
+        auto j = new jobs::Job{std::move(job), counter};
+        j->waiting = 1;
+        for (auto it = first; it != last; ++it) {
+            auto &handle = *it;
+            if (handle.done())
+                continue;
+            std::lock_guard<std::mutex> lock(handle.counter_->mutex);
+            if (!handle.counter_->done) {
+                j->waiting++;
+                handle.counter_->continuations.push_back(j);
+            }
+        }
+        release(j);
+        return JobHandle(counter);
+    }
+
+    void JobSystem::release(jobs::Job *job) {
+        if (--job->waiting == 0)
+            push(job);
+    }
+
+    void JobSystem::push(jobs::Job *job) {
+        {
+            // Counted before the job is published, so pop() never takes the counter below zero. Taking the
+            // lock orders the increment with the sleeping threads' check, no wake up is lost.
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            queued_++;
+        }
+        if (worker_index >= 0) {
+            auto &queue = *queues_[worker_index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        } else {
+            std::lock_guard<std::mutex> lock(shared_mutex_);
+            shared_.push_back(job);
+        }
+        wake_.notify_one();
+    }
+
+    jobs::Job *JobSystem::pop(int index) {
+        jobs::Job *job = nullptr;
+        if (index >= 0) {
+            auto &queue = *queues_[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+        }
+        if (!job) {
+            std::lock_guard<std::mutex> lock(shared_mutex_);
+            if (!shared_.empty()) {
+                job = shared_.front();
+                shared_.pop_front();
+            }
+        }
+        // Stealing starts at the next worker, so the thieves do not all go after the same deque.
+        auto n = static_cast<int>(queues_.size());
+        for (int k = 1; !job && k <= n; k++) {
+            auto victim = (std::max(index, 0) + k) % n;
+            if (victim == index)
+                continue;
+            auto &queue = *queues_[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+        }
+        if (job)
+            queued_--;
+        return job;
+    }
+
+    void JobSystem::execute(jobs::Job *job) {
+        job->function();
+        auto counter = job->counter;
+        delete job;
+
+        if (counter->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        std::vector<jobs::Job *> continuations;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            counter->done = true;
+            continuations.swap(counter->continuations);
+        }
+        for (auto continuation: continuations)
+            release(continuation);
+
+        bool waiters;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            waiters = waiters_ > 0;
+        }
+        if (waiters)
+            wake_.notify_all();
+    }
+
+    void JobSystem::wait(const JobHandle &handle) {
+        while (!handle.done()) {
+            if (auto job = pop(worker_index)) {
+                execute(job);
+                continue;
+            }
+            // Nothing to run, sleeps until a job is queued or a handle (maybe this one) is done.
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            waiters_++;
+            wake_.wait(lock, [this, &handle] { return handle.done() || queued_ > 0; });
+            waiters_--;
+        }
+    }
+
+    void JobSystem::worker_loop(unsigned index) {
+        worker_index = static_cast<int>(index);
+        while (true) {
+            if (auto job = pop(worker_index)) {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+            if (stop_)
+                break;
+        }
+    }
+}
@@ -0,0 +1,190 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RegisteredObject.h"
+
+namespace xe {
+
+    class JobSystem;
+
+    namespace jobs {
+        struct Job;
+
+        // Number of unfinished jobs behind a handle and the jobs waiting for them.
+        struct Counter {
+            explicit Counter(int n) : unfinished(n) {}
+
+            std::atomic<int> unfinished;
+            std::mutex mutex;
+            bool done = false;
+            std::vector<Job *> continuations;
+        };
+
+        struct Job {
+            std::function<void()> function;
+            std::shared_ptr<Counter> counter;
+            // Unfinished dependencies, plus one held while the job is being set up.
+            std::atomic<int> waiting{0};
+        };
+    }
+
+    /**
+     * @brief Refers to one or more scheduled jobs, cheap to copy.
+     *
+     * An empty handle is always done.
+     */
+    class JobHandle {
+    public:
+        JobHandle() = default;
+
+        bool done() const { return !counter_ || counter_->unfinished.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+
+        explicit JobHandle(std::shared_ptr<jobs::Counter> counter) : counter_(std::move(counter)) {}
+
+        std::shared_ptr<jobs::Counter> counter_;
+    };
+
+    /**
+     * @brief Fixed pool of worker threads running short CPU jobs.
+     *
+     * Every worker owns a deque: it pushes and pops its own jobs at the back (the most recent job is the one
+     * whose data is still in the cache) and, when the deque is empty, steals the oldest jobs from the front
+     * of the other deques. Jobs scheduled from other threads go into a shared queue. Idle workers sleep.
+     *
+     * A job can depend on other handles, it is queued only once all of them are done, so chains of work need
+     * no waiting thread. wait() runs queued jobs until the handle is done and sleeps only when there is
+     * nothing to run, so jobs may wait for the jobs they start and the main thread adds to the pool instead
+     * of idling.
+     *
+     * The pool is created on the first instance() call with worker_count() threads, see
+     * Application::run_cli (--job-threads). Jobs must not call GL, only the main thread has a context.
+     */
+    class JobSystem : public RegisteredObject {
+    public:
+        using job_t = std::function<void()>;
+
+        static JobSystem &instance();
+
+        ~JobSystem() override;
+
+        // 0 (the default) uses a worker per hardware thread but one, which is left to the main thread.
+        // Has to be set before the first instance() call.
+        static void set_worker_count(unsigned n);
+
+        unsigned worker_count() const { return static_cast<unsigned>(workers_.size()); }
+
+        // Threads running jobs, the workers and the thread calling wait().
+        unsigned concurrency() const { return worker_count() + 1; }
+
+        JobHandle run(job_t job) { return run(std::move(job), nullptr, nullptr); }
+
+        // Runs the job once all the handles are done.
+        JobHandle run(job_t job, std::initializer_list<JobHandle> after) {
+            return run(std::move(job), after.begin(), after.end());
+        }
+
+        JobHandle run(job_t job, const std::vector<JobHandle> &after) {
+            return run(std::move(job), after.data(), after.data() + after.size());
+        }
+
+        // Runs queued jobs until the handle is done.
+        void wait(const JobHandle &handle);
+
+        /**
+         * Calls body(i) for every i in [begin, end) on all threads and returns when all calls are done.
+         *
+         * The range is handed out in chunks of decreasing size: each grab takes a share of the remaining
+         * indices proportional to the number of threads, but at least min_chunk of them. Big chunks at the
+         * start keep the overhead low, small ones at the end balance uneven iterations.
+         */
+        template<typename F>
+        void parallel_for(size_t begin, size_t end, F &&body, size_t min_chunk = 1);
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<jobs::Job *> jobs;
+        };
+
+        JobSystem();
+
+        JobHandle run(job_t job, const JobHandle *first, const JobHandle *last);
+
+        void worker_loop(unsigned index);
+
+        void push(jobs::Job *job);
+
+        jobs::Job *pop(int index);
+
+        void execute(jobs::Job *job);
+
+        // Queues the job when it is no longer waiting for anything.
+        void release(jobs::Job *job);
+
+        static JobSystem *instance_;
+        static unsigned requested_workers_;
+
+        std::vector<std::unique_ptr<Worker>> queues_;
+        std::vector<std::thread> workers_;
+        std::mutex shared_mutex_;
+        std::deque<jobs::Job *> shared_;
+
+        std::atomic<size_t> queued_{0};
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        // Threads sleeping in wait(), woken when a handle is done. Guarded by sleep_mutex_.
+        int waiters_ = 0;
+        bool stop_ = false;
+    };
+
+    template<typename F>
+    void JobSystem::parallel_for(size_t begin, size_t end, F &&body, size_t min_chunk) {
+        if (begin >= end)
+            return;
+        min_chunk = std::max<size_t>(min_chunk, 1);
+        auto n_threads = static_cast<size_t>(concurrency());
+        auto n_helpers = std::min(n_threads, (end - begin + min_chunk - 1) / min_chunk) - 1;
+
+        std::atomic<size_t> next(begin);
+        auto loop = [&]() {
+            auto i = next.load(std::memory_order_relaxed);
+            while (i < end) {
+                auto chunk = std::max(min_chunk, (end - i) / (2 * n_threads));
+                if (!next.compare_exchange_weak(i, std::min(end, i + chunk), std::memory_order_relaxed))
+                    continue;
+                for (auto last = std::min(end, i + chunk); i < last; i++)
+                    body(i);
+                i = next.load(std::memory_order_relaxed);
+            }
+        };
+        if (n_helpers == 0) {
+            loop();
+            return;
+        }
+
+        // The helpers share one counter, the caller works too and then waits for them.
+        auto counter = std::make_shared<jobs::Counter>(static_cast<int>(n_helpers));
+        for (size_t h = 0; h < n_helpers; h++)
+            push(new jobs::Job{loop, counter});
+        loop();
+        wait(JobHandle(counter));
+    }
+}
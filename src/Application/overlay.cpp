@@ -0,0 +1,47 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "overlay.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "imgui.h"
+
+namespace {
+    struct Panel {
+        int id;
+        std::string name;
+        xe::overlay::panel_t draw;
+    };
+
+    std::vector<Panel> &panels() {
+        static std::vector<Panel> panels_;
+        return panels_;
+    }
+
+    int next_id = 0;
+}
+
+namespace xe {
+    namespace overlay {
+        int add_panel(const std::string &name, panel_t panel) {
+            panels().push_back({next_id, name, std::move(panel)});
+            return next_id++;
+        }
+
+        void remove_panel(int id) {
+            auto &p = panels();
+            p.erase(std::remove_if(p.begin(), p.end(), [id](const Panel &panel) { return panel.id == id; }), p.end());
+        }
+
+        void draw_panels() {
+            for (auto &panel: panels()) {
+                ImGui::Separator();
+                if (ImGui::CollapsingHeader(panel.name.c_str(), ImGuiTreeNodeFlags_DefaultOpen))
+                    panel.draw();
+            }
+        }
+    }
+}
@@ -0,0 +1,26 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+namespace xe {
+    /**
+     * @brief Additional panels shown in the ImGui overlay drawn by xe::Application::loop.
+     *
+     * Subsystems that want to show their statistics register a callback that issues ImGui calls.
+     * The callbacks are invoked every frame inside the overlay window, in the order of registration.
+     */
+    namespace overlay {
+        using panel_t = std::function<void()>;
+
+        int add_panel(const std::string &name, panel_t panel);
+
+        void remove_panel(int id);
+
+        void draw_panels();
+    }
+}
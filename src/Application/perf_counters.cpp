@@ -0,0 +1,241 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#endif
+
+#include "spdlog/spdlog.h"
+#include "imgui.h"
+
+#include "overlay.h"
+
+namespace {
+    uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+#ifdef __linux__
+    const uint64_t EVENTS[xe::PerfCounters::N_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    // The counter group of one thread.
+    struct Group {
+        Group() {
+            for (int i = 0; i < xe::PerfCounters::N_COUNTERS; i++) {
+                perf_event_attr attr = {};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = EVENTS[i];
+                attr.disabled = leader < 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                   PERF_FORMAT_TOTAL_TIME_RUNNING;
+                auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+                if (fd < 0)
+                    continue;
+                if (leader < 0)
+                    leader = fd;
+                else
+                    fds.push_back(fd);
+                slots[n_open++] = i;
+            }
+            if (leader < 0) {
+                static std::atomic<bool> warned{false};
+                if (!warned.exchange(true))
+                    SPDLOG_WARN("No hardware counters available (perf_event_paranoid?), measuring the wall time only");
+                return;
+            }
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        ~Group() {
+            for (auto fd: fds)
+                close(fd);
+            if (leader >= 0)
+                close(leader);
+        }
+
+        void read_into(xe::PerfCounters::Sample &sample) const {
+            if (leader < 0)
+                return;
+            uint64_t data[3 + xe::PerfCounters::N_COUNTERS];
+            if (::read(leader, data, sizeof(data)) < static_cast<ssize_t>((3 + n_open) * sizeof(uint64_t)))
+                return;
+            sample.time_enabled = data[1];
+            sample.time_running = data[2];
+            for (int i = 0; i < n_open; i++) {
+                sample.values[slots[i]] = data[3 + i];
+                sample.valid |= 1u << slots[i];
+            }
+        }
+
+        int leader = -1;
+        std::vector<int> fds;
+        // The counter read in the i-th place.
+        int slots[xe::PerfCounters::N_COUNTERS] = {};
+        int n_open = 0;
+    };
+#endif
+}
+
+namespace xe {
+
+    PerfCounters *PerfCounters::instance_ = nullptr;
+    std::atomic<bool> PerfCounters::enabled_{false};
+
+    PerfCounters &PerfCounters::instance() {
+        if (!instance_)
+            instance_ = new PerfCounters;
+        return *instance_;
+    }
+
+    PerfCounters::PerfCounters() {
+        overlay_panel_ = overlay::add_panel("Perf counters", [this]() { draw_overlay(); });
+    }
+
+    PerfCounters::~PerfCounters() {
+        overlay::remove_panel(overlay_panel_);
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    bool PerfCounters::available() {
+#ifdef __linux__
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void PerfCounters::set_enabled(bool enabled) {
+        if (enabled && !available())
+            SPDLOG_WARN("Hardware counters need Linux perf_event_open, measuring the wall time only");
+        // Created here, the scopes may end on any thread.
+        if (enabled)
+            instance();
+        enabled_ = enabled;
+    }
+
+    const char *PerfCounters::counter_name(Counter counter) {
+        switch (counter) {
+            case cycles:
+                return "cycles";
+            case instructions:
+                return "instructions";
+            case cache_misses:
+                return "cache misses";
+            case branch_misses:
+                return "branch misses";
+            default:
+                return "?";
+        }
+    }
+
+    PerfCounters::Sample PerfCounters::read() {
+        Sample sample;
+#ifdef __linux__
+        thread_local Group group;
+        group.read_into(sample);
+#endif
+        // Last, so the read above is not timed.
+        sample.ns = now_ns();
+        return sample;
+    }
+
+    void PerfCounters::add(const char *name, const Sample &start, const Sample &end, uint64_t elements) {
+        auto valid = start.valid & end.valid;
+        auto enabled = end.time_enabled - start.time_enabled;
+        auto running = end.time_running - start.time_running;
+        // The counters ran only part of the time when the kernel multiplexed them.
+        auto scale = running > 0 ? static_cast<double>(enabled) / running : 0.0;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &s = stats_[name];
+        s.name = name;
+        s.calls++;
+        s.elements += elements;
+        s.ns += end.ns - start.ns;
+        s.valid |= valid;
+        for (int i = 0; i < N_COUNTERS; i++) {
+            if (valid & (1u << i))
+                s.counts[i] += (end.values[i] - start.values[i]) * scale;
+        }
+    }
+
+    std::vector<PerfCounters::Stats> PerfCounters::stats() const {
+        std::vector<Stats> result;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &[name, s]: stats_)
+                result.push_back(s);
+        }
+        std::sort(result.begin(), result.end(), [](const Stats &a, const Stats &b) { return a.ns > b.ns; });
+        return result;
+    }
+
+    void PerfCounters::log_summary() const {
+        auto all = stats();
+        if (all.empty())
+            return;
+        SPDLOG_INFO("Perf counters:");
+        for (auto &s: all) {
+            if (!s.valid) {
+                SPDLOG_INFO("  {:<24} {:>6} calls {:>9.3f} ms", s.name, s.calls, s.ns * 1e-6);
+                continue;
+            }
+            auto per = s.elements > 0 ? "element" : "call";
+            SPDLOG_INFO("  {:<24} {:>6} calls {:>9.3f} ms, IPC {:.2f}, {:.3f} cache misses and {:.3f} branch misses "
+                        "per {}", s.name, s.calls, s.ns * 1e-6, s.ipc(), s.per_element(cache_misses),
+                        s.per_element(branch_misses), per);
+        }
+    }
+
+    void PerfCounters::draw_overlay() {
+        bool enabled = enabled_;
+        if (ImGui::Checkbox("Read hardware counters", &enabled))
+            set_enabled(enabled);
+        if (ImGui::BeginTable("perf_counters", 5)) {
+            ImGui::TableSetupColumn("scope");
+            ImGui::TableSetupColumn("ms/call");
+            ImGui::TableSetupColumn("IPC");
+            ImGui::TableSetupColumn("cache miss/el");
+            ImGui::TableSetupColumn("branch miss/el");
+            ImGui::TableHeadersRow();
+            for (auto &s: stats()) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(s.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", s.ns * 1e-6 / s.calls);
+                if (!s.valid)
+                    continue;
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", s.ipc());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", s.per_element(cache_misses));
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", s.per_element(branch_misses));
+            }
+            ImGui::EndTable();
+        }
+    }
+}
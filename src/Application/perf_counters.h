@@ -0,0 +1,130 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "RegisteredObject.h"
+#include "profiler.h"
+
+namespace xe {
+
+    /**
+     * @brief Hardware performance counters of named CPU scopes (Linux perf_event_open).
+     *
+     * Every thread opens its own group of counters (cycles, instructions, cache misses, branch misses) the
+     * first time it enters a scope, user space only, so it works with the default perf_event_paranoid of 2.
+     * A scope reads the group when it starts and ends and adds the difference to the totals of its name,
+     * scaled by the time the group was actually counting when the kernel multiplexes the counters. With
+     * the number of elements the scope processed (vertices, texels, ...) the report shows the misses per
+     * element, so layouts can be compared by their cache behaviour and not only by the wall time.
+     *
+     * Counters that the CPU (or the VM) does not have are left out, on other systems only the wall time is
+     * measured. Off until enabled, then a scope costs two read() calls.
+     */
+    class PerfCounters : public RegisteredObject {
+    public:
+        enum Counter {
+            cycles,
+            instructions,
+            cache_misses,
+            branch_misses,
+            N_COUNTERS
+        };
+
+        struct Sample {
+            uint64_t ns = 0;
+            uint64_t time_enabled = 0;
+            uint64_t time_running = 0;
+            std::array<uint64_t, N_COUNTERS> values = {};
+            // Bit i set when the counter i is counting on this thread.
+            unsigned valid = 0;
+        };
+
+        struct Stats {
+            const char *name = nullptr;
+            uint64_t calls = 0;
+            uint64_t elements = 0;
+            uint64_t ns = 0;
+            std::array<double, N_COUNTERS> counts = {};
+            unsigned valid = 0;
+
+            double ipc() const { return counts[cycles] > 0 ? counts[instructions] / counts[cycles] : 0.0; }
+
+            // Per element, per call when the scope did not count elements.
+            double per_element(Counter counter) const {
+                auto n = elements > 0 ? elements : calls;
+                return n > 0 ? counts[counter] / n : 0.0;
+            }
+        };
+
+        static PerfCounters &instance();
+
+        ~PerfCounters() override;
+
+        // Compiled for Linux, the counters themselves may still be unavailable.
+        static bool available();
+
+        static void set_enabled(bool enabled);
+
+        static bool enabled() { return enabled_; }
+
+        // This thread's counters, opened on the first call.
+        static Sample read();
+
+        void add(const char *name, const Sample &start, const Sample &end, uint64_t elements);
+
+        // Sorted by the time spent.
+        std::vector<Stats> stats() const;
+
+        void log_summary() const;
+
+        void draw_overlay();
+
+        static const char *counter_name(Counter counter);
+
+    private:
+        PerfCounters();
+
+        static PerfCounters *instance_;
+        static std::atomic<bool> enabled_;
+
+        mutable std::mutex mutex_;
+        // Keyed by the name pointer, scope names are string literals.
+        std::unordered_map<const char *, Stats> stats_;
+        int overlay_panel_ = -1;
+    };
+
+    class PerfScope {
+    public:
+        PerfScope(const char *name, uint64_t elements) : name_(name), elements_(elements), profile_(name) {
+            if (PerfCounters::enabled())
+                start_ = PerfCounters::read();
+        }
+
+        ~PerfScope() {
+            if (PerfCounters::enabled() && start_.ns)
+                PerfCounters::instance().add(name_, start_, PerfCounters::read(), elements_);
+        }
+
+    private:
+        const char *name_;
+        uint64_t elements_;
+        PerfCounters::Sample start_;
+        ProfileScope profile_;
+    };
+}
+
+#ifdef XE_PROFILER
+// A CPU profiling scope that also reads the hardware counters, elements is the amount of work done in it.
+#define XE_PERF_SCOPE(name, elements) xe::PerfScope XE_PROFILE_CONCAT(xe_perf_scope_, __LINE__)(name, elements)
+#else
+#define XE_PERF_SCOPE(name, elements)
+#endif
@@ -0,0 +1,388 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "spdlog/spdlog.h"
+#include "imgui.h"
+
+#include "overlay.h"
+#include "utils.h"
+
+namespace {
+    // Written by one thread, drained by the GL thread in Profiler::end_frame.
+    struct ThreadRing {
+        static const size_t CAPACITY = 1u << 13;
+
+        explicit ThreadRing(uint32_t thread) : thread(thread) {}
+
+        void push(const xe::Profiler::Event &event) {
+            auto h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) == CAPACITY) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            events[h % CAPACITY] = event;
+            head.store(h + 1, std::memory_order_release);
+        }
+
+        template<typename F>
+        void drain(F &&f) {
+            auto t = tail.load(std::memory_order_relaxed);
+            auto h = head.load(std::memory_order_acquire);
+            for (; t != h; ++t)
+                f(events[t % CAPACITY]);
+            tail.store(h, std::memory_order_release);
+        }
+
+        const uint32_t thread;
+        std::array<xe::Profiler::Event, CAPACITY> events;
+        std::atomic<size_t> head{0};
+        std::atomic<size_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    struct Rings {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadRing>> rings;
+    };
+
+    Rings &rings() {
+        static Rings rings_;
+        return rings_;
+    }
+
+    thread_local ThreadRing *thread_ring_ = nullptr;
+    thread_local uint32_t depth_ = 0;
+
+    // The only lock is taken once per thread, on its first event.
+    ThreadRing &thread_ring() {
+        if (!thread_ring_) {
+            auto &r = rings();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.rings.push_back(std::make_unique<ThreadRing>(static_cast<uint32_t>(r.rings.size())));
+            thread_ring_ = r.rings.back().get();
+        }
+        return *thread_ring_;
+    }
+
+    std::atomic<bool> enabled_flag{true};
+
+    ImU32 event_color(const char *name) {
+        auto hash = std::hash<std::string>()(name);
+        return ImColor::HSV(static_cast<float>(hash % 360) / 360.0f, 0.45f, 0.85f);
+    }
+
+    void write_json_string(std::ostream &out, const char *s) {
+        out << '"';
+        for (; *s; ++s) {
+            if (*s == '"' || *s == '\\')
+                out << '\\';
+            out << *s;
+        }
+        out << '"';
+    }
+}
+
+namespace xe {
+
+    Profiler *Profiler::instance_ = nullptr;
+
+    Profiler &Profiler::instance() {
+        if (!instance_)
+            instance_ = new Profiler;
+        return *instance_;
+    }
+
+    uint64_t Profiler::now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Profiler::Profiler() {
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        gpu_supported_ = bits > 0;
+        if (!gpu_supported_)
+            SPDLOG_WARN("Timestamp queries are not supported, GPU scopes are not timed");
+        overlay_panel_ = overlay::add_panel("Profiler", [this]() { draw_overlay(); });
+    }
+
+    Profiler::~Profiler() {
+        for (auto &gpu_frame: gpu_frames_) {
+            for (auto &scope: gpu_frame.scopes)
+                glDeleteQueries(2, scope.queries);
+        }
+        overlay::remove_panel(overlay_panel_);
+        if (instance_ == this)
+            instance_ = nullptr;
+    }
+
+    bool Profiler::enabled() {
+        return enabled_flag.load(std::memory_order_relaxed);
+    }
+
+    void Profiler::set_enabled(bool enabled) {
+        enabled_flag.store(enabled, std::memory_order_relaxed);
+    }
+
+    void Profiler::record_cpu(const char *name, uint64_t start_ns, uint64_t end_ns, uint32_t depth) {
+        if (!enabled_flag.load(std::memory_order_relaxed))
+            return;
+        auto &ring = thread_ring();
+        ring.push({name, start_ns, end_ns, depth, ring.thread});
+    }
+
+    void Profiler::begin_frame() {
+        if (!enabled())
+            return;
+        auto now = now_ns();
+
+        // This pool was used N_GPU_FRAMES frames ago, its queries should be done by now.
+        auto &gpu_frame = gpu_frames_[frame_index_ % N_GPU_FRAMES];
+        if (gpu_frame.pending)
+            collect_gpu_frame(gpu_frame);
+        gpu_frame.index = frame_index_;
+        gpu_frame.used = 0;
+        gpu_frame.pending = false;
+        if (gpu_supported_) {
+            GLint64 gpu_now = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+            gpu_frame.gpu_to_cpu_ns = static_cast<int64_t>(now) - gpu_now;
+        }
+
+        if (!paused_) {
+            frames_.push_back({frame_index_, now, now, {}, {}});
+            while (frames_.size() > history_size_)
+                frames_.pop_front();
+        }
+    }
+
+    void Profiler::end_frame() {
+        if (!enabled())
+            return;
+        if (!gpu_stack_.empty()) {
+            SPDLOG_WARN("Profiler: {} GPU scopes still open at the end of the frame", gpu_stack_.size());
+            gpu_stack_.clear();
+        }
+        collect_cpu_events();
+
+        auto &gpu_frame = gpu_frames_[frame_index_ % N_GPU_FRAMES];
+        gpu_frame.pending = gpu_frame.used > 0;
+        if (auto frame = find_frame(frame_index_))
+            frame->end_ns = now_ns();
+        frame_index_++;
+    }
+
+    void Profiler::begin_gpu(const char *name) {
+        if (!enabled() || !gpu_supported_) {
+            gpu_stack_.push_back(SIZE_MAX);
+            return;
+        }
+        auto &gpu_frame = gpu_frames_[frame_index_ % N_GPU_FRAMES];
+        if (gpu_frame.used == gpu_frame.scopes.size()) {
+            GpuScope scope{};
+            OGL_CALL(glGenQueries(2, scope.queries));
+            gpu_frame.scopes.push_back(scope);
+        }
+        auto &scope = gpu_frame.scopes[gpu_frame.used];
+        scope.name = name;
+        scope.depth = static_cast<uint32_t>(gpu_stack_.size());
+        OGL_CALL(glQueryCounter(scope.queries[0], GL_TIMESTAMP));
+        gpu_stack_.push_back(gpu_frame.used++);
+    }
+
+    void Profiler::end_gpu() {
+        if (gpu_stack_.empty())
+            return;
+        auto index = gpu_stack_.back();
+        gpu_stack_.pop_back();
+        if (index == SIZE_MAX)
+            return;
+        auto &gpu_frame = gpu_frames_[frame_index_ % N_GPU_FRAMES];
+        if (index < gpu_frame.used) {
+            OGL_CALL(glQueryCounter(gpu_frame.scopes[index].queries[1], GL_TIMESTAMP));
+        }
+    }
+
+    void Profiler::collect_pending_gpu() {
+        for (auto &gpu_frame: gpu_frames_) {
+            if (gpu_frame.pending)
+                collect_gpu_frame(gpu_frame);
+        }
+    }
+
+    void Profiler::collect_cpu_events() {
+        auto frame = paused_ ? nullptr : find_frame(frame_index_);
+        auto &r = rings();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (auto &ring: r.rings) {
+            ring->drain([frame](const Event &event) {
+                if (frame)
+                    frame->cpu.push_back(event);
+            });
+        }
+    }
+
+    void Profiler::collect_gpu_frame(GpuFrame &gpu_frame) {
+        gpu_frame.pending = false;
+        for (size_t i = 0; i < gpu_frame.used; i++) {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(gpu_frame.scopes[i].queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                dropped_gpu_ += gpu_frame.used;
+                return;
+            }
+        }
+
+        auto frame = find_frame(gpu_frame.index);
+        if (!frame)
+            return;
+        for (size_t i = 0; i < gpu_frame.used; i++) {
+            const auto &scope = gpu_frame.scopes[i];
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(scope.queries[0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(scope.queries[1], GL_QUERY_RESULT, &end);
+            frame->gpu.push_back({scope.name, start + gpu_frame.gpu_to_cpu_ns, end + gpu_frame.gpu_to_cpu_ns,
+                                  scope.depth, GPU_THREAD});
+        }
+    }
+
+    Profiler::Frame *Profiler::find_frame(uint64_t index) {
+        // Indices have gaps while paused.
+        auto it = std::lower_bound(frames_.begin(), frames_.end(), index,
+                                   [](const Frame &frame, uint64_t i) { return frame.index < i; });
+        return it != frames_.end() && it->index == index ? &*it : nullptr;
+    }
+
+    uint64_t Profiler::dropped_events() const {
+        uint64_t dropped = dropped_gpu_;
+        auto &r = rings();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (auto &ring: r.rings)
+            dropped += ring->dropped.load(std::memory_order_relaxed);
+        return dropped;
+    }
+
+    bool Profiler::write_chrome_trace(const std::string &path) const {
+        std::ofstream out(path);
+        if (!out) {
+            SPDLOG_ERROR("Cannot write trace to `{}'", path);
+            return false;
+        }
+        const uint64_t origin = frames_.empty() ? 0 : frames_.front().start_ns;
+        auto us = [origin](uint64_t ns) { return static_cast<double>(static_cast<int64_t>(ns - origin)) / 1000.0; };
+
+        // CPU threads are one process, the GPU is another.
+        out << "{\"traceEvents\":[\n";
+        out << R"({"name":"process_name","ph":"M","pid":1,"tid":0,"args":{"name":"CPU"}},)" << "\n";
+        out << R"({"name":"process_name","ph":"M","pid":2,"tid":0,"args":{"name":"GPU"}})";
+        auto write_event = [&](const Event &event, const char *category) {
+            bool gpu = event.thread == GPU_THREAD;
+            out << ",\n{\"name\":";
+            write_json_string(out, event.name);
+            out << ",\"cat\":\"" << category << "\",\"ph\":\"X\",\"ts\":" << us(event.start_ns)
+                << ",\"dur\":" << static_cast<double>(event.end_ns - event.start_ns) / 1000.0
+                << ",\"pid\":" << (gpu ? 2 : 1) << ",\"tid\":" << (gpu ? 0 : event.thread) << "}";
+        };
+        out.precision(3);
+        out << std::fixed;
+        for (const auto &frame: frames_) {
+            out << ",\n{\"name\":\"frame " << frame.index << "\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":"
+                << us(frame.start_ns) << ",\"dur\":" << static_cast<double>(frame.end_ns - frame.start_ns) / 1000.0
+                << ",\"pid\":1,\"tid\":0}";
+            for (const auto &event: frame.cpu)
+                write_event(event, "cpu");
+            for (const auto &event: frame.gpu)
+                write_event(event, "gpu");
+        }
+        out << "\n]}\n";
+        SPDLOG_INFO("Wrote {} frames of trace to `{}'", frames_.size(), path);
+        return true;
+    }
+
+    void Profiler::draw_overlay() {
+        ImGui::Checkbox("Pause", &paused_);
+        ImGui::SameLine();
+        if (ImGui::Button("Save trace")) {
+            write_chrome_trace("trace_" + std::to_string(trace_n_++) + ".json");
+        }
+
+        // The newest frame with GPU results, GPU timings arrive N_GPU_FRAMES frames late.
+        const Frame *frame = nullptr;
+        for (auto it = frames_.rbegin(); it != frames_.rend(); ++it) {
+            if (!it->gpu.empty() || (!gpu_supported_ && it->end_ns > it->start_ns)) {
+                frame = &*it;
+                break;
+            }
+        }
+        if (!frame) {
+            ImGui::Text("No complete frames");
+            return;
+        }
+
+        uint64_t gpu_start = UINT64_MAX, gpu_end = 0, end = frame->end_ns;
+        for (const auto &event: frame->gpu) {
+            gpu_start = std::min(gpu_start, event.start_ns);
+            gpu_end = std::max(gpu_end, event.end_ns);
+        }
+        end = std::max(end, gpu_end);
+        ImGui::Text("Frame %llu CPU %.3f ms GPU %.3f ms", static_cast<unsigned long long>(frame->index),
+                    (frame->end_ns - frame->start_ns) * 1e-6, gpu_end > gpu_start ? (gpu_end - gpu_start) * 1e-6 : 0.0);
+        if (auto dropped = dropped_events())
+            ImGui::Text("Dropped events: %llu", static_cast<unsigned long long>(dropped));
+
+        // One row per thread and nesting depth, the GPU rows come last.
+        std::map<uint64_t, int> rows;
+        for (const auto &event: frame->cpu)
+            rows[(static_cast<uint64_t>(event.thread) << 32) | event.depth] = 0;
+        for (const auto &event: frame->gpu)
+            rows[(static_cast<uint64_t>(GPU_THREAD) << 32) | event.depth] = 0;
+        int n_rows = 0;
+        for (auto &row: rows)
+            row.second = n_rows++;
+
+        const float width = std::max(ImGui::GetContentRegionAvail().x, 300.0f);
+        const float row_height = ImGui::GetTextLineHeight() + 2.0f;
+        const double span = static_cast<double>(std::max<uint64_t>(end - frame->start_ns, 1));
+        auto origin = ImGui::GetCursorScreenPos();
+        auto draw_list = ImGui::GetWindowDrawList();
+
+        auto draw_event = [&](const Event &event) {
+            auto row = rows[(static_cast<uint64_t>(event.thread) << 32) | event.depth];
+            auto x0 = origin.x + static_cast<float>((static_cast<int64_t>(event.start_ns - frame->start_ns)) / span * width);
+            auto x1 = origin.x + static_cast<float>((static_cast<int64_t>(event.end_ns - frame->start_ns)) / span * width);
+            x0 = std::max(x0, origin.x);
+            x1 = std::min(std::max(x1, x0 + 1.0f), origin.x + width);
+            ImVec2 a(x0, origin.y + row * row_height), b(x1, origin.y + (row + 1) * row_height - 1.0f);
+            draw_list->AddRectFilled(a, b, event_color(event.name));
+            if (ImGui::CalcTextSize(event.name).x < x1 - x0 - 4.0f)
+                draw_list->AddText(ImVec2(x0 + 2.0f, a.y), IM_COL32_BLACK, event.name);
+            if (ImGui::IsMouseHoveringRect(a, b))
+                ImGui::SetTooltip("%s%s %.3f ms", event.thread == GPU_THREAD ? "GPU " : "", event.name,
+                                  (event.end_ns - event.start_ns) * 1e-6);
+        };
+        for (const auto &event: frame->cpu)
+            draw_event(event);
+        for (const auto &event: frame->gpu)
+            draw_event(event);
+        ImGui::Dummy(ImVec2(width, n_rows * row_height));
+    }
+
+    ProfileScope::ProfileScope(const char *name) : name_(name), start_(Profiler::now_ns()) {
+        depth_++;
+    }
+
+    ProfileScope::~ProfileScope() {
+        depth_--;
+        Profiler::record_cpu(name_, start_, Profiler::now_ns(), depth_);
+    }
+}
@@ -0,0 +1,168 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "glad/gl.h"
+
+#include "RegisteredObject.h"
+#include "frame_pacer.h"
+
+namespace xe {
+
+    /**
+     * @brief CPU and GPU frame profiler.
+     *
+     * Scopes are marked with the macros below, names must be string literals (only the pointer is stored).
+     * CPU scopes can be used on any thread: each thread writes finished scopes into its own single producer,
+     * single consumer ring buffer, which the GL thread drains in end_frame(). A full ring drops events
+     * instead of waiting.
+     *
+     * GPU scopes use GL_TIMESTAMP query pairs, so unlike GL_TIME_ELAPSED they can nest. Each frame has its own
+     * pool and the pools are reused N_GPU_FRAMES frames later, one more than the frames the CPU may run ahead
+     * (see FramePacer); results that are still not available are dropped rather than waited for, so reading
+     * them never stalls the pipeline.
+     *
+     * The last history_size() frames are kept for the overlay timeline and can be written as a Chrome trace
+     * (chrome://tracing, ui.perfetto.dev).
+     */
+    class Profiler : public RegisteredObject {
+    public:
+        struct Event {
+            const char *name;
+            uint64_t start_ns;
+            uint64_t end_ns;
+            uint32_t depth;
+            uint32_t thread;
+        };
+
+        struct Frame {
+            uint64_t index;
+            uint64_t start_ns;
+            uint64_t end_ns;
+            std::vector<Event> cpu;
+            std::vector<Event> gpu;
+        };
+
+        static const int N_GPU_FRAMES = FramePacer::MAX_FRAMES_IN_FLIGHT + 1;
+        static const uint32_t GPU_THREAD = 0xffffffffu;
+
+        static Profiler &instance();
+
+        ~Profiler() override;
+
+        static bool enabled();
+
+        static void set_enabled(bool enabled);
+
+        // Called by the application around every frame, on the GL thread.
+        void begin_frame();
+
+        void end_frame();
+
+        void begin_gpu(const char *name);
+
+        void end_gpu();
+
+        // Collects the GPU timings of the last frames, once the GPU has finished them.
+        void collect_pending_gpu();
+
+        // Thread safe, does not need the instance.
+        static void record_cpu(const char *name, uint64_t start_ns, uint64_t end_ns, uint32_t depth);
+
+        const std::deque<Frame> &frames() const { return frames_; }
+
+        size_t history_size() const { return history_size_; }
+
+        void set_history_size(size_t size) { history_size_ = size; }
+
+        uint64_t dropped_events() const;
+
+        bool write_chrome_trace(const std::string &path) const;
+
+        void draw_overlay();
+
+        static uint64_t now_ns();
+
+    private:
+        struct GpuScope {
+            const char *name;
+            GLuint queries[2];
+            uint32_t depth;
+        };
+
+        struct GpuFrame {
+            uint64_t index = 0;
+            std::vector<GpuScope> scopes;
+            size_t used = 0;
+            bool pending = false;
+            int64_t gpu_to_cpu_ns = 0;
+        };
+
+        Profiler();
+
+        void collect_cpu_events();
+
+        void collect_gpu_frame(GpuFrame &gpu_frame);
+
+        Frame *find_frame(uint64_t index);
+
+        static Profiler *instance_;
+
+        size_t history_size_ = 240;
+        uint64_t frame_index_ = 0;
+        std::deque<Frame> frames_;
+
+        std::array<GpuFrame, N_GPU_FRAMES> gpu_frames_;
+        std::vector<size_t> gpu_stack_;
+        bool gpu_supported_ = true;
+        uint64_t dropped_gpu_ = 0;
+
+        int overlay_panel_ = -1;
+        bool paused_ = false;
+        int trace_n_ = 0;
+    };
+
+    class ProfileScope {
+    public:
+        explicit ProfileScope(const char *name);
+
+        ~ProfileScope();
+
+    private:
+        const char *name_;
+        uint64_t start_;
+    };
+
+    class GpuProfileScope {
+    public:
+        explicit GpuProfileScope(const char *name) : cpu_(name) { Profiler::instance().begin_gpu(name); }
+
+        ~GpuProfileScope() { Profiler::instance().end_gpu(); }
+
+    private:
+        ProfileScope cpu_;
+    };
+}
+
+#define XE_PROFILE_CONCAT_(a, b) a##b
+#define XE_PROFILE_CONCAT(a, b) XE_PROFILE_CONCAT_(a, b)
+
+#ifdef XE_PROFILER
+// Times the enclosing scope on the CPU.
+#define XE_PROFILE_SCOPE(name) xe::ProfileScope XE_PROFILE_CONCAT(xe_profile_scope_, __LINE__)(name)
+// Times the enclosing scope on the CPU and the GL commands issued in it on the GPU, GL thread only.
+#define XE_PROFILE_GPU_SCOPE(name) xe::GpuProfileScope XE_PROFILE_CONCAT(xe_profile_scope_, __LINE__)(name)
+#define XE_PROFILE_FUNCTION() XE_PROFILE_SCOPE(__func__)
+#else
+#define XE_PROFILE_SCOPE(name)
+#define XE_PROFILE_GPU_SCOPE(name)
+#define XE_PROFILE_FUNCTION()
+#endif
@@ -0,0 +1,469 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "program_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "file_watcher.h"
+#include "shader_preprocessor.h"
+#include "shader_source.h"
+#include "uniforms.h"
+
+#ifndef XE_PROGRAM_CACHE_DIR
+#define XE_PROGRAM_CACHE_DIR "program_cache"
+#endif
+
+// GL_KHR_parallel_shader_compile, same values as the ARB extension.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace {
+    // FNV-1a, good enough to tell shader sources apart and stable across runs and platforms.
+    uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+        auto bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    uint64_t hash_string(uint64_t hash, const std::string &str) {
+        auto size = static_cast<uint64_t>(str.size());
+        hash = hash_bytes(hash, &size, sizeof(size));
+        return hash_bytes(hash, str.data(), str.size());
+    }
+
+    using max_shader_compiler_threads_t = void (GLAD_API_PTR *)(GLuint count);
+
+    const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+
+    const uint32_t BINARY_MAGIC = 0x42505845u; // "EXPB"
+    const uint32_t BINARY_VERSION = 1u;
+
+    struct BinaryHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+}
+
+namespace xe {
+
+    namespace {
+        // The name may be reused by the next program, so the reflection cached for it has to go.
+        void delete_program(GLuint program) {
+            forget_reflection(program);
+            glDeleteProgram(program);
+        }
+    }
+
+    ProgramCache *ProgramCache::instance_ = nullptr;
+
+    ProgramCache &ProgramCache::instance() {
+        if (!instance_)
+            instance_ = new ProgramCache;
+        return *instance_;
+    }
+
+    ProgramCache::ProgramCache() : dir_(XE_PROGRAM_CACHE_DIR) {
+        driver_ = utils::get_gl_vendor() + "|" + utils::get_gl_renderer() + "|" + utils::get_gl_version();
+        GLint n_formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+        binaries_supported_ = n_formats > 0;
+
+        // The loader is generated without extensions, the single entry point we need is fetched by hand.
+        GLint n_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+        std::string max_threads_name;
+        for (GLint i = 0; i < n_extensions; i++) {
+            auto name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+            if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0) {
+                max_threads_name = "glMaxShaderCompilerThreadsKHR";
+                break;
+            }
+            if (std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0)
+                max_threads_name = "glMaxShaderCompilerThreadsARB";
+        }
+        if (!max_threads_name.empty()) {
+            parallel_compile_ = true;
+            auto max_threads = reinterpret_cast<max_shader_compiler_threads_t>(
+                    glfwGetProcAddress(max_threads_name.c_str()));
+            // 0xFFFFFFFF lets the driver use as many threads as it wants.
+            if (max_threads)
+                max_threads(0xFFFFFFFFu);
+        }
+        SPDLOG_DEBUG("ProgramCache: directory `{}', {} program binary formats, parallel compile {}", dir_, n_formats,
+                     parallel_compile_);
+    }
+
+    ProgramCache::~ProgramCache() {
+        for (auto &reload: reloads_)
+            discard(*reload.replacement);
+        for (auto &[key, program]: programs_) {
+            for (auto [type, shader]: program->shaders_)
+                glDeleteShader(shader);
+            if (program->program_)
+                delete_program(program->program_);
+        }
+        if (instance_ == this)
+            instance_ = nullptr;
+        SPDLOG_DEBUG("ProgramCache: {} memory hits, {} disk hits, {} rejected binaries, {} compiled, {} failed",
+                     stats_.memory_hits, stats_.disk_hits, stats_.disk_rejected, stats_.compiled, stats_.failed);
+    }
+
+    GLuint ProgramCache::program(const utils::shader_source_map_t &shader_paths, const std::string &defines) {
+        auto program = program_async(shader_paths, defines);
+        wait(program);
+        return program->failed() ? 0u : program->program_;
+    }
+
+    void ProgramCache::wait(AsyncProgram *program) {
+        // It stays in pending_ until the next update(), which skips finished programs.
+        if (program->pending())
+            complete(*program);
+    }
+
+    uint64_t ProgramCache::prepare(const utils::shader_source_map_t &shader_paths, const std::string &defines,
+                                   std::map<GLenum, utils::source_t> &sources, std::vector<std::string> &files,
+                                   bool &loaded) const {
+        uint64_t key = hash_string(hash_string(FNV_OFFSET, driver_), defines);
+        loaded = true;
+        for (const auto &[type, path]: shader_paths) {
+            auto preprocessed = utils::preprocess_shader(path, defines);
+            files.insert(files.end(), preprocessed.files.begin(), preprocessed.files.end());
+            if (!preprocessed.ok) {
+                loaded = false;
+                continue;
+            }
+            // One string per stage, the driver does not care about lines.
+            auto &source = sources[type];
+            source.push_back_string(preprocessed.source);
+#ifdef __APPLE__
+            source.replace_version("410");
+#endif
+        }
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+
+        for (const auto &[type, source]: sources) {
+            std::ostringstream text;
+            text << source;
+            key = hash_bytes(key, &type, sizeof(type));
+            key = hash_string(key, text.str());
+        }
+        return key;
+    }
+
+    void ProgramCache::build(AsyncProgram &program, std::map<GLenum, utils::source_t> &sources, bool loaded) {
+        if (!loaded) {
+            program.failed_ = true;
+            stats_.failed++;
+        } else if ((program.program_ = load_binary(program.key_))) {
+            program.ready_ = true;
+            stats_.disk_hits++;
+            check_blocks(program.program_);
+        } else {
+            // Nothing is queried here, so the driver is free to compile and link in the background.
+            program.program_ = glCreateProgram();
+            for (auto &[type, source]: sources) {
+                auto shader = glCreateShader(type);
+                glShaderSource(shader, static_cast<GLsizei>(source.size()), source.data(), nullptr);
+                glCompileShader(shader);
+                glAttachShader(program.program_, shader);
+                program.shaders_[type] = shader;
+            }
+            if (binaries_supported_)
+                glProgramParameteri(program.program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            glLinkProgram(program.program_);
+            pending_.push_back(&program);
+        }
+    }
+
+    AsyncProgram *ProgramCache::program_async(const utils::shader_source_map_t &shader_paths,
+                                              const std::string &defines, GLuint fallback) {
+        // Ordered, so the key does not depend on the iteration order of the unordered map.
+        std::map<GLenum, utils::source_t> sources;
+        std::vector<std::string> files;
+        bool loaded;
+        auto key = prepare(shader_paths, defines, sources, files, loaded);
+
+        auto it = programs_.find(key);
+        if (it != programs_.end()) {
+            stats_.memory_hits++;
+            if (fallback && !it->second->fallback_)
+                it->second->fallback_ = fallback;
+            return it->second.get();
+        }
+
+        auto program = std::make_unique<AsyncProgram>();
+        program->key_ = key;
+        program->fallback_ = fallback;
+        program->shader_paths_ = shader_paths;
+        program->defines_ = defines;
+        program->files_ = std::move(files);
+        build(*program, sources, loaded);
+
+        auto result = program.get();
+        programs_[key] = std::move(program);
+        if (FileWatcher::instance().enabled())
+            watch(result);
+        return result;
+    }
+
+    void ProgramCache::watch(AsyncProgram *program) {
+        auto &watcher = FileWatcher::instance();
+        for (auto id: program->watch_ids_)
+            watcher.unwatch(id);
+        program->watch_ids_.clear();
+        for (const auto &file: program->files_)
+            program->watch_ids_.push_back(watcher.watch(file, [this, program]() { reload(program); }));
+    }
+
+    void ProgramCache::discard(AsyncProgram &program) {
+        pending_.erase(std::remove(pending_.begin(), pending_.end(), &program), pending_.end());
+        for (auto [type, shader]: program.shaders_)
+            glDeleteShader(shader);
+        program.shaders_.clear();
+        if (program.program_)
+            delete_program(program.program_);
+        program.program_ = 0u;
+    }
+
+    void ProgramCache::reload(AsyncProgram *program) {
+        std::map<GLenum, utils::source_t> sources;
+        std::vector<std::string> files;
+        bool loaded;
+        auto key = prepare(program->shader_paths_, program->defines_, sources, files, loaded);
+
+        // A newer edit supersedes a reload still compiling.
+        auto it = std::find_if(reloads_.begin(), reloads_.end(),
+                               [program](const Reload &reload) { return reload.target == program; });
+        if (it != reloads_.end()) {
+            discard(*it->replacement);
+            reloads_.erase(it);
+        }
+        if (key == program->key_)
+            return;
+
+        auto replacement = std::make_unique<AsyncProgram>();
+        replacement->key_ = key;
+        replacement->files_ = std::move(files);
+        build(*replacement, sources, loaded);
+        reloads_.push_back({program, std::move(replacement)});
+    }
+
+    void ProgramCache::finish_reload(AsyncProgram &target, AsyncProgram &replacement) {
+        if (replacement.failed()) {
+            SPDLOG_ERROR("Program reload failed, keeping the last good version");
+            return;
+        }
+
+        // Loading the new binary into the old program object keeps its name, so code holding on to it (or
+        // having it bound) picks up the change. Uniforms of the default block are reset as after any link.
+        bool transferred = false;
+        if (target.program_ && binaries_supported_) {
+            GLint length = 0;
+            glGetProgramiv(replacement.program_, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length > 0) {
+                std::vector<char> binary(length);
+                GLenum format;
+                glGetProgramBinary(replacement.program_, length, &length, &format, binary.data());
+                glProgramBinary(target.program_, format, binary.data(), length);
+                GLint status = GL_FALSE;
+                glGetProgramiv(target.program_, GL_LINK_STATUS, &status);
+                transferred = status == GL_TRUE;
+            }
+        }
+        if (transferred) {
+            delete_program(replacement.program_);
+        } else {
+            if (target.program_)
+                delete_program(target.program_);
+            target.program_ = replacement.program_;
+            SPDLOG_DEBUG("Reloaded program got a new name {}", target.program_);
+        }
+        replacement.program_ = 0u;
+        forget_reflection(target.program_);
+        target.ready_ = true;
+        target.failed_ = false;
+
+        // If the new sources match another program the entry keeps the old key, only lookups suffer.
+        if (programs_.find(replacement.key_) == programs_.end()) {
+            auto node = programs_.extract(target.key_);
+            node.key() = replacement.key_;
+            programs_.insert(std::move(node));
+            target.key_ = replacement.key_;
+        }
+        if (target.files_ != replacement.files_) {
+            target.files_ = replacement.files_;
+            watch(&target);
+        }
+        SPDLOG_INFO("Program reloaded");
+    }
+
+    void ProgramCache::complete(AsyncProgram &program) {
+        auto linked = utils::check_link_status(program.program_);
+        for (auto [type, shader]: program.shaders_) {
+            if (!linked)
+                utils::check_compile_status(shader, type);
+            glDetachShader(program.program_, shader);
+            glDeleteShader(shader);
+        }
+        program.shaders_.clear();
+
+        if (linked) {
+            program.ready_ = true;
+            stats_.compiled++;
+            store_binary(program.key_, program.program_);
+            check_blocks(program.program_);
+        } else {
+            delete_program(program.program_);
+            program.program_ = 0u;
+            program.failed_ = true;
+            stats_.failed++;
+        }
+    }
+
+    void ProgramCache::update() {
+        if (pending_.empty() && reloads_.empty())
+            return;
+        int blocking = 0;
+        for (auto program: pending_) {
+            // Finished by wait() since the last update.
+            if (!program->pending())
+                continue;
+            if (parallel_compile_) {
+                GLint done = GL_FALSE;
+                glGetProgramiv(program->program_, GL_COMPLETION_STATUS_KHR, &done);
+                if (done)
+                    complete(*program);
+            } else if (blocking < max_blocking_per_update_) {
+                complete(*program);
+                blocking++;
+            }
+        }
+        pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+                                      [](const AsyncProgram *program) { return !program->pending(); }),
+                       pending_.end());
+
+        for (auto it = reloads_.begin(); it != reloads_.end();) {
+            if (it->replacement->pending()) {
+                ++it;
+                continue;
+            }
+            finish_reload(*it->target, *it->replacement);
+            it = reloads_.erase(it);
+        }
+    }
+
+    void ProgramCache::finish() {
+        for (auto program: pending_) {
+            if (program->pending())
+                complete(*program);
+        }
+        pending_.clear();
+    }
+
+    void ProgramCache::check_blocks(GLuint program) {
+        if (blocks_.empty())
+            return;
+        for (const auto &block: reflect(program).blocks) {
+            auto it = blocks_.find(block.name);
+            if (it != blocks_.end())
+                it->second(block);
+        }
+    }
+
+    ProgramCache::Stats ProgramCache::stats() const {
+        auto stats = stats_;
+        stats.pending = std::count_if(pending_.begin(), pending_.end(),
+                                      [](const AsyncProgram *program) { return program->pending(); });
+        return stats;
+    }
+
+    std::string ProgramCache::binary_path(uint64_t key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(dir_) / name).string();
+    }
+
+    GLuint ProgramCache::load_binary(uint64_t key) {
+        if (dir_.empty() || !binaries_supported_)
+            return 0;
+        std::ifstream file(binary_path(key), std::ios::binary);
+        if (!file)
+            return 0;
+
+        BinaryHeader header{};
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!file || header.magic != BINARY_MAGIC || header.version != BINARY_VERSION || header.key != key)
+            return 0;
+        std::vector<char> binary(header.length);
+        file.read(binary.data(), header.length);
+        if (!file)
+            return 0;
+
+        auto program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (!status) {
+            // Not an error: the driver is free to reject binaries, e.g. after an update.
+            SPDLOG_DEBUG("Program binary `{}' rejected by the driver, recompiling", binary_path(key));
+            delete_program(program);
+            stats_.disk_rejected++;
+            return 0;
+        }
+        return program;
+    }
+
+    void ProgramCache::store_binary(uint64_t key, GLuint program) const {
+        if (dir_.empty() || !binaries_supported_)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        if (ec) {
+            SPDLOG_WARN("Cannot create program cache directory `{}': {}", dir_, ec.message());
+            return;
+        }
+        // Written under a temporary name first, so a concurrently starting process never reads half a file.
+        auto path = binary_path(key);
+        auto tmp_path = path + ".tmp";
+        {
+            std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+            BinaryHeader header{BINARY_MAGIC, BINARY_VERSION, key, format, static_cast<uint32_t>(length)};
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(binary.data(), length);
+            if (!file) {
+                SPDLOG_WARN("Cannot write program binary `{}'", tmp_path);
+                return;
+            }
+        }
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec)
+            SPDLOG_WARN("Cannot write program binary `{}': {}", path, ec.message());
+    }
+}
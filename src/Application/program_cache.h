@@ -0,0 +1,184 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glad/gl.h"
+
+#include "RegisteredObject.h"
+#include "shader_source.h"
+#include "uniforms.h"
+#include "utils.h"
+
+namespace xe {
+
+    /**
+     * @brief A program that may still be compiling. Until it is ready program() returns the fallback.
+     */
+    class AsyncProgram {
+    public:
+        GLuint program() const { return ready_ ? program_ : fallback_; }
+
+        bool ready() const { return ready_; }
+
+        bool failed() const { return failed_; }
+
+        bool pending() const { return !ready_ && !failed_; }
+
+        void set_fallback(GLuint fallback) { fallback_ = fallback; }
+
+        // Source files of all stages including the included ones.
+        const std::vector<std::string> &files() const { return files_; }
+
+    private:
+        friend class ProgramCache;
+
+        uint64_t key_ = 0;
+        GLuint program_ = 0u;
+        GLuint fallback_ = 0u;
+        utils::shader_source_map_t shader_paths_;
+        std::string defines_;
+        utils::shader_map_t shaders_;
+        std::vector<std::string> files_;
+        std::vector<int> watch_ids_;
+        bool ready_ = false;
+        bool failed_ = false;
+    };
+
+    /**
+     * @brief Cache of linked programs, in memory and on disk.
+     *
+     * Programs are identified by a hash of the preprocessed sources (see utils::preprocess_shader), the shader
+     * stages, the defines and the vendor, renderer and version strings of the driver. Requesting the same
+     * program twice in one run returns the same object. Linked binaries are stored with glGetProgramBinary and
+     * restored with glProgramBinary in later runs; a binary the driver does not accept anymore (e.g. after a
+     * driver update) is silently replaced by a fresh compilation.
+     *
+     * program_async() only submits the compilation and linking and never queries their status, so the driver
+     * can work on all the submitted programs at once. update() polls them: with GL_KHR_parallel_shader_compile
+     * (or the ARB variant) through GL_COMPLETION_STATUS_KHR without blocking, otherwise by finishing at most
+     * max_blocking_per_update() programs per call, which spreads the cost over several frames.
+     *
+     * With hot reload enabled (see FileWatcher) every program watches its source files, including the
+     * included ones. A changed program is rebuilt in the background; once it links, it is loaded into the
+     * existing program object, so its name stays valid. If the new version does not compile the last good
+     * one stays in use.
+     *
+     * Blocks registered with register_block() are checked against every program that is completed, loaded from
+     * the disk or reloaded and uses them, a mismatch is logged by check_block_layout.
+     *
+     * utils::create_program goes through this cache, programs it returns must not be deleted by the caller.
+     */
+    class ProgramCache : public RegisteredObject {
+    public:
+        struct Stats {
+            size_t memory_hits = 0;
+            size_t disk_hits = 0;
+            size_t disk_rejected = 0;
+            size_t compiled = 0;
+            size_t failed = 0;
+            size_t pending = 0;
+        };
+
+        static ProgramCache &instance();
+
+        ~ProgramCache() override;
+
+        // Directory holding the binaries, empty disables the disk cache.
+        void set_directory(const std::string &dir) { dir_ = dir; }
+
+        const std::string &directory() const { return dir_; }
+
+        bool parallel_compile() const { return parallel_compile_; }
+
+        // defines are inserted after the #version line of every stage, e.g. "#define SHADOWS 1\n".
+        GLuint program(const utils::shader_source_map_t &shader_paths, const std::string &defines = "");
+
+        // The returned object is owned by the cache and lives as long as the cache.
+        AsyncProgram *program_async(const utils::shader_source_map_t &shader_paths, const std::string &defines = "",
+                                    GLuint fallback = 0u);
+
+        // Polls the pending programs, call once per frame.
+        void update();
+
+        // Blocks until the program is finished.
+        void wait(AsyncProgram *program);
+
+        // Blocks until all submitted programs are finished.
+        void finish();
+
+        // True while programs or reloads are still compiling, update() then has work to do.
+        bool busy() const { return !pending_.empty() || !reloads_.empty(); }
+
+        // D describes the block like layout::Mirror does, see BlockBuffer. Register before creating the programs.
+        template<layout::Packing P, typename D>
+        void register_block(const std::string &name) {
+            blocks_[name] = [](const BlockInfo &block) { check_block_layout<P, D>(block); };
+        }
+
+        void set_max_blocking_per_update(int n) { max_blocking_per_update_ = n; }
+
+        int max_blocking_per_update() const { return max_blocking_per_update_; }
+
+        Stats stats() const;
+
+    private:
+        ProgramCache();
+
+        std::string binary_path(uint64_t key) const;
+
+        GLuint load_binary(uint64_t key);
+
+        void store_binary(uint64_t key, GLuint program) const;
+
+        struct Reload {
+            AsyncProgram *target;
+            std::unique_ptr<AsyncProgram> replacement;
+        };
+
+        // Preprocesses the sources and computes the key of the program.
+        uint64_t prepare(const utils::shader_source_map_t &shader_paths, const std::string &defines,
+                         std::map<GLenum, utils::source_t> &sources, std::vector<std::string> &files,
+                         bool &loaded) const;
+
+        // Loads the binary from the disk cache or submits the compilation.
+        void build(AsyncProgram &program, std::map<GLenum, utils::source_t> &sources, bool loaded);
+
+        // Queries the link status (blocking if the program is not completed yet) and finishes the program.
+        void complete(AsyncProgram &program);
+
+        void discard(AsyncProgram &program);
+
+        // Runs the layout checks of the registered blocks the linked program uses.
+        void check_blocks(GLuint program);
+
+        void watch(AsyncProgram *program);
+
+        void reload(AsyncProgram *program);
+
+        void finish_reload(AsyncProgram &target, AsyncProgram &replacement);
+
+        static ProgramCache *instance_;
+
+        std::string dir_;
+        std::string driver_;
+        bool binaries_supported_ = false;
+        bool parallel_compile_ = false;
+        int max_blocking_per_update_ = 1;
+
+        std::unordered_map<uint64_t, std::unique_ptr<AsyncProgram>> programs_;
+        std::vector<AsyncProgram *> pending_;
+        std::vector<Reload> reloads_;
+        std::unordered_map<std::string, std::function<void(const BlockInfo &)>> blocks_;
+        Stats stats_;
+    };
+}
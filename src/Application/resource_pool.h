@@ -0,0 +1,213 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "RegisteredObject.h"
+
+namespace xe {
+
+    /**
+     * @brief Refers to an object in a ResourcePool.
+     *
+     * The slot index is paired with the generation of the slot, so a handle to a destroyed object is detected
+     * even when the slot holds a new one.
+     */
+    template<typename T>
+    struct Handle {
+        uint32_t index = 0xffffffffu;
+        uint32_t generation = 0;
+
+        bool operator==(const Handle &other) const {
+            return index == other.index && generation == other.generation;
+        }
+
+        bool operator!=(const Handle &other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief Reference counted objects of one type stored in pages of slots.
+     *
+     * Pages are never moved or freed before the pool, so pointers stay valid while the object lives and a
+     * destroyed object's slot is reused by the next one: streaming resources in and out allocates only when
+     * the number of live objects reaches a new peak. create() returns a handle with one reference, the
+     * object is destroyed when release() drops the last one. Objects holding GL names should hand them over
+     * to DeletionQueue in their destructors.
+     *
+     * There is one pool per type, deleted with the other registered objects. Objects created in a pool are
+     * owned by it and removed from the RegisteredObject registry. Not thread safe: keep the Refs on the main
+     * thread and hand Handles, which are plain values, to jobs. get() may be called from jobs while the main
+     * thread does not create or release objects (e.g. during ecs::Scheduler::run).
+     */
+    template<typename T>
+    class ResourcePool : public RegisteredObject {
+    public:
+        static const size_t PAGE_SIZE = 256;
+
+        static ResourcePool &instance() {
+            if (!instance_)
+                instance_ = new ResourcePool;
+            return *instance_;
+        }
+
+        static bool exists() { return instance_ != nullptr; }
+
+        ~ResourcePool() override {
+            for (uint32_t i = 0; i < n_slots_; i++) {
+                if (slot(i).refs > 0)
+                    object(i)->~T();
+            }
+            if (instance_ == this)
+                instance_ = nullptr;
+        }
+
+        template<typename... Args>
+        Handle<T> create(Args &&... args) {
+            uint32_t index;
+            if (free_ != NONE) {
+                index = free_;
+                free_ = slot(index).next_free;
+            } else {
+                if (n_slots_ == pages_.size() * PAGE_SIZE)
+                    pages_.push_back(std::make_unique<Slot[]>(PAGE_SIZE));
+                index = n_slots_++;
+            }
+            auto &s = slot(index);
+            auto p = new(s.storage) T(std::forward<Args>(args)...);
+            if constexpr (std::is_base_of_v<RegisteredObject, T>)
+                RegisteredObject::remove(p);
+            s.refs = 1;
+            size_++;
+            return {index, s.generation};
+        }
+
+        // nullptr when the handle is stale.
+        T *get(Handle<T> handle) const {
+            if (!alive(handle))
+                return nullptr;
+            return object(handle.index);
+        }
+
+        bool alive(Handle<T> handle) const {
+            return handle.index < n_slots_ && slot(handle.index).generation == handle.generation &&
+                   slot(handle.index).refs > 0;
+        }
+
+        void retain(Handle<T> handle) {
+            if (alive(handle))
+                slot(handle.index).refs++;
+        }
+
+        void release(Handle<T> handle) {
+            if (!alive(handle))
+                return;
+            auto &s = slot(handle.index);
+            if (--s.refs > 0)
+                return;
+            object(handle.index)->~T();
+            s.generation++;
+            s.next_free = free_;
+            free_ = handle.index;
+            size_--;
+        }
+
+        uint32_t refs(Handle<T> handle) const { return alive(handle) ? slot(handle.index).refs : 0; }
+
+        // Live objects.
+        size_t size() const { return size_; }
+
+        size_t capacity() const { return pages_.size() * PAGE_SIZE; }
+
+    private:
+        static constexpr uint32_t NONE = 0xffffffffu;
+
+        struct Slot {
+            alignas(T) std::byte storage[sizeof(T)];
+            uint32_t generation = 0;
+            uint32_t refs = 0;
+            uint32_t next_free = NONE;
+        };
+
+        ResourcePool() = default;
+
+        Slot &slot(uint32_t index) const { return pages_[index / PAGE_SIZE][index % PAGE_SIZE]; }
+
+        T *object(uint32_t index) const { return std::launder(reinterpret_cast<T *>(slot(index).storage)); }
+
+        static ResourcePool *instance_;
+
+        std::vector<std::unique_ptr<Slot[]>> pages_;
+        uint32_t n_slots_ = 0;
+        uint32_t free_ = NONE;
+        size_t size_ = 0;
+    };
+
+    template<typename T>
+    ResourcePool<T> *ResourcePool<T>::instance_ = nullptr;
+
+    /**
+     * @brief Owning reference to an object in its ResourcePool.
+     *
+     * Copies retain the object, destruction releases it.
+     */
+    template<typename T>
+    class Ref {
+    public:
+        Ref() = default;
+
+        // Takes over the reference returned by ResourcePool::create.
+        explicit Ref(Handle<T> handle) : handle_(handle) {}
+
+        template<typename... Args>
+        static Ref make(Args &&... args) {
+            return Ref(ResourcePool<T>::instance().create(std::forward<Args>(args)...));
+        }
+
+        Ref(const Ref &other) : handle_(other.handle_) { retain(); }
+
+        Ref(Ref &&other) noexcept : handle_(std::exchange(other.handle_, Handle<T>{})) {}
+
+        Ref &operator=(Ref other) noexcept {
+            std::swap(handle_, other.handle_);
+            return *this;
+        }
+
+        ~Ref() { reset(); }
+
+        // References outliving the pool (deleted at cleanup) are dropped.
+        void reset() {
+            if (handle_ != Handle<T>{} && ResourcePool<T>::exists())
+                ResourcePool<T>::instance().release(std::exchange(handle_, Handle<T>{}));
+        }
+
+        T *get() const {
+            return handle_ == Handle<T>{} || !ResourcePool<T>::exists() ? nullptr
+                                                                      : ResourcePool<T>::instance().get(handle_);
+        }
+
+        T *operator->() const { return get(); }
+
+        T &operator*() const { return *get(); }
+
+        explicit operator bool() const { return get() != nullptr; }
+
+        Handle<T> handle() const { return handle_; }
+
+    private:
+        void retain() {
+            if (handle_ != Handle<T>{} && ResourcePool<T>::exists())
+                ResourcePool<T>::instance().retain(handle_);
+        }
+
+        Handle<T> handle_;
+    };
+}
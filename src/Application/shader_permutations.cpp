@@ -0,0 +1,35 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "shader_permutations.h"
+
+namespace xe {
+
+    std::string ShaderPermutations::defines(uint32_t key) const {
+        std::string defines;
+        for (const auto &feature: features_) {
+            defines += "#define ";
+            defines += feature.name;
+            defines += ' ';
+            defines += std::to_string(feature.value(key));
+            defines += '\n';
+        }
+        return defines;
+    }
+
+    AsyncProgram *ShaderPermutations::program_async(uint32_t key, GLuint fallback) {
+        auto it = variants_.find(key);
+        if (it != variants_.end())
+            return it->second;
+        auto program = ProgramCache::instance().program_async(shader_paths_, defines(key), fallback);
+        variants_[key] = program;
+        return program;
+    }
+
+    GLuint ShaderPermutations::program(uint32_t key) {
+        auto program = program_async(key);
+        ProgramCache::instance().wait(program);
+        return program->failed() ? 0u : program->program();
+    }
+}
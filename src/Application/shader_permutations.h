@@ -0,0 +1,70 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glad/gl.h"
+
+#include "program_cache.h"
+#include "utils.h"
+
+namespace xe {
+
+    /**
+     * @brief A field of a permutation key: bits consecutive bits starting at shift.
+     *
+     * Features are usually declared constexpr, so the keys are computed at compile time:
+     *
+     *     constexpr ShaderFeature NORMAL_MAP{"HAS_NORMAL_MAP", 0};
+     *     constexpr ShaderFeature N_LIGHTS{"N_LIGHTS", 1, 3};
+     *     constexpr uint32_t key = NORMAL_MAP() | N_LIGHTS(4);
+     *
+     * Every feature is passed to the shader as `#define NAME value`, so shaders test them with #if.
+     */
+    struct ShaderFeature {
+        const char *name;
+        uint32_t shift;
+        uint32_t bits = 1;
+
+        // Shifting a 32 bit value by 32 is undefined, so a field spanning the whole key is handled apart.
+        constexpr uint32_t mask() const { return (bits >= 32u ? ~0u : (1u << bits) - 1u) << shift; }
+
+        constexpr uint32_t operator()(uint32_t value = 1u) const { return (value << shift) & mask(); }
+
+        constexpr uint32_t value(uint32_t key) const { return (key & mask()) >> shift; }
+    };
+
+    /**
+     * @brief All the specialised variants of one set of shaders, compiled lazily on first use.
+     *
+     * Instead of branching on uniforms in an uber-shader, each combination of features is compiled into its
+     * own program. Only the combinations actually requested are compiled, through the ProgramCache, so they
+     * are also shared and persisted like any other program.
+     */
+    class ShaderPermutations {
+    public:
+        ShaderPermutations(utils::shader_source_map_t shader_paths, std::vector<ShaderFeature> features) :
+                shader_paths_(std::move(shader_paths)), features_(std::move(features)) {}
+
+        // Blocks on the first use of a key.
+        GLuint program(uint32_t key);
+
+        // Starts compiling the variant in the background, until it is ready its program() is the fallback.
+        AsyncProgram *program_async(uint32_t key, GLuint fallback = 0u);
+
+        std::string defines(uint32_t key) const;
+
+        size_t n_variants() const { return variants_.size(); }
+
+    private:
+        utils::shader_source_map_t shader_paths_;
+        std::vector<ShaderFeature> features_;
+        std::unordered_map<uint32_t, AsyncProgram *> variants_;
+    };
+}
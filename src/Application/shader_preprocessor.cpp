@@ -0,0 +1,196 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "shader_preprocessor.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "spdlog/spdlog.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    std::unordered_map<std::string, std::string> &embedded_shaders() {
+        // Function local, the registrars run during static initialisation.
+        static std::unordered_map<std::string, std::string> shaders;
+        return shaders;
+    }
+
+    std::string normalize(const fs::path &path) {
+        return path.lexically_normal().generic_string();
+    }
+
+    bool exists(const std::string &path) {
+        return fs::exists(path) || xe::utils::find_embedded_shader(path);
+    }
+
+    // The file on disk wins so hot reload sees edits, the embedded copy is only a fallback for shipped builds.
+    bool read_shader(const std::string &path, std::string &text) {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (file) {
+            std::ostringstream contents;
+            contents << file.rdbuf();
+            text = contents.str();
+            return true;
+        }
+        if (auto embedded = xe::utils::find_embedded_shader(path)) {
+            text = *embedded;
+            return true;
+        }
+        return false;
+    }
+
+    std::string trim(const std::string &text) {
+        auto begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+            return "";
+        auto end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    // Returns the directive name if the line is a preprocessor directive, the rest of the line goes into args.
+    std::string directive(const std::string &line, std::string &args) {
+        auto i = line.find_first_not_of(" \t");
+        if (i == std::string::npos || line[i] != '#')
+            return "";
+        i = line.find_first_not_of(" \t", i + 1);
+        if (i == std::string::npos)
+            return "";
+        auto end = line.find_first_of(" \t\r", i);
+        auto name = line.substr(i, end == std::string::npos ? std::string::npos : end - i);
+        args = end == std::string::npos ? "" : line.substr(end);
+        return name;
+    }
+
+    class Preprocessor {
+    public:
+        Preprocessor(const std::string &defines, const std::vector<std::string> &include_dirs) :
+                defines_(defines), include_dirs_(include_dirs) {}
+
+        bool process(const std::string &path, int depth, std::ostringstream &out) {
+            if (depth > MAX_DEPTH) {
+                SPDLOG_ERROR("Shader `{}': includes nested too deep, is there a cycle?", path);
+                return false;
+            }
+            if (once_.count(path))
+                return true;
+
+            std::string text;
+            if (!read_shader(path, text)) {
+                SPDLOG_ERROR("Cannot load shader source from `{}'", path);
+                return false;
+            }
+            auto index = static_cast<int>(files_.size());
+            files_.push_back(path);
+
+            std::istringstream lines(text);
+            std::string line, args;
+            int line_number = 0;
+            while (std::getline(lines, line)) {
+                line_number++;
+                auto name = directive(line, args);
+                if (name == "version") {
+                    if (depth == 0) {
+                        version_seen_ = true;
+                        out << line << '\n' << defines_;
+                        if (!defines_.empty() && defines_.back() != '\n')
+                            out << '\n';
+                        out << "#line " << line_number + 1 << ' ' << index << '\n';
+                    } else {
+                        out << '\n';
+                    }
+                } else if (name == "pragma" && trim(args) == "once") {
+                    once_.insert(path);
+                    out << '\n';
+                } else if (name == "include") {
+                    auto begin = args.find_first_of("\"<");
+                    auto end = begin == std::string::npos ? begin : args.find_first_of("\">", begin + 1);
+                    if (end == std::string::npos) {
+                        SPDLOG_ERROR("{}:{}: malformed #include", path, line_number);
+                        return false;
+                    }
+                    auto included = resolve(path, args.substr(begin + 1, end - begin - 1));
+                    if (included.empty()) {
+                        SPDLOG_ERROR("{}:{}: cannot find `{}'", path, line_number,
+                                     args.substr(begin + 1, end - begin - 1));
+                        return false;
+                    }
+                    out << "#line 1 " << files_.size() << '\n';
+                    if (!process(included, depth + 1, out))
+                        return false;
+                    out << "#line " << line_number + 1 << ' ' << index << '\n';
+                } else {
+                    out << line << '\n';
+                }
+            }
+            return true;
+        }
+
+        const std::vector<std::string> &files() const { return files_; }
+
+        bool version_seen() const { return version_seen_; }
+
+    private:
+        static const int MAX_DEPTH = 32;
+
+        std::string resolve(const std::string &from, const std::string &name) const {
+            auto relative = normalize(fs::path(from).parent_path() / name);
+            if (exists(relative))
+                return relative;
+            for (const auto &dir: include_dirs_) {
+                auto candidate = normalize(fs::path(dir) / name);
+                if (exists(candidate))
+                    return candidate;
+            }
+            auto engine = normalize(fs::path(ROOT_DIR) / "src/Engine/shaders" / name);
+            if (exists(engine))
+                return engine;
+            return "";
+        }
+
+        const std::string &defines_;
+        const std::vector<std::string> &include_dirs_;
+        std::vector<std::string> files_;
+        std::unordered_set<std::string> once_;
+        bool version_seen_ = false;
+    };
+}
+
+namespace xe {
+    namespace utils {
+
+        PreprocessedShader preprocess_shader(const std::string &path, const std::string &defines,
+                                             const std::vector<std::string> &include_dirs) {
+            PreprocessedShader result;
+            Preprocessor preprocessor(defines, include_dirs);
+            std::ostringstream out;
+            result.ok = preprocessor.process(normalize(path), 0, out);
+            result.source = out.str();
+            if (!preprocessor.version_seen() && !defines.empty())
+                result.source = defines + (defines.back() == '\n' ? "" : "\n") + "#line 1 0\n" + result.source;
+            result.files = preprocessor.files();
+            return result;
+        }
+
+        void register_embedded_shader(const std::string &path, const char *text, size_t size) {
+            embedded_shaders()[normalize(path)] = std::string(text, size);
+        }
+
+        const std::string *find_embedded_shader(const std::string &path) {
+            auto &shaders = embedded_shaders();
+            if (shaders.empty())
+                return nullptr;
+            auto it = shaders.find(normalize(path));
+            return it == shaders.end() ? nullptr : &it->second;
+        }
+
+        size_t embedded_shaders_count() {
+            return embedded_shaders().size();
+        }
+    }
+}
@@ -0,0 +1,62 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace xe {
+    namespace utils {
+
+        /**
+         * @brief Result of preprocess_shader.
+         *
+         * files lists the root file and all included files, the index of a file is also the source string
+         * number used in the #line directives, so compiler messages like 0(12) or 2(7) can be mapped back.
+         */
+        struct PreprocessedShader {
+            std::string source;
+            std::vector<std::string> files;
+            bool ok = false;
+        };
+
+        /**
+         * @brief Resolves #include directives and injects defines.
+         *
+         * `#include "file"` is searched for relative to the including file, then in include_dirs and finally in
+         * the engine shader directory. Files containing `#pragma once` are included only once, classic #ifndef
+         * guards work as usual since they are handled by the GLSL compiler. The defines are inserted right after
+         * the #version line of the root file; #version lines of included files are dropped.
+         *
+         * Files registered with register_embedded_shader are read from memory when they are missing on disk.
+         */
+        PreprocessedShader preprocess_shader(const std::string &path, const std::string &defines = "",
+                                             const std::vector<std::string> &include_dirs = {});
+
+        // Makes a shader available to preprocess_shader without file I/O, path should be absolute.
+        void register_embedded_shader(const std::string &path, const char *text, size_t size);
+
+        // nullptr when there is no such embedded shader.
+        const std::string *find_embedded_shader(const std::string &path);
+
+        size_t embedded_shaders_count();
+
+        struct EmbeddedShader {
+            const char *path;
+            const char *text;
+            size_t size;
+        };
+
+        // Used by the sources generated by xe_embed_shaders (cmake/EmbedShaders.cmake).
+        struct EmbeddedShaderRegistrar {
+            EmbeddedShaderRegistrar(std::initializer_list<EmbeddedShader> shaders) {
+                for (const auto &shader: shaders)
+                    register_embedded_shader(shader.path, shader.text, shader.size);
+            }
+        };
+    }
+}
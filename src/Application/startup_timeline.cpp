@@ -0,0 +1,96 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "startup_timeline.h"
+
+#include <mutex>
+
+#include "spdlog/spdlog.h"
+
+namespace {
+    const auto process_start = std::chrono::steady_clock::now();
+
+    // The first frame may be presented by the render thread.
+    std::mutex mutex;
+    bool closed = false;
+    // Nesting of the phases open on the calling thread, a load on a worker thread starts at the top level.
+    thread_local int depth = 0;
+    double first_frame_ms = 0.0;
+
+    std::vector<xe::startup::Phase> &phase_list() {
+        static std::vector<xe::startup::Phase> list;
+        return list;
+    }
+
+    double now_ms() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - process_start).count();
+    }
+}
+
+namespace xe::startup {
+
+    bool open() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !closed;
+    }
+
+    int begin(std::string name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed)
+            return -1;
+        auto &list = phase_list();
+        list.push_back({std::move(name), now_ms(), 0.0, depth++});
+        return static_cast<int>(list.size() - 1);
+    }
+
+    void end(int phase) {
+        if (phase < 0)
+            return;
+        depth--;
+        std::lock_guard<std::mutex> lock(mutex);
+        // Phases still open at the first frame were ended there.
+        if (!closed)
+            phase_list()[phase].end_ms = now_ms();
+    }
+
+    void first_frame() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed)
+            return;
+        first_frame_ms = now_ms();
+        for (auto &phase: phase_list()) {
+            if (phase.end_ms == 0.0)
+                phase.end_ms = first_frame_ms;
+        }
+        closed = true;
+    }
+
+    double time_to_first_frame_ms() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return first_frame_ms;
+    }
+
+    std::vector<Phase> phases() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return phase_list();
+    }
+
+    void log_report(int verbose) {
+        if (verbose <= 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        SPDLOG_INFO("Time to first frame: {:.1f} ms", first_frame_ms);
+        if (verbose <= 1)
+            return;
+        double covered = 0.0;
+        for (auto &phase: phase_list()) {
+            SPDLOG_INFO("  {:>8.1f} ms {:>8.1f} ms  {}{}", phase.start_ms, phase.end_ms - phase.start_ms,
+                        std::string(2 * phase.depth, ' '), phase.name);
+            if (phase.depth == 0)
+                covered += phase.end_ms - phase.start_ms;
+        }
+        SPDLOG_INFO("  {:>8.1f} ms outside of the phases (static initialization, the constructor, the first frame)",
+                    first_frame_ms - covered);
+    }
+}
@@ -0,0 +1,69 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace xe {
+
+    /**
+     * @brief Breaks the time from the process start to the first presented frame into phases.
+     *
+     * Phases are marked with XE_STARTUP_PHASE and may nest. The timeline closes when the application has
+     * presented its first frame, later phases are not recorded, so the marks can stay in code that also
+     * runs after the startup (loading a mesh, compiling a program). The times are measured from the
+     * static initialization of the application library, which is close to the process start.
+     *
+     * Phases may be marked on any thread, the nesting depth is counted per thread. Phases still open when
+     * the first frame is presented end there.
+     */
+    namespace startup {
+        struct Phase {
+            std::string name;
+            double start_ms;
+            double end_ms;
+            int depth;
+        };
+
+        bool open();
+
+        // Returns the index of the phase, -1 when the timeline is closed.
+        int begin(std::string name);
+
+        void end(int phase);
+
+        // Closes the timeline, called by the application after the first frame.
+        void first_frame();
+
+        double time_to_first_frame_ms();
+
+        // A copy, complete once the timeline is closed.
+        std::vector<Phase> phases();
+
+        // Time to the first frame, with verbose > 1 also every phase.
+        void log_report(int verbose);
+
+        class Scope {
+        public:
+            explicit Scope(std::string name) : phase_(begin(std::move(name))) {}
+
+            ~Scope() { end(phase_); }
+
+            Scope(const Scope &) = delete;
+
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            int phase_;
+        };
+    }
+}
+
+#define XE_STARTUP_CONCAT_(a, b) a##b
+#define XE_STARTUP_CONCAT(a, b) XE_STARTUP_CONCAT_(a, b)
+// Times the enclosing scope as a startup phase.
+#define XE_STARTUP_PHASE(name) xe::startup::Scope XE_STARTUP_CONCAT(xe_startup_phase_, __LINE__)(name)
@@ -0,0 +1,184 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+#include "glm/glm.hpp"
+
+namespace xe::layout {
+
+    /**
+     * @brief Compile time std140/std430 layout of interface blocks.
+     *
+     * A block is described as a list of its member types, e.g. the GLSL block
+     *
+     *     layout(std140) uniform Mixer { float strength; vec3 mix_color; };
+     *
+     * is Struct<float, glm::vec3>. Supported members are float, int32_t and uint32_t (GLSL bool is
+     * written as uint32_t), glm vectors and float matrices, arrays (T[N] or std::array) and nested Structs.
+     * offset<P, S, I>() gives the offset of member I, size<P, S>() the size of the whole block, both as
+     * constants.
+     *
+     * A C++ struct can stand for a Struct when Mirror is specialized for it, see xe::PointLight. Its members
+     * offsets are then checked at compile time, so the struct can be copied into the block as a whole.
+     */
+    enum class Packing {
+        std140, std430
+    };
+
+    template<typename... Members>
+    struct Struct {
+    };
+
+    // Specialize with `using type = Struct<...>;`, `offsets` (offsetof of the members) and `names`
+    // (the member names in GLSL, used to check the layout against the program).
+    template<typename T>
+    struct Mirror {
+    };
+
+    constexpr size_t round_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    template<Packing P, typename T, typename Enable = void>
+    struct Traits;
+
+    template<Packing P, typename T>
+    constexpr size_t alignment() { return Traits<P, T>::alignment; }
+
+    template<Packing P, typename T>
+    constexpr size_t size() { return Traits<P, T>::size; }
+
+    // Writes value into the block data at dst, padding is left untouched.
+    template<Packing P, typename T, typename V>
+    void write(uint8_t *dst, const V &value) { Traits<P, T>::write(dst, value); }
+
+    template<Packing P, typename T>
+    struct Traits<P, T, std::enable_if_t<std::is_same_v<T, float> || std::is_same_v<T, int32_t> ||
+                                         std::is_same_v<T, uint32_t>>> {
+        static constexpr size_t alignment = 4;
+        static constexpr size_t size = 4;
+
+        static void write(uint8_t *dst, T value) { std::memcpy(dst, &value, sizeof(T)); }
+    };
+
+    template<Packing P, glm::length_t N, typename T, glm::qualifier Q>
+    struct Traits<P, glm::vec<N, T, Q>> {
+        static_assert(sizeof(T) == 4, "only 32 bit vector components are supported");
+        static constexpr size_t alignment = N == 3 ? 16 : N * 4;
+        static constexpr size_t size = N * 4;
+
+        static void write(uint8_t *dst, const glm::vec<N, T, Q> &value) { std::memcpy(dst, &value, size); }
+    };
+
+    // Arrays (and the columns of matrices): std140 rounds the element alignment up to a vec4, std430 does not.
+    template<Packing P, typename T>
+    struct ArrayElement {
+        static constexpr size_t alignment =
+                P == Packing::std140 ? round_up(layout::alignment<P, T>(), 16) : layout::alignment<P, T>();
+        static constexpr size_t stride = round_up(layout::size<P, T>(), alignment);
+    };
+
+    template<Packing P, glm::length_t C, glm::length_t R, glm::qualifier Q>
+    struct Traits<P, glm::mat<C, R, float, Q>> {
+        using column = glm::vec<R, float, Q>;
+        static constexpr size_t alignment = ArrayElement<P, column>::alignment;
+        static constexpr size_t stride = ArrayElement<P, column>::stride;
+        static constexpr size_t size = C * stride;
+
+        static void write(uint8_t *dst, const glm::mat<C, R, float, Q> &value) {
+            for (glm::length_t c = 0; c < C; c++)
+                Traits<P, column>::write(dst + c * stride, value[c]);
+        }
+    };
+
+    template<Packing P, typename T, size_t N>
+    struct Traits<P, T[N]> {
+        static constexpr size_t alignment = ArrayElement<P, T>::alignment;
+        static constexpr size_t stride = ArrayElement<P, T>::stride;
+        static constexpr size_t size = N * stride;
+
+        template<typename V>
+        static void write(uint8_t *dst, const V &value) {
+            for (size_t i = 0; i < N; i++)
+                Traits<P, T>::write(dst + i * stride, value[i]);
+        }
+    };
+
+    template<Packing P, typename T, size_t N>
+    struct Traits<P, std::array<T, N>> : Traits<P, T[N]> {
+    };
+
+    template<Packing P, typename... Members>
+    struct Traits<P, Struct<Members...>> {
+        static constexpr size_t n_members = sizeof...(Members);
+        static_assert(n_members > 0, "empty structs are not allowed in GLSL");
+
+        static constexpr size_t alignment = [] {
+            size_t a = std::max({layout::alignment<P, Members>()...});
+            return P == Packing::std140 ? round_up(a, 16) : a;
+        }();
+
+        static constexpr std::array<size_t, n_members> offsets = [] {
+            std::array<size_t, n_members> alignments = {layout::alignment<P, Members>()...};
+            std::array<size_t, n_members> sizes = {layout::size<P, Members>()...};
+            std::array<size_t, n_members> result = {};
+            size_t end = 0;
+            for (size_t i = 0; i < n_members; i++) {
+                result[i] = round_up(end, alignments[i]);
+                end = result[i] + sizes[i];
+            }
+            return result;
+        }();
+
+        // Rounded up to the alignment, so a member following the struct starts on a proper boundary.
+        static constexpr size_t size = round_up(offsets[n_members - 1] + layout::size<P, std::tuple_element_t<
+                n_members - 1, std::tuple<Members...>>>(), alignment);
+    };
+
+    template<Packing P, typename T>
+    struct Traits<P, T, std::void_t<typename Mirror<T>::type>> : Traits<P, typename Mirror<T>::type> {
+        // True when the C++ struct has the same layout as the block, only then it can be copied as a whole.
+        static constexpr bool matches = [] {
+            using base = Traits<P, typename Mirror<T>::type>;
+            if (Mirror<T>::offsets.size() != base::n_members || sizeof(T) > base::size)
+                return false;
+            for (size_t i = 0; i < base::n_members; i++) {
+                if (Mirror<T>::offsets[i] != base::offsets[i])
+                    return false;
+            }
+            return true;
+        }();
+
+        static void write(uint8_t *dst, const T &value) {
+            static_assert(matches, "the C++ struct does not match the block layout");
+            std::memcpy(dst, &value, sizeof(T));
+        }
+    };
+
+    template<Packing P, typename S, size_t I>
+    constexpr size_t offset() { return Traits<P, S>::offsets[I]; }
+
+    template<typename S, size_t I>
+    struct member;
+
+    template<size_t I, typename... Members>
+    struct member<Struct<Members...>, I> {
+        using type = std::tuple_element_t<I, std::tuple<Members...>>;
+    };
+
+    template<typename S, size_t I>
+    using member_t = typename member<S, I>::type;
+
+    template<Packing P, typename T>
+    constexpr bool mirrors() { return Traits<P, T>::matches; }
+}
@@ -6,46 +6,206 @@
 #include "spdlog/spdlog.h"
 #include "spdlog/fmt/fmt.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 #include "glad/gl.h"
 
 #include "Application/utils.h"
 
 void uniform_info(GLuint program, const char *name) {
-
-    auto index = glGetUniformBlockIndex(program, name);
-    if (index == -1) {
+    auto block = xe::reflect(program).block(name);
+    if (!block) {
         fmt::print("Uniform block {} not found in program\n", name);
         return;
     }
 
-    fmt::print("Index of uniform block {} = {}\n", name, index);
-    GLuint binding;
-    OGL_CALL(glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_BINDING,
-                                       reinterpret_cast<GLint *>(&binding)));
-    fmt::print("Uniform block {} binding = {}\n", name, binding);
-    GLint size;
-    OGL_CALL(glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE,
-                                       &size));
-    fmt::print("Uniform block {} size = {}\n", name, size);
-    GLint num_uniforms;
-    OGL_CALL(glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS,
-                                       &num_uniforms));
-    fmt::print("Uniform block {} num uniforms = {}\n", name, num_uniforms);
-    GLint *uniform_indices = new GLint[num_uniforms];
-    OGL_CALL(glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES,
-                                       uniform_indices));
-    for (int i = 0; i < num_uniforms; i++) {
-        GLsizei length;
-        GLenum type;
-        GLchar u_name[32];
-        GLint size;
-        GLint uniform_index = uniform_indices[i];
-        OGL_CALL(glGetActiveUniform(program, uniform_index, 32, &length, &size, &type, u_name));
-        fmt::print("Uniform block {} uniform {} name = {}\n", name, i, u_name);
-        GLint offset;
-        OGL_CALL(glGetActiveUniformsiv(program, 1, reinterpret_cast<GLuint *>(&uniform_index),
-                                       GL_UNIFORM_OFFSET, &offset));
-        fmt::print("Uniform block {} uniform {} offset = {}\n", u_name, i, offset);
+    fmt::print("Index of uniform block {} = {}\n", name, block->index);
+    fmt::print("Uniform block {} binding = {}\n", name, block->binding);
+    fmt::print("Uniform block {} size = {}\n", name, block->size);
+    fmt::print("Uniform block {} num uniforms = {}\n", name, block->members.size());
+    for (size_t i = 0; i < block->members.size(); i++) {
+        const auto &member = block->members[i];
+        fmt::print("Uniform block {} uniform {} name = {}\n", name, i, member.name);
+        fmt::print("Uniform block {} uniform {} offset = {}\n", member.name, i, member.offset);
     }
 }
 
+namespace xe {
+
+    namespace {
+        std::unordered_map<GLuint, ProgramReflection> reflections;
+
+        void strip_instance_name(BlockInfo &block) {
+            auto prefix = block.name + ".";
+            for (auto &member: block.members) {
+                if (member.name.compare(0, prefix.size(), prefix) == 0)
+                    member.name.erase(0, prefix.size());
+            }
+        }
+
+        // Members of all the uniform blocks are queried with one call per property.
+        void reflect_uniform_blocks(GLuint program, ProgramReflection &reflection) {
+            GLint n_blocks = 0, max_name = 0, max_uniform_name = 0;
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &n_blocks);
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_name);
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_uniform_name);
+            std::vector<GLchar> name(std::max(max_name, max_uniform_name) + 1);
+
+            for (GLuint b = 0; b < static_cast<GLuint>(n_blocks); b++) {
+                BlockInfo block{};
+                block.interface = GL_UNIFORM_BLOCK;
+                block.index = b;
+                GLsizei length = 0;
+                OGL_CALL(glGetActiveUniformBlockName(program, b, static_cast<GLsizei>(name.size()), &length,
+                                                     name.data()));
+                block.name.assign(name.data(), length);
+                OGL_CALL(glGetActiveUniformBlockiv(program, b, GL_UNIFORM_BLOCK_BINDING, &block.binding));
+                OGL_CALL(glGetActiveUniformBlockiv(program, b, GL_UNIFORM_BLOCK_DATA_SIZE, &block.size));
+                GLint n_uniforms = 0;
+                OGL_CALL(glGetActiveUniformBlockiv(program, b, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &n_uniforms));
+
+                std::vector<GLint> indices(n_uniforms);
+                if (n_uniforms > 0) {
+                    OGL_CALL(glGetActiveUniformBlockiv(program, b, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES,
+                                                       indices.data()));
+                }
+                auto uniform_indices = reinterpret_cast<const GLuint *>(indices.data());
+                std::vector<GLint> types(n_uniforms), offsets(n_uniforms), sizes(n_uniforms), array_strides(
+                        n_uniforms), matrix_strides(n_uniforms);
+                if (n_uniforms > 0) {
+                    OGL_CALL(glGetActiveUniformsiv(program, n_uniforms, uniform_indices, GL_UNIFORM_TYPE,
+                                                   types.data()));
+                    OGL_CALL(glGetActiveUniformsiv(program, n_uniforms, uniform_indices, GL_UNIFORM_OFFSET,
+                                                   offsets.data()));
+                    OGL_CALL(glGetActiveUniformsiv(program, n_uniforms, uniform_indices, GL_UNIFORM_SIZE,
+                                                   sizes.data()));
+                    OGL_CALL(glGetActiveUniformsiv(program, n_uniforms, uniform_indices, GL_UNIFORM_ARRAY_STRIDE,
+                                                   array_strides.data()));
+                    OGL_CALL(glGetActiveUniformsiv(program, n_uniforms, uniform_indices, GL_UNIFORM_MATRIX_STRIDE,
+                                                   matrix_strides.data()));
+                }
+                for (int i = 0; i < n_uniforms; i++) {
+                    OGL_CALL(glGetActiveUniformName(program, uniform_indices[i], static_cast<GLsizei>(name.size()),
+                                                    &length, name.data()));
+                    block.members.push_back({std::string(name.data(), length), static_cast<GLenum>(types[i]),
+                                             offsets[i], sizes[i], array_strides[i], matrix_strides[i]});
+                }
+                strip_instance_name(block);
+                reflection.blocks.push_back(std::move(block));
+            }
+        }
+
+        // Shader storage blocks need the program interface query (GL 4.3), it is missing on macOS.
+        void reflect_storage_blocks(GLuint program, ProgramReflection &reflection) {
+            if (!glGetProgramResourceiv)
+                return;
+            GLint n_blocks = 0, max_name = 0;
+            glGetProgramInterfaceiv(program, GL_SHADER_STORAGE_BLOCK, GL_ACTIVE_RESOURCES, &n_blocks);
+            if (n_blocks == 0)
+                return;
+            glGetProgramInterfaceiv(program, GL_BUFFER_VARIABLE, GL_MAX_NAME_LENGTH, &max_name);
+            GLint max_block_name = 0;
+            glGetProgramInterfaceiv(program, GL_SHADER_STORAGE_BLOCK, GL_MAX_NAME_LENGTH, &max_block_name);
+            std::vector<GLchar> name(std::max(max_name, max_block_name) + 1);
+
+            const GLenum block_props[] = {GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE, GL_NUM_ACTIVE_VARIABLES};
+            const GLenum member_props[] = {GL_TYPE, GL_OFFSET, GL_ARRAY_SIZE, GL_ARRAY_STRIDE, GL_MATRIX_STRIDE};
+            for (GLuint b = 0; b < static_cast<GLuint>(n_blocks); b++) {
+                BlockInfo block{};
+                block.interface = GL_SHADER_STORAGE_BLOCK;
+                block.index = b;
+                GLsizei length = 0;
+                OGL_CALL(glGetProgramResourceName(program, GL_SHADER_STORAGE_BLOCK, b,
+                                                  static_cast<GLsizei>(name.size()), &length, name.data()));
+                block.name.assign(name.data(), length);
+                GLint values[3];
+                OGL_CALL(glGetProgramResourceiv(program, GL_SHADER_STORAGE_BLOCK, b, 3, block_props, 3, nullptr,
+                                                values));
+                block.binding = values[0];
+                block.size = values[1];
+
+                std::vector<GLint> variables(values[2]);
+                if (!variables.empty()) {
+                    const GLenum active = GL_ACTIVE_VARIABLES;
+                    OGL_CALL(glGetProgramResourceiv(program, GL_SHADER_STORAGE_BLOCK, b, 1, &active,
+                                                    static_cast<GLsizei>(variables.size()), nullptr,
+                                                    variables.data()));
+                }
+                for (auto variable: variables) {
+                    GLint v[5];
+                    OGL_CALL(glGetProgramResourceiv(program, GL_BUFFER_VARIABLE, variable, 5, member_props, 5,
+                                                    nullptr, v));
+                    OGL_CALL(glGetProgramResourceName(program, GL_BUFFER_VARIABLE, variable,
+                                                      static_cast<GLsizei>(name.size()), &length, name.data()));
+                    block.members.push_back({std::string(name.data(), length), static_cast<GLenum>(v[0]), v[1], v[2],
+                                             v[3], v[4]});
+                }
+                strip_instance_name(block);
+                reflection.blocks.push_back(std::move(block));
+            }
+        }
+    }
+
+    const BlockMember *BlockInfo::member(const std::string &name) const {
+        for (const auto &m: members) {
+            if (m.name == name)
+                return &m;
+        }
+        return nullptr;
+    }
+
+    const BlockInfo *ProgramReflection::block(const std::string &name) const {
+        for (const auto &b: blocks) {
+            if (b.name == name)
+                return &b;
+        }
+        return nullptr;
+    }
+
+    const ProgramReflection &reflect(GLuint program) {
+        auto it = reflections.find(program);
+        if (it != reflections.end())
+            return it->second;
+
+        auto &reflection = reflections[program];
+        reflect_uniform_blocks(program, reflection);
+        reflect_storage_blocks(program, reflection);
+        return reflection;
+    }
+
+    void forget_reflection(GLuint program) {
+        reflections.erase(program);
+    }
+
+    bool check_block_layout(const BlockInfo &block, const size_t *offsets, const char *const *names,
+                            size_t n_members, size_t size) {
+        bool ok = true;
+        for (size_t i = 0; i < n_members; i++) {
+            // Arrays are reflected as name[0], structs by their members only.
+            std::string name = names[i];
+            GLint offset = -1;
+            for (const auto &member: block.members) {
+                const auto &m = member.name;
+                bool is_member = m == name || m == name + "[0]" || m.compare(0, name.size() + 1, name + ".") == 0 ||
+                                 m.compare(0, name.size() + 4, name + "[0].") == 0;
+                if (is_member && (offset < 0 || member.offset < offset))
+                    offset = member.offset;
+            }
+            if (offset < 0) {
+                SPDLOG_ERROR("Block {}: member {} not found", block.name, name);
+                ok = false;
+            } else if (static_cast<size_t>(offset) != offsets[i]) {
+                SPDLOG_ERROR("Block {}: member {} is at offset {}, expected {}", block.name, name, offset,
+                             offsets[i]);
+                ok = false;
+            }
+        }
+        // An unsized array at the end of a storage block makes the reflected size smaller.
+        if (block.size > static_cast<GLint>(size)) {
+            SPDLOG_ERROR("Block {} has {} bytes, the layout only {}", block.name, block.size, size);
+            ok = false;
+        }
+        return ok;
+    }
+}
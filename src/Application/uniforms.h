@@ -4,7 +4,152 @@
 
 #pragma once
 
+#include <array>
+#include <string>
+#include <vector>
+
 #include "spdlog/spdlog.h"
 #include "glad/gl.h"
 
-void uniform_info(GLuint program, const char *name) ;
\ No newline at end of file
+#include "frame_pacer.h"
+#include "std_layout.h"
+#include "utils.h"
+
+void uniform_info(GLuint program, const char *name) ;
+
+namespace xe {
+
+    struct BlockMember {
+        std::string name; // without the block instance name
+        GLenum type;
+        GLint offset;
+        GLint array_size;
+        GLint array_stride;
+        GLint matrix_stride;
+    };
+
+    struct BlockInfo {
+        std::string name;
+        GLenum interface; // GL_UNIFORM_BLOCK or GL_SHADER_STORAGE_BLOCK
+        GLuint index;
+        GLint binding;
+        GLint size;
+        std::vector<BlockMember> members;
+
+        const BlockMember *member(const std::string &name) const;
+    };
+
+    struct ProgramReflection {
+        std::vector<BlockInfo> blocks;
+
+        const BlockInfo *block(const std::string &name) const;
+    };
+
+    /**
+     * @brief Uniform and shader storage blocks of a linked program.
+     *
+     * The program is queried on the first call only, later calls return the cached result. Programs that
+     * are relinked (hot reload) or deleted have to be forgotten.
+     */
+    const ProgramReflection &reflect(GLuint program);
+
+    void forget_reflection(GLuint program);
+
+    // Compares the offsets of the named members with the reflected block, see layout::Mirror for the names.
+    bool check_block_layout(const BlockInfo &block, const size_t *offsets, const char *const *names,
+                            size_t n_members, size_t size);
+
+    template<layout::Packing P, typename D>
+    bool check_block_layout(const BlockInfo &block) {
+        using traits = layout::Traits<P, typename D::type>;
+        static_assert(D::names.size() == traits::n_members, "a name is needed for every member");
+        return check_block_layout(block, traits::offsets.data(), D::names.data(), traits::n_members, traits::size);
+    }
+
+    /**
+     * @brief Buffer backing an interface block with layout known at compile time.
+     *
+     * D describes the block like layout::Mirror does (type and names). Members are written into a CPU copy
+     * at constant offsets, upload() sends the whole block with a single call. The layout is checked against
+     * the program once, when the buffer is created.
+     *
+     * The buffer has a slice for every frame in flight (see FramePacer), upload() writes and bind() binds
+     * the slice of the current frame, so a slice is never written while the GPU still reads it. Call upload()
+     * before bind() in every frame the block is used, it does nothing when the slice is up to date.
+     */
+    template<layout::Packing P, typename D>
+    class BlockBuffer {
+    public:
+        using block_t = typename D::type;
+        static constexpr size_t size = layout::size<P, block_t>();
+        static constexpr GLenum target = P == layout::Packing::std140 ? GL_UNIFORM_BUFFER : GL_SHADER_STORAGE_BUFFER;
+
+        explicit BlockBuffer(GLuint binding) : binding_(binding), data_(size) {
+            GLint alignment = 256;
+            glGetIntegerv(target == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+                                                      : GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            slice_ = layout::round_up(size, alignment);
+            OGL_CALL(glCreateBuffers(1, &buffer_));
+            OGL_CALL(glNamedBufferStorage(buffer_, slice_ * FramePacer::MAX_FRAMES_IN_FLIGHT, nullptr,
+                                          GL_DYNAMIC_STORAGE_BIT));
+        }
+
+        // Takes the binding from the program and checks the layout, logs an error when they do not match.
+        BlockBuffer(GLuint program, const std::string &name) : BlockBuffer(0u) {
+            auto block = reflect(program).block(name);
+            if (!block) {
+                SPDLOG_ERROR("Block {} not found in program {}", name, program);
+                return;
+            }
+            binding_ = block->binding;
+            check_block_layout<P, D>(*block);
+        }
+
+        BlockBuffer(const BlockBuffer &) = delete;
+
+        BlockBuffer &operator=(const BlockBuffer &) = delete;
+
+        ~BlockBuffer() { glDeleteBuffers(1, &buffer_); }
+
+        template<size_t I, typename V>
+        void set(const V &value) {
+            layout::write<P, layout::member_t<block_t, I>>(data_.data() + layout::offset<P, block_t, I>(), value);
+            version_++;
+        }
+
+        // Element of the array member I.
+        template<size_t I, typename V>
+        void set(size_t element, const V &value) {
+            using array_t = layout::Traits<P, layout::member_t<block_t, I>>;
+            using element_t = std::remove_extent_t<layout::member_t<block_t, I>>;
+            layout::write<P, element_t>(data_.data() + layout::offset<P, block_t, I>() + element * array_t::stride,
+                                        value);
+            version_++;
+        }
+
+        void upload() {
+            auto slot = FramePacer::instance().slot();
+            if (uploaded_[slot] == version_)
+                return;
+            OGL_CALL(glNamedBufferSubData(buffer_, slot * slice_, size, data_.data()));
+            uploaded_[slot] = version_;
+        }
+
+        void bind() const {
+            OGL_CALL(glBindBufferRange(target, binding_, buffer_, FramePacer::instance().slot() * slice_, size));
+        }
+
+        GLuint buffer() const { return buffer_; }
+
+        GLuint binding() const { return binding_; }
+
+    private:
+        GLuint binding_;
+        GLuint buffer_ = 0u;
+        size_t slice_ = size;
+        std::vector<uint8_t> data_;
+        // Incremented by every set(), a slice is up to date when it was uploaded at the current version.
+        uint64_t version_ = 1;
+        std::array<uint64_t, FramePacer::MAX_FRAMES_IN_FLIGHT> uploaded_ = {};
+    };
+}
@@ -12,6 +12,7 @@
 #include "glad/gl.h"
 
 #include "Application/shader_source.h"
+#include "Application/program_cache.h"
 
 namespace xe {
     namespace utils {
@@ -99,49 +100,35 @@ namespace xe {
         }
 
         GLenum
-        get_and_report_error(const std::string function_call, std::string file_name, int line_number, bool critical) {
-            auto error = glGetError();
-            auto error_name = error_msg(error);
-            std::stringstream ss;
-            if (error != GL_NO_ERROR) {
-                ss << "OpenGL error: " << error_name;
-                if (!function_call.empty()) {
-                    ss << "  " << function_call;
-                }
-                if (!file_name.empty()) {
-                    ss << " " << file_name;
-                }
-
-                if (line_number >= 0) {
-                    ss << ":" << line_number;
-                }
-                if (critical) {
-                    spdlog::critical(ss.str());
-                    exit(-1);
-                } else {
-                    spdlog::error(ss.str());
-                }
-            }
-            return error;
+        get_and_report_error(const char *function_call, const char *file_name, int line_number, bool critical) {
+            // The message is only formatted when there is an error.
+            return gl_check::check(function_call, file_name, line_number, critical);
         }
 
-        GLuint link_program(GLuint program) {
-            glLinkProgram(program);
+        bool check_link_status(GLuint program) {
             GLint link_status;
             glGetProgramiv(program, GL_LINK_STATUS, &link_status);
             if (!link_status) {
                 spdlog::error("Error linking program\n");
                 GLint max_log_length = 0;
                 glGetProgramiv(program, GL_INFO_LOG_LENGTH, &max_log_length);
-                GLchar *info_log = new GLchar[max_log_length];
-                glGetProgramInfoLog(program, max_log_length, &max_log_length, info_log);
-                std::istringstream iss(info_log);
+                std::string info_log;
+                info_log.resize(max_log_length);
+                glGetProgramInfoLog(program, max_log_length, &max_log_length, info_log.data());
+                std::istringstream iss(info_log.substr(0, max_log_length));
                 std::string line;
                 while (std::getline(iss, line)) {
                     spdlog::error(line);
                 }
-                return 0;
+                return false;
             }
+            return true;
+        }
+
+        GLuint link_program(GLuint program) {
+            glLinkProgram(program);
+            if (!check_link_status(program))
+                return 0;
 
             return program;
         }
@@ -153,18 +140,7 @@ namespace xe {
             }
         }
 
-        GLuint create_program(const shader_source_map_t &shaders_src, const std::string &version) {
-            shader_map_t shaders;
-            for (const auto &[shader_type, src]: shaders_src) {
-                auto shader = create_shader_from_file(shader_type, src);
-                if (shader > 0)
-                    shaders[shader_type] = shader;
-                else {
-                    delete_shaders(shaders);
-                    return 0;
-                }
-            }
-
+        GLuint link_shaders(shader_map_t &shaders, bool binary_retrievable) {
             GLuint program = glCreateProgram();
             if (program == 0) {
                 spdlog::error("Error creating program");
@@ -181,17 +157,57 @@ namespace xe {
                     return 0;
                 }
             }
+            if (binary_retrievable)
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
             if (link_program(program) == 0) {
                 spdlog::error("Cannot link program");
                 glDeleteProgram(program);
                 delete_shaders(shaders);
                 return 0;
             }
+            // The attached shaders are only flagged for deletion and go away together with the program.
+            delete_shaders(shaders);
             return program;
         }
 
+        GLuint compile_program(const shader_source_map_t &shaders_src) {
+            shader_map_t shaders;
+            for (const auto &[shader_type, src]: shaders_src) {
+                auto shader = create_shader_from_file(shader_type, src);
+                if (shader > 0)
+                    shaders[shader_type] = shader;
+                else {
+                    delete_shaders(shaders);
+                    return 0;
+                }
+            }
+            return link_shaders(shaders);
+        }
+
         GLuint create_program(const shader_source_map_t &shaders_src) {
-            return create_program(shaders_src, "");
+            return ProgramCache::instance().program(shaders_src);
+        }
+
+        bool check_compile_status(GLuint shader, GLenum type) {
+            GLint is_compiled = 0;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &is_compiled);
+            if (!is_compiled) {
+                GLint max_log_length = 0u;
+                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &max_log_length);
+                std::string error_log;
+                error_log.resize(max_log_length);
+                int length = 0;
+                glGetShaderInfoLog(shader, max_log_length, &length, error_log.data());
+
+                spdlog::error("Error compiling {} shader", shader_type(type));
+                std::istringstream iss(error_log.substr(0, length));
+                std::string line;
+                while (std::getline(iss, line)) {
+                    spdlog::error(line);
+                }
+                return false;
+            }
+            return true;
         }
 
         GLuint create_shader_from_source(GLenum type, source_t &shader_source) {
@@ -212,25 +228,8 @@ namespace xe {
             glShaderSource(shader, shader_source.size(), shader_source.data(), nullptr);
 
             glCompileShader(shader);
-            GLint is_compiled = 0;
-            glGetShaderiv(shader, GL_COMPILE_STATUS, &is_compiled);
-            if (!is_compiled) {
-                GLint max_log_length = 0u;
-                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &max_log_length);
-                std::string error_log;
-                error_log.resize(max_log_length);
-                int length = 0;
-                glGetShaderInfoLog(shader, max_log_length, &length, error_log.data());
+            if (!check_compile_status(shader, type)) {
                 glDeleteShader(shader);
-
-
-                spdlog::error("Error compiling {} shader", shader_type(type));
-                std::istringstream iss(error_log.substr(0, length));
-                std::string line;
-                while (std::getline(iss, line)) {
-                    spdlog::error(line);
-                }
-
                 return 0;
             }
             return shader;
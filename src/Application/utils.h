@@ -14,6 +14,8 @@
 
 #include "glad/gl.h"
 
+#include "gl_check.h"
+
 namespace xe {
     namespace utils {
 
@@ -21,6 +23,8 @@ namespace xe {
         using shader_map_t = std::unordered_map<GLenum, GLuint>;
         using shader_map_element_t = std::pair<GLenum, std::string>;
 
+        class source_t;
+
         std::string get_gl_version(void);
 
         std::string get_gl_vendor(void);
@@ -39,8 +43,9 @@ namespace xe {
 
         std::string error_msg(GLenum status);
 
+        // Always calls glGetError, regardless of the gl_check level.
         GLenum
-        get_and_report_error(const std::string function_call = "", std::string file_name = "", int line_number = -1,
+        get_and_report_error(const char *function_call = "", const char *file_name = "", int line_number = -1,
                              bool critical = false);
 
         // Program creation utils
@@ -49,12 +54,26 @@ namespace xe {
 
         GLuint create_shader_from_file(GLenum type, const std::string &path);
 
+        GLuint create_shader_from_source(GLenum type, source_t &shader_source);
+
         GLuint link_program(GLuint program);
 
+        // Query the status and log the info log on failure. Both wait for the compilation or linking to finish.
+        bool check_compile_status(GLuint shader, GLenum type);
+
+        bool check_link_status(GLuint program);
+
+        // Attaches and links the shaders, the shaders are deleted in any case.
+        GLuint link_shaders(shader_map_t &shaders, bool binary_retrievable = false);
+
         GLuint create_program(const std::string &vs_path, const std::string &fs_path);
 
+        // Returns a program shared through the ProgramCache, it must not be deleted.
         GLuint create_program(const shader_source_map_t &shaders_src);
 
+        // Always compiles a new program, bypassing the cache.
+        GLuint compile_program(const shader_source_map_t &shaders_src);
+
 
         namespace glfw {
 
@@ -63,17 +82,3 @@ namespace xe {
         }
     }
 }
-
-#ifdef DEBUG_NO_ABORT
-#define CRITICAL__  false
-#else
-#define CRITICAL__  true
-#endif
-
-#ifndef NO_OGL_CALL
-#define OGL_CALL(call)                                              \
-        call;                                                       \
-        xe::utils::get_and_report_error(#call, __FILE__, __LINE__, CRITICAL__);
-#else
-#define OGL_CALL(call) {call;}
-#endif
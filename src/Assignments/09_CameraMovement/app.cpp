@@ -5,9 +5,12 @@
 
 #include "app.h"
 #include "camera.h"
+#include <fstream>
+#include <sstream>
 #include <vector>
 #include "spdlog/spdlog.h"
 #include "glad/gl.h"
+#include "Application/program_cache.h"
 #include "Application/utils.h"
 
 #include <glm/glm.hpp>
@@ -17,8 +20,8 @@
 
 void SimpleShapeApplication::framebuffer_resize_callback(int w, int h) {
     Application::framebuffer_resize_callback(w, h);
-    //
-    OGL_CALL(glViewport(0, 0, w, h));
+    // With --render-thread the callbacks run on a thread without the GL context.
+    on_render_thread([w, h]() { OGL_CALL(glViewport(0, 0, w, h)); });
 }
 
 void SimpleShapeApplication::init() {
@@ -32,6 +35,8 @@ void SimpleShapeApplication::init() {
     set_camera(new Camera);
     set_controler(new CameraController(camera()));
 
+    xe::ProgramCache::instance().register_block<xe::layout::Packing::std140, TransformationsBlock>("Transformations");
+
     auto program = xe::utils::create_program(
         {
             {GL_VERTEX_SHADER, std::string(PROJECT_DIR) + "/shaders/base_vs.glsl"},
@@ -126,7 +131,7 @@ void SimpleShapeApplication::init() {
 
 
 
-    M_ = glm::mat4(1.0);
+    models_ = {glm::mat4(1.0)};
 
 
 
@@ -134,9 +139,7 @@ void SimpleShapeApplication::init() {
     camera()->look_at(glm::vec3(2.0f, 1.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
     camera()->perspective(glm::radians(45.0f), static_cast<float>(w) / h, 0.1f, 100.0f);
 
-    OGL_CALL(glCreateBuffers(1, &u_trans_buffer_handle_));
-    OGL_CALL(glNamedBufferData(u_trans_buffer_handle_, 16 * sizeof(float), nullptr, GL_STATIC_DRAW));
-    //OGL_CALL(glNamedBufferSubData(u_trans_buffer_handle_, 0, 16 * sizeof(float), &PVM[0]));
+    u_trans_buffer_ = std::make_unique<xe::BlockBuffer<xe::layout::Packing::std140, TransformationsBlock>>(1);
 
 
     OGL_CALL(glViewport(0, 0, w, h));
@@ -154,15 +157,81 @@ void SimpleShapeApplication::frame() {
     glm::mat4 P = camera()->projection();
 
 
-    glm::mat4 PVM = P * V * M_;
-    OGL_CALL(glNamedBufferSubData(u_trans_buffer_handle_, 0, 16 * sizeof(float), &PVM[0]));
-    OGL_CALL(glBindBufferBase(GL_UNIFORM_BUFFER, 1,u_trans_buffer_handle_));
+    draw_pyramids(P * V);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, 0);  
+}
+
+// The same frame recorded for the render thread (--render-thread).
+void SimpleShapeApplication::record(xe::CommandList &commands) {
+    glm::mat4 PV = camera()->projection() * camera()->view();
+    // The slot of the frame is only known when the render thread executes it.
+    commands.call([this, PV]() { draw_pyramids(PV); });
+
+    commands.bind_buffer_base(GL_UNIFORM_BUFFER, 0, 0);
+}
 
+void SimpleShapeApplication::draw_pyramids(const glm::mat4 &PV) {
     OGL_CALL(glBindVertexArray(vao_));
-    OGL_CALL(glDrawElements(GL_TRIANGLES, 18,GL_UNSIGNED_BYTE,nullptr));
+    for (const auto &M: models_) {
+        upload_transformations(PV * M);
+        OGL_CALL(glDrawElements(GL_TRIANGLES, 18, GL_UNSIGNED_BYTE, nullptr));
+    }
     OGL_CALL(glBindVertexArray(0));
+}
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, 0);  
+bool SimpleShapeApplication::load_scene(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) {
+        SPDLOG_ERROR("Cannot read the scene `{}'", path);
+        return false;
+    }
+    std::vector<glm::mat4> models;
+    std::string line;
+    int line_n = 0;
+    while (std::getline(in, line)) {
+        line_n++;
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first) || first[0] == '#')
+            continue;
+        if (first == "pyramid") {
+            glm::vec3 position;
+            if (!(fields >> position.x >> position.y >> position.z)) {
+                SPDLOG_ERROR("{}:{}: expected `pyramid x y z [scale [angle]]'", path, line_n);
+                return false;
+            }
+            float scale = 1.0f, angle = 0.0f;
+            if (fields >> scale)
+                fields >> angle;
+            auto M = glm::translate(glm::mat4(1.0f), position);
+            M = glm::rotate(M, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
+            models.push_back(glm::scale(M, glm::vec3(scale)));
+        } else if (first == "camera") {
+            glm::vec3 eye, center, up;
+            if (!(fields >> eye.x >> eye.y >> eye.z >> center.x >> center.y >> center.z >> up.x >> up.y >> up.z)) {
+                SPDLOG_ERROR("{}:{}: expected `camera ex ey ez cx cy cz ux uy uz'", path, line_n);
+                return false;
+            }
+            camera()->look_at(eye, center, up);
+        } else {
+            SPDLOG_ERROR("{}:{}: unknown entry `{}'", path, line_n, first);
+            return false;
+        }
+    }
+    if (models.empty()) {
+        SPDLOG_ERROR("The scene `{}' has no pyramids", path);
+        return false;
+    }
+    SPDLOG_INFO("Loaded {} pyramids from `{}'", models.size(), path);
+    models_ = std::move(models);
+    return true;
+}
+
+void SimpleShapeApplication::upload_transformations(const glm::mat4 &PVM) {
+    u_trans_buffer_->set<0>(PVM);
+    u_trans_buffer_->upload();
+    u_trans_buffer_->bind();
 }
 
 void SimpleShapeApplication::scroll_callback(double xoffset, double yoffset) {
@@ -5,6 +5,7 @@
 #pragma once
 
 
+#include <memory>
 #include <vector>
 
 #include "camera.h"
@@ -15,6 +16,13 @@
 
 #include "camera_controller.h"
 #include "Application/application.h"
+#include "Application/uniforms.h"
+
+// GLSL: layout(std140, binding=1) uniform Transformations { mat4 PVM; };
+struct TransformationsBlock {
+    using type = xe::layout::Struct<glm::mat4>;
+    static constexpr std::array<const char *, 1> names = {"PVM"};
+};
 
 
 class SimpleShapeApplication : public xe::Application {
@@ -36,11 +44,29 @@ public:
 
     void frame() override;
 
+    void set_camera_pose(const xe::CameraPose &pose) override {
+        camera()->look_at(pose.eye, pose.center, pose.up);
+    }
+
+    /*
+     * Replaces the single pyramid with the ones listed in a text file, one per line:
+     *
+     *     pyramid x y z [scale [angle]]        # angle in degrees around the z axis
+     *     camera ex ey ez cx cy cz ux uy uz    # optional, as in look_at
+     *
+     * Empty lines and lines starting with # are skipped.
+     */
+    bool load_scene(const std::string &path) override;
+
+    void record(xe::CommandList &commands) override;
+
     void framebuffer_resize_callback(int w, int h) override;
 
-    glm::mat4 M_;
+    // Model matrices of the drawn pyramids.
+    std::vector<glm::mat4> models_;
 
-    GLuint u_trans_buffer_handle_;
+    // A slice per frame in flight, see FramePacer.
+    std::unique_ptr<xe::BlockBuffer<xe::layout::Packing::std140, TransformationsBlock>> u_trans_buffer_;
 
     void scroll_callback(double xoffset, double yoffset) override;
     void set_controler(CameraController *controller) { controller_ = controller; }
@@ -69,6 +95,12 @@ public:
     }
 
 private:
+    // Writes PVM into the slice of the current frame and binds it, on the GL thread.
+    void upload_transformations(const glm::mat4 &PVM);
+
+    // Draws every pyramid, on the GL thread.
+    void draw_pyramids(const glm::mat4 &PV);
+
     GLuint vao_;
 
     CameraController *controller_;
@@ -1,7 +1,7 @@
 #include "app.h"
 
-int main() {
+int main(int argc, char **argv) {
     SimpleShapeApplication app(650, 480, PROJECT_NAME, true);
-    app.run(1);
+    app.run_cli(argc, argv);
     return 0;
 }
\ No newline at end of file
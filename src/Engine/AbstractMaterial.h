@@ -12,6 +12,7 @@
 #include "Material.h"
 #include "Application/utils.h"
 #include "Application/RegisteredObject.h"
+#include "Application/startup_timeline.h"
 
 namespace xe {
     template<class D>
@@ -39,6 +40,7 @@ namespace xe {
 
     template<class D>
     void xe::AbstractMaterial<D>::create_program(const utils::shader_source_map_t &shader_sources) {
+        XE_STARTUP_PHASE("material program");
         auto program = utils::create_program(shader_sources);
         if (!program) {
             SPDLOG_CRITICAL("Invalid program");
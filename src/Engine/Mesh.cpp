@@ -2,12 +2,16 @@
 // Created by Piotr Białas on 12/11/2021.
 //
 
+#include <algorithm>
 #include <iostream>
+#include <utility>
 
 #include "Mesh.h"
 
 #include "spdlog/spdlog.h"
 
+#include "Application/deletion_queue.h"
+#include "Application/file_watcher.h"
 #include "Application/utils.h"
 
 namespace xe {
@@ -41,6 +45,37 @@ namespace xe {
     }
 
 
+    Mesh::~Mesh() {
+        // A frame in flight may still draw the mesh.
+        DeletionQueue::release(GL_VERTEX_ARRAY, vao_);
+        DeletionQueue::release(GL_BUFFER, v_buffer_);
+        DeletionQueue::release(GL_BUFFER, i_buffer_);
+        if (FileWatcher::exists()) {
+            for (auto id: watch_ids_)
+                FileWatcher::instance().unwatch(id);
+        }
+    }
+
+    std::vector<const Material *> Mesh::materials() const {
+        std::vector<const Material *> materials;
+        for (const auto &primitive: primitives_) {
+            if (std::find(materials.begin(), materials.end(), primitive.material) == materials.end())
+                materials.push_back(primitive.material);
+        }
+        return materials;
+    }
+
+    void Mesh::swap(Mesh &other) {
+        std::swap(attributes_, other.attributes_);
+        std::swap(index_size_, other.index_size_);
+        std::swap(vao_, other.vao_);
+        std::swap(v_buffer_, other.v_buffer_);
+        std::swap(i_buffer_, other.i_buffer_);
+        std::swap(index_type_, other.index_type_);
+        std::swap(stride_, other.stride_);
+        primitives_.swap(other.primitives_);
+    }
+
     void Mesh::load_indices(size_t offset, size_t size, void *data) {
         OGL_CALL(glNamedBufferSubData(i_buffer_, offset, size, data));
     }
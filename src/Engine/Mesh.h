@@ -32,7 +32,16 @@ namespace xe {
         Mesh(GLsizei stride, GLsizei v_buffer_size, GLenum v_buffer_hint,
              GLsizei i_buffer_size, GLenum index_type, GLenum i_buffer_hint);
 
-        virtual ~Mesh() {};
+        virtual ~Mesh();
+
+        // Exchanges the GPU buffers and submeshes with other, used to swap in a reloaded mesh.
+        void swap(Mesh &other);
+
+        // FileWatcher ids of the files the mesh was loaded from, unwatched when the mesh is destroyed.
+        void set_watch_ids(std::vector<int> ids) { watch_ids_ = std::move(ids); }
+
+        // Materials of the submeshes, each once.
+        std::vector<const Material *> materials() const;
 
 
         void load_vertices(size_t offset, size_t size, void *data);
@@ -89,10 +98,11 @@ namespace xe {
         GLuint vao_;
         GLuint v_buffer_;
         GLuint i_buffer_;
-        const GLenum index_type_;
-        const GLsizei stride_;
+        GLenum index_type_;
+        GLsizei stride_;
 
         std::vector<SubMesh> primitives_;
+        std::vector<int> watch_ids_;
 
     };
 
@@ -0,0 +1,57 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Engine/Material.h"
+#include "Engine/Mesh.h"
+#include "Engine/light.h"
+
+#include "Application/resource_pool.h"
+
+namespace xe {
+
+    // Components of the entities in an ecs::World, PointLight (light.h) is used as the light component.
+
+    struct Transform {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        glm::vec3 scale = glm::vec3(1.0f);
+
+        glm::mat4 matrix() const {
+            glm::mat4 M = glm::mat4_cast(rotation);
+            M[0] *= scale.x;
+            M[1] *= scale.y;
+            M[2] *= scale.z;
+            M[3] = glm::vec4(position, 1.0f);
+            return M;
+        }
+    };
+
+    // Model matrix computed from the Transform, read by the rendering.
+    struct WorldMatrix {
+        glm::mat4 M = glm::mat4(1.0f);
+    };
+
+    // Non-owning: systems copy components on the job threads, where the reference counts of a Ref would race.
+    // The mesh is kept alive by the Ref returned by load_mesh_from_obj, held on the main thread.
+    struct MeshRef {
+        Handle<Mesh> mesh;
+
+        Mesh *get() const { return ResourcePool<Mesh>::instance().get(mesh); }
+    };
+
+    struct MaterialRef {
+        const Material *material = nullptr;
+    };
+
+    // Axis aligned box in the model space.
+    struct Bounds {
+        glm::vec3 min = glm::vec3(0.0f);
+        glm::vec3 max = glm::vec3(0.0f);
+    };
+}
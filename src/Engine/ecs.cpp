@@ -0,0 +1,205 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "ecs.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "spdlog/spdlog.h"
+
+#include "Application/profiler.h"
+
+namespace {
+    const size_t CHUNK_ALIGNMENT = 64; // a cache line
+
+    size_t round_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    std::mutex registry_mutex;
+
+    std::vector<xe::ecs::ComponentInfo> &registry() {
+        static std::vector<xe::ecs::ComponentInfo> components;
+        return components;
+    }
+}
+
+namespace xe::ecs {
+
+    ComponentId register_component(const ComponentInfo &info) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto &components = registry();
+        if (components.size() == MAX_COMPONENTS) {
+            SPDLOG_CRITICAL("More than {} component types", MAX_COMPONENTS);
+            exit(-1);
+        }
+        // Reserved up front, component_info() reads without the lock.
+        components.reserve(MAX_COMPONENTS);
+        components.push_back(info);
+        return static_cast<ComponentId>(components.size() - 1);
+    }
+
+    const ComponentInfo &component_info(ComponentId id) {
+        return registry()[id];
+    }
+
+    Archetype::Archetype(Mask mask) : mask_(mask) {
+        size_t row_size = sizeof(Entity);
+        for (ComponentId id = 0; id < MAX_COMPONENTS; id++) {
+            if (mask & (Mask(1) << id)) {
+                components_.push_back(id);
+                row_size += component_info(id).size;
+            }
+        }
+        // The arrays are aligned, the padding between them can take a few rows.
+        capacity_ = std::max<size_t>(1, CHUNK_SIZE / row_size);
+        while (capacity_ > 1) {
+            size_t end = round_up(capacity_ * sizeof(Entity), CHUNK_ALIGNMENT);
+            for (auto id: components_) {
+                auto &info = component_info(id);
+                end = round_up(end, std::max(info.alignment, CHUNK_ALIGNMENT)) + capacity_ * info.size;
+            }
+            if (end <= CHUNK_SIZE)
+                break;
+            capacity_--;
+        }
+        size_t end = round_up(capacity_ * sizeof(Entity), CHUNK_ALIGNMENT);
+        for (auto id: components_) {
+            auto &info = component_info(id);
+            offsets_[id] = round_up(end, std::max(info.alignment, CHUNK_ALIGNMENT));
+            end = offsets_[id] + capacity_ * info.size;
+        }
+    }
+
+    Archetype::~Archetype() {
+        for (size_t row = 0; row < size_; row++) {
+            for (auto id: components_)
+                component_info(id).destroy(component(id, row));
+        }
+        for (auto chunk: chunks_)
+            ::operator delete(chunk, std::align_val_t(CHUNK_ALIGNMENT));
+    }
+
+    size_t Archetype::push(Entity entity) {
+        auto row = size_++;
+        if (row / capacity_ == chunks_.size()) {
+            // Bigger than CHUNK_SIZE only when a single row does not fit.
+            size_t chunk_size = CHUNK_SIZE;
+            for (auto id: components_)
+                chunk_size = std::max(chunk_size, offsets_[id] + capacity_ * component_info(id).size);
+            chunks_.push_back(static_cast<std::byte *>(::operator new(chunk_size, std::align_val_t(CHUNK_ALIGNMENT))));
+        }
+        this->entity(row) = entity;
+        return row;
+    }
+
+    Entity Archetype::erase(size_t row) {
+        auto last = --size_;
+        Entity moved;
+        if (row != last) {
+            for (auto id: components_)
+                component_info(id).move(component(id, row), component(id, last));
+            moved = entity(last);
+            entity(row) = moved;
+        }
+        // One empty chunk is kept, so an entity moving back and forth does not allocate every time.
+        if (chunks_.size() > n_chunks() + 1) {
+            ::operator delete(chunks_.back(), std::align_val_t(CHUNK_ALIGNMENT));
+            chunks_.pop_back();
+        }
+        return moved;
+    }
+
+    World::~World() {
+        // Destroys the components.
+        archetype_list_.clear();
+        archetypes_.clear();
+    }
+
+    Archetype &World::archetype(Mask mask) {
+        auto &a = archetypes_[mask];
+        if (!a) {
+            a = std::make_unique<Archetype>(mask);
+            archetype_list_.push_back(a.get());
+        }
+        return *a;
+    }
+
+    Entity World::allocate() {
+        Entity entity;
+        if (!free_.empty()) {
+            entity.index = free_.back();
+            free_.pop_back();
+        } else {
+            entity.index = static_cast<uint32_t>(entities_.size());
+            entities_.emplace_back();
+        }
+        entity.generation = entities_[entity.index].generation;
+        return entity;
+    }
+
+    void World::fix_location(Entity moved, size_t row) {
+        if (moved.index != Entity().index)
+            entities_[moved.index].row = row;
+    }
+
+    void World::destroy(Entity entity) {
+        if (!alive(entity))
+            return;
+        auto &location = entities_[entity.index];
+        auto a = location.archetype;
+        for (auto id: a->components())
+            component_info(id).destroy(a->component(id, location.row));
+        fix_location(a->erase(location.row), location.row);
+        location.archetype = nullptr;
+        location.generation++;
+        free_.push_back(entity.index);
+        size_--;
+    }
+
+    void World::move(Entity entity, Mask mask) {
+        auto &location = entities_[entity.index];
+        auto from = location.archetype;
+        auto &to = archetype(mask);
+        auto row = to.push(entity);
+        for (auto id: from->components()) {
+            if (mask & (Mask(1) << id))
+                component_info(id).move(to.component(id, row), from->component(id, location.row));
+            else
+                component_info(id).destroy(from->component(id, location.row));
+        }
+        fix_location(from->erase(location.row), location.row);
+        location.archetype = &to;
+        location.row = row;
+    }
+
+    void Scheduler::add(const char *name, Mask reads, Mask writes, system_t system) {
+        System s{name, reads, writes, std::move(system), {}};
+        for (size_t i = 0; i < systems_.size(); i++) {
+            auto &other = systems_[i];
+            if ((s.writes & (other.reads | other.writes)) || (s.reads & other.writes))
+                s.after.push_back(i);
+        }
+        systems_.push_back(std::move(s));
+    }
+
+    void Scheduler::run(World &world) {
+        auto &jobs = JobSystem::instance();
+        std::vector<JobHandle> handles(systems_.size());
+        std::vector<JobHandle> after;
+        for (size_t i = 0; i < systems_.size(); i++) {
+            after.clear();
+            for (auto j: systems_[i].after)
+                after.push_back(handles[j]);
+            auto &system = systems_[i];
+            handles[i] = jobs.run([&system, &world]() {
+                XE_PROFILE_SCOPE(system.name);
+                system.run(world);
+            }, after);
+        }
+        for (auto &handle: handles)
+            jobs.wait(handle);
+    }
+}
@@ -0,0 +1,338 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Application/job_system.h"
+
+namespace xe::ecs {
+
+    /**
+     * @brief Entity/component store with the components grouped by archetype.
+     *
+     * An archetype is a set of component types. All entities with exactly that set live in the archetype's
+     * chunks, fixed size blocks holding an array per component (structure of arrays), so a query walks
+     * plain arrays chunk by chunk and touches only the components it asks for. Adding or removing a
+     * component moves the entity into another archetype, the last entity of the chunk fills the hole.
+     *
+     * Entities are indices with a generation, a destroyed entity's index is reused with the next
+     * generation, so stale handles are detected by alive().
+     *
+     * Components must be movable, at most MAX_COMPONENTS types can be used. Entities and components may
+     * not be created, added or removed while iterating.
+     */
+    struct Entity {
+        uint32_t index = 0xffffffffu;
+        uint32_t generation = 0;
+
+        bool operator==(const Entity &other) const {
+            return index == other.index && generation == other.generation;
+        }
+
+        bool operator!=(const Entity &other) const { return !(*this == other); }
+    };
+
+    const size_t MAX_COMPONENTS = 64;
+    using ComponentId = uint32_t;
+    using Mask = uint64_t;
+
+    struct ComponentInfo {
+        size_t size;
+        size_t alignment;
+        void (*move)(void *dst, void *src); // move constructs dst and destroys src
+        void (*destroy)(void *p);
+    };
+
+    ComponentId register_component(const ComponentInfo &info);
+
+    const ComponentInfo &component_info(ComponentId id);
+
+    // Ids are handed out on the first use of a type.
+    template<typename T>
+    ComponentId component_id() {
+        using C = std::remove_cv_t<T>;
+        static const ComponentId id = register_component(
+                {sizeof(C), alignof(C),
+                 [](void *dst, void *src) {
+                     new(dst) C(std::move(*static_cast<C *>(src)));
+                     static_cast<C *>(src)->~C();
+                 },
+                 [](void *p) { static_cast<C *>(p)->~C(); }});
+        return id;
+    }
+
+    template<typename... C>
+    Mask mask_of() { return (Mask(0) | ... | (Mask(1) << component_id<C>())); }
+
+    class Archetype {
+    public:
+        static const size_t CHUNK_SIZE = 16 * 1024;
+
+        explicit Archetype(Mask mask);
+
+        ~Archetype();
+
+        Archetype(const Archetype &) = delete;
+
+        Archetype &operator=(const Archetype &) = delete;
+
+        Mask mask() const { return mask_; }
+
+        size_t size() const { return size_; }
+
+        // Entities per chunk.
+        size_t chunk_capacity() const { return capacity_; }
+
+        size_t n_chunks() const { return (size_ + capacity_ - 1) / capacity_; }
+
+        size_t chunk_size(size_t chunk) const { return std::min(capacity_, size_ - chunk * capacity_); }
+
+        template<typename T>
+        T *column(size_t chunk) const {
+            return static_cast<T *>(column(component_id<T>(), chunk));
+        }
+
+        Entity *entities(size_t chunk) const {
+            return reinterpret_cast<Entity *>(chunks_[chunk] + entities_offset_);
+        }
+
+        void *column(ComponentId id, size_t chunk) const { return chunks_[chunk] + offsets_[id]; }
+
+        void *component(ComponentId id, size_t row) const {
+            return chunks_[row / capacity_] + offsets_[id] + row % capacity_ * component_info(id).size;
+        }
+
+        Entity &entity(size_t row) const { return entities(row / capacity_)[row % capacity_]; }
+
+        const std::vector<ComponentId> &components() const { return components_; }
+
+    private:
+        friend class World;
+
+        // Appends a row with uninitialized components.
+        size_t push(Entity entity);
+
+        // Fills the row with the last one, which is returned, the components of the row must have been
+        // destroyed or moved out before.
+        Entity erase(size_t row);
+
+        Mask mask_;
+        std::vector<ComponentId> components_;
+        std::array<size_t, MAX_COMPONENTS> offsets_ = {};
+        size_t entities_offset_ = 0;
+        size_t capacity_ = 0;
+        std::vector<std::byte *> chunks_;
+        size_t size_ = 0;
+    };
+
+    class World {
+    public:
+        World() = default;
+
+        ~World();
+
+        World(const World &) = delete;
+
+        World &operator=(const World &) = delete;
+
+        template<typename... C>
+        Entity create(C... components);
+
+        void destroy(Entity entity);
+
+        bool alive(Entity entity) const {
+            return entity.index < entities_.size() && entities_[entity.index].generation == entity.generation &&
+                   entities_[entity.index].archetype;
+        }
+
+        // nullptr when the entity does not have the component.
+        template<typename T>
+        T *get(Entity entity);
+
+        // Replaces the component when the entity already has one.
+        template<typename T>
+        void add(Entity entity, T component);
+
+        template<typename T>
+        void remove(Entity entity);
+
+        size_t size() const { return size_; }
+
+        const std::vector<Archetype *> &archetypes() const { return archetype_list_; }
+
+        // Calls f(n, C *...) for every chunk with all the components C.
+        template<typename... C, typename F>
+        void each_chunk(F &&f);
+
+        // Calls f(C &...) for every entity with all the components C.
+        template<typename... C, typename F>
+        void each(F &&f);
+
+        // Like each, the chunks are spread over the job system.
+        template<typename... C, typename F>
+        void parallel_each(F &&f);
+
+    private:
+        struct Location {
+            Archetype *archetype = nullptr;
+            size_t row = 0;
+            uint32_t generation = 0;
+        };
+
+        Archetype &archetype(Mask mask);
+
+        Entity allocate();
+
+        // Moves the entity into the archetype with the mask, the components both have are moved, the ones
+        // missing in the new archetype are destroyed and the new ones are left uninitialized.
+        void move(Entity entity, Mask mask);
+
+        void fix_location(Entity moved, size_t row);
+
+        std::vector<Location> entities_;
+        std::vector<uint32_t> free_;
+        std::unordered_map<Mask, std::unique_ptr<Archetype>> archetypes_;
+        std::vector<Archetype *> archetype_list_;
+        size_t size_ = 0;
+    };
+
+    template<typename... C>
+    Entity World::create(C... components) {
+        auto entity = allocate();
+        auto &a = archetype(mask_of<C...>());
+        auto row = a.push(entity);
+        (new(a.component(component_id<C>(), row)) C(std::move(components)), ...);
+        entities_[entity.index].archetype = &a;
+        entities_[entity.index].row = row;
+        size_++;
+        return entity;
+    }
+
+    template<typename T>
+    T *World::get(Entity entity) {
+        if (!alive(entity))
+            return nullptr;
+        auto &location = entities_[entity.index];
+        auto id = component_id<T>();
+        if (!(location.archetype->mask() & (Mask(1) << id)))
+            return nullptr;
+        return static_cast<T *>(location.archetype->component(id, location.row));
+    }
+
+    template<typename T>
+    void World::add(Entity entity, T component) {
+        if (auto existing = get<T>(entity)) {
+            *existing = std::move(component);
+            return;
+        }
+        if (!alive(entity))
+            return;
+        move(entity, entities_[entity.index].archetype->mask() | mask_of<T>());
+        auto &location = entities_[entity.index];
+        new(location.archetype->component(component_id<T>(), location.row)) T(std::move(component));
+    }
+
+    template<typename T>
+    void World::remove(Entity entity) {
+        if (!get<T>(entity))
+            return;
+        move(entity, entities_[entity.index].archetype->mask() & ~mask_of<T>());
+    }
+
+    template<typename... C, typename F>
+    void World::each_chunk(F &&f) {
+        auto required = mask_of<std::remove_cv_t<C>...>();
+        for (auto a: archetype_list_) {
+            if ((a->mask() & required) != required)
+                continue;
+            for (size_t chunk = 0; chunk < a->n_chunks(); chunk++)
+                f(a->chunk_size(chunk), a->template column<std::remove_cv_t<C>>(chunk)...);
+        }
+    }
+
+    template<typename... C, typename F>
+    void World::each(F &&f) {
+        each_chunk<C...>([&f](size_t n, auto *... columns) {
+            for (size_t i = 0; i < n; i++)
+                f(columns[i]...);
+        });
+    }
+
+    template<typename... C, typename F>
+    void World::parallel_each(F &&f) {
+        auto required = mask_of<std::remove_cv_t<C>...>();
+        std::vector<std::pair<Archetype *, size_t>> chunks;
+        for (auto a: archetype_list_) {
+            if ((a->mask() & required) == required) {
+                for (size_t chunk = 0; chunk < a->n_chunks(); chunk++)
+                    chunks.emplace_back(a, chunk);
+            }
+        }
+        JobSystem::instance().parallel_for(0, chunks.size(), [&](size_t i) {
+            auto [a, chunk] = chunks[i];
+            auto n = a->chunk_size(chunk);
+            auto columns = std::make_tuple(a->template column<std::remove_cv_t<C>>(chunk)...);
+            for (size_t j = 0; j < n; j++)
+                std::apply([&](auto *... c) { f(c[j]...); }, columns);
+        });
+    }
+
+    template<typename... C>
+    struct Read {
+    };
+
+    template<typename... C>
+    struct Write {
+    };
+
+    /**
+     * @brief Runs systems, functions over a World, on the job system.
+     *
+     * Every system declares the components it reads and writes. Systems run in the order they were added
+     * as far as they conflict (one writes what the other reads or writes), the others run in parallel.
+     * A system may use parallel_each itself, the waiting thread helps with the chunks.
+     */
+    class Scheduler {
+    public:
+        using system_t = std::function<void(World &)>;
+
+        // The name must be a string literal, it is the name of the profiler scope (only the pointer is kept).
+        template<typename... R, typename... W>
+        void add(const char *name, Read<R...>, Write<W...>, system_t system) {
+            add(name, mask_of<R...>(), mask_of<W...>(), std::move(system));
+        }
+
+        void add(const char *name, Mask reads, Mask writes, system_t system);
+
+        // Runs all the systems once and waits for them.
+        void run(World &world);
+
+        // Systems the system i has to wait for.
+        const std::vector<size_t> &dependencies(size_t i) const { return systems_[i].after; }
+
+        size_t size() const { return systems_.size(); }
+
+    private:
+        struct System {
+            const char *name;
+            Mask reads;
+            Mask writes;
+            system_t run;
+            std::vector<size_t> after;
+        };
+
+        std::vector<System> systems_;
+    };
+}
@@ -5,9 +5,13 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include <glad/gl.h>
 #include <glm/glm.hpp>
 
+#include "Application/std_layout.h"
+
 namespace xe {
 
     const GLuint MAX_POINT_LIGHTS = 16;
@@ -30,7 +34,17 @@ namespace xe {
         }
     };
 
+    // GLSL: struct PointLight { vec3 position; float radius; vec3 color; float intensity; };
+    template<>
+    struct layout::Mirror<PointLight> {
+        using type = Struct<glm::vec3, float, glm::vec3, float>;
+        static constexpr std::array<size_t, 4> offsets = {offsetof(PointLight, position), offsetof(PointLight, radius),
+                                                          offsetof(PointLight, color), offsetof(PointLight, intensity)};
+        static constexpr std::array<const char *, 4> names = {"position", "radius", "color", "intensity"};
+    };
 
+    // The alignas above are checked against std140 at compile time.
+    static_assert(layout::mirrors<layout::Packing::std140, PointLight>(), "PointLight does not match std140");
 
     inline PointLight transform(const PointLight &light, const glm::mat4 &M) {
         PointLight transformed_light(light);
@@ -7,7 +7,10 @@
 
 #include "mesh_loader.h"
 
+#include <algorithm>
+#include <fstream>
 #include <memory>
+#include <sstream>
 
 #include "spdlog/spdlog.h"
 
@@ -15,6 +18,11 @@
 #include "glm/gtx/string_cast.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include "Application/alloc_tracker.h"
+#include "Application/arena.h"
+#include "Application/file_watcher.h"
+#include "Application/perf_counters.h"
+#include "Application/startup_timeline.h"
 #include "ObjectReader/obj_reader.h"
 #include "Engine/Material.h"
 #include "Engine/Mesh.h"
@@ -23,130 +31,245 @@
 namespace xe {
 
     static std::unordered_map<std::string, mat_function_t> mat_functions = {{}};
+    static TexturePacker *packer = nullptr;
 
     using uint = unsigned int;
 
-    Mesh *load_mesh_from_obj(std::string path, std::string mtl_dir) {
+    namespace {
+        void pack_textures(sMesh &smesh, const std::string &mtl_dir) {
+            // Scratch for the load, given back when the scope ends.
+            ArenaScope scope(load_arena());
+            auto &arena = scope.arena();
+            std::pmr::vector<int> texture_ids(smesh.materials.size(), -1, &arena);
+            for (size_t m = 0; m < smesh.materials.size(); m++) {
+                const auto &name = smesh.materials[m].diffuse_texname;
+                if (!name.empty())
+                    texture_ids[m] = packer->add(mtl_dir + "/" + name);
+            }
+            packer->build();
+
+            if (!smesh.has_texcoords[0])
+                return;
+            auto &uv = smesh.vertex_texcoords[0];
+            // Vertices shared by submeshes with different atlas regions cannot be remapped for both.
+            std::pmr::vector<int> remapped(uv.size(), -1, &arena);
+            bool clamped = false;
+            for (const auto &sm: smesh.submeshes) {
+                if (sm.mat_idx < 0 || texture_ids[sm.mat_idx] < 0)
+                    continue;
+                auto id = texture_ids[sm.mat_idx];
+                const auto &region = packer->region(id);
+                if (!region.in_atlas)
+                    continue;
+                for (int f = sm.start; f < sm.end; f++) {
+                    for (auto v: smesh.faces[f].v) {
+                        if (remapped[v] == id)
+                            continue;
+                        if (remapped[v] >= 0) {
+                            SPDLOG_WARN("Vertex {} is shared by two atlas regions", v);
+                            continue;
+                        }
+                        auto t = glm::clamp(uv[v], 0.0f, 1.0f);
+                        clamped = clamped || t != uv[v];
+                        uv[v] = region.remap(t);
+                        remapped[v] = id;
+                    }
+                }
+            }
+            if (clamped)
+                SPDLOG_WARN("Texture coordinates outside [0,1] were clamped, textures in the atlas cannot repeat");
+        }
 
+        Ref<Mesh> build_mesh(sMesh &smesh, const std::string &path, const std::string &mtl_dir) {
+            if (packer)
+                pack_textures(smesh, mtl_dir);
 
-        auto smesh = xe::load_smesh_from_obj(path, mtl_dir);
-        if (smesh.vertex_coords.empty())
-            return nullptr;
 
+            uint n_floats_per_vertex = 3;
+            for (auto &&t: smesh.has_texcoords) {
+                if (t)
+                    n_floats_per_vertex += 2;
+            }
+            if (smesh.has_normals)
+                n_floats_per_vertex += 3;
+            if (smesh.has_tangents)
+                n_floats_per_vertex += 4;
 
-        uint n_floats_per_vertex = 3;
-        for (auto &&t: smesh.has_texcoords) {
-            if (t)
-                n_floats_per_vertex += 2;
-        }
-        if (smesh.has_normals)
-            n_floats_per_vertex += 3;
-        if (smesh.has_tangents)
-            n_floats_per_vertex += 4;
 
+            size_t stride = n_floats_per_vertex * sizeof(GLfloat);
 
-        size_t stride = n_floats_per_vertex * sizeof(GLfloat);
+            auto n_vertices = smesh.vertex_coords.size();
+            auto n_indices = 3 * smesh.faces.size(); //assumes triangles
 
-        auto n_vertices = smesh.vertex_coords.size();
-        auto n_indices = 3 * smesh.faces.size(); //assumes triangles
+            SPDLOG_DEBUG("Loaded sMesh n_floats_per_vertex from {} : {} n_vertices: {} n_indices: {}", path,
+                         n_floats_per_vertex,
+                         n_vertices, n_indices);
 
-        SPDLOG_DEBUG("Loaded sMesh n_floats_per_vertex from {} : {} n_vertices: {} n_indices: {}", path,
-                     n_floats_per_vertex,
-                     n_vertices, n_indices);
+            size_t vertex_buffer_size = smesh.vertex_coords.size() * stride;
+            size_t index_buffer_size = smesh.faces.size() * 3 * sizeof(uint16_t);
 
-        size_t vertex_buffer_size = smesh.vertex_coords.size() * stride;
-        size_t index_buffer_size = smesh.faces.size() * 3 * sizeof(uint16_t);
+            SPDLOG_DEBUG("vertex_buffer_size: {} index_buffer_size: {}", vertex_buffer_size, index_buffer_size);
+            auto mesh = Ref<Mesh>::make(stride, vertex_buffer_size, GL_STATIC_DRAW,
+                                        index_buffer_size, GL_UNSIGNED_SHORT, GL_STATIC_DRAW);
 
-        SPDLOG_DEBUG("vertex_buffer_size: {} index_buffer_size: {}", vertex_buffer_size, index_buffer_size);
-        auto mesh = new Mesh(stride, vertex_buffer_size, GL_STATIC_DRAW,
-                             index_buffer_size, GL_UNSIGNED_SHORT, GL_STATIC_DRAW);
 
+            mesh->load_indices(0, n_indices * sizeof(uint16_t), smesh.faces.data());
+            mesh->add_attribute(xe::AttributeType::POSITION, 3, GL_FLOAT, 0);
 
-        mesh->load_indices(0, n_indices * sizeof(uint16_t), smesh.faces.data());
-        mesh->add_attribute(xe::AttributeType::POSITION, 3, GL_FLOAT, 0);
 
+            auto v_ptr = reinterpret_cast<uint8_t *>(mesh->map_vertex_buffer());
 
-        auto v_ptr = reinterpret_cast<uint8_t *>(mesh->map_vertex_buffer());
+            // The interleaving, the upload and the materials, up to the end of the function.
+            XE_PERF_SCOPE("build mesh", n_vertices);
+            size_t offset = 0;
 
-        size_t offset = 0;
+            {
 
-        {
+                auto v_offset = offset;
+                for (auto i = 0; i < smesh.vertex_coords.size(); i++, v_offset += stride) {
+                    SPDLOG_TRACE("vertex[{}] {} ", i, glm::to_string(smesh.vertex_coords[i]));
+                    std::memcpy(v_ptr + v_offset, glm::value_ptr(smesh.vertex_coords[i]), sizeof(glm::vec3));
+                }
+            }
+            offset += 3 * sizeof(GLfloat);
 
-            auto v_offset = offset;
-            for (auto i = 0; i < smesh.vertex_coords.size(); i++, v_offset += stride) {
-                SPDLOG_TRACE("vertex[{}] {} ", i, glm::to_string(smesh.vertex_coords[i]));
-                std::memcpy(v_ptr + v_offset, glm::value_ptr(smesh.vertex_coords[i]), sizeof(glm::vec3));
+            for (int it = 0; it < xe::sMesh::MAX_TEXCOORDS; it++) {
+                if (smesh.has_texcoords[it]) {
+                    mesh->add_attribute(static_cast<xe::AttributeType>(xe::AttributeType::TEXCOORD_0 + it), 2, GL_FLOAT,
+                                        offset);
+
+                    auto v_offset = offset;
+                    for (auto i = 0; i < smesh.vertex_texcoords[it].size(); i++, v_offset += stride) {
+                        SPDLOG_TRACE("texcoord[{}] {} ", i, glm::to_string(smesh.vertex_texcoords[0][i]));
+                        std::memcpy(v_ptr + v_offset, glm::value_ptr(smesh.vertex_texcoords[0][i]), sizeof(glm::vec2));
+                    }
+                    offset += 2 * sizeof(GLfloat);
+                }
             }
-        }
-        offset += 3 * sizeof(GLfloat);
+            if (smesh.has_normals) {
 
-        for (int it = 0; it < xe::sMesh::MAX_TEXCOORDS; it++) {
-            if (smesh.has_texcoords[it]) {
-                mesh->add_attribute(static_cast<xe::AttributeType>(xe::AttributeType::TEXCOORD_0 + it), 2, GL_FLOAT,
-                                    offset);
+                mesh->add_attribute(xe::AttributeType::NORMAL, 3, GL_FLOAT, offset);
 
                 auto v_offset = offset;
-                for (auto i = 0; i < smesh.vertex_texcoords[it].size(); i++, v_offset += stride) {
-                    SPDLOG_TRACE("texcoord[{}] {} ", i, glm::to_string(smesh.vertex_texcoords[0][i]));
-                    std::memcpy(v_ptr + v_offset, glm::value_ptr(smesh.vertex_texcoords[0][i]), sizeof(glm::vec2));
+                for (auto i = 0; i < smesh.vertex_normals.size(); i++, v_offset += stride) {
+                    SPDLOG_TRACE("normal[{}] {} ", i, glm::to_string(smesh.vertex_normals[i]));
+                    std::memcpy(v_ptr + v_offset, glm::value_ptr(smesh.vertex_normals[i]), sizeof(glm::vec3));
                 }
-                offset += 2 * sizeof(GLfloat);
-            }
-        }
-        if (smesh.has_normals) {
 
-            mesh->add_attribute(xe::AttributeType::NORMAL, 3, GL_FLOAT, offset);
+                offset += 3 * sizeof(GLfloat);
+            }
 
-            auto v_offset = offset;
-            for (auto i = 0; i < smesh.vertex_normals.size(); i++, v_offset += stride) {
-                SPDLOG_TRACE("normal[{}] {} ", i, glm::to_string(smesh.vertex_normals[i]));
-                std::memcpy(v_ptr + v_offset, glm::value_ptr(smesh.vertex_normals[i]), sizeof(glm::vec3));
+            if (smesh.has_tangents) {
+                mesh->add_attribute(xe::AttributeType::TANGENT, 4, GL_FLOAT, stride);
+                offset += 4 * sizeof(GLfloat);
             }
 
-            offset += 3 * sizeof(GLfloat);
-        }
+            mesh->unmap_vertex_buffer();
+
+
+            for (int i = 0; i < smesh.submeshes.size(); i++) {
+                auto sm = smesh.submeshes[i];
+
+                Material *material = (Material *) xe::NullMaterial::null_material();
+                if (sm.mat_idx >= 0) {
+                    const auto &mat = smesh.materials[sm.mat_idx];
+                    SPDLOG_DEBUG("Material illum {}", mat.illum);
+                    switch (mat.illum) {
+                        case 0:
+                            material = mat_functions["KdMaterial"](mat, mtl_dir);
+                            break;
+                        case 1:
+                            material = mat_functions["BlinnPhongMaterial"](mat, mtl_dir);
+                            break;
+                        case 2:
+                            material = mat_functions["BlinnPhongMaterial"](mat, mtl_dir);
+                            break;
+                        case 11:
+                            material = mat_functions["PBRMaterial"](mat, mtl_dir);
+                            break;
+                        default:
+                            spdlog::error("Unknown Illumimination model {}", mat.illum);
+                            break;
+                    }
+                    if (!material)
+                        material = (Material *) (xe::NullMaterial::null_material());
+
+                }
+
+                SPDLOG_DEBUG("Adding primitive {:4d} {:4d} {:4d}", i, 3 * sm.start, 3 * sm.end);
+                mesh->add_primitive(3 * sm.start, 3 * sm.end, material);
+            }
 
-        if (smesh.has_tangents) {
-            mesh->add_attribute(xe::AttributeType::TANGENT, 4, GL_FLOAT, stride);
-            offset += 4 * sizeof(GLfloat);
+            return mesh;
         }
 
-        mesh->unmap_vertex_buffer();
-
-
-        for (int i = 0; i < smesh.submeshes.size(); i++) {
-            auto sm = smesh.submeshes[i];
-
-            Material *material = (Material *) xe::NullMaterial::null_material();
-            if (sm.mat_idx >= 0) {
-                auto mat = smesh.materials[sm.mat_idx];
-                SPDLOG_DEBUG("Material illum {}", mat.illum);
-                switch (mat.illum) {
-                    case 0:
-                        material = mat_functions["KdMaterial"](mat, mtl_dir);
-                        break;
-                    case 1:
-                        material = mat_functions["BlinnPhongMaterial"](mat, mtl_dir);
-                        break;
-                    case 2:
-                        material = mat_functions["BlinnPhongMaterial"](mat, mtl_dir);
-                        break;
-                    case 11:
-                        material = mat_functions["PBRMaterial"](mat, mtl_dir);
-                        break;
-                    default:
-                        spdlog::error("Unknown Illumimination model {}", mat.illum);
-                        break;
+        // The obj file and the material libraries it references.
+        std::vector<std::string> mesh_files(const std::string &path, const std::string &mtl_dir) {
+            std::vector<std::string> files{path};
+            std::ifstream in(path);
+            std::string line;
+            while (std::getline(in, line)) {
+                std::istringstream words(line);
+                std::string keyword, name;
+                if (words >> keyword && keyword == "mtllib") {
+                    while (words >> name)
+                        files.push_back((mtl_dir.empty() ? std::string(".") : mtl_dir) + "/" + name);
                 }
-                if (!material)
-                    material = (Material *) (xe::NullMaterial::null_material());
-
             }
+            return files;
+        }
 
-            SPDLOG_DEBUG("Adding primitive {:4d} {:4d} {:4d}", i, 3 * sm.start, 3 * sm.end);
-            mesh->add_primitive(3 * sm.start, 3 * sm.end, material);
+        // Parsing runs in the background, the buffers are created and swapped in on the main thread. The
+        // callbacks hold a handle, not a reference, so a mesh destroyed while its reload is parsed is not
+        // brought back; the mesh unwatches its files when destroyed. Materials are created anew and the
+        // old ones, which only this mesh used, are deleted.
+        void watch_mesh(Mesh *mesh, Handle<Mesh> handle, const std::string &path, const std::string &mtl_dir) {
+            auto reload = [handle, path, mtl_dir]() {
+                FileWatcher::instance().background([handle, path, mtl_dir]() -> FileWatcher::continuation_t {
+                    XE_ALLOC_TAG(object_reader);
+                    auto smesh = std::make_shared<sMesh>(xe::load_smesh_from_obj(path, mtl_dir));
+                    return [handle, smesh, path, mtl_dir]() {
+                        XE_ALLOC_TAG(engine);
+                        auto mesh = ResourcePool<Mesh>::instance().get(handle);
+                        if (!mesh)
+                            return;
+                        if (smesh->vertex_coords.empty()) {
+                            SPDLOG_ERROR("Cannot reload `{}', keeping the last good version", path);
+                            return;
+                        }
+                        // The old buffers go with the fresh mesh.
+                        auto fresh = build_mesh(*smesh, path, mtl_dir);
+                        mesh->swap(*fresh);
+                        auto current = mesh->materials();
+                        for (auto material: fresh->materials()) {
+                            if (material != NullMaterial::null_material() &&
+                                std::find(current.begin(), current.end(), material) == current.end())
+                                delete material;
+                        }
+                    };
+                }, path);
+            };
+            std::vector<int> ids;
+            for (const auto &file: mesh_files(path, mtl_dir))
+                ids.push_back(FileWatcher::instance().watch(file, reload));
+            mesh->set_watch_ids(std::move(ids));
         }
+    }
+
+    Ref<Mesh> load_mesh_from_obj(std::string path, std::string mtl_dir) {
+        XE_ALLOC_TAG(engine);
+        XE_STARTUP_PHASE("load " + path);
+        auto smesh = [&]() {
+            XE_ALLOC_TAG(object_reader);
+            XE_PERF_SCOPE("parse OBJ", 0);
+            return xe::load_smesh_from_obj(path, mtl_dir);
+        }();
+        if (smesh.vertex_coords.empty())
+            return {};
 
+        auto mesh = build_mesh(smesh, path, mtl_dir);
+        if (FileWatcher::instance().enabled())
+            watch_mesh(mesh.get(), mesh.handle(), path, mtl_dir);
         return mesh;
     }
 
@@ -155,6 +278,14 @@ namespace xe {
         return func;
     }
 
+    void set_texture_packer(TexturePacker *new_packer) {
+        packer = new_packer;
+    }
+
+    TexturePacker *texture_packer() {
+        return packer;
+    }
+
     mat_function_t get_mat_function(std::string name) {
         auto it = mat_functions.find(name);
         if (it != mat_functions.end()) {
@@ -9,16 +9,28 @@
 #include <unordered_map>
 #include "ObjectReader/sMesh.h"
 
+#include "Application/resource_pool.h"
+
 #include "Engine/Material.h"
 #include "Engine/Mesh.h"
+#include "Engine/texture_packer.h"
 
 namespace xe {
 
     using mat_function_t = std::add_pointer<xe::Material *(const xe::mtl_material_t &mat, std::string mtl_dir)>::type;
 
-    Mesh *load_mesh_from_obj(std::string path, std::string mtl_dir);
+    // The mesh lives in ResourcePool<Mesh>, it is destroyed when the last Ref to it goes and its GL objects once
+    // the frames in flight are done with them (see DeletionQueue). Empty when the file cannot be read.
+    // Used to return a Mesh * that was never freed, callers now have to keep the Ref (get() gives the pointer).
+    Ref<Mesh> load_mesh_from_obj(std::string path, std::string mtl_dir);
 
 
     mat_function_t add_mat_function(std::string name, mat_function_t func);
     mat_function_t get_mat_function(std::string name);
+
+    // When set, load_mesh_from_obj packs the diffuse textures of the materials (map_Kd) and remaps the first set
+    // of texture coordinates into the packed regions. Material functions find their texture layer with
+    // texture_packer()->find(mtl_dir + "/" + mat.diffuse_texname).
+    void set_texture_packer(TexturePacker *packer);
+    TexturePacker *texture_packer();
 }
@@ -0,0 +1,202 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "mipmap.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XE_MIPMAP_SSE2
+
+#include <emmintrin.h>
+
+#endif
+
+namespace {
+
+    const int LINEAR_TO_SRGB_BITS = 12;
+    const int LINEAR_TO_SRGB_SIZE = 1 << LINEAR_TO_SRGB_BITS;
+
+    struct SrgbTables {
+        SrgbTables() {
+            for (int i = 0; i < 256; i++) {
+                auto c = i / 255.0f;
+                to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                unorm[i] = c;
+            }
+            for (int i = 0; i < LINEAR_TO_SRGB_SIZE; i++) {
+                auto l = i / float(LINEAR_TO_SRGB_SIZE - 1);
+                auto s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                to_srgb[i] = static_cast<uint8_t>(std::clamp(s * 255.0f + 0.5f, 0.0f, 255.0f));
+            }
+        }
+
+        std::array<float, 256> to_linear;
+        std::array<float, 256> unorm;
+        std::array<uint8_t, LINEAR_TO_SRGB_SIZE> to_srgb;
+    };
+
+    const SrgbTables &srgb_tables() {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    // Averages the 2x2 footprint in linear space and writes one sRGB pixel.
+    inline void average_srgb(const uint8_t *a0, const uint8_t *a1, const uint8_t *b0, const uint8_t *b1,
+                             uint8_t *dst, const SrgbTables &t) {
+#ifdef XE_MIPMAP_SSE2
+        auto load = [&t](const uint8_t *p) {
+            return _mm_set_ps(t.unorm[p[3]], t.to_linear[p[2]], t.to_linear[p[1]], t.to_linear[p[0]]);
+        };
+        const __m128 scale = _mm_set_ps(255.0f * 0.25f, (LINEAR_TO_SRGB_SIZE - 1) * 0.25f,
+                                        (LINEAR_TO_SRGB_SIZE - 1) * 0.25f, (LINEAR_TO_SRGB_SIZE - 1) * 0.25f);
+        __m128 sum = _mm_add_ps(_mm_add_ps(load(a0), load(a1)), _mm_add_ps(load(b0), load(b1)));
+        __m128i q = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(sum, scale), _mm_set1_ps(0.5f)));
+        alignas(16) int32_t idx[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(idx), q);
+#else
+        int32_t idx[4];
+        for (int c = 0; c < 3; c++) {
+            auto sum = t.to_linear[a0[c]] + t.to_linear[a1[c]] + t.to_linear[b0[c]] + t.to_linear[b1[c]];
+            idx[c] = static_cast<int32_t>(sum * 0.25f * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f);
+        }
+        idx[3] = (a0[3] + a1[3] + b0[3] + b1[3] + 2) >> 2;
+#endif
+        dst[0] = t.to_srgb[std::min(idx[0], LINEAR_TO_SRGB_SIZE - 1)];
+        dst[1] = t.to_srgb[std::min(idx[1], LINEAR_TO_SRGB_SIZE - 1)];
+        dst[2] = t.to_srgb[std::min(idx[2], LINEAR_TO_SRGB_SIZE - 1)];
+        dst[3] = static_cast<uint8_t>(std::min(idx[3], 255));
+    }
+
+    inline void average_unorm(const uint8_t *a0, const uint8_t *a1, const uint8_t *b0, const uint8_t *b1,
+                              uint8_t *dst) {
+        for (int c = 0; c < 4; c++)
+            dst[c] = static_cast<uint8_t>((a0[c] + a1[c] + b0[c] + b1[c] + 2) >> 2);
+    }
+
+    // Averages an nx by ny footprint, used for the last row and column of odd sized levels, where the extra
+    // source row or column is folded into the last destination pixel instead of being skipped.
+    void average_footprint(const uint8_t *src, size_t stride, int x0, int nx, int y0, int ny, uint8_t *dst,
+                           bool srgb, const SrgbTables &t) {
+        float sum[4] = {};
+        for (int y = y0; y < y0 + ny; y++) {
+            for (int x = x0; x < x0 + nx; x++) {
+                auto p = src + y * stride + x * 4;
+                for (int c = 0; c < 3; c++)
+                    sum[c] += srgb ? t.to_linear[p[c]] : p[c];
+                sum[3] += p[3];
+            }
+        }
+        auto n = static_cast<float>(nx * ny);
+        for (int c = 0; c < 3; c++) {
+            if (srgb) {
+                auto idx = static_cast<int>(sum[c] / n * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f);
+                dst[c] = t.to_srgb[std::min(idx, LINEAR_TO_SRGB_SIZE - 1)];
+            } else {
+                dst[c] = static_cast<uint8_t>(std::min(sum[c] / n + 0.5f, 255.0f));
+            }
+        }
+        dst[3] = static_cast<uint8_t>(std::min(sum[3] / n + 0.5f, 255.0f));
+    }
+
+#ifdef XE_MIPMAP_SSE2
+
+    // Two destination pixels from a 4x2 block of source pixels, all in 16 bit integer lanes.
+    inline void average_unorm_x2(const uint8_t *row0, const uint8_t *row1, uint8_t *dst) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1));
+        __m128i s_lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i s_hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+        s_lo = _mm_add_epi16(s_lo, _mm_srli_si128(s_lo, 8));
+        s_hi = _mm_add_epi16(s_hi, _mm_srli_si128(s_hi, 8));
+        __m128i d = _mm_unpacklo_epi64(s_lo, s_hi);
+        d = _mm_srli_epi16(_mm_add_epi16(d, _mm_set1_epi16(2)), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(d, zero));
+    }
+
+#endif
+}
+
+namespace xe {
+
+    int mip_levels_count(int width, int height) {
+        int levels = 1;
+        while (width > 1 || height > 1) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            levels++;
+        }
+        return levels;
+    }
+
+    void downsample_rgba8(const uint8_t *src, int src_w, int src_h, uint8_t *dst, int dst_w, int dst_h, bool srgb) {
+        const auto &tables = srgb_tables();
+        const size_t src_stride = static_cast<size_t>(src_w) * 4;
+        // An odd edge longer than 1 has one source row (column) more than twice the destination, the last
+        // destination row (column) then averages three of them.
+        const bool odd_w = src_w > 1 && src_w % 2 == 1;
+        const bool odd_h = src_h > 1 && src_h % 2 == 1;
+        for (int y = 0; y < dst_h; y++) {
+            auto row0 = src + std::min(2 * y, src_h - 1) * src_stride;
+            auto row1 = src + std::min(2 * y + 1, src_h - 1) * src_stride;
+            auto out = dst + static_cast<size_t>(y) * dst_w * 4;
+            const bool last_row = odd_h && y == dst_h - 1;
+            int x = 0;
+#ifdef XE_MIPMAP_SSE2
+            if (!srgb && !last_row) {
+                for (; x + 2 <= dst_w && 2 * x + 4 <= src_w; x += 2)
+                    average_unorm_x2(row0 + 8 * x, row1 + 8 * x, out + 4 * x);
+            }
+#endif
+            for (; x < dst_w; x++) {
+                const bool last_column = odd_w && x == dst_w - 1;
+                if (last_row || last_column) {
+                    auto nx = last_column ? 3 : std::min(src_w, 2);
+                    auto ny = last_row ? 3 : std::min(src_h, 2);
+                    average_footprint(src, src_stride, std::min(2 * x, src_w - 1), nx, std::min(2 * y, src_h - 1), ny,
+                                      out + 4 * x, srgb, tables);
+                    continue;
+                }
+                auto x0 = std::min(2 * x, src_w - 1) * 4;
+                auto x1 = std::min(2 * x + 1, src_w - 1) * 4;
+                if (srgb)
+                    average_srgb(row0 + x0, row0 + x1, row1 + x0, row1 + x1, out + 4 * x, tables);
+                else
+                    average_unorm(row0 + x0, row0 + x1, row1 + x0, row1 + x1, out + 4 * x);
+            }
+        }
+    }
+
+    MipChain build_mip_chain(const uint8_t *rgba, int width, int height, bool srgb) {
+        MipChain chain;
+        chain.width = width;
+        chain.height = height;
+        chain.srgb = srgb;
+
+        auto n_levels = mip_levels_count(width, height);
+        chain.levels.reserve(n_levels);
+        size_t offset = 0;
+        int w = width, h = height;
+        for (int l = 0; l < n_levels; l++) {
+            chain.levels.push_back({w, h, offset});
+            offset += chain.levels.back().size();
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        chain.data.resize(offset);
+
+        std::memcpy(chain.level_data(0), rgba, chain.levels[0].size());
+        for (int l = 1; l < n_levels; l++) {
+            const auto &src = chain.levels[l - 1];
+            const auto &dst = chain.levels[l];
+            downsample_rgba8(chain.level_data(l - 1), src.width, src.height,
+                             chain.level_data(l), dst.width, dst.height, srgb);
+        }
+        return chain;
+    }
+}
@@ -0,0 +1,54 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace xe {
+
+    /**
+     * @brief Complete chain of RGBA8 mip levels kept in one contiguous block of memory.
+     *
+     * Level 0 is the original image, level n_levels()-1 is 1x1.
+     */
+    struct MipChain {
+        struct Level {
+            int width;
+            int height;
+            size_t offset;
+
+            size_t size() const { return static_cast<size_t>(width) * height * 4; }
+        };
+
+        int width = 0;
+        int height = 0;
+        bool srgb = false;
+        std::vector<Level> levels;
+        std::vector<uint8_t> data;
+
+        int n_levels() const { return static_cast<int>(levels.size()); }
+
+        const uint8_t *level_data(int level) const { return data.data() + levels[level].offset; }
+
+        uint8_t *level_data(int level) { return data.data() + levels[level].offset; }
+
+        size_t size() const { return data.size(); }
+    };
+
+    int mip_levels_count(int width, int height);
+
+    /**
+     * @brief Builds a full mip chain from RGBA8 pixels using a 2x2 box filter.
+     *
+     * The last row and column of a level with an odd size are 3 pixels wide, so no source pixel is dropped.
+     * When srgb is true the colour channels are averaged in linear space (alpha is always linear),
+     * which keeps the coarser levels from getting darker. The inner loops use SSE2 when available.
+     */
+    MipChain build_mip_chain(const uint8_t *rgba, int width, int height, bool srgb);
+
+    void downsample_rgba8(const uint8_t *src, int src_w, int src_h, uint8_t *dst, int dst_w, int dst_h, bool srgb);
+}
@@ -0,0 +1,56 @@
+// Virtual texture sampling, the C++ side is xe::VirtualTexture (src/Engine/virtual_texture.h),
+// which also sets all the uniforms below in VirtualTexture::bind.
+//
+// vt_sample(uv) returns the texel for ordinary texture coordinates, vt_feedback(uv) returns the
+// encoded page that the fragment needs and is written by the feedback pass.
+
+uniform sampler2D vt_atlas;
+uniform sampler2D vt_indirection;
+uniform vec2 vt_pages;              // page grid of level 0
+uniform vec2 vt_uv_scale;           // part of the page grid covered by the image
+uniform vec4 vt_page;               // tile size, border, page size, atlas size (all in texels)
+uniform float vt_max_level;
+uniform float vt_feedback_lod_bias; // the feedback buffer is smaller than the frame buffer
+
+float vt_lod(vec2 uv) {
+    vec2 texels = uv * vt_uv_scale * vt_pages * vt_page.x;
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+
+// Pages of the level covered by the image. With a non-square grid the shorter axis gets below one page
+// on the coarse levels, the image then fills only a part of the page along it.
+vec2 vt_level_pages(int level) {
+    return vt_pages * exp2(-float(level));
+}
+
+ivec2 vt_page_at(vec2 vuv, int level) {
+    ivec2 pages = max(ivec2(vt_pages) >> level, ivec2(1));
+    return clamp(ivec2(vuv * vt_level_pages(level)), ivec2(0), pages - 1);
+}
+
+vec4 vt_sample_level(vec2 vuv, int level) {
+    ivec4 entry = ivec4(texelFetch(vt_indirection, vt_page_at(vuv, level), level) * 255.0 + 0.5);
+    if (entry.a == 0)
+        return vec4(0.0);
+
+    // The entry may point to a coarser page than requested when the page is not resident yet.
+    vec2 in_page = clamp(vuv * vt_level_pages(entry.b) - vec2(vt_page_at(vuv, entry.b)), 0.0, 1.0);
+    vec2 texel = vec2(entry.rg) * vt_page.z + vt_page.y + in_page * vt_page.x;
+    return textureLod(vt_atlas, texel / vt_page.w, 0.0);
+}
+
+vec4 vt_sample(vec2 uv) {
+    float lod = clamp(vt_lod(uv), 0.0, vt_max_level);
+    vec2 vuv = fract(uv) * vt_uv_scale;
+    int level = int(lod);
+    int next_level = min(level + 1, int(vt_max_level));
+    return mix(vt_sample_level(vuv, level), vt_sample_level(vuv, next_level), fract(lod));
+}
+
+vec4 vt_feedback(vec2 uv) {
+    int level = int(clamp(vt_lod(uv) + vt_feedback_lod_bias, 0.0, vt_max_level));
+    ivec2 page = vt_page_at(fract(uv) * vt_uv_scale, level);
+    return vec4(page.x & 255, page.y & 255, (page.x >> 8) | ((page.y >> 8) << 4), level) / 255.0;
+}
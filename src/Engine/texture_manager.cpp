@@ -0,0 +1,256 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "texture_manager.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "spdlog/spdlog.h"
+#include "imgui.h"
+
+#include "Application/alloc_tracker.h"
+#include "Application/arena.h"
+#include "Application/overlay.h"
+#include "Application/perf_counters.h"
+
+namespace {
+    float triangle_area(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+        return 0.5f * glm::length(glm::cross(b - a, c - a));
+    }
+
+    float triangle_area(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c) {
+        auto u = b - a;
+        auto v = c - a;
+        return 0.5f * std::abs(u.x * v.y - u.y * v.x);
+    }
+
+    double to_mb(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+}
+
+namespace xe {
+
+    float estimate_uv_density(const sMesh &mesh, int texcoord_set) {
+        if (!mesh.has_texcoords[texcoord_set])
+            return 0.0f;
+        const auto &uv = mesh.vertex_texcoords[texcoord_set];
+        const auto &p = mesh.vertex_coords;
+        double world_area = 0.0, uv_area = 0.0;
+        for (const auto &face: mesh.faces) {
+            auto [i, j, k] = face.v;
+            world_area += triangle_area(p[i], p[j], p[k]);
+            uv_area += triangle_area(uv[i], uv[j], uv[k]);
+        }
+        if (world_area <= 0.0)
+            return 0.0f;
+        return static_cast<float>(std::sqrt(uv_area / world_area));
+    }
+
+    TextureManager::TextureManager(size_t vram_budget, size_t upload_budget) :
+            streamer_(new TextureStreamer(upload_budget)), budget_(vram_budget),
+            view_{glm::vec3(0.0f), 1.0f, 1} {
+        overlay_panel_ = overlay::add_panel("Textures", [this]() { draw_overlay(); });
+    }
+
+    TextureManager::~TextureManager() {
+        overlay::remove_panel(overlay_panel_);
+    }
+
+    Texture *TextureManager::load(const std::string &path, bool srgb) {
+        auto texture = streamer_->load(path, srgb);
+        // Only the 1x1 level gets storage at first, the manager streams in the rest when it is needed.
+        streamer_->set_storage_level(texture, 1 << 16);
+        index_[texture] = entries_.size();
+        entries_.push_back({texture, 0, 0});
+        return texture;
+    }
+
+    void TextureManager::begin_frame(const ViewInfo &view) {
+        view_ = view;
+        frame_++;
+    }
+
+    int TextureManager::required_level(const Texture *texture, const glm::vec3 &center, float radius,
+                                       float uv_density) const {
+        if (texture->n_levels() == 0 || uv_density <= 0.0f)
+            return 0;
+
+        auto distance = std::max(glm::length(view_.eye - center) - radius, 1e-3f);
+        auto pixels_per_unit = view_.viewport_height / (2.0f * distance * std::tan(0.5f * view_.fov_y));
+        auto texels_per_unit = uv_density * std::max(texture->width(), texture->height());
+        auto level = static_cast<int>(std::floor(std::log2(texels_per_unit / pixels_per_unit)));
+        return std::clamp(level, 0, texture->n_levels() - 1);
+    }
+
+    void TextureManager::request(Texture *texture, const glm::vec3 &center, float radius, float uv_density) {
+        request_level(texture, required_level(texture, center, radius, uv_density));
+    }
+
+    void TextureManager::request_level(Texture *texture, int level) {
+        auto it = index_.find(texture);
+        if (it == index_.end()) {
+            SPDLOG_WARN("Texture `{}' is not managed", texture->path());
+            return;
+        }
+        auto &entry = entries_[it->second];
+        if (entry.last_used_frame != frame_)
+            entry.wanted_level = level;
+        else
+            entry.wanted_level = std::min(entry.wanted_level, level);
+        entry.last_used_frame = frame_;
+    }
+
+    int TextureManager::tail_level(const Texture *texture) const {
+        int level = 0;
+        while (level < texture->n_levels() - 1 &&
+               std::max(texture->level_width(level), texture->level_height(level)) > MIN_RESIDENT_SIZE)
+            level++;
+        return level;
+    }
+
+    int TextureManager::target_level(const Entry &entry) const {
+        auto texture = entry.texture;
+        if (texture->n_levels() == 0)
+            return 0;
+        auto level = entry.last_used_frame == frame_ ? entry.wanted_level : texture->storage_level();
+        return std::min(level, tail_level(texture));
+    }
+
+    size_t TextureManager::resident_bytes() const {
+        size_t bytes = 0;
+        for (const auto &entry: entries_)
+            bytes += entry.texture->resident_bytes();
+        return bytes;
+    }
+
+    bool TextureManager::evict_one(const Entry *exclude) {
+        // Textures holding more than they currently need go first, then the least recently used ones.
+        // Textures drawn in this frame at their wanted level are never evicted, that would only thrash.
+        const Entry *victim = nullptr;
+        bool victim_surplus = false;
+        for (const auto &entry: entries_) {
+            auto texture = entry.texture;
+            if (&entry == exclude || !texture->handle() || texture->storage_level() >= tail_level(texture))
+                continue;
+            bool surplus = texture->storage_level() < target_level(entry);
+            if (entry.last_used_frame == frame_ && !surplus)
+                continue;
+            if (!victim || (surplus && !victim_surplus) ||
+                (surplus == victim_surplus && entry.last_used_frame < victim->last_used_frame)) {
+                victim = &entry;
+                victim_surplus = surplus;
+            }
+        }
+        if (!victim)
+            return false;
+
+        // A surplus texture goes straight to the level it needs, every change reallocates its storage.
+        auto texture = victim->texture;
+        auto level = victim_surplus ? target_level(*victim) : texture->storage_level() + 1;
+        streamer_->set_storage_level(texture, level);
+        evictions_++;
+        evictions_last_frame_++;
+        return true;
+    }
+
+    void TextureManager::update() {
+        XE_ALLOC_TAG(engine);
+        evictions_last_frame_ = 0;
+        stream_ins_last_frame_ = 0;
+        int changes = 0;
+
+        ArenaScope scope(frame_arena());
+        std::pmr::vector<Entry *> candidates(&scope.arena());
+        for (auto &entry: entries_) {
+            auto texture = entry.texture;
+            if (texture->handle() && target_level(entry) < texture->storage_level())
+                candidates.push_back(&entry);
+        }
+        {
+            XE_PERF_SCOPE("sort eviction candidates", candidates.size());
+            std::sort(candidates.begin(), candidates.end(), [this](const Entry *a, const Entry *b) {
+                if (a->last_used_frame != b->last_used_frame)
+                    return a->last_used_frame > b->last_used_frame;
+                return a->texture->storage_level() - target_level(*a) >
+                       b->texture->storage_level() - target_level(*b);
+            });
+        }
+
+        auto resident = resident_bytes();
+        for (auto entry: candidates) {
+            if (changes >= max_changes_per_frame_)
+                break;
+            auto texture = entry->texture;
+            auto target = target_level(*entry);
+            while (target < texture->storage_level()) {
+                auto needed = texture->bytes_from_level(target) - texture->resident_bytes();
+                if (resident + needed <= budget_)
+                    break;
+                if (changes < max_changes_per_frame_ && evict_one(entry)) {
+                    changes++;
+                    resident = resident_bytes();
+                } else {
+                    target++;
+                }
+            }
+            if (target < texture->storage_level()) {
+                streamer_->set_storage_level(texture, target);
+                resident = resident_bytes();
+                stream_ins_++;
+                stream_ins_last_frame_++;
+                changes++;
+            }
+        }
+
+        // The budget could have been lowered.
+        while (resident > budget_ && changes < max_changes_per_frame_ && evict_one(nullptr)) {
+            resident = resident_bytes();
+            changes++;
+        }
+
+        streamer_->update();
+
+        auto s = stats();
+        auto streaming = streamer_->stats();
+        std::lock_guard<std::mutex> lock(overlay_mutex_);
+        overlay_stats_ = s;
+        overlay_streaming_ = streaming;
+    }
+
+    TextureManager::Stats TextureManager::stats() const {
+        Stats stats;
+        stats.budget = budget_;
+        stats.n_textures = entries_.size();
+        for (const auto &entry: entries_) {
+            auto texture = entry.texture;
+            stats.resident_bytes += texture->resident_bytes();
+            if (texture->n_levels() > 0) {
+                auto target = target_level(entry);
+                stats.wanted_bytes += texture->bytes_from_level(target);
+                if (texture->base_level() <= target)
+                    stats.n_at_wanted_level++;
+            }
+        }
+        stats.evictions = evictions_;
+        stats.evictions_last_frame = evictions_last_frame_;
+        stats.stream_ins = stream_ins_;
+        stats.stream_ins_last_frame = stream_ins_last_frame_;
+        return stats;
+    }
+
+    void TextureManager::draw_overlay() const {
+        std::unique_lock<std::mutex> lock(overlay_mutex_);
+        auto s = overlay_stats_;
+        auto streaming = overlay_streaming_;
+        lock.unlock();
+        ImGui::Text("Budget: %.1f MB", to_mb(s.budget));
+        ImGui::ProgressBar(s.budget ? float(double(s.resident_bytes) / s.budget) : 0.0f, ImVec2(160.0f, 0.0f));
+        ImGui::Text("Resident: %.1f MB  wanted: %.1f MB", to_mb(s.resident_bytes), to_mb(s.wanted_bytes));
+        ImGui::Text("Textures: %zu  at wanted level: %zu", s.n_textures, s.n_at_wanted_level);
+        ImGui::Text("Evictions: %zu (+%zu)  stream-ins: %zu (+%zu)", s.evictions, s.evictions_last_frame,
+                    s.stream_ins, s.stream_ins_last_frame);
+        ImGui::Text("Decoding: %zu  uploading: %zu  uploaded: %.1f MB/frame", streaming.pending_decode,
+                    streaming.uploading, to_mb(streaming.bytes_uploaded_last_frame));
+    }
+}
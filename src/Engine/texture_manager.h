@@ -0,0 +1,127 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Application/RegisteredObject.h"
+#include "ObjectReader/sMesh.h"
+#include "texture_streamer.h"
+
+namespace xe {
+
+    /**
+     * @brief Ratio of texture space to object space edge length, averaged over the mesh.
+     *
+     * Multiplied by the texture size it gives the number of texels per unit length on the surface.
+     */
+    float estimate_uv_density(const sMesh &mesh, int texcoord_set = 0);
+
+    /**
+     * @brief Keeps every texture at the mip level its on-screen usage needs, within a GPU memory budget.
+     *
+     * Every frame the application calls begin_frame() with the current view, reports the textures it draws
+     * with request() and finally calls update(). The manager estimates the finest useful level from the
+     * bounds of the geometry, its UV density and the distance to the camera. Missing levels are streamed in
+     * (most recently used textures first); when this would exceed the budget the finest levels of the least
+     * recently used textures are evicted. The coarsest levels are never evicted, so every texture can always
+     * be sampled. No CPU copies are kept, evicted levels are decoded from the file again when they are needed.
+     */
+    class TextureManager : public RegisteredObject {
+    public:
+        struct ViewInfo {
+            glm::vec3 eye;
+            float fov_y;
+            int viewport_height;
+        };
+
+        struct Stats {
+            size_t budget = 0;
+            size_t resident_bytes = 0;
+            size_t wanted_bytes = 0;
+            size_t n_textures = 0;
+            size_t n_at_wanted_level = 0;
+            size_t evictions = 0;
+            size_t evictions_last_frame = 0;
+            size_t stream_ins = 0;
+            size_t stream_ins_last_frame = 0;
+        };
+
+        // Levels of this size and below (in texels, along the longer edge) are always resident.
+        static const int MIN_RESIDENT_SIZE = 64;
+
+        explicit TextureManager(size_t vram_budget, size_t upload_budget = 16u << 20);
+
+        ~TextureManager() override;
+
+        Texture *load(const std::string &path, bool srgb = true);
+
+        void begin_frame(const ViewInfo &view);
+
+        // The texture is used by the geometry with the given world space bounding sphere.
+        void request(Texture *texture, const glm::vec3 &center, float radius, float uv_density);
+
+        void request_level(Texture *texture, int level);
+
+        int required_level(const Texture *texture, const glm::vec3 &center, float radius, float uv_density) const;
+
+        // Rebalances residency and streams pending uploads, call once per frame on the GL thread.
+        void update();
+
+        size_t budget() const { return budget_; }
+
+        void set_budget(size_t budget) { budget_ = budget; }
+
+        // Number of texture reallocations allowed per frame, each one copies the resident levels on the GPU.
+        void set_max_changes_per_frame(int n) { max_changes_per_frame_ = n; }
+
+        Stats stats() const;
+
+        TextureStreamer *streamer() const { return streamer_; }
+
+        // Shows the statistics of the last update(), the overlay may be drawn on another thread.
+        void draw_overlay() const;
+
+    private:
+        struct Entry {
+            Texture *texture;
+            int wanted_level;
+            uint64_t last_used_frame;
+        };
+
+        int tail_level(const Texture *texture) const;
+
+        int target_level(const Entry &entry) const;
+
+        bool evict_one(const Entry *exclude);
+
+        size_t resident_bytes() const;
+
+        TextureStreamer *streamer_;
+        size_t budget_;
+        int max_changes_per_frame_ = 8;
+        int overlay_panel_;
+
+        ViewInfo view_;
+        uint64_t frame_ = 0;
+
+        std::vector<Entry> entries_;
+        std::unordered_map<const Texture *, size_t> index_;
+
+        size_t evictions_ = 0;
+        size_t evictions_last_frame_ = 0;
+        size_t stream_ins_ = 0;
+        size_t stream_ins_last_frame_ = 0;
+
+        mutable std::mutex overlay_mutex_;
+        Stats overlay_stats_;
+        TextureStreamer::Stats overlay_streaming_;
+    };
+}
@@ -0,0 +1,307 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "texture_packer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+#include "spdlog/spdlog.h"
+
+#include "stb/stb_image.h"
+
+#include "Application/job_system.h"
+#include "Application/utils.h"
+#include "mipmap.h"
+
+namespace xe {
+
+    SkylinePacker::SkylinePacker(int width, int height) : width_(width), height_(height) {
+        skyline_.push_back({0, 0, width});
+    }
+
+    int SkylinePacker::fit(size_t i, int w, int h) const {
+        auto x = skyline_[i].x;
+        if (x + w > width_)
+            return -1;
+        int y = 0;
+        int left = w;
+        for (; left > 0; i++) {
+            y = std::max(y, skyline_[i].y);
+            if (y + h > height_)
+                return -1;
+            left -= skyline_[i].width;
+        }
+        return y;
+    }
+
+    bool SkylinePacker::insert(int w, int h, int &x, int &y) {
+        int best = -1, best_y = height_, best_width = width_;
+        for (size_t i = 0; i < skyline_.size(); i++) {
+            auto top = fit(i, w, h);
+            if (top < 0)
+                continue;
+            if (top < best_y || (top == best_y && skyline_[i].width < best_width)) {
+                best = static_cast<int>(i);
+                best_y = top;
+                best_width = skyline_[i].width;
+            }
+        }
+        if (best < 0)
+            return false;
+
+        x = skyline_[best].x;
+        y = best_y;
+        skyline_.insert(skyline_.begin() + best, {x, y + h, w});
+
+        // Shrink or remove the nodes now covered by the new one.
+        for (size_t i = best + 1; i < skyline_.size();) {
+            auto &prev = skyline_[i - 1];
+            auto &node = skyline_[i];
+            if (node.x >= prev.x + prev.width)
+                break;
+            auto shrink = prev.x + prev.width - node.x;
+            node.x += shrink;
+            node.width -= shrink;
+            if (node.width > 0)
+                break;
+            skyline_.erase(skyline_.begin() + i);
+        }
+        // Merge neighbours at the same height.
+        for (size_t i = 0; i + 1 < skyline_.size();) {
+            if (skyline_[i].y == skyline_[i + 1].y) {
+                skyline_[i].width += skyline_[i + 1].width;
+                skyline_.erase(skyline_.begin() + i + 1);
+            } else {
+                i++;
+            }
+        }
+        used_area_ += static_cast<size_t>(w) * h;
+        return true;
+    }
+
+    TexturePacker::TexturePacker(int atlas_size, int padding, int min_array_group) :
+            atlas_size_(atlas_size), padding_(std::max(1, padding)), min_array_group_(min_array_group) {
+        if (padding_ & (padding_ - 1)) {
+            SPDLOG_WARN("Atlas padding {} is not a power of two", padding_);
+        }
+    }
+
+    TexturePacker::~TexturePacker() {
+        if (!textures_.empty())
+            glDeleteTextures(static_cast<GLsizei>(textures_.size()), textures_.data());
+    }
+
+    int TexturePacker::add(const std::string &path, bool srgb, bool flip_vertically) {
+        auto it = index_.find(path);
+        if (it != index_.end())
+            return it->second;
+        auto id = static_cast<int>(entries_.size());
+        entries_.push_back({path, srgb, flip_vertically});
+        index_[path] = id;
+        return id;
+    }
+
+    const TextureRegion *TexturePacker::find(const std::string &path) const {
+        auto it = index_.find(path);
+        if (it == index_.end() || !built(it->second))
+            return nullptr;
+        return &regions_[it->second];
+    }
+
+    void TexturePacker::build() {
+        const int first = static_cast<int>(regions_.size());
+        const int n = static_cast<int>(entries_.size()) - first;
+        if (n == 0)
+            return;
+        regions_.resize(entries_.size());
+
+        // Decoding is by far the slowest part, it is spread over all cores.
+        std::vector<Image> images(n);
+        JobSystem::instance().parallel_for(0, n, [&](size_t i) {
+            const auto &entry = entries_[first + i];
+            auto &image = images[i];
+            stbi_set_flip_vertically_on_load_thread(entry.flip_vertically);
+            int channels;
+            auto pixels = stbi_load(entry.path.c_str(), &image.width, &image.height, &channels, 4);
+            if (pixels) {
+                image.pixels.assign(pixels, pixels + static_cast<size_t>(image.width) * image.height * 4);
+                stbi_image_free(pixels);
+            } else {
+                SPDLOG_ERROR("Cannot decode texture `{}': {}", entry.path, stbi_failure_reason());
+                image.width = image.height = 1;
+                image.pixels.assign(4, 255);
+            }
+        });
+
+        std::map<std::tuple<int, int, bool>, std::vector<int>> groups;
+        for (int i = 0; i < n; i++)
+            groups[{images[i].width, images[i].height, entries_[first + i].srgb}].push_back(first + i);
+
+        std::vector<int> atlas_ids[2];
+        for (const auto &[key, ids]: groups) {
+            auto [width, height, srgb] = key;
+            auto fits_atlas = padded_size(std::max(width, height)) <= atlas_size_;
+            if (static_cast<int>(ids.size()) >= min_array_group_ || !fits_atlas)
+                build_array(ids, images, first, srgb);
+            else
+                atlas_ids[srgb].insert(atlas_ids[srgb].end(), ids.begin(), ids.end());
+        }
+        for (int srgb = 0; srgb < 2; srgb++) {
+            if (!atlas_ids[srgb].empty())
+                build_atlas(atlas_ids[srgb], images, first, srgb);
+        }
+
+        auto s = stats();
+        SPDLOG_INFO("Packed {} textures into {} array textures: {} layers, {} atlas pages ({:.0f}% used)",
+                    s.n_textures, s.n_array_textures, s.n_layers, s.n_atlas_pages, 100.0f * s.atlas_occupancy);
+    }
+
+    namespace {
+        GLuint create_array_texture(int width, int height, int n_levels, int n_layers, bool srgb, GLenum wrap) {
+            GLuint texture;
+            OGL_CALL(glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture));
+            OGL_CALL(glTextureStorage3D(texture, n_levels, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height,
+                                        n_layers));
+            OGL_CALL(glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+            OGL_CALL(glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            OGL_CALL(glTextureParameteri(texture, GL_TEXTURE_WRAP_S, wrap));
+            OGL_CALL(glTextureParameteri(texture, GL_TEXTURE_WRAP_T, wrap));
+            OGL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+            return texture;
+        }
+
+        void upload_layer(GLuint texture, int layer, const MipChain &mips, int n_levels) {
+            for (int l = 0; l < n_levels; l++) {
+                const auto &level = mips.levels[l];
+                OGL_CALL(glTextureSubImage3D(texture, l, 0, 0, layer, level.width, level.height, 1,
+                                             GL_RGBA, GL_UNSIGNED_BYTE, mips.level_data(l)));
+            }
+        }
+
+        int max_array_layers() {
+            GLint layers = 256;
+            glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layers);
+            return layers;
+        }
+    }
+
+    void TexturePacker::build_array(const std::vector<int> &ids, const std::vector<Image> &images, int first,
+                                    bool srgb) {
+        const auto &front = images[ids.front() - first];
+        const int n_levels = mip_levels_count(front.width, front.height);
+        const int max_layers = max_array_layers();
+
+        for (size_t start = 0; start < ids.size(); start += max_layers) {
+            auto n_layers = static_cast<int>(std::min<size_t>(ids.size() - start, max_layers));
+            auto texture = create_array_texture(front.width, front.height, n_levels, n_layers, srgb, GL_REPEAT);
+            textures_.push_back(texture);
+
+            for (int layer = 0; layer < n_layers; layer++) {
+                auto id = ids[start + layer];
+                const auto &image = images[id - first];
+                upload_layer(texture, layer, build_mip_chain(image.pixels.data(), image.width, image.height, srgb),
+                             n_levels);
+                regions_[id] = {texture, layer, glm::vec2(0.0f), glm::vec2(1.0f), false};
+            }
+            n_layers_ += n_layers;
+        }
+    }
+
+    void TexturePacker::build_atlas(const std::vector<int> &ids, const std::vector<Image> &images, int first,
+                                    bool srgb) {
+        // Tallest first gives a much flatter skyline.
+        auto sorted = ids;
+        std::sort(sorted.begin(), sorted.end(), [&](int a, int b) {
+            return images[a - first].height > images[b - first].height;
+        });
+
+        std::vector<SkylinePacker> packers;
+        std::vector<std::vector<uint8_t>> pages;
+        const size_t row_bytes = static_cast<size_t>(atlas_size_) * 4;
+        std::vector<std::pair<int, glm::ivec2>> placements(sorted.size());
+
+        for (size_t i = 0; i < sorted.size(); i++) {
+            const auto &image = images[sorted[i] - first];
+            // Sizes rounded up to the padding keep every entry aligned to whole texels in all atlas mip levels.
+            auto w = padded_size(image.width);
+            auto h = padded_size(image.height);
+            int x = 0, y = 0;
+            size_t page = 0;
+            while (page < packers.size() && !packers[page].insert(w, h, x, y))
+                page++;
+            if (page == packers.size()) {
+                SkylinePacker packer(atlas_size_, atlas_size_);
+                if (!packer.insert(w, h, x, y)) {
+                    // Does not fit even an empty page, it gets a layer of its own.
+                    placements[i] = {-1, glm::ivec2(0)};
+                    build_array({sorted[i]}, images, first, srgb);
+                    continue;
+                }
+                packers.push_back(packer);
+                pages.emplace_back(row_bytes * atlas_size_, 0);
+            }
+            placements[i] = {static_cast<int>(page), glm::ivec2(x, y)};
+
+            // Copy the image and replicate its edges into the padding.
+            auto dst = pages[page].data();
+            const size_t src_row = static_cast<size_t>(image.width) * 4;
+            for (int row = -padding_; row < image.height + padding_; row++) {
+                auto src = image.pixels.data() + std::clamp(row, 0, image.height - 1) * src_row;
+                auto out = dst + (y + padding_ + row) * row_bytes + static_cast<size_t>(x + padding_) * 4;
+                std::memcpy(out, src, src_row);
+                for (int p = 1; p <= padding_; p++) {
+                    std::memcpy(out - 4 * p, src, 4);
+                    std::memcpy(out + src_row + 4 * (p - 1), src + src_row - 4, 4);
+                }
+            }
+        }
+
+        if (pages.empty())
+            return;
+
+        // Below this level the padding would be smaller than one texel and neighbours would bleed in.
+        int n_levels = 1;
+        while ((1 << n_levels) <= padding_ && n_levels < mip_levels_count(atlas_size_, atlas_size_))
+            n_levels++;
+
+        auto texture = create_array_texture(atlas_size_, atlas_size_, n_levels, static_cast<int>(pages.size()), srgb,
+                                            GL_CLAMP_TO_EDGE);
+        textures_.push_back(texture);
+        for (size_t page = 0; page < pages.size(); page++) {
+            upload_layer(texture, static_cast<int>(page),
+                         build_mip_chain(pages[page].data(), atlas_size_, atlas_size_, srgb), n_levels);
+            atlas_occupancy_sum_ += packers[page].occupancy();
+        }
+
+        for (size_t i = 0; i < sorted.size(); i++) {
+            const auto &image = images[sorted[i] - first];
+            auto [page, xy] = placements[i];
+            if (page < 0)
+                continue;
+            n_in_atlas_++;
+            auto &region = regions_[sorted[i]];
+            region.texture = texture;
+            region.layer = page;
+            region.uv_offset = glm::vec2(xy.x + padding_, xy.y + padding_) / float(atlas_size_);
+            region.uv_scale = glm::vec2(image.width, image.height) / float(atlas_size_);
+            region.in_atlas = true;
+        }
+        n_layers_ += pages.size();
+        n_atlas_pages_ += pages.size();
+    }
+
+    TexturePacker::Stats TexturePacker::stats() const {
+        Stats stats;
+        stats.n_textures = regions_.size();
+        stats.n_array_textures = textures_.size();
+        stats.n_layers = n_layers_;
+        stats.n_atlas_pages = n_atlas_pages_;
+        stats.n_in_atlas = n_in_atlas_;
+        stats.atlas_occupancy = n_atlas_pages_ ? float(atlas_occupancy_sum_ / n_atlas_pages_) : 0.0f;
+        return stats;
+    }
+}
@@ -0,0 +1,142 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glad/gl.h"
+#include "glm/glm.hpp"
+
+#include "Application/RegisteredObject.h"
+
+namespace xe {
+
+    /**
+     * @brief Skyline rectangle packer, every rectangle is placed as low as possible (bottom-left rule).
+     */
+    class SkylinePacker {
+    public:
+        SkylinePacker(int width, int height);
+
+        // Returns false when the rectangle does not fit anymore.
+        bool insert(int w, int h, int &x, int &y);
+
+        float occupancy() const { return float(double(used_area_) / (double(width_) * height_)); }
+
+    private:
+        struct Node {
+            int x;
+            int y;
+            int width;
+        };
+
+        // Lowest y at which a w x h rectangle can start at node i, -1 if it does not fit.
+        int fit(size_t i, int w, int h) const;
+
+        int width_;
+        int height_;
+        size_t used_area_ = 0;
+        std::vector<Node> skyline_;
+    };
+
+    /**
+     * @brief Place of a packed texture: a layer of a GL_TEXTURE_2D_ARRAY and the sub-rectangle inside it.
+     *
+     * For textures that got a layer of their own uv_offset is 0 and uv_scale is 1.
+     */
+    struct TextureRegion {
+        GLuint texture = 0u;
+        int layer = 0;
+        glm::vec2 uv_offset = glm::vec2(0.0f);
+        glm::vec2 uv_scale = glm::vec2(1.0f);
+        bool in_atlas = false;
+
+        glm::vec2 remap(const glm::vec2 &uv) const { return uv_offset + uv * uv_scale; }
+    };
+
+    /**
+     * @brief Packs many small textures into a few array textures, so draws using different textures can share
+     * one binding and be batched.
+     *
+     * Textures of the same size and colour space go into the layers of one GL_TEXTURE_2D_ARRAY and keep their
+     * full mip chains and wrapping. Sizes that occur only once are skyline-packed into atlas pages (the layers of
+     * another array texture). Every atlas entry is surrounded by a padding of replicated edge texels and the
+     * atlas has only as many mip levels as the padding can protect from bleeding. Texture coordinates of atlas
+     * entries have to be remapped with TextureRegion::remap and cannot repeat.
+     *
+     * Textures are only collected by add(), the packing, decoding and uploading happens in build(). Textures
+     * added after a build() are packed into new array textures by the next build().
+     */
+    class TexturePacker : public RegisteredObject {
+    public:
+        struct Stats {
+            size_t n_textures = 0;
+            size_t n_array_textures = 0;
+            size_t n_layers = 0;
+            size_t n_atlas_pages = 0;
+            size_t n_in_atlas = 0;
+            float atlas_occupancy = 0.0f;
+        };
+
+        /**
+         * @param atlas_size width and height of the atlas pages
+         * @param padding texels around every atlas entry, a power of two
+         * @param min_array_group fewer textures of the same size than this are put into the atlas instead
+         */
+        explicit TexturePacker(int atlas_size = 2048, int padding = 8, int min_array_group = 2);
+
+        ~TexturePacker() override;
+
+        // Returns the id of the texture, adding the same path twice returns the same id.
+        int add(const std::string &path, bool srgb = true, bool flip_vertically = true);
+
+        void build();
+
+        bool built(int id) const { return id < static_cast<int>(regions_.size()); }
+
+        const TextureRegion &region(int id) const { return regions_[id]; }
+
+        // nullptr if the texture was not added or is not built yet.
+        const TextureRegion *find(const std::string &path) const;
+
+        Stats stats() const;
+
+    private:
+        struct Entry {
+            std::string path;
+            bool srgb;
+            bool flip_vertically;
+        };
+
+        struct Image {
+            int width = 0;
+            int height = 0;
+            std::vector<uint8_t> pixels;
+        };
+
+        void build_array(const std::vector<int> &ids, const std::vector<Image> &images, int first, bool srgb);
+
+        void build_atlas(const std::vector<int> &ids, const std::vector<Image> &images, int first, bool srgb);
+
+        // Size of an atlas entry: rounded up to the padding, with the padding on both sides.
+        int padded_size(int size) const { return (size + padding_ - 1) / padding_ * padding_ + 2 * padding_; }
+
+        int atlas_size_;
+        int padding_;
+        int min_array_group_;
+
+        std::vector<Entry> entries_;
+        std::unordered_map<std::string, int> index_;
+        std::vector<TextureRegion> regions_;
+        std::vector<GLuint> textures_;
+
+        size_t n_layers_ = 0;
+        size_t n_atlas_pages_ = 0;
+        size_t n_in_atlas_ = 0;
+        double atlas_occupancy_sum_ = 0.0;
+    };
+}
@@ -0,0 +1,394 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+
+#include "stb/stb_image.h"
+
+#include "Application/alloc_tracker.h"
+#include "Application/deletion_queue.h"
+#include "Application/file_watcher.h"
+#include "Application/utils.h"
+
+namespace xe {
+
+    void Texture::bind(GLuint unit) const {
+        OGL_CALL(glBindTextureUnit(unit, ready() ? handle_ : fallback_));
+    }
+
+    size_t Texture::bytes_from_level(int level) const {
+        size_t bytes = 0;
+        for (int l = level; l < n_levels_; l++)
+            bytes += static_cast<size_t>(level_width(l)) * level_height(l) * 4;
+        return bytes;
+    }
+
+    TextureStreamer::TextureStreamer(size_t upload_budget, unsigned n_workers, bool retain_cpu_copy) :
+            upload_budget_(upload_budget), retain_cpu_copy_(retain_cpu_copy), stop_(false),
+            pbo_size_(upload_budget) {
+        OGL_CALL(glCreateBuffers(N_PBOS, pbos_));
+        for (auto pbo: pbos_) {
+            OGL_CALL(glNamedBufferData(pbo, pbo_size_, nullptr, GL_STREAM_DRAW));
+        }
+
+        const uint8_t white[4] = {255, 255, 255, 255};
+        OGL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &fallback_));
+        OGL_CALL(glTextureStorage2D(fallback_, 1, GL_RGBA8, 1, 1));
+        OGL_CALL(glTextureSubImage2D(fallback_, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white));
+
+        if (n_workers == 0) {
+            // hardware_concurrency() may return 0 when it is not known.
+            auto hc = std::thread::hardware_concurrency();
+            n_workers = std::max(1u, hc > 1 ? hc - 1 : 1u);
+        }
+        for (unsigned i = 0; i < n_workers; i++)
+            workers_.emplace_back(&TextureStreamer::worker_loop, this);
+        SPDLOG_DEBUG("TextureStreamer: {} workers, upload budget {} bytes/frame", n_workers, upload_budget_);
+    }
+
+    TextureStreamer::~TextureStreamer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto &worker: workers_)
+            worker.join();
+        // The watcher may already be gone during the static teardown.
+        if (FileWatcher::exists()) {
+            for (auto id: watch_ids_)
+                FileWatcher::instance().unwatch(id);
+        }
+
+        for (auto &texture: textures_) {
+            if (texture->handle_)
+                glDeleteTextures(1, &texture->handle_);
+        }
+        glDeleteTextures(1, &fallback_);
+        glDeleteBuffers(N_PBOS, pbos_);
+    }
+
+    Texture *TextureStreamer::load(const std::string &path, bool srgb, bool flip_vertically) {
+        textures_.emplace_back(new Texture(path, srgb, flip_vertically));
+        auto texture = textures_.back().get();
+        texture->fallback_ = fallback_;
+        queue_decode(texture);
+        if (FileWatcher::instance().enabled())
+            watch_ids_.push_back(FileWatcher::instance().watch(path, [this, texture]() { reload(texture); }));
+        return texture;
+    }
+
+    void TextureStreamer::reload(Texture *texture) {
+        queue_decode(texture);
+    }
+
+    void TextureStreamer::queue_decode(Texture *texture, bool restore) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            decode_queue_.push_back({texture, texture->flip_vertically_, ++texture->queued_decodes_, restore});
+        }
+        cv_.notify_one();
+    }
+
+    void TextureStreamer::worker_loop() {
+        while (true) {
+            DecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !decode_queue_.empty(); });
+                if (stop_)
+                    return;
+                job = decode_queue_.front();
+                decode_queue_.pop_front();
+                in_flight_++;
+            }
+
+            DecodeResult result{job.texture, nullptr, job.generation, job.restore};
+            stbi_set_flip_vertically_on_load_thread(job.flip_vertically);
+            int width, height, channels;
+            auto pixels = stbi_load(job.texture->path_.c_str(), &width, &height, &channels, 4);
+            if (pixels) {
+                result.mips = std::make_unique<MipChain>(build_mip_chain(pixels, width, height, job.texture->srgb_));
+                stbi_image_free(pixels);
+            } else {
+                SPDLOG_ERROR("Cannot decode texture `{}': {}", job.texture->path_, stbi_failure_reason());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            decoded_.push_back(std::move(result));
+            in_flight_--;
+        }
+    }
+
+    namespace {
+        GLuint create_texture_storage(const Texture &texture, int storage_level, bool srgb) {
+            GLuint handle;
+            auto format = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+            OGL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &handle));
+            OGL_CALL(glTextureStorage2D(handle, texture.n_levels() - storage_level, format,
+                                        texture.level_width(storage_level), texture.level_height(storage_level)));
+            OGL_CALL(glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+            OGL_CALL(glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            OGL_CALL(glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_REPEAT));
+            OGL_CALL(glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_REPEAT));
+            return handle;
+        }
+    }
+
+    void TextureStreamer::queue_upload(Texture *texture) {
+        if (std::find(upload_queue_.begin(), upload_queue_.end(), texture) == upload_queue_.end())
+            upload_queue_.push_back(texture);
+    }
+
+    void TextureStreamer::start_upload(DecodeResult &result) {
+        auto texture = result.texture;
+        if (!result.mips) {
+            texture->failed_ = true;
+            return;
+        }
+
+        texture->failed_ = false;
+        texture->mips_ = std::move(result.mips);
+        texture->width_ = texture->mips_->width;
+        texture->height_ = texture->mips_->height;
+        texture->n_levels_ = texture->mips_->n_levels();
+        texture->storage_level_ = std::clamp(texture->storage_level_, 0, texture->n_levels_ - 1);
+        texture->base_level_ = texture->n_levels_;
+        texture->upload_level_ = texture->n_levels_ - 1;
+        texture->upload_row_ = 0;
+        texture->handle_ = create_texture_storage(*texture, texture->storage_level_, texture->srgb_);
+
+        queue_upload(texture);
+    }
+
+    void TextureStreamer::finish_reload(DecodeResult &result) {
+        auto texture = result.texture;
+        if (!result.mips) {
+            SPDLOG_ERROR("Cannot reload texture `{}', keeping the last good version", texture->path_);
+            return;
+        }
+
+        // The new version is uploaded at once, streaming it would show the fallback in between.
+        auto it = std::find(upload_queue_.begin(), upload_queue_.end(), texture);
+        if (it != upload_queue_.end())
+            upload_queue_.erase(it);
+        DeletionQueue::release(GL_TEXTURE, texture->handle_);
+
+        texture->mips_ = std::move(result.mips);
+        texture->failed_ = false;
+        texture->width_ = texture->mips_->width;
+        texture->height_ = texture->mips_->height;
+        texture->n_levels_ = texture->mips_->n_levels();
+        texture->storage_level_ = std::clamp(texture->storage_level_, 0, texture->n_levels_ - 1);
+        texture->handle_ = create_texture_storage(*texture, texture->storage_level_, texture->srgb_);
+
+        OGL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        for (int l = texture->storage_level_; l < texture->n_levels_; l++) {
+            OGL_CALL(glTextureSubImage2D(texture->handle_, l - texture->storage_level_, 0, 0,
+                                         texture->level_width(l), texture->level_height(l),
+                                         GL_RGBA, GL_UNSIGNED_BYTE, texture->mips_->level_data(l)));
+        }
+        texture->base_level_ = texture->storage_level_;
+        if (!retain_cpu_copy_)
+            texture->mips_.reset();
+        SPDLOG_INFO("Texture `{}' reloaded", texture->path_);
+    }
+
+    void TextureStreamer::finish_restore(DecodeResult &result) {
+        auto texture = result.texture;
+        if (!result.mips) {
+            SPDLOG_ERROR("Cannot decode texture `{}' again, its finer levels stay missing", texture->path_);
+            return;
+        }
+        // The file changed in between, it replaces the texture as a reload does.
+        if (result.mips->width != texture->width_ || result.mips->height != texture->height_) {
+            finish_reload(result);
+            return;
+        }
+        if (texture->mips_ || texture->base_level_ <= texture->storage_level_)
+            return;
+        texture->mips_ = std::move(result.mips);
+        texture->upload_level_ = texture->base_level_ - 1;
+        texture->upload_row_ = 0;
+        queue_upload(texture);
+    }
+
+    void TextureStreamer::set_storage_level(Texture *texture, int level) {
+        if (!texture->handle_) {
+            texture->storage_level_ = std::max(0, level);
+            return;
+        }
+        level = std::clamp(level, 0, texture->n_levels_ - 1);
+        if (level == texture->storage_level_)
+            return;
+
+        auto old_handle = texture->handle_;
+        auto old_storage = texture->storage_level_;
+        auto handle = create_texture_storage(*texture, level, texture->srgb_);
+
+        // Everything already on the GPU that also fits into the new storage is copied on the GPU side.
+        auto base = std::max(texture->base_level_, level);
+        for (int l = base; l < texture->n_levels_; l++) {
+            OGL_CALL(glCopyImageSubData(old_handle, GL_TEXTURE_2D, l - old_storage, 0, 0, 0,
+                                        handle, GL_TEXTURE_2D, l - level, 0, 0, 0,
+                                        texture->level_width(l), texture->level_height(l), 1));
+        }
+        DeletionQueue::release(GL_TEXTURE, old_handle);
+
+        texture->handle_ = handle;
+        texture->storage_level_ = level;
+        texture->base_level_ = base;
+        if (base < texture->n_levels_) {
+            OGL_CALL(glTextureParameteri(handle, GL_TEXTURE_BASE_LEVEL, base - level));
+        }
+
+        if (level < base && texture->mips_) {
+            texture->upload_level_ = base - 1;
+            texture->upload_row_ = 0;
+            queue_upload(texture);
+        } else if (level < base) {
+            // The finer levels come back from the file, see finish_restore().
+            if (!std::exchange(texture->restoring_, true))
+                queue_decode(texture, true);
+        } else {
+            // All the levels that are left were already on the GPU.
+            auto it = std::find(upload_queue_.begin(), upload_queue_.end(), texture);
+            if (it != upload_queue_.end())
+                upload_queue_.erase(it);
+        }
+    }
+
+    size_t TextureStreamer::upload_chunk(Texture *texture, size_t budget) {
+        auto level = texture->upload_level_;
+        const auto &info = texture->mips_->levels[level];
+        const size_t row_bytes = static_cast<size_t>(info.width) * 4;
+
+        auto max_rows = std::max<size_t>(1, std::min(budget, pbo_size_) / row_bytes);
+        auto rows = static_cast<int>(std::min<size_t>(info.height - texture->upload_row_, max_rows));
+        auto bytes = rows * row_bytes;
+        auto data = texture->mips_->level_data(level) + texture->upload_row_ * row_bytes;
+
+        OGL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        if (row_bytes > pbo_size_) {
+            // A single row does not fit into the PBO, it goes from the client memory, one row per call.
+            if (!std::exchange(logged_wide_rows_, true))
+                SPDLOG_WARN("Texture `{}' has rows of {} bytes, more than the upload buffer of {} bytes, uploading "
+                            "them without the buffer", texture->path_, row_bytes, pbo_size_);
+            OGL_CALL(glTextureSubImage2D(texture->handle_, level - texture->storage_level_, 0, texture->upload_row_,
+                                         info.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, data));
+            return finish_rows(texture, rows, bytes);
+        }
+
+        // Invalidating the whole buffer lets the driver hand us fresh storage if the previous
+        // upload from this PBO is still in flight, instead of stalling on it.
+        auto pbo = pbos_[next_pbo_];
+        next_pbo_ = (next_pbo_ + 1) % N_PBOS;
+        auto ptr = glMapNamedBufferRange(pbo, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!ptr) {
+            SPDLOG_ERROR("Cannot map pixel unpack buffer");
+            return 0;
+        }
+        std::memcpy(ptr, data, bytes);
+        OGL_CALL(glUnmapNamedBuffer(pbo));
+
+        OGL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo));
+        OGL_CALL(glTextureSubImage2D(texture->handle_, level - texture->storage_level_, 0, texture->upload_row_,
+                                     info.width, rows,
+                                     GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+        OGL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0u));
+        return finish_rows(texture, rows, bytes);
+    }
+
+    size_t TextureStreamer::finish_rows(Texture *texture, int rows, size_t bytes) {
+        auto level = texture->upload_level_;
+        const auto &info = texture->mips_->levels[level];
+        texture->upload_row_ += rows;
+        if (texture->upload_row_ == info.height) {
+            texture->base_level_ = level;
+            OGL_CALL(glTextureParameteri(texture->handle_, GL_TEXTURE_BASE_LEVEL, level - texture->storage_level_));
+            texture->upload_level_--;
+            texture->upload_row_ = 0;
+            if (texture->uploaded()) {
+                if (!retain_cpu_copy_)
+                    texture->mips_.reset();
+                SPDLOG_DEBUG("Texture `{}' uploaded down to level {}", texture->path_, level);
+            }
+        }
+        return bytes;
+    }
+
+    void TextureStreamer::update() {
+        XE_ALLOC_TAG(engine);
+        std::vector<DecodeResult> decoded;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            decoded.swap(decoded_);
+        }
+        for (auto &result: decoded) {
+            auto texture = result.texture;
+            if (result.restore)
+                texture->restoring_ = false;
+            if (result.generation < texture->applied_decode_)
+                continue;
+            texture->applied_decode_ = result.generation;
+            // Whichever decode arrives first creates the texture, the later ones replace it.
+            if (!texture->handle_)
+                start_upload(result);
+            else if (result.restore)
+                finish_restore(result);
+            else
+                finish_reload(result);
+        }
+
+        size_t uploaded = 0;
+        while (!upload_queue_.empty()) {
+            auto texture = upload_queue_.front();
+            auto row_bytes = static_cast<size_t>(texture->mips_->levels[texture->upload_level_].width) * 4;
+            // Always make some progress, but never start a chunk that would overshoot the budget.
+            if (uploaded > 0 && uploaded + row_bytes > upload_budget_)
+                break;
+            auto bytes = upload_chunk(texture, upload_budget_ - std::min(uploaded, upload_budget_));
+            if (bytes == 0)
+                break;
+            uploaded += bytes;
+            if (texture->uploaded())
+                upload_queue_.pop_front();
+        }
+        bytes_uploaded_last_frame_ = uploaded;
+    }
+
+    void TextureStreamer::finish() {
+        while (true) {
+            update();
+            bool pending;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending = !decode_queue_.empty() || in_flight_ > 0 || !decoded_.empty();
+            }
+            if (!pending && upload_queue_.empty())
+                return;
+            if (upload_queue_.empty())
+                std::this_thread::yield();
+        }
+    }
+
+    TextureStreamer::Stats TextureStreamer::stats() const {
+        Stats stats;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats.pending_decode = decode_queue_.size() + in_flight_ + decoded_.size();
+        }
+        stats.uploading = upload_queue_.size();
+        stats.complete = std::count_if(textures_.begin(), textures_.end(),
+                                       [](const std::unique_ptr<Texture> &t) { return t->complete(); });
+        stats.bytes_uploaded_last_frame = bytes_uploaded_last_frame_;
+        return stats;
+    }
+}
@@ -0,0 +1,222 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glad/gl.h"
+
+#include "Application/RegisteredObject.h"
+#include "mipmap.h"
+
+namespace xe {
+
+    /**
+     * @brief A 2D texture that becomes usable before it is fully loaded.
+     *
+     * The GL storage for the mip levels is allocated as soon as the image is decoded, the levels are then
+     * uploaded from the coarsest to the finest one. GL_TEXTURE_BASE_LEVEL always points to the finest
+     * level uploaded so far, so the texture can be sampled all the time and just gets sharper.
+     *
+     * The storage does not have to start at level 0: only levels storage_level()..n_levels()-1 are
+     * allocated on the GPU. Level numbers in this interface always refer to the source image.
+     */
+    class Texture {
+    public:
+        GLuint handle() const { return handle_; }
+
+        const std::string &path() const { return path_; }
+
+        int width() const { return width_; }
+
+        int height() const { return height_; }
+
+        int n_levels() const { return n_levels_; }
+
+        // Finest level that can be sampled, equal to n_levels() when nothing has been uploaded yet.
+        int base_level() const { return base_level_; }
+
+        // Finest level that has storage allocated on the GPU.
+        int storage_level() const { return storage_level_; }
+
+        bool ready() const { return handle_ != 0 && base_level_ < n_levels_; }
+
+        // All allocated levels are uploaded.
+        bool uploaded() const { return handle_ != 0 && base_level_ == storage_level_; }
+
+        // Uploaded at full resolution.
+        bool complete() const { return handle_ != 0 && base_level_ == 0; }
+
+        bool failed() const { return failed_; }
+
+        int level_width(int level) const { return std::max(1, width_ >> level); }
+
+        int level_height(int level) const { return std::max(1, height_ >> level); }
+
+        // GPU memory needed to keep levels level..n_levels()-1 resident.
+        size_t bytes_from_level(int level) const;
+
+        size_t resident_bytes() const { return handle_ ? bytes_from_level(storage_level_) : 0; }
+
+        // Binds the texture, or the 1x1 fallback texture while the texture is not ready.
+        void bind(GLuint unit) const;
+
+    private:
+        friend class TextureStreamer;
+
+        explicit Texture(std::string path, bool srgb, bool flip_vertically) :
+                path_(std::move(path)), srgb_(srgb), flip_vertically_(flip_vertically) {}
+
+        std::string path_;
+        bool srgb_;
+        bool flip_vertically_;
+        bool failed_ = false;
+        GLuint handle_ = 0u;
+        GLuint fallback_ = 0u;
+        int width_ = 0;
+        int height_ = 0;
+        int n_levels_ = 0;
+        int base_level_ = 0;
+        int storage_level_ = 0;
+
+        // Decodes queued for this texture and the newest one applied, results arriving out of order (e.g. a
+        // reload overtaking the first decode) are dropped when they are older than the applied one.
+        uint64_t queued_decodes_ = 0;
+        uint64_t applied_decode_ = 0;
+        // A decode restoring the finer levels dropped by set_storage_level() is queued.
+        bool restoring_ = false;
+
+        // Upload state, owned by the GL thread.
+        std::unique_ptr<MipChain> mips_;
+        int upload_level_ = 0;
+        int upload_row_ = 0;
+    };
+
+    /**
+     * @brief Loads textures in the background and streams them to the GPU.
+     *
+     * Decoding (stb_image) and mip generation run on worker threads. The update() method has to be called
+     * once per frame from the thread owning the GL context; it uploads at most upload_budget bytes through
+     * a small ring of pixel unpack buffers, so no single frame pays for a whole image.
+     *
+     * set_storage_level() can drop levels from the GPU and bring them back later. The decoded mip chains are
+     * freed after the upload unless retain_cpu_copy is set, the file is then decoded again to restore the
+     * dropped levels, which keeps the host memory independent of the number of textures.
+     *
+     * With hot reload enabled (see FileWatcher) a changed image file is decoded again in the background
+     * and replaces the texture in one go, keeping its storage level. The handle changes, the Texture
+     * pointer stays valid. If the new file cannot be decoded the old texture is kept.
+     */
+    class TextureStreamer : public RegisteredObject {
+    public:
+        struct Stats {
+            size_t pending_decode = 0;
+            size_t uploading = 0;
+            size_t complete = 0;
+            size_t bytes_uploaded_last_frame = 0;
+        };
+
+        explicit TextureStreamer(size_t upload_budget = 16u << 20, unsigned n_workers = 0,
+                                 bool retain_cpu_copy = false);
+
+        ~TextureStreamer() override;
+
+        // Returns immediately, the texture is decoded in the background.
+        Texture *load(const std::string &path, bool srgb = true, bool flip_vertically = true);
+
+        // Call once per frame on the GL thread.
+        void update();
+
+        /**
+         * @brief Changes the finest level kept on the GPU.
+         *
+         * The texture gets new storage, the levels already on the GPU are copied with glCopyImageSubData
+         * and missing finer levels are queued for streaming, after decoding the file again if the CPU copy
+         * is gone. Before the texture is decoded this just sets the level the initial upload stops at.
+         */
+        void set_storage_level(Texture *texture, int level);
+
+        // Decodes the file again and replaces the texture once it is decoded.
+        void reload(Texture *texture);
+
+        bool retains_cpu_copy() const { return retain_cpu_copy_; }
+
+        // Blocks (while still uploading within budget) until all the requested textures are complete.
+        void finish();
+
+        Stats stats() const;
+
+        size_t upload_budget() const { return upload_budget_; }
+
+        void set_upload_budget(size_t budget) { upload_budget_ = budget; }
+
+    private:
+        struct DecodeJob {
+            Texture *texture;
+            bool flip_vertically;
+            uint64_t generation;
+            bool restore;
+        };
+
+        struct DecodeResult {
+            Texture *texture;
+            std::unique_ptr<MipChain> mips;
+            uint64_t generation;
+            bool restore;
+        };
+
+        void worker_loop();
+
+        void queue_decode(Texture *texture, bool restore = false);
+
+        void start_upload(DecodeResult &result);
+
+        void finish_reload(DecodeResult &result);
+
+        // Streams the levels between the storage and the base level from the decoded chain.
+        void finish_restore(DecodeResult &result);
+
+        size_t upload_chunk(Texture *texture, size_t budget);
+
+        // Advances the upload position past the uploaded rows, returns bytes.
+        size_t finish_rows(Texture *texture, int rows, size_t bytes);
+
+        void queue_upload(Texture *texture);
+
+        size_t upload_budget_;
+        bool retain_cpu_copy_;
+        std::vector<std::thread> workers_;
+        std::atomic<bool> stop_;
+
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<DecodeJob> decode_queue_;
+        std::vector<DecodeResult> decoded_;
+        size_t in_flight_ = 0;
+
+        std::vector<std::unique_ptr<Texture>> textures_;
+        std::deque<Texture *> upload_queue_;
+
+        static const int N_PBOS = 3;
+        GLuint pbos_[N_PBOS];
+        size_t pbo_size_;
+        int next_pbo_ = 0;
+        bool logged_wide_rows_ = false;
+        GLuint fallback_ = 0u;
+
+        size_t bytes_uploaded_last_frame_ = 0;
+
+        std::vector<int> watch_ids_;
+    };
+}
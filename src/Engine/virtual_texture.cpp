@@ -0,0 +1,484 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#include "virtual_texture.h"
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "spdlog/spdlog.h"
+
+#include "stb/stb_image.h"
+#include "stb/stb_image_write.h"
+
+#include "Application/arena.h"
+#include "Application/perf_counters.h"
+#include "Application/utils.h"
+#include "mipmap.h"
+
+namespace {
+    int next_power_of_two(int n) {
+        int p = 1;
+        while (p < n)
+            p *= 2;
+        return p;
+    }
+
+    int log2_int(int n) {
+        int l = 0;
+        while ((1 << (l + 1)) <= n)
+            l++;
+        return l;
+    }
+
+    uint32_t pack_entry(int slot_x, int slot_y, int level) {
+        return uint32_t(slot_x) | (uint32_t(slot_y) << 8) | (uint32_t(level) << 16) | (255u << 24);
+    }
+}
+
+namespace xe {
+
+    const char *VirtualTexture::INFO_FILE = "vt.txt";
+
+    VirtualTexture::VirtualTexture(const std::string &tiles_dir, int atlas_pages, int feedback_scale,
+                                   unsigned n_workers) :
+            dir_(tiles_dir), atlas_pages_(std::min(atlas_pages, 256)), feedback_scale_(feedback_scale), stop_(false) {
+
+        std::ifstream info_file(dir_ + "/" + INFO_FILE);
+        Info info;
+        if (!(info_file >> info.width >> info.height >> info.tile_size >> info.border >> info.n_levels
+                        >> info.pages_x >> info.pages_y >> info.srgb)) {
+            SPDLOG_ERROR("Cannot read virtual texture description from `{}/{}'", dir_, INFO_FILE);
+            return;
+        }
+        info_ = info;
+
+        auto atlas_size = atlas_pages_ * info_.page_size();
+        OGL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &atlas_));
+        OGL_CALL(glTextureStorage2D(atlas_, 1, info_.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, atlas_size, atlas_size));
+        OGL_CALL(glTextureParameteri(atlas_, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        OGL_CALL(glTextureParameteri(atlas_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        OGL_CALL(glTextureParameteri(atlas_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        OGL_CALL(glTextureParameteri(atlas_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+
+        OGL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &indirection_));
+        OGL_CALL(glTextureStorage2D(indirection_, info_.n_levels, GL_RGBA8, info_.pages_x, info_.pages_y));
+        OGL_CALL(glTextureParameteri(indirection_, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST));
+        OGL_CALL(glTextureParameteri(indirection_, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+
+        for (int l = 0; l < info_.n_levels; l++) {
+            page_slots_.emplace_back(pages_x(l) * pages_y(l), -1);
+            indirection_data_.emplace_back(pages_x(l) * pages_y(l), 0u);
+        }
+        slots_.resize(atlas_pages_ * atlas_pages_);
+        for (int i = static_cast<int>(slots_.size()) - 1; i >= 0; i--)
+            free_slots_.push_back(i);
+
+        for (unsigned i = 0; i < n_workers; i++)
+            workers_.emplace_back(&VirtualTexture::worker_loop, this);
+
+        SPDLOG_INFO("Virtual texture `{}' {}x{} {} levels, atlas {}x{} pages ({} MB)", dir_, info_.width,
+                    info_.height, info_.n_levels, atlas_pages_, atlas_pages_,
+                    size_t(atlas_size) * atlas_size * 4 / (1024 * 1024));
+
+        // The single page of the coarsest level is the fallback for everything and is never evicted.
+        request_page(info_.n_levels - 1, 0, 0);
+    }
+
+    VirtualTexture::~VirtualTexture() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto &worker: workers_)
+            worker.join();
+
+        for (auto &readback: readbacks_) {
+            if (readback.fence)
+                glDeleteSync(readback.fence);
+            if (readback.pbo)
+                glDeleteBuffers(1, &readback.pbo);
+        }
+        if (feedback_fbo_) {
+            glDeleteFramebuffers(1, &feedback_fbo_);
+            glDeleteTextures(1, &feedback_color_);
+            glDeleteRenderbuffers(1, &feedback_depth_);
+        }
+        if (atlas_) {
+            glDeleteTextures(1, &atlas_);
+            glDeleteTextures(1, &indirection_);
+        }
+    }
+
+    std::string VirtualTexture::tile_path(int level, int x, int y) const {
+        return dir_ + "/" + std::to_string(level) + "/" + std::to_string(x) + "_" + std::to_string(y) + ".png";
+    }
+
+    void VirtualTexture::bind(GLuint program, GLuint atlas_unit, GLuint indirection_unit) const {
+        OGL_CALL(glBindTextureUnit(atlas_unit, atlas_));
+        OGL_CALL(glBindTextureUnit(indirection_unit, indirection_));
+
+        auto tile_size = float(info_.tile_size);
+        OGL_CALL(glProgramUniform1i(program, glGetUniformLocation(program, "vt_atlas"), atlas_unit));
+        OGL_CALL(glProgramUniform1i(program, glGetUniformLocation(program, "vt_indirection"), indirection_unit));
+        OGL_CALL(glProgramUniform2f(program, glGetUniformLocation(program, "vt_pages"),
+                                    float(info_.pages_x), float(info_.pages_y)));
+        OGL_CALL(glProgramUniform2f(program, glGetUniformLocation(program, "vt_uv_scale"),
+                                    info_.width / (info_.pages_x * tile_size),
+                                    info_.height / (info_.pages_y * tile_size)));
+        OGL_CALL(glProgramUniform4f(program, glGetUniformLocation(program, "vt_page"), tile_size,
+                                    float(info_.border), float(info_.page_size()),
+                                    float(atlas_pages_ * info_.page_size())));
+        OGL_CALL(glProgramUniform1f(program, glGetUniformLocation(program, "vt_max_level"),
+                                    float(info_.n_levels - 1)));
+        OGL_CALL(glProgramUniform1f(program, glGetUniformLocation(program, "vt_feedback_lod_bias"),
+                                    -std::log2(float(feedback_scale_))));
+    }
+
+    void VirtualTexture::resize(int width, int height) {
+        auto w = std::max(1, width / feedback_scale_);
+        auto h = std::max(1, height / feedback_scale_);
+        if (w == feedback_width_ && h == feedback_height_)
+            return;
+        feedback_width_ = w;
+        feedback_height_ = h;
+
+        if (feedback_fbo_) {
+            glDeleteFramebuffers(1, &feedback_fbo_);
+            glDeleteTextures(1, &feedback_color_);
+            glDeleteRenderbuffers(1, &feedback_depth_);
+        }
+        OGL_CALL(glCreateTextures(GL_TEXTURE_2D, 1, &feedback_color_));
+        OGL_CALL(glTextureStorage2D(feedback_color_, 1, GL_RGBA8, w, h));
+        OGL_CALL(glCreateRenderbuffers(1, &feedback_depth_));
+        OGL_CALL(glNamedRenderbufferStorage(feedback_depth_, GL_DEPTH_COMPONENT24, w, h));
+        OGL_CALL(glCreateFramebuffers(1, &feedback_fbo_));
+        OGL_CALL(glNamedFramebufferTexture(feedback_fbo_, GL_COLOR_ATTACHMENT0, feedback_color_, 0));
+        OGL_CALL(glNamedFramebufferRenderbuffer(feedback_fbo_, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth_));
+        if (glCheckNamedFramebufferStatus(feedback_fbo_, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            SPDLOG_ERROR("Virtual texture feedback frame buffer is incomplete");
+
+        for (auto &readback: readbacks_) {
+            if (readback.fence) {
+                glDeleteSync(readback.fence);
+                readback.fence = nullptr;
+            }
+            if (!readback.pbo) {
+                OGL_CALL(glCreateBuffers(1, &readback.pbo));
+            }
+            OGL_CALL(glNamedBufferData(readback.pbo, size_t(w) * h * 4, nullptr, GL_STREAM_READ));
+        }
+    }
+
+    void VirtualTexture::begin_feedback() {
+        if (!feedback_fbo_) {
+            SPDLOG_WARN("VirtualTexture::resize was not called, there is no feedback buffer");
+            return;
+        }
+        glGetIntegerv(GL_VIEWPORT, saved_viewport_);
+        // Alpha 255 marks texels that do not reference any page.
+        const GLfloat none[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        const GLfloat far_depth = 1.0f;
+        OGL_CALL(glClearNamedFramebufferfv(feedback_fbo_, GL_COLOR, 0, none));
+        OGL_CALL(glClearNamedFramebufferfv(feedback_fbo_, GL_DEPTH, 0, &far_depth));
+        OGL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, feedback_fbo_));
+        OGL_CALL(glViewport(0, 0, feedback_width_, feedback_height_));
+    }
+
+    void VirtualTexture::end_feedback() {
+        if (!feedback_fbo_)
+            return;
+        auto &readback = readbacks_[next_readback_];
+        // If the oldest read back has not been consumed yet we skip this frame instead of waiting.
+        if (!readback.fence) {
+            OGL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo));
+            OGL_CALL(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+            OGL_CALL(glReadPixels(0, 0, feedback_width_, feedback_height_, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+            OGL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u));
+            readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            readback.width = feedback_width_;
+            readback.height = feedback_height_;
+            next_readback_ = (next_readback_ + 1) % N_READBACKS;
+        }
+        OGL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0u));
+        OGL_CALL(glViewport(saved_viewport_[0], saved_viewport_[1], saved_viewport_[2], saved_viewport_[3]));
+    }
+
+    void VirtualTexture::update() {
+        if (!valid())
+            return;
+        frame_++;
+        requested_last_frame_ = 0;
+        uploaded_last_frame_ = 0;
+        evicted_last_frame_ = 0;
+
+        for (auto &readback: readbacks_) {
+            if (!readback.fence)
+                continue;
+            auto status = glClientWaitSync(readback.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            auto n_texels = size_t(readback.width) * readback.height;
+            auto texels = glMapNamedBufferRange(readback.pbo, 0, n_texels * 4, GL_MAP_READ_BIT);
+            if (texels) {
+                process_feedback(reinterpret_cast<const uint8_t *>(texels), n_texels);
+                OGL_CALL(glUnmapNamedBuffer(readback.pbo));
+            }
+        }
+
+        std::deque<LoadedPage> loaded;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto n = std::min<size_t>(loaded_.size(), max_uploads_per_frame_);
+            loaded.insert(loaded.end(), std::make_move_iterator(loaded_.begin()),
+                          std::make_move_iterator(loaded_.begin() + n));
+            loaded_.erase(loaded_.begin(), loaded_.begin() + n);
+        }
+        for (auto &page: loaded)
+            upload_page(page);
+
+        if (indirection_dirty_)
+            rebuild_indirection();
+    }
+
+    void VirtualTexture::process_feedback(const uint8_t *texels, size_t n_texels) {
+        XE_PERF_SCOPE("process feedback", n_texels);
+        ArenaScope scope(frame_arena());
+        std::pmr::unordered_set<uint64_t> seen(&scope.arena());
+        std::pmr::vector<PageRequest> pages(&scope.arena());
+        for (size_t i = 0; i < n_texels; i++) {
+            auto t = texels + 4 * i;
+            int level = t[3];
+            if (level >= info_.n_levels)
+                continue;
+            int x = t[0] | ((t[2] & 0x0f) << 8);
+            int y = t[1] | ((t[2] >> 4) << 8);
+            // Ancestors are requested too, so a usable fallback arrives before the page itself.
+            for (; level < info_.n_levels; level++, x /= 2, y /= 2) {
+                if (x >= pages_x(level) || y >= pages_y(level))
+                    break;
+                if (!seen.insert(page_key(level, x, y)).second)
+                    break;
+                pages.push_back({level, x, y});
+            }
+        }
+
+        std::sort(pages.begin(), pages.end(),
+                  [](const PageRequest &a, const PageRequest &b) { return a.level > b.level; });
+        for (const auto &page: pages) {
+            auto slot = page_slot(page.level, page.x, page.y);
+            if (slot >= 0)
+                slots_[slot].last_used = frame_;
+            else
+                request_page(page.level, page.x, page.y);
+        }
+    }
+
+    void VirtualTexture::request_page(int level, int x, int y) {
+        auto key = page_key(level, x, y);
+        if (pending_.size() >= max_pending_loads_ || pending_.count(key) || missing_.count(key))
+            return;
+        pending_.insert(key);
+        requested_last_frame_++;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            load_queue_.push_back({level, x, y});
+        }
+        cv_.notify_one();
+    }
+
+    void VirtualTexture::worker_loop() {
+        stbi_set_flip_vertically_on_load_thread(1);
+        while (true) {
+            PageRequest request;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !load_queue_.empty(); });
+                if (stop_)
+                    return;
+                request = load_queue_.front();
+                load_queue_.pop_front();
+            }
+
+            LoadedPage page{request, {}};
+            int w, h, c;
+            auto path = tile_path(request.level, request.x, request.y);
+            auto pixels = stbi_load(path.c_str(), &w, &h, &c, 4);
+            if (pixels) {
+                if (w == info_.page_size() && h == info_.page_size())
+                    page.pixels.assign(pixels, pixels + size_t(w) * h * 4);
+                else
+                    SPDLOG_ERROR("Tile `{}' is {}x{}, expected {}x{}", path, w, h, info_.page_size(),
+                                 info_.page_size());
+                stbi_image_free(pixels);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            loaded_.push_back(std::move(page));
+        }
+    }
+
+    int VirtualTexture::allocate_slot() {
+        if (!free_slots_.empty()) {
+            auto slot = free_slots_.back();
+            free_slots_.pop_back();
+            return slot;
+        }
+
+        // Pages seen in the last processed feedback are not evicted.
+        int victim = -1;
+        for (int i = 0; i < static_cast<int>(slots_.size()); i++) {
+            const auto &slot = slots_[i];
+            if (slot.pinned || slot.last_used >= frame_)
+                continue;
+            if (victim < 0 || slot.last_used < slots_[victim].last_used)
+                victim = i;
+        }
+        if (victim < 0)
+            return -1;
+
+        auto &slot = slots_[victim];
+        page_slot(slot.level, slot.x, slot.y) = -1;
+        slot.level = -1;
+        evicted_last_frame_++;
+        indirection_dirty_ = true;
+        return victim;
+    }
+
+    void VirtualTexture::upload_page(LoadedPage &page) {
+        auto &p = page.page;
+        pending_.erase(page_key(p.level, p.x, p.y));
+        if (page.pixels.empty()) {
+            missing_.insert(page_key(p.level, p.x, p.y));
+            return;
+        }
+        if (page_slot(p.level, p.x, p.y) >= 0)
+            return;
+
+        auto slot = allocate_slot();
+        if (slot < 0)
+            return; // The atlas is full of pages in use, the feedback will ask again.
+
+        slots_[slot] = {p.level, p.x, p.y, frame_, p.level == info_.n_levels - 1};
+        page_slot(p.level, p.x, p.y) = slot;
+
+        auto page_size = info_.page_size();
+        OGL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        OGL_CALL(glTextureSubImage2D(atlas_, 0, (slot % atlas_pages_) * page_size, (slot / atlas_pages_) * page_size,
+                                     page_size, page_size, GL_RGBA, GL_UNSIGNED_BYTE, page.pixels.data()));
+        uploaded_last_frame_++;
+        indirection_dirty_ = true;
+    }
+
+    void VirtualTexture::rebuild_indirection() {
+        // Every page points to the finest resident page covering it, coarser levels are resolved first.
+        for (int l = info_.n_levels - 1; l >= 0; l--) {
+            auto px = pages_x(l), py = pages_y(l);
+            auto &data = indirection_data_[l];
+            for (int y = 0; y < py; y++) {
+                for (int x = 0; x < px; x++) {
+                    auto slot = page_slots_[l][y * px + x];
+                    if (slot >= 0) {
+                        data[y * px + x] = pack_entry(slot % atlas_pages_, slot / atlas_pages_, l);
+                    } else if (l + 1 < info_.n_levels) {
+                        auto parent_x = std::min(x / 2, pages_x(l + 1) - 1);
+                        auto parent_y = std::min(y / 2, pages_y(l + 1) - 1);
+                        data[y * px + x] = indirection_data_[l + 1][parent_y * pages_x(l + 1) + parent_x];
+                    } else {
+                        data[y * px + x] = 0u;
+                    }
+                }
+            }
+            OGL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+            OGL_CALL(glTextureSubImage2D(indirection_, l, 0, 0, px, py, GL_RGBA, GL_UNSIGNED_BYTE, data.data()));
+        }
+        indirection_dirty_ = false;
+    }
+
+    VirtualTexture::Stats VirtualTexture::stats() const {
+        Stats stats;
+        stats.atlas_pages = slots_.size();
+        stats.resident_pages = slots_.size() - free_slots_.size();
+        stats.pending_loads = pending_.size();
+        stats.requested_last_frame = requested_last_frame_;
+        stats.uploaded_last_frame = uploaded_last_frame_;
+        stats.evicted_last_frame = evicted_last_frame_;
+        return stats;
+    }
+
+    bool build_virtual_texture_tiles(const std::string &image_path, const std::string &dir,
+                                     int tile_size, int border, bool srgb) {
+        stbi_set_flip_vertically_on_load_thread(1);
+        int width, height, channels;
+        auto pixels = stbi_load(image_path.c_str(), &width, &height, &channels, 4);
+        if (!pixels) {
+            SPDLOG_ERROR("Cannot load `{}': {}", image_path, stbi_failure_reason());
+            return false;
+        }
+
+        VirtualTexture::Info info;
+        info.width = width;
+        info.height = height;
+        info.tile_size = tile_size;
+        info.border = border;
+        info.pages_x = next_power_of_two((width + tile_size - 1) / tile_size);
+        info.pages_y = next_power_of_two((height + tile_size - 1) / tile_size);
+        info.n_levels = log2_int(std::max(info.pages_x, info.pages_y)) + 1;
+        info.srgb = srgb;
+
+        std::vector<uint8_t> level(pixels, pixels + size_t(width) * height * 4);
+        stbi_image_free(pixels);
+
+        // Tiles are stored bottom row first in memory, like everything we upload to OpenGL,
+        // flipping on write keeps the PNG files the right way up.
+        stbi_flip_vertically_on_write(1);
+        auto page_size = info.page_size();
+        std::vector<uint8_t> page(size_t(page_size) * page_size * 4);
+        int lw = width, lh = height;
+        size_t n_tiles = 0;
+        for (int l = 0; l < info.n_levels; l++) {
+            std::filesystem::create_directories(dir + "/" + std::to_string(l));
+            auto px = std::max(1, info.pages_x >> l);
+            auto py = std::max(1, info.pages_y >> l);
+            for (int ty = 0; ty < py; ty++) {
+                for (int tx = 0; tx < px; tx++) {
+                    if (tx * tile_size >= lw || ty * tile_size >= lh)
+                        continue; // Padding of the page grid, never sampled.
+                    for (int j = 0; j < page_size; j++) {
+                        auto sy = std::clamp(ty * tile_size - border + j, 0, lh - 1);
+                        for (int i = 0; i < page_size; i++) {
+                            auto sx = std::clamp(tx * tile_size - border + i, 0, lw - 1);
+                            std::memcpy(&page[(size_t(j) * page_size + i) * 4], &level[(size_t(sy) * lw + sx) * 4], 4);
+                        }
+                    }
+                    auto path = dir + "/" + std::to_string(l) + "/" + std::to_string(tx) + "_" + std::to_string(ty) +
+                                ".png";
+                    if (!stbi_write_png(path.c_str(), page_size, page_size, 4, page.data(), page_size * 4)) {
+                        SPDLOG_ERROR("Cannot write tile `{}'", path);
+                        return false;
+                    }
+                    n_tiles++;
+                }
+            }
+
+            auto nw = std::max(1, lw / 2), nh = std::max(1, lh / 2);
+            std::vector<uint8_t> next(size_t(nw) * nh * 4);
+            downsample_rgba8(level.data(), lw, lh, next.data(), nw, nh, srgb);
+            level.swap(next);
+            lw = nw;
+            lh = nh;
+        }
+
+        std::ofstream info_file(dir + "/" + VirtualTexture::INFO_FILE);
+        info_file << info.width << " " << info.height << " " << info.tile_size << " " << info.border << " "
+                  << info.n_levels << " " << info.pages_x << " " << info.pages_y << " " << info.srgb << "\n";
+        SPDLOG_INFO("Wrote {} tiles, {} levels, to `{}'", n_tiles, info.n_levels, dir);
+        return true;
+    }
+}
@@ -0,0 +1,208 @@
+//
+// Created by agent on 19.10.26.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "glad/gl.h"
+
+#include "Application/RegisteredObject.h"
+
+namespace xe {
+
+    /**
+     * @brief Tile-based virtual texturing for textures much bigger than the GPU memory we want to spend on them.
+     *
+     * The source image is cut offline into a mip pyramid of tiles (see build_virtual_texture_tiles). The page
+     * grid of level 0 is padded to a power of two, so level l has exactly (pages_x >> l) x (pages_y >> l) pages
+     * and the indirection texture can use ordinary mip levels, one texel per page. On the coarse levels of a
+     * non-square grid the shorter axis stays at one page which the image only partly covers, the shader
+     * maps the coordinates with the unclamped pages_x / 2^l and pages_y / 2^l.
+     *
+     * At runtime:
+     *  - the scene is rendered into a small feedback buffer with a shader calling vt_feedback()
+     *    (src/Engine/shaders/virtual_texture.glsl), which writes the page each fragment needs,
+     *  - the feedback is read back asynchronously and the missing pages are loaded by worker threads,
+     *  - loaded pages are copied into free slots of a fixed size physical atlas, evicting least recently
+     *    used pages when the atlas is full,
+     *  - the indirection texture maps every virtual page to the finest resident page covering it and
+     *    vt_sample() translates virtual texture coordinates into atlas coordinates.
+     *
+     * GPU memory is fixed by the atlas size, it does not depend on the size of the source image.
+     */
+    class VirtualTexture : public RegisteredObject {
+    public:
+        struct Info {
+            int width = 0;
+            int height = 0;
+            int tile_size = 0;
+            int border = 0;
+            int n_levels = 0;
+            int pages_x = 0;
+            int pages_y = 0;
+            bool srgb = true;
+
+            int page_size() const { return tile_size + 2 * border; }
+        };
+
+        struct Stats {
+            size_t resident_pages = 0;
+            size_t atlas_pages = 0;
+            size_t pending_loads = 0;
+            size_t requested_last_frame = 0;
+            size_t uploaded_last_frame = 0;
+            size_t evicted_last_frame = 0;
+        };
+
+        static const char *INFO_FILE;
+
+        /**
+         * @param tiles_dir directory created by build_virtual_texture_tiles
+         * @param atlas_pages the physical atlas holds atlas_pages x atlas_pages pages
+         * @param feedback_scale the feedback buffer is feedback_scale times smaller than the frame buffer
+         */
+        VirtualTexture(const std::string &tiles_dir, int atlas_pages = 32, int feedback_scale = 8,
+                       unsigned n_workers = 2);
+
+        ~VirtualTexture() override;
+
+        bool valid() const { return info_.n_levels > 0; }
+
+        const Info &info() const { return info_; }
+
+        // Sets the vt_* uniforms of the program and binds the atlas and the indirection textures.
+        void bind(GLuint program, GLuint atlas_unit, GLuint indirection_unit) const;
+
+        // Resizes the feedback buffer to match the frame buffer.
+        void resize(int width, int height);
+
+        // Binds the feedback frame buffer, the scene should then be drawn with the feedback shader.
+        void begin_feedback();
+
+        // Restores the default frame buffer and starts an asynchronous read back of the feedback.
+        void end_feedback();
+
+        // Processes finished read backs, loads and uploads pages. Call once per frame on the GL thread.
+        void update();
+
+        int max_uploads_per_frame() const { return max_uploads_per_frame_; }
+
+        void set_max_uploads_per_frame(int n) { max_uploads_per_frame_ = n; }
+
+        Stats stats() const;
+
+    private:
+        struct Slot {
+            int level = -1;
+            int x = 0;
+            int y = 0;
+            uint64_t last_used = 0;
+            bool pinned = false;
+        };
+
+        struct PageRequest {
+            int level;
+            int x;
+            int y;
+        };
+
+        struct LoadedPage {
+            PageRequest page;
+            std::vector<uint8_t> pixels;
+        };
+
+        struct Readback {
+            GLuint pbo = 0u;
+            GLsync fence = nullptr;
+            int width = 0;
+            int height = 0;
+        };
+
+        static uint64_t page_key(int level, int x, int y) {
+            return (uint64_t(level) << 48) | (uint64_t(y) << 24) | uint64_t(x);
+        }
+
+        int pages_x(int level) const { return std::max(1, info_.pages_x >> level); }
+
+        int pages_y(int level) const { return std::max(1, info_.pages_y >> level); }
+
+        int32_t &page_slot(int level, int x, int y) { return page_slots_[level][y * pages_x(level) + x]; }
+
+        std::string tile_path(int level, int x, int y) const;
+
+        void worker_loop();
+
+        void process_feedback(const uint8_t *texels, size_t n_texels);
+
+        void request_page(int level, int x, int y);
+
+        int allocate_slot();
+
+        void upload_page(LoadedPage &page);
+
+        void rebuild_indirection();
+
+        std::string dir_;
+        Info info_;
+        int atlas_pages_;
+        int feedback_scale_;
+        int max_uploads_per_frame_ = 16;
+        size_t max_pending_loads_ = 64;
+
+        GLuint atlas_ = 0u;
+        GLuint indirection_ = 0u;
+        GLuint feedback_fbo_ = 0u;
+        GLuint feedback_color_ = 0u;
+        GLuint feedback_depth_ = 0u;
+        int feedback_width_ = 0;
+        int feedback_height_ = 0;
+        GLint saved_viewport_[4];
+
+        static const int N_READBACKS = 3;
+        Readback readbacks_[N_READBACKS];
+        int next_readback_ = 0;
+
+        uint64_t frame_ = 0;
+        std::vector<Slot> slots_;
+        std::vector<int> free_slots_;
+        std::vector<std::vector<int32_t>> page_slots_;
+        std::vector<std::vector<uint32_t>> indirection_data_;
+        bool indirection_dirty_ = true;
+
+        std::unordered_set<uint64_t> pending_;
+        std::unordered_set<uint64_t> missing_;
+
+        std::vector<std::thread> workers_;
+        std::atomic<bool> stop_;
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<PageRequest> load_queue_;
+        std::deque<LoadedPage> loaded_;
+
+        size_t requested_last_frame_ = 0;
+        size_t uploaded_last_frame_ = 0;
+        size_t evicted_last_frame_ = 0;
+    };
+
+    /**
+     * @brief Cuts an image into the tile pyramid read by VirtualTexture.
+     *
+     * Tiles are tile_size x tile_size texels plus a border of the neighbouring texels on every side
+     * (needed for bilinear filtering inside the atlas) and are stored as PNG files dir/<level>/<x>_<y>.png.
+     * The source has to fit into memory; larger datasets must be tiled by the production pipeline directly
+     * into the same layout.
+     */
+    bool build_virtual_texture_tiles(const std::string &image_path, const std::string &dir,
+                                     int tile_size = 128, int border = 4, bool srgb = true);
+}
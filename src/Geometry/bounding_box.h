@@ -19,7 +19,7 @@ namespace xe {
 
         BoundingBox() : n_points_(0),
                         min_(std::numeric_limits<F>::max()),
-                        max_(std::numeric_limits<F>::min()) {}
+                        max_(std::numeric_limits<F>::lowest()) {}
 
         void add(const vec_t &p) {
             n_points_++;
@@ -16,19 +16,19 @@
 
 
 namespace {
-    xe::Triangle get_face(tinyobj::shape_t sh, size_t index_offset, const tinyobj::attrib_t &attrib) {
+    xe::Triangle get_face(const tinyobj::shape_t &sh, size_t index_offset, const tinyobj::attrib_t &attrib) {
 
         xe::Triangle triangle;
-        std::vector<glm::vec3> p(3);
         for (size_t v = 0; v < 3; v++) {
             // access to vertex
             tinyobj::index_t idx = sh.mesh.indices[index_offset + v];
 
-            p[v].x = attrib.vertices[3 * idx.vertex_index + 0];
-            p[v].y = attrib.vertices[3 * idx.vertex_index + 1];
-            p[v].z = attrib.vertices[3 * idx.vertex_index + 2];
+            glm::vec3 p;
+            p.x = attrib.vertices[3 * idx.vertex_index + 0];
+            p.y = attrib.vertices[3 * idx.vertex_index + 1];
+            p.z = attrib.vertices[3 * idx.vertex_index + 2];
 
-            triangle.position[v] = p[v];
+            triangle.position[v] = p;
 
             glm::vec2 t;
 
@@ -69,6 +69,17 @@ namespace {
         mesh.has_normals = !attrib.normals.empty();
         mesh.has_texcoords[0] = !attrib.texcoords.empty();
 
+        // Every face corner becomes a vertex, reserving avoids regrowing the arrays while reading.
+        size_t n_faces = 0;
+        for (const auto &sh: shapes)
+            n_faces += sh.mesh.num_face_vertices.size();
+        mesh.faces.reserve(n_faces);
+        mesh.vertex_coords.reserve(3 * n_faces);
+        if (mesh.has_texcoords[0])
+            mesh.vertex_texcoords[0].reserve(3 * n_faces);
+        if (mesh.has_normals)
+            mesh.vertex_normals.reserve(3 * n_faces);
+
         int index = 0;
         int fce = 0;
 
@@ -76,7 +87,7 @@ namespace {
         xe::sMesh::SubMesh sub_mesh;
         sub_mesh.start = fce;
         sub_mesh.mat_idx = mat_idx;
-        for (auto sh: shapes) {
+        for (const auto &sh: shapes) {
             SPDLOG_DEBUG("Processing shape `{}'", sh.name);
             size_t index_offset = 0;
 
@@ -98,6 +109,7 @@ namespace {
                 xe::sMesh::Face face;
                 for (size_t v = 0; v < fv; v++) {
                     mesh.vertex_coords.push_back(triangle.position[v]);
+                    mesh.bb.add(triangle.position[v]);
                     if (!triangle.has_texcoord[v]) {
                         if (mesh.has_texcoords[0]) {
                             spdlog::warn("Some vertices have texture coordinates and some do not in OBJ file.");
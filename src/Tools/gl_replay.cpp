@@ -0,0 +1,435 @@
+//
+// Created by agent on 19.10.26.
+//
+
+// Replays a GL call trace recorded with --gl-capture, as fast as the GPU allows.
+//
+//   gl_replay <trace> [application options, e.g. --headless --frames 1000 --frame-stats replay.csv]
+//
+// The setup part of the trace (resource creation and uploads) is replayed once, then the captured frames
+// are replayed in a loop, one per application frame. The frame times are reported by the application.
+
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "Application/application.h"
+#include "Application/gl_trace.h"
+
+namespace {
+    namespace trace = xe::gl_trace;
+
+    class Replay;
+
+    struct Value {
+        char kind;
+        char element;
+        uint64_t bits = 0;
+        const uint8_t *data = nullptr; // data, pixels, strings and arrays
+        uint32_t count = 0; // bytes of data, elements of arrays
+    };
+
+    struct Call;
+
+    class Args;
+
+    using execute_t = void (*)(Args &a);
+
+    struct ReplayFunction {
+        const char *name;
+        const char *signature;
+        execute_t execute;
+    };
+
+    struct Call {
+        const ReplayFunction *function;
+        char ret;
+        std::vector<Value> args;
+        std::vector<GLuint> outputs; // the names created in the capture
+        uint64_t ret_value = 0;
+    };
+
+    // The arguments of a call being replayed, the names are remapped to the ones created by the replay.
+    class Args {
+    public:
+        Args(Replay &replay, const Call &call) : replay_(replay), call_(call) {}
+
+        GLuint u(size_t i) const;
+
+        GLint i(size_t i) const { return static_cast<GLint>(call_.args[i].bits); }
+
+        float f(size_t i) const {
+            float value;
+            auto bits = static_cast<uint32_t>(call_.args[i].bits);
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        double d(size_t i) const {
+            double value;
+            std::memcpy(&value, &call_.args[i].bits, sizeof(value));
+            return value;
+        }
+
+        int64_t l(size_t i) const { return static_cast<int64_t>(call_.args[i].bits); }
+
+        const void *p(size_t i) const {
+            auto &v = call_.args[i];
+            return v.data ? v.data : reinterpret_cast<const void *>(static_cast<uintptr_t>(v.bits));
+        }
+
+        void *out_p(size_t i) const { return const_cast<void *>(p(i)); }
+
+        const GLfloat *fv(size_t i) const { return static_cast<const GLfloat *>(p(i)); }
+
+        const GLint *iv(size_t i) const { return static_cast<const GLint *>(p(i)); }
+
+        const GLuint *n(size_t i);
+
+        GLuint *o(size_t i) {
+            outputs_.resize(call_.args[i - 1].bits);
+            return outputs_.data();
+        }
+
+        GLsync y(size_t i) const;
+
+        void ret(GLuint name) { ret_name_ = name; }
+
+        void ret(GLsync sync) { ret_sync_ = sync; }
+
+        void shader_source() {
+            auto &v = call_.args[1];
+            auto source = reinterpret_cast<const GLchar *>(v.data);
+            auto length = static_cast<GLint>(v.count);
+            glShaderSource(u(0), 1, &source, &length);
+        }
+
+        const std::vector<GLuint> &outputs() const { return outputs_; }
+
+        GLuint ret_name() const { return ret_name_; }
+
+        GLsync ret_sync() const { return ret_sync_; }
+
+    private:
+        Replay &replay_;
+        const Call &call_;
+        std::vector<GLuint> names_;
+        std::vector<GLuint> outputs_;
+        GLuint ret_name_ = 0u;
+        GLsync ret_sync_ = nullptr;
+    };
+
+    const ReplayFunction replay_functions[] = {
+#define XE_GL_TRACE(name, signature, replay) {#name, signature, [](Args &a) { replay; }},
+
+#include "Application/gl_trace_functions.h"
+
+#undef XE_GL_TRACE
+    };
+
+    const ReplayFunction *find_replay_function(const std::string &name) {
+        for (auto &f: replay_functions) {
+            if (name == f.name)
+                return &f;
+        }
+        return nullptr;
+    }
+
+    class Trace {
+    public:
+        bool load(const std::string &path);
+
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<Call> setup;
+        std::vector<std::vector<Call>> frames;
+
+    private:
+        template<typename T>
+        T get() {
+            T value{};
+            if (pos_ + sizeof(T) > bytes_.size()) {
+                pos_ = bytes_.size() + 1;
+                return value;
+            }
+            std::memcpy(&value, bytes_.data() + pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return value;
+        }
+
+        const uint8_t *get_data(uint32_t size);
+
+        bool read_call(Call &call);
+
+        std::vector<uint8_t> bytes_;
+        size_t pos_ = 0;
+        std::unordered_map<uint16_t, const ReplayFunction *> functions_;
+        // Copies of the data, aligned for the driver.
+        std::deque<std::vector<uint8_t>> data_;
+    };
+
+    const uint8_t *Trace::get_data(uint32_t size) {
+        if (pos_ + size > bytes_.size()) {
+            pos_ = bytes_.size() + 1;
+            return nullptr;
+        }
+        data_.emplace_back(bytes_.begin() + pos_, bytes_.begin() + pos_ + size);
+        pos_ += size;
+        // Not null for empty data, null is stored separately.
+        return data_.back().empty() ? reinterpret_cast<const uint8_t *>("") : data_.back().data();
+    }
+
+    bool Trace::read_call(Call &call) {
+        auto id = get<uint16_t>();
+        auto it = functions_.find(id);
+        if (it == functions_.end()) {
+            SPDLOG_ERROR("Undefined function {} in the trace", id);
+            return false;
+        }
+        call.function = it->second;
+        auto signature = trace::parse_signature(call.function->signature);
+        call.ret = signature.ret;
+        bool outputs = false;
+        for (auto &arg: signature.args) {
+            Value v{arg.kind, arg.element};
+            switch (arg.kind) {
+                case 'l':
+                case 'p':
+                case 'Y':
+                case 'd':
+                    v.bits = get<uint64_t>();
+                    break;
+                case 'b':
+                case 's': {
+                    auto size = get<uint32_t>();
+                    if (size != trace::NULL_DATA) {
+                        v.data = get_data(size);
+                        v.count = size;
+                    }
+                    break;
+                }
+                case 'x':
+                    if (get<uint8_t>()) {
+                        auto size = get<uint32_t>();
+                        if (size != trace::NULL_DATA) {
+                            v.data = get_data(size);
+                            v.count = size;
+                        }
+                    } else {
+                        v.bits = get<uint64_t>();
+                    }
+                    break;
+                case '[':
+                    v.count = get<uint32_t>();
+                    v.data = get_data(v.count * sizeof(GLuint));
+                    break;
+                case ']':
+                    outputs = true;
+                    break;
+                default:
+                    v.bits = get<uint32_t>();
+                    break;
+            }
+            call.args.push_back(v);
+        }
+        if (outputs) {
+            call.outputs.resize(get<uint32_t>());
+            for (auto &name: call.outputs)
+                name = get<GLuint>();
+        }
+        if (call.ret == 'Y')
+            call.ret_value = get<uint64_t>();
+        else if (call.ret)
+            call.ret_value = get<uint32_t>();
+        return pos_ <= bytes_.size();
+    }
+
+    bool Trace::load(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            SPDLOG_ERROR("Cannot open `{}'", path);
+            return false;
+        }
+        bytes_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (bytes_.size() < sizeof(trace::MAGIC) || std::memcmp(bytes_.data(), trace::MAGIC, sizeof(trace::MAGIC))) {
+            SPDLOG_ERROR("`{}' is not a GL trace", path);
+            return false;
+        }
+        pos_ = sizeof(trace::MAGIC);
+        auto version = get<uint32_t>();
+        if (version != trace::VERSION) {
+            SPDLOG_ERROR("Trace version {} is not supported", version);
+            return false;
+        }
+        width = get<uint32_t>();
+        height = get<uint32_t>();
+
+        bool started = false;
+        std::vector<Call> frame;
+        while (pos_ < bytes_.size()) {
+            auto tag = static_cast<trace::Tag>(get<uint8_t>());
+            switch (tag) {
+                case trace::Tag::function: {
+                    auto id = get<uint16_t>();
+                    auto length = get<uint16_t>();
+                    std::string name(reinterpret_cast<const char *>(bytes_.data() + pos_), length);
+                    pos_ += length;
+                    functions_[id] = find_replay_function(name);
+                    if (!functions_[id]) {
+                        SPDLOG_ERROR("{} cannot be replayed by this version", name);
+                        return false;
+                    }
+                    break;
+                }
+                case trace::Tag::call: {
+                    Call call;
+                    if (!read_call(call)) {
+                        SPDLOG_ERROR("Truncated trace");
+                        return false;
+                    }
+                    (started ? frame : setup).push_back(std::move(call));
+                    break;
+                }
+                case trace::Tag::frame:
+                    if (started)
+                        frames.push_back(std::move(frame));
+                    frame.clear();
+                    break;
+                case trace::Tag::start:
+                    started = true;
+                    break;
+                default:
+                    SPDLOG_ERROR("Corrupted trace at byte {}", pos_ - 1);
+                    return false;
+            }
+        }
+        bytes_.clear();
+        bytes_.shrink_to_fit();
+        if (frames.empty()) {
+            SPDLOG_ERROR("No frames captured in `{}'", path);
+            return false;
+        }
+        size_t n_calls = 0;
+        for (auto &f: frames)
+            n_calls += f.size();
+        SPDLOG_INFO("Trace {}x{}: {} setup calls, {} frames with {} calls", width, height, setup.size(),
+                    frames.size(), n_calls);
+        return true;
+    }
+
+    class Replay : public xe::Application {
+    public:
+        explicit Replay(Trace &trace) : Application(trace.width, trace.height, "gl_replay", false, 0),
+                                        trace_(trace) {}
+
+        void init() override {
+            names_['F'][0] = default_framebuffer();
+            for (auto &call: trace_.setup)
+                execute(call);
+            glFinish();
+            SPDLOG_INFO("Setup replayed");
+        }
+
+        void frame() override {
+            if (frame_ == trace_.frames.size()) {
+                frame_ = 0;
+                // The fences the frames were waiting for belong to the previous loop.
+                for (auto sync: frame_syncs_)
+                    glDeleteSync(sync);
+                frame_syncs_.clear();
+                syncs_.clear();
+            }
+            for (auto &call: trace_.frames[frame_])
+                execute(call);
+            frame_++;
+        }
+
+        GLuint map(char kind, GLuint name) const {
+            auto &names = names_[static_cast<unsigned char>(kind)];
+            auto it = names.find(name);
+            return it == names.end() ? name : it->second;
+        }
+
+        bool has_sync(uint64_t id) const { return syncs_.count(id) > 0; }
+
+        GLsync sync(uint64_t id) const {
+            auto it = syncs_.find(id);
+            return it == syncs_.end() ? nullptr : it->second;
+        }
+
+    private:
+        void execute(const Call &call) {
+            for (auto &arg: call.args) {
+                // Fences created before the captured frames are not known in the first loop.
+                if (arg.kind == 'Y' && !has_sync(arg.bits))
+                    return;
+            }
+            Args a(*this, call);
+            call.function->execute(a);
+
+            for (auto &arg: call.args) {
+                if (arg.kind == ']') {
+                    auto &names = names_[static_cast<unsigned char>(arg.element)];
+                    for (size_t i = 0; i < call.outputs.size() && i < a.outputs().size(); i++)
+                        names[call.outputs[i]] = a.outputs()[i];
+                }
+            }
+            if (call.ret == 'Y') {
+                syncs_[call.ret_value] = a.ret_sync();
+                frame_syncs_.insert(a.ret_sync());
+            } else if (call.ret) {
+                names_[static_cast<unsigned char>(call.ret)][static_cast<GLuint>(call.ret_value)] = a.ret_name();
+            }
+            if (std::strcmp(call.function->name, "glDeleteSync") == 0) {
+                frame_syncs_.erase(sync(call.args[0].bits));
+                syncs_.erase(call.args[0].bits);
+            }
+        }
+
+        Trace &trace_;
+        size_t frame_ = 0;
+        std::unordered_map<GLuint, GLuint> names_[128];
+        std::unordered_map<uint64_t, GLsync> syncs_;
+        std::unordered_set<GLsync> frame_syncs_;
+    };
+
+    GLuint Args::u(size_t i) const {
+        auto &v = call_.args[i];
+        return replay_.map(v.kind, static_cast<GLuint>(v.bits));
+    }
+
+    const GLuint *Args::n(size_t i) {
+        auto &v = call_.args[i];
+        names_.resize(v.count);
+        std::memcpy(names_.data(), v.data, v.count * sizeof(GLuint));
+        for (auto &name: names_)
+            name = replay_.map(v.element, name);
+        return names_.data();
+    }
+
+    GLsync Args::y(size_t i) const {
+        return replay_.sync(call_.args[i].bits);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argv[1][0] == '-') {
+        spdlog::error("Usage: {} <trace> [application options]", argv[0]);
+        return 1;
+    }
+    Trace trace;
+    if (!trace.load(argv[1]))
+        return 1;
+
+    std::vector<char *> args = {argv[0]};
+    args.insert(args.end(), argv + 2, argv + argc);
+    Replay app(trace);
+    app.run_cli(static_cast<int>(args.size()), args.data());
+    return 0;
+}
@@ -0,0 +1,25 @@
+//
+// Created by agent on 19.10.26.
+//
+
+// Cuts an image into the tile pyramid used by xe::VirtualTexture.
+//
+//   vt_tiler <image> <output dir> [tile size = 128] [border = 4] [srgb = 1]
+
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+#include "Engine/virtual_texture.h"
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        spdlog::error("Usage: {} <image> <output dir> [tile size] [border] [srgb]", argv[0]);
+        return 1;
+    }
+    auto tile_size = argc > 3 ? std::stoi(argv[3]) : 128;
+    auto border = argc > 4 ? std::stoi(argv[4]) : 4;
+    auto srgb = argc > 5 ? std::stoi(argv[5]) != 0 : true;
+
+    return xe::build_virtual_texture_tiles(argv[1], argv[2], tile_size, border, srgb) ? 0 : 1;
+}